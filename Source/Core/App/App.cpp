@@ -608,4 +608,7 @@ void App::changeListenerCallback(ChangeBroadcaster *source)
     this->getWindow()->createWorkspaceComponent();
 }
 
+// The tests link the whole app as a library, and have their own entry points
+#if ! HELIO_TESTS
 START_JUCE_APPLICATION(App)
+#endif
@@ -49,19 +49,30 @@ void Config::set(const String &keyName, const XmlElement *xml)
     App::Helio()->getConfig()->setValue(keyName, xml);
 }
 
+// The stress tests and benchmarks run the core without the app instance,
+// so the readers just fall back to the defaults there
+static Config *getConfigIfAny()
+{
+    App *app = App::Helio();
+    return (app != nullptr) ? app->getConfig() : nullptr;
+}
+
 String Config::get(StringRef keyName, const String &defaultReturnValue /*= String::empty*/)
 {
-    return App::Helio()->getConfig()->getValue(keyName, defaultReturnValue);
+    Config *config = getConfigIfAny();
+    return (config != nullptr) ? config->getValue(keyName, defaultReturnValue) : defaultReturnValue;
 }
 
 bool Config::contains(StringRef keyName)
 {
-    return App::Helio()->getConfig()->containsKey(keyName);
+    Config *config = getConfigIfAny();
+    return (config != nullptr) && config->containsKey(keyName);
 }
 
 XmlElement *Config::getXml(StringRef keyName)
 {
-    return App::Helio()->getConfig()->getXmlValue(keyName);
+    Config *config = getConfigIfAny();
+    return (config != nullptr) ? config->getXmlValue(keyName) : nullptr;
 }
 
 void Config::save(const String &key, const Serializable *serializer)
@@ -109,7 +109,7 @@ AudioMonitor *AudioCore::getMonitor() const noexcept
 Instrument *AudioCore::addInstrument(const PluginDescription &pluginDescription,
                                      const String &name)
 {
-    auto instrument = new Instrument(formatManager, name);
+    auto instrument = new Instrument(formatManager, *this->audioMonitor, name);
     this->addInstrumentToDevice(instrument);
 
     instrument->initializeFrom(pluginDescription);
@@ -281,7 +281,7 @@ void AudioCore::deserialize(const XmlElement &xml)
         {
             //Logger::writeToLog("--- instrument ---");
             //Logger::writeToLog(instrumentNode->createDocument(""));
-            Instrument *instrument = new Instrument(this->formatManager, "");
+            Instrument *instrument = new Instrument(this->formatManager, *this->audioMonitor, "");
             this->addInstrumentToDevice(instrument);
             instrument->deserialize(*instrumentNode);
             this->instruments.add(instrument);
@@ -17,6 +17,7 @@
 
 #include "Common.h"
 #include "Instrument.h"
+#include "InstrumentProcessor.h"
 #include "PluginWindow.h"
 #include "InternalPluginFormat.h"
 #include "PluginSmartDescription.h"
@@ -24,7 +25,9 @@
 
 const int Instrument::midiChannelNumber = 0x1000;
 
-Instrument::Instrument(AudioPluginFormatManager &formatManager, String name) :
+Instrument::Instrument(AudioPluginFormatManager &formatManager,
+                       const AudioMonitor &deviceClock,
+                       String name) :
     formatManager(formatManager),
     instrumentName(std::move(name)),
     lastUID(0),
@@ -32,13 +35,15 @@ Instrument::Instrument(AudioPluginFormatManager &formatManager, String name) :
 {
     this->processorGraph = new AudioProcessorGraph();
     this->initializeDefaultNodes();
-    this->processorPlayer.setProcessor(this->processorGraph);
+    this->instrumentProcessor = new InstrumentProcessor(*this->processorGraph, deviceClock);
+    this->processorPlayer.setProcessor(this->instrumentProcessor);
 }
 
 Instrument::~Instrument()
 {
     this->masterReference.clear();
     this->processorPlayer.setProcessor(nullptr);
+    this->instrumentProcessor = nullptr;
     
     PluginWindow::closeAllCurrentlyOpenWindows();
     this->processorGraph->clear();
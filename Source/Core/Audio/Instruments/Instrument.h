@@ -18,8 +18,10 @@
 #pragma once
 
 class AudioCore;
+class AudioMonitor;
 class FilterInGraph;
 class Instrument;
+class InstrumentProcessor;
 
 #include "Serializable.h"
 
@@ -29,7 +31,9 @@ class Instrument :
 {
 public:
 
-    Instrument(AudioPluginFormatManager &formatManager, String name);
+    Instrument(AudioPluginFormatManager &formatManager,
+               const AudioMonitor &deviceClock,
+               String name);
 
     ~Instrument() override;
 
@@ -51,6 +55,10 @@ public:
     AudioProcessorGraph *getProcessorGraph() noexcept
     { return this->processorGraph; }
 
+    // plays the graph along with the events scheduled by the transport
+    InstrumentProcessor &getInstrumentProcessor() noexcept
+    { return *this->instrumentProcessor; }
+
 
 
 
@@ -172,6 +180,8 @@ private:
 
     ScopedPointer<AudioProcessorGraph> processorGraph;
 
+    ScopedPointer<InstrumentProcessor> instrumentProcessor;
+
 
     uint32 lastUID;
 
@@ -0,0 +1,215 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "InstrumentProcessor.h"
+#include "AudioMonitor.h"
+
+static Atomic<int> lastSessionId;
+
+InstrumentProcessor::InstrumentProcessor(AudioProcessorGraph &targetGraph,
+                                         const AudioMonitor &deviceClock) :
+    graph(targetGraph),
+    clock(deviceClock),
+    fifo(INSTRUMENT_PROCESSOR_FIFO_SIZE),
+    activeSession(0)
+{
+    // all the slots are allocated here, so that the audio thread never resizes the array
+    this->events.resize(INSTRUMENT_PROCESSOR_FIFO_SIZE);
+}
+
+InstrumentProcessor::~InstrumentProcessor()
+{
+}
+
+
+//===----------------------------------------------------------------------===//
+// Scheduling
+//===----------------------------------------------------------------------===//
+
+int InstrumentProcessor::createSessionId() noexcept
+{
+    return ++lastSessionId;
+}
+
+void InstrumentProcessor::setActiveSession(int sessionId) noexcept
+{
+    this->activeSession = sessionId;
+}
+
+bool InstrumentProcessor::scheduleEvent(const MidiMessage &message, int64 frame, int sessionId)
+{
+    int start1, size1, start2, size2;
+    this->fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+    if (size1 == 0)
+    {
+        return false;
+    }
+
+    ScheduledEvent &event = this->events.getReference(start1);
+    event.message = message;
+    event.frame = frame;
+    event.sessionId = sessionId;
+
+    this->fifo.finishedWrite(1);
+    return true;
+}
+
+bool InstrumentProcessor::isFifoFull() const noexcept
+{
+    return (this->fifo.getFreeSpace() == 0);
+}
+
+const AudioMonitor &InstrumentProcessor::getClock() const noexcept
+{
+    return this->clock;
+}
+
+
+//===----------------------------------------------------------------------===//
+// AudioProcessor
+//===----------------------------------------------------------------------===//
+
+const String InstrumentProcessor::getName() const
+{
+    return this->graph.getName();
+}
+
+void InstrumentProcessor::prepareToPlay(double sampleRate, int estimatedSamplesPerBlock)
+{
+    this->graph.setPlayConfigDetails(this->getTotalNumInputChannels(),
+                                     this->getTotalNumOutputChannels(),
+                                     sampleRate, estimatedSamplesPerBlock);
+
+    this->graph.prepareToPlay(sampleRate, estimatedSamplesPerBlock);
+}
+
+void InstrumentProcessor::releaseResources()
+{
+    this->graph.releaseResources();
+}
+
+void InstrumentProcessor::processBlock(AudioSampleBuffer &buffer, MidiBuffer &midiMessages)
+{
+    const int numSamples = buffer.getNumSamples();
+    const int64 blockStart = this->clock.getBlockStartFrame();
+    const int64 blockEnd = blockStart + numSamples;
+    const int session = this->activeSession.get();
+
+    while (this->fifo.getNumReady() > 0)
+    {
+        int start1, size1, start2, size2;
+        this->fifo.prepareToRead(1, start1, size1, start2, size2);
+        const ScheduledEvent &event = this->events.getReference(start1);
+
+        if (event.sessionId == session)
+        {
+            if (event.frame >= blockEnd)
+            {
+                break;
+            }
+
+            // the late events, if any, are played at the very start of the block
+            const int sampleNumber = int(jmax(int64(0), event.frame - blockStart));
+            midiMessages.addEvent(event.message, jmin(sampleNumber, numSamples - 1));
+        }
+
+        this->fifo.finishedRead(1);
+    }
+
+    const ScopedLock lock(this->graph.getCallbackLock());
+    this->graph.processBlock(buffer, midiMessages);
+}
+
+void InstrumentProcessor::reset()
+{
+    this->graph.reset();
+}
+
+double InstrumentProcessor::getTailLengthSeconds() const
+{
+    return this->graph.getTailLengthSeconds();
+}
+
+bool InstrumentProcessor::acceptsMidi() const
+{
+    return true;
+}
+
+bool InstrumentProcessor::producesMidi() const
+{
+    return this->graph.producesMidi();
+}
+
+
+//===----------------------------------------------------------------------===//
+// Editor
+//===----------------------------------------------------------------------===//
+
+AudioProcessorEditor *InstrumentProcessor::createEditor()
+{
+    return nullptr;
+}
+
+bool InstrumentProcessor::hasEditor() const
+{
+    return false;
+}
+
+
+//===----------------------------------------------------------------------===//
+// Programs
+//===----------------------------------------------------------------------===//
+
+int InstrumentProcessor::getNumPrograms()
+{
+    return 0;
+}
+
+int InstrumentProcessor::getCurrentProgram()
+{
+    return 0;
+}
+
+void InstrumentProcessor::setCurrentProgram(int index)
+{
+}
+
+const String InstrumentProcessor::getProgramName(int index)
+{
+    return String::empty;
+}
+
+void InstrumentProcessor::changeProgramName(int index, const String &newName)
+{
+}
+
+
+//===----------------------------------------------------------------------===//
+// State
+//===----------------------------------------------------------------------===//
+
+// The state is serialized by the instrument itself, node by node
+
+void InstrumentProcessor::getStateInformation(juce::MemoryBlock &destData)
+{
+}
+
+void InstrumentProcessor::setStateInformation(const void *data, int sizeInBytes)
+{
+}
@@ -0,0 +1,131 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+class AudioMonitor;
+
+#define INSTRUMENT_PROCESSOR_FIFO_SIZE 4096
+
+// The processor which the instrument's AudioProcessorPlayer runs instead of the bare graph.
+// Besides the messages from the collector, it merges in the events scheduled
+// by the player thread ahead of time, each at its exact sample position in the block.
+//
+// The scheduled events come through a lock-free single-producer single-consumer fifo,
+// the producer being the player thread, and the consumer being the audio callback.
+// Each playback is a session: the events of the sessions that are not active anymore
+// are skipped, so that stopping never has to wait for the audio thread.
+
+class InstrumentProcessor : public AudioProcessor
+{
+public:
+
+    InstrumentProcessor(AudioProcessorGraph &targetGraph, const AudioMonitor &deviceClock);
+
+    ~InstrumentProcessor() override;
+
+
+    //===------------------------------------------------------------------===//
+    // Scheduling
+    //===------------------------------------------------------------------===//
+
+    static int createSessionId() noexcept;
+
+    void setActiveSession(int sessionId) noexcept;
+
+    // Returns false if the fifo is full, the caller should try later
+    bool scheduleEvent(const MidiMessage &message, int64 frame, int sessionId);
+
+    bool isFifoFull() const noexcept;
+
+    const AudioMonitor &getClock() const noexcept;
+
+
+    //===------------------------------------------------------------------===//
+    // AudioProcessor
+    //===------------------------------------------------------------------===//
+
+    const String getName() const override;
+
+    void prepareToPlay(double sampleRate, int estimatedSamplesPerBlock) override;
+
+    void releaseResources() override;
+
+    void processBlock(AudioSampleBuffer &buffer, MidiBuffer &midiMessages) override;
+
+    void reset() override;
+
+    double getTailLengthSeconds() const override;
+
+    bool acceptsMidi() const override;
+
+    bool producesMidi() const override;
+
+
+    //===------------------------------------------------------------------===//
+    // Editor
+    //===------------------------------------------------------------------===//
+
+    AudioProcessorEditor *createEditor() override;
+
+    bool hasEditor() const override;
+
+
+    //===------------------------------------------------------------------===//
+    // Programs
+    //===------------------------------------------------------------------===//
+
+    int getNumPrograms() override;
+
+    int getCurrentProgram() override;
+
+    void setCurrentProgram(int index) override;
+
+    const String getProgramName(int index) override;
+
+    void changeProgramName(int index, const String &newName) override;
+
+
+    //===------------------------------------------------------------------===//
+    // State
+    //===------------------------------------------------------------------===//
+
+    void getStateInformation(juce::MemoryBlock &destData) override;
+
+    void setStateInformation(const void *data, int sizeInBytes) override;
+
+private:
+
+    struct ScheduledEvent
+    {
+        MidiMessage message;
+        int64 frame;
+        int sessionId;
+    };
+
+    AudioProcessorGraph &graph;
+
+    const AudioMonitor &clock;
+
+    AbstractFifo fifo;
+
+    Array<ScheduledEvent> events;
+
+    Atomic<int> activeSession;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InstrumentProcessor)
+};
@@ -69,7 +69,10 @@ private:
 AudioMonitor::AudioMonitor() :
     fft(),
     spectrumSize(AUDIO_MONITOR_SPECTRUM_SIZE),
-    sampleRate(AUDIO_MONITOR_DEFAULT_SAMPLERATE)
+    sampleRate(AUDIO_MONITOR_DEFAULT_SAMPLERATE),
+    blockStartFrame(0),
+    blockSize(0),
+    deviceRunning(0)
 {
     zeromem(this->spectrum, sizeof(float) * AUDIO_MONITOR_MAX_CHANNELS * AUDIO_MONITOR_MAX_SPECTRUMSIZE);
     this->asyncClippingWarning = new ClippingWarningAsyncCallback(*this);
@@ -88,6 +91,8 @@ AudioMonitor::~AudioMonitor()
 void AudioMonitor::audioDeviceAboutToStart(AudioIODevice *device)
 {
     this->sampleRate = device->getCurrentSampleRate();
+    this->blockSize = device->getCurrentBufferSizeSamples();
+    this->deviceRunning = 1;
 }
 
 void AudioMonitor::audioDeviceIOCallback(const float **inputChannelData,
@@ -156,10 +161,15 @@ void AudioMonitor::audioDeviceIOCallback(const float **inputChannelData,
     {
         FloatVectorOperations::clear(outputChannelData[i], numSamples);
     }
+    
+    // the instruments are called after the monitor, so this is the start of their block
+    this->blockStartFrame += this->blockSize.get();
+    this->blockSize = numSamples;
 }
 
 void AudioMonitor::audioDeviceStopped()
 {
+    this->deviceRunning = 0;
 }
 
 //===----------------------------------------------------------------------===//
@@ -186,6 +196,30 @@ float AudioMonitor::getInterpolatedSpectrumAtFrequency(float frequency) const
                  (AudioCore::fastLog10(f2) - AudioCore::fastLog10(f1))) * (y2 - y1);
 }
 
+//===----------------------------------------------------------------------===//
+// Device clock
+//===----------------------------------------------------------------------===//
+
+int64 AudioMonitor::getBlockStartFrame() const noexcept
+{
+    return this->blockStartFrame.get();
+}
+
+int AudioMonitor::getBlockSize() const noexcept
+{
+    return this->blockSize.get();
+}
+
+double AudioMonitor::getSampleRate() const noexcept
+{
+    return this->sampleRate;
+}
+
+bool AudioMonitor::isDeviceRunning() const noexcept
+{
+    return (this->deviceRunning.get() != 0);
+}
+
 //===----------------------------------------------------------------------===//
 // Clipping data
 //===----------------------------------------------------------------------===//
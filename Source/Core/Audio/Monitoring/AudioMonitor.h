@@ -79,6 +79,22 @@ public:
     
     float getInterpolatedSpectrumAtFrequency(float frequency) const;
     
+    //===------------------------------------------------------------------===//
+    // Device clock
+    //===------------------------------------------------------------------===//
+    
+    // The monitor is the first callback of the device, so within any audio callback
+    // all the instruments see the same block start, which makes it usable
+    // as a sample-accurate clock for the events scheduled from other threads.
+    
+    int64 getBlockStartFrame() const noexcept;
+    
+    int getBlockSize() const noexcept;
+    
+    double getSampleRate() const noexcept;
+    
+    bool isDeviceRunning() const noexcept;
+    
 private:
 
     SpectrumFFT	fft;
@@ -93,6 +109,10 @@ private:
     int spectrumSize;
     double sampleRate;
 
+    Atomic<int64> blockStartFrame;
+    Atomic<int> blockSize;
+    Atomic<int> deviceRunning;
+
     ListenerList<ClippingListener> clippingListeners;
 
     ScopedPointer<AsyncUpdater> asyncClippingWarning;
@@ -47,31 +47,29 @@ PlayerThread::~PlayerThread()
 
 void PlayerThread::run()
 {
-    this->transport.rebuildSequencesIfNeeded();
-    ProjectSequences sequences = this->transport.getSequences();
+    // the own copy of the sequences holds the cursors
+    int snapshotVersion = this->transport.getSnapshotVersion();
+    PlaybackSnapshot::Ptr snapshot(this->transport.getPlaybackSnapshot());
+    ProjectSequences sequences(snapshot->sequences);
+    TempoMap::Ptr tempoMap(snapshot->tempoMap);
     Array<Instrument *> uniqueInstruments(sequences.getUniqueInstruments());
     
     double TPQN = Transport::millisecondsPerBeat; // ticks-per-quarter-note
-    double nextEventTimeDelta = 0.0;
-    
-    double tempoAtTheEndOfTrack = 0.0;
-    double totalTimeMs = 0.0;
-    this->transport.calcTimeAndTempoAt(1.0, totalTimeMs, tempoAtTheEndOfTrack);
     
     const double absStartPosition = this->transport.isLooped() ? this->transport.getLoopStart() : this->transport.getSeekPosition();
     const double absEndPosition = this->transport.isLooped() ? this->transport.getLoopEnd() : 1.0;
     
+    const double totalTime = round(this->transport.getTotalTime());
+    const double startPositionInTime = round(absStartPosition * this->transport.getTotalTime());
+    const double endPositionInTime = round(absEndPosition * this->transport.getTotalTime());
+    
+    double totalTimeMs = tempoMap->getTimeMsAt(totalTime);
     double msPerTick = 500.0 / TPQN; // default 120 BPM
     double currentTimeMs = 0.0;
-    this->transport.calcTimeAndTempoAt(absStartPosition,
-                                       currentTimeMs,
-                                       msPerTick);
+    tempoMap->getTimeAndTempoAt(startPositionInTime, currentTimeMs, msPerTick);
     
     this->transport.broadcastTempoChanged(msPerTick);
     
-    const double startPositionInTime = round(absStartPosition * this->transport.getTotalTime());
-    const double endPositionInTime = round(absEndPosition * this->transport.getTotalTime());
-    
     sequences.seekToTime(startPositionInTime);
     double prevTimeStamp = startPositionInTime;
     
@@ -126,117 +124,187 @@ void PlayerThread::run()
         }
     };
     
-    // And here we go.
-    sendMidiStart();
-    
-    while (1)
+    // The automation curves and the tempo curve are sampled at the update rate,
+    // and on every event, but only the changed values are sent
+    auto sendAutomationAt = [&](double timeStamp)
     {
-        MessageWrapper wrapper;
-
-        if (! sequences.getNextMessage(wrapper))
+        sequences.sampleAutomation(timeStamp, 0.0, 1, [](const MessageWrapper &automation, int) -> bool
         {
-            nextEventTimeDelta = msPerTick * (endPositionInTime - prevTimeStamp);
-            
-#if PLAYER_THREAD_SENDS_SEEK_EVENTS
-            
-            const double targetTimeStamp = endPositionInTime;
-            const double targetTime = Time::getMillisecondCounterHiRes() + nextEventTimeDelta;
-            double deltaTime = targetTime - Time::getMillisecondCounterHiRes();
-            
-            while (deltaTime > UPDATE_TIME_MS)
-            {
-                // fixme! extremely unsafe, no message manager lock gained
-                this->transport.broadcastSeek((targetTimeStamp - deltaTime / msPerTick) / this->transport.getTotalTime(),
-                                              currentTimeMs,
-                                              totalTimeMs);
-                
-                Time::waitForMillisecondCounter(Time::getMillisecondCounter() + UPDATE_TIME_MS);
-                
-                if (this->threadShouldExit())
-                {
-                    sendHoldingNotesOffAndMidiStop();
-                    return;
-                }
-                
-                deltaTime = targetTime - Time::getMillisecondCounterHiRes();
-            }
-            
-            Time::waitForMillisecondCounter(Time::getMillisecondCounter() + uint32(deltaTime));
+            MidiMessage message(automation.message);
+            message.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+            automation.listener->addMessageToQueue(message);
+            return true;
+        });
+        
+        const double newMsPerTick = tempoMap->getMsPerTickAt(timeStamp);
+        
+        if (newMsPerTick != msPerTick)
+        {
+            msPerTick = newMsPerTick;
+            this->transport.broadcastTempoChanged(msPerTick);
             
-#else
+            MidiMessage tempoEvent(tempoMap->getTempoEventAt(timeStamp));
+            tempoEvent.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+            sendTempoChangeToEverybody(tempoEvent);
+        }
+    };
+    
+    // Picks up the recent snapshot, if the project was edited while playing.
+    // Should only be called when all the events at prevTimeStamp have been sent.
+    auto applySequencesUpdateIfAny = [&]() -> bool
+    {
+        const int actualSnapshotVersion = this->transport.getSnapshotVersion();
+        
+        if (actualSnapshotVersion == snapshotVersion)
+        {
+            return false;
+        }
+        
+        snapshotVersion = actualSnapshotVersion;
+        const PlaybackSnapshot::Ptr newSnapshot(this->transport.getPlaybackSnapshot());
+        const bool tempoMapChanged = (newSnapshot->tempoMapVersion != snapshot->tempoMapVersion);
+        const bool sequencesChanged = (newSnapshot->sequencesVersion != snapshot->sequencesVersion);
+        
+        // the previous snapshot is released last, so that it is the one to keep
+        // its sequences and tempo map alive until the message thread releases it
+        const PlaybackSnapshot::Ptr previousSnapshot(snapshot);
+        snapshot = newSnapshot;
+        
+        if (! tempoMapChanged && ! sequencesChanged)
+        {
+            return false;
+        }
+        
+        if (tempoMapChanged)
+        {
+            tempoMap = snapshot->tempoMap;
             
-            Time::waitForMillisecondCounter(Time::getMillisecondCounter() + uint32(nextEventTimeDelta));
-
-#endif
+            const double newMsPerTick = tempoMap->getMsPerTickAt(prevTimeStamp);
+            currentTimeMs = tempoMap->getTimeMsAt(prevTimeStamp);
+            totalTimeMs = tempoMap->getTimeMsAt(totalTime);
             
-            if (this->transport.isLooped())
-            {
-                //Logger::writeToLog("Sekk to time " + String(startPositionInTime));
-                sequences.seekToTime(startPositionInTime);
-                prevTimeStamp = startPositionInTime;
-                continue;
-            }
-            else
+            if (newMsPerTick != msPerTick)
             {
-                //Logger::writeToLog("Track finished");
-                sendHoldingNotesOffAndMidiStop();
-                this->transport.allNotesControllersAndSoundOff();
-                this->transport.seekToPosition(this->transport.getSeekPosition());
-                this->transport.broadcastStop();
-                return;
+                msPerTick = newMsPerTick;
+                this->transport.broadcastTempoChanged(msPerTick);
             }
         }
         
-        const bool shouldRewind = (this->transport.isLooped() &&
-                                   (wrapper.message.getTimeStamp() > endPositionInTime));
-        
-        const double nextEventTimeStamp = shouldRewind ? endPositionInTime : wrapper.message.getTimeStamp();
-        
-        //Logger::writeToLog(String(prevTimeStamp) + " > " + String(nextEventTimeStamp));
+        if (! sequencesChanged)
+        {
+            // the message taken for the interrupted wait is to be taken again
+            sequences.seekPastTime(prevTimeStamp);
+            return true;
+        }
         
-        nextEventTimeDelta = msPerTick * (nextEventTimeStamp - prevTimeStamp);
+        sequences = snapshot->sequences;
+        uniqueInstruments = sequences.getUniqueInstruments();
+        sequences.seekPastTime(prevTimeStamp);
         
-        currentTimeMs += nextEventTimeDelta;
+        // The notes, which note-offs have been removed or moved before the playhead
+        // by the edit, would hang forever, so release them right now
+        for (int i = holdingNotes.size() - 1; i >= 0; --i)
+        {
+            const HoldingNote &holding = holdingNotes.getReference(i);
+            
+            if (! sequences.hasPendingNoteOff(holding.listener, holding.channel, holding.key))
+            {
+                MidiMessage noteOff(MidiMessage::noteOff(holding.channel, holding.key, 0.f));
+                noteOff.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+                holding.listener->addMessageToQueue(noteOff);
+                holdingNotes.remove(i);
+            }
+        }
         
-#if PLAYER_THREAD_SENDS_SEEK_EVENTS
-
-        const double targetTimeStamp = nextEventTimeStamp;
-        const double targetTime = Time::getMillisecondCounterHiRes() + nextEventTimeDelta;
+        return true;
+    };
+    
+    enum WaitResult
+    {
+        waitFinished,
+        waitInterruptedByUpdate,
+        waitInterruptedByExit
+    };
+    
+    auto waitUntil = [&](double targetTime, double targetTimeStamp) -> WaitResult
+    {
+        // Events with the same timestamp are sent without a pause,
+        // so it is only safe to switch the sequences between the different timestamps
+        const bool canApplyUpdates = (targetTimeStamp > prevTimeStamp);
         double deltaTime = targetTime - Time::getMillisecondCounterHiRes();
         
         while (deltaTime > UPDATE_TIME_MS)
         {
-            this->transport.broadcastSeek((targetTimeStamp - deltaTime / msPerTick) / this->transport.getTotalTime(),
-                                          currentTimeMs,
-                                          totalTimeMs);
+            const double currentTimeStamp =
+                tempoMap->getTimeStampAtTimeMs(tempoMap->getTimeMsAt(targetTimeStamp) - deltaTime);
+            
+            sendAutomationAt(jmax(prevTimeStamp, currentTimeStamp));
             
             Time::waitForMillisecondCounter(Time::getMillisecondCounter() + UPDATE_TIME_MS);
             
             if (this->threadShouldExit())
             {
-                sendHoldingNotesOffAndMidiStop();
-                return;
+                return waitInterruptedByExit;
             }
-        
+            
+            if (canApplyUpdates && applySequencesUpdateIfAny())
+            {
+                return waitInterruptedByUpdate;
+            }
+            
             deltaTime = targetTime - Time::getMillisecondCounterHiRes();
         }
         
+        if (deltaTime > 0.0)
+        {
+            Time::waitForMillisecondCounter(Time::getMillisecondCounter() + uint32(deltaTime));
+        }
+        
+        return this->threadShouldExit() ? waitInterruptedByExit : waitFinished;
+    };
+    
+    // And here we go.
+    sendMidiStart();
+    sendAutomationAt(startPositionInTime);
+    
+    // Events are scheduled relative to the moment when the previous one was due,
+    // not to the moment when it was actually sent, so that the delays don't accumulate
+    double prevEventTime = Time::getMillisecondCounterHiRes();
+    
+    while (1)
+    {
+        MessageWrapper wrapper;
         
-        Time::waitForMillisecondCounter(Time::getMillisecondCounter() + uint32(deltaTime));
+        const bool hasNextMessage = sequences.getNextMessage(wrapper);
+        
+        const bool shouldRewind = (this->transport.isLooped() &&
+            (! hasNextMessage || wrapper.message.getTimeStamp() > endPositionInTime));
         
-#else
-      
-        Time::waitForMillisecondCounter(Time::getMillisecondCounter() + uint32(nextEventTimeDelta));
+        const bool shouldFinish = (! hasNextMessage && ! shouldRewind);
         
-        if (this->threadShouldExit())
+        const double nextEventTimeStamp = (shouldRewind || shouldFinish) ?
+            endPositionInTime : wrapper.message.getTimeStamp();
+        
+        const double nextEventTimeDelta = tempoMap->getTimeMsAt(nextEventTimeStamp) - currentTimeMs;
+        const double targetTime = prevEventTime + nextEventTimeDelta;
+        const WaitResult waitResult = waitUntil(targetTime, nextEventTimeStamp);
+        
+        if (waitResult == waitInterruptedByExit)
         {
             sendHoldingNotesOffAndMidiStop();
             return;
         }
         
-#endif
+        if (waitResult == waitInterruptedByUpdate)
+        {
+            // the sequences have been re-seeked right after prevTimeStamp,
+            // so just take the next message from the new snapshot
+            continue;
+        }
         
+        prevEventTime = targetTime;
         prevTimeStamp = nextEventTimeStamp;
+        currentTimeMs = tempoMap->getTimeMsAt(prevTimeStamp);
 
         this->transport.broadcastSeek(prevTimeStamp / this->transport.getTotalTime(),
                                       currentTimeMs, totalTimeMs);
@@ -245,46 +313,59 @@ void PlayerThread::run()
         {
             sequences.seekToTime(startPositionInTime);
             prevTimeStamp = startPositionInTime;
+            currentTimeMs = tempoMap->getTimeMsAt(prevTimeStamp);
+            sendAutomationAt(prevTimeStamp);
+            continue;
         }
-        else
+        
+        if (shouldFinish)
         {
-            const int key = wrapper.message.getNoteNumber();
-            const int channel = wrapper.message.getChannel();
-            wrapper.message.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
-            
-            // Master tempo event is sent to everybody
-            if (wrapper.message.isTempoMetaEvent())
-            {
-                msPerTick = wrapper.message.getTempoSecondsPerQuarterNote() * 1000.f / TPQN;
-                this->transport.broadcastTempoChanged(msPerTick);
-                
-                // Sends this to everybody (need to do that for drum-machines) - TODO test
-                sendTempoChangeToEverybody(wrapper.message);
-            }
-            else
-            {
-                wrapper.listener->addMessageToQueue(wrapper.message);
-            }
-            
-            if (wrapper.message.isNoteOn())
-            {
-                holdingNotes.add(HoldingNote({key, channel, wrapper.listener}));
-            }
+            sendHoldingNotesOffAndMidiStop();
+            this->transport.allNotesControllersAndSoundOff();
+            this->transport.seekToPosition(this->transport.getSeekPosition());
+            this->transport.broadcastStop();
+            return;
+        }
+        
+        const int key = wrapper.message.getNoteNumber();
+        const int channel = wrapper.message.getChannel();
+        wrapper.message.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+        
+        // Master tempo event is sent to everybody
+        if (wrapper.message.isTempoMetaEvent())
+        {
+            // the same as the tempo map has, so that the sampling doesn't repeat it
+            msPerTick = tempoMap->getMsPerTickAt(prevTimeStamp);
+            this->transport.broadcastTempoChanged(msPerTick);
             
-            if (wrapper.message.isNoteOff())
+            // Sends this to everybody (need to do that for drum-machines) - TODO test
+            sendTempoChangeToEverybody(wrapper.message);
+        }
+        else
+        {
+            wrapper.listener->addMessageToQueue(wrapper.message);
+        }
+        
+        if (wrapper.message.isNoteOn())
+        {
+            holdingNotes.add(HoldingNote({key, channel, wrapper.listener}));
+        }
+        
+        if (wrapper.message.isNoteOff())
+        {
+            for (int i = 0; i < holdingNotes.size(); ++i)
             {
-                for (int i = 0; i < holdingNotes.size(); ++i)
+                if (holdingNotes[i].key == key &&
+                    holdingNotes[i].channel == channel &&
+                    holdingNotes[i].listener == wrapper.listener)
                 {
-                    if (holdingNotes[i].key == key &&
-                        holdingNotes[i].channel == channel &&
-                        holdingNotes[i].listener == wrapper.listener)
-                    {
-                        holdingNotes.remove(i);
-                        break;
-                    }
+                    holdingNotes.remove(i);
+                    break;
                 }
             }
         }
+        
+        sendAutomationAt(prevTimeStamp);
     }
     
     Logger::writeToLog("Never happens.");
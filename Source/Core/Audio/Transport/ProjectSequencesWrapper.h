@@ -18,14 +18,29 @@
 #pragma once
 
 #include "Instrument.h"
+#include "MidiLayer.h"
 #include <float.h>
 
-class MidiLayer;
+// The automation curves are sampled in chunks of this size
+#define AUTOMATION_SAMPLING_CHUNK 64
+
+// Sequence wrappers are never modified once published:
+// an edit creates a new wrapper for the affected layer instead,
+// so that the player thread can keep reading the snapshot it holds.
+
+// The messages are shared with the layer's export cache, not copied,
+// so the track offset is applied on the fly whenever a timestamp is read.
+
+// The automation layers' curves are sampled by the player and the renderer,
+// and only the nodes come through the sequences.
 
 struct SequenceWrapper : public ReferenceCountedObject
 {
-    MidiMessageSequence sequence;
-    int currentIndex;
+    MidiLayer::ExportedSequence::Ptr sequence;
+    AutomationCurve::Ptr automation;
+    int channel;
+    int controllerNumber;
+    double timeOffset;
     MidiMessageCollector *listener;
     Instrument *instrument;
     const MidiLayer *layer;
@@ -48,6 +63,17 @@ private:
     
     Array<Instrument *> uniqueInstruments;
     ReferenceCountedArray<SequenceWrapper> sequences;
+    
+    // Playback cursors are owned by each copy, not by the shared wrappers
+    Array<int> currentIndexes;
+    
+    // The last controller values sent for each automation, -1 if none yet
+    Array<int> lastAutomationValues;
+    
+    // A binary min-heap of the indexes of sequences which still have events,
+    // ordered by the timestamps under their cursors (ties are resolved by index),
+    // so that picking the next message is O(log n) instead of a scan
+    Array<int> mergeHeap;
 
 public:
     
@@ -55,7 +81,10 @@ public:
     
     ProjectSequences(const ProjectSequences &other) :
     sequences(other.sequences),
-    uniqueInstruments(other.uniqueInstruments)
+    uniqueInstruments(other.uniqueInstruments),
+    currentIndexes(other.currentIndexes),
+    lastAutomationValues(other.lastAutomationValues),
+    mergeHeap(other.mergeHeap)
     {
     }
     
@@ -67,13 +96,48 @@ public:
     SequenceWrapper *addWrapper(SequenceWrapper *const newWrapper) noexcept
     {
         this->uniqueInstruments.addIfNotAlreadyThere(newWrapper->instrument);
-        return this->sequences.add(newWrapper);
+        this->currentIndexes.add(0);
+        this->lastAutomationValues.add(-1);
+        SequenceWrapper *addedWrapper = this->sequences.add(newWrapper);
+        this->pushToHeap(this->sequences.size() - 1);
+        return addedWrapper;
+    }
+    
+    // Replaces the wrapper of the same layer, or adds a new one
+    SequenceWrapper *updateWrapper(SequenceWrapper *const newWrapper) noexcept
+    {
+        for (int i = 0; i < this->sequences.size(); ++i)
+        {
+            if (this->sequences.getUnchecked(i)->layer == newWrapper->layer)
+            {
+                this->sequences.set(i, newWrapper);
+                this->currentIndexes.set(i, 0);
+                this->lastAutomationValues.set(i, -1);
+                this->updateUniqueInstruments();
+                this->rebuildHeap();
+                return newWrapper;
+            }
+        }
+        
+        return this->addWrapper(newWrapper);
+    }
+    
+    void swapWith(ProjectSequences &other) noexcept
+    {
+        this->uniqueInstruments.swapWith(other.uniqueInstruments);
+        this->sequences.swapWith(other.sequences);
+        this->currentIndexes.swapWith(other.currentIndexes);
+        this->lastAutomationValues.swapWith(other.lastAutomationValues);
+        this->mergeHeap.swapWith(other.mergeHeap);
     }
     
     void clear()
     {
         this->uniqueInstruments.clear();
         this->sequences.clear();
+        this->currentIndexes.clear();
+        this->lastAutomationValues.clear();
+        this->mergeHeap.clear();
     }
     
     bool empty() const
@@ -130,75 +194,213 @@ public:
         for (int i = 0; i < this->sequences.size(); ++i)
         {
             SequenceWrapper *wrapper = this->sequences.getUnchecked(i);
-            wrapper->currentIndex = this->getNextIndexAtTime(wrapper->sequence, (position - DBL_MIN));
+            this->currentIndexes.set(i, this->getNextIndexAtTime(wrapper->sequence->messages, (position - wrapper->timeOffset - DBL_MIN)));
+            this->lastAutomationValues.set(i, -1);
+        }
+        
+        this->rebuildHeap();
+    }
+    
+    // Moves the cursors to the first events strictly after the given time,
+    // used to continue playback with a fresh snapshot
+    void seekPastTime(double position)
+    {
+        for (int i = 0; i < this->sequences.size(); ++i)
+        {
+            SequenceWrapper *wrapper = this->sequences.getUnchecked(i);
+            this->currentIndexes.set(i, this->getIndexPastTime(wrapper->sequence->messages, position - wrapper->timeOffset));
         }
+        
+        this->rebuildHeap();
     }
     
+    // Index of the first event at or after the timestamp (a binary search)
     int getNextIndexAtTime(const MidiMessageSequence &sequence,
                            const double timeStamp) const
     {
-        const int numEvents = sequence.getNumEvents();
+        int start = 0;
+        int end = sequence.getNumEvents();
         
-        int i = 0;
-        for (; i < numEvents; ++i)
+        while (start < end)
         {
-            if (sequence.getEventPointer(i)->message.getTimeStamp() >= timeStamp)
+            const int middle = start + (end - start) / 2;
+            
+            if (sequence.getEventPointer(middle)->message.getTimeStamp() < timeStamp)
             {
-                break;
+                start = middle + 1;
+            }
+            else
+            {
+                end = middle;
             }
         }
         
-        return i;
+        return start;
     }
     
-    void seekToZeroIndexes()
+    // Index of the first event strictly after the timestamp (a binary search)
+    int getIndexPastTime(const MidiMessageSequence &sequence,
+                         const double timeStamp) const
     {
-        for (int i = 0; i < this->sequences.size(); ++i)
+        int start = 0;
+        int end = sequence.getNumEvents();
+        
+        while (start < end)
         {
-            this->sequences.getUnchecked(i)->currentIndex = 0;
+            const int middle = start + (end - start) / 2;
+            
+            if (sequence.getEventPointer(middle)->message.getTimeStamp() <= timeStamp)
+            {
+                start = middle + 1;
+            }
+            else
+            {
+                end = middle;
+            }
         }
+        
+        return start;
     }
     
-    bool getNextMessage(MessageWrapper &target)
+    void seekToZeroIndexes()
     {
-        double minTimeStamp = DBL_MAX;
-        int targetSequenceIndex = -1;
-
-        for (int i = 0; i < this->sequences.size(); ++i)
+        for (int i = 0; i < this->currentIndexes.size(); ++i)
         {
-            SequenceWrapper *wrapper = this->sequences.getUnchecked(i);
-
-            if (wrapper->currentIndex < wrapper->sequence.getNumEvents())
-            {
-                MidiMessage &message = wrapper->sequence.getEventPointer(wrapper->currentIndex)->message;
-
-                if (message.getTimeStamp() < minTimeStamp)
-                {
-                    minTimeStamp = message.getTimeStamp();
-                    targetSequenceIndex = i;
-                }
-            }
+            this->currentIndexes.set(i, 0);
         }
-
-        if (targetSequenceIndex < 0)
+        
+        this->rebuildHeap();
+    }
+    
+    bool getNextMessage(MessageWrapper &target)
+    {
+        if (this->mergeHeap.size() == 0)
         { return false; }
 
+        const int targetSequenceIndex = this->mergeHeap.getUnchecked(0);
         SequenceWrapper *foundWrapper = this->sequences.getUnchecked(targetSequenceIndex);
-        MidiMessage &foundMessage = foundWrapper->sequence.getEventPointer(foundWrapper->currentIndex)->message;
-        foundWrapper->currentIndex++;
+        int &foundIndex = this->currentIndexes.getReference(targetSequenceIndex);
+        const MidiMessage &foundMessage = foundWrapper->sequence->messages.getEventPointer(foundIndex)->message;
+        foundIndex++;
+        
+        if (foundIndex < foundWrapper->sequence->messages.getNumEvents())
+        {
+            // the root's key has grown, so just push it down
+            this->siftDown(0);
+        }
+        else
+        {
+            const int lastIndex = this->mergeHeap.size() - 1;
+            this->mergeHeap.set(0, this->mergeHeap.getUnchecked(lastIndex));
+            this->mergeHeap.removeLast();
+            this->siftDown(0);
+        }
         
         //if (foundMessage.isTempoMetaEvent())
         //{
         //    Logger::writeToLog("foundMessage.isTempoMetaEvent");
         //}
         
+        // the nodes are sent as they are, so the sampling shouldn't repeat them
+        if (foundWrapper->automation != nullptr && foundMessage.isController())
+        {
+            this->lastAutomationValues.set(targetSequenceIndex, foundMessage.getControllerValue());
+        }
+        
         target.message = foundMessage;
+        target.message.addToTimeStamp(foundWrapper->timeOffset);
         target.listener = foundWrapper->listener;
         target.instrument = foundWrapper->instrument;
 
         return true;
     }
-
+    
+    // Samples the automation curves at numPoints points, evenly spaced from the position,
+    // and calls back with a controller message and the point's index for every value
+    // changed since the last one sent. The callback returns false, if the message
+    // could not be sent, and the rest is skipped, to be retried on the next call.
+    template <typename Callback>
+    void sampleAutomation(double position, double step, int numPoints, Callback callback)
+    {
+        float values[AUTOMATION_SAMPLING_CHUNK];
+        
+        for (int i = 0; i < this->sequences.size(); ++i)
+        {
+            const SequenceWrapper *wrapper = this->sequences.getUnchecked(i);
+            const AutomationCurve *curve = wrapper->automation;
+            
+            if (curve == nullptr)
+            { continue; }
+            
+            // nothing is sent before the first node, the same as with the exported events
+            const double startTimeStamp = curve->getStartTimeStamp();
+            int &lastValue = this->lastAutomationValues.getReference(i);
+            
+            for (int chunkStart = 0; chunkStart < numPoints; chunkStart += AUTOMATION_SAMPLING_CHUNK)
+            {
+                const int chunkSize = jmin(AUTOMATION_SAMPLING_CHUNK, numPoints - chunkStart);
+                const double chunkTimeStamp = position - wrapper->timeOffset + step * chunkStart;
+                curve->getValues(chunkTimeStamp, step, values, chunkSize);
+                
+                for (int j = 0; j < chunkSize; ++j)
+                {
+                    const int value = AutomationCurve::getControllerValue(values[j]);
+                    
+                    if (value == lastValue ||
+                        (chunkTimeStamp + step * j) < startTimeStamp)
+                    {
+                        continue;
+                    }
+                    
+                    MessageWrapper target;
+                    target.message = MidiMessage::controllerEvent(wrapper->channel, wrapper->controllerNumber, value);
+                    target.message.setTimeStamp(position + step * (chunkStart + j));
+                    target.listener = wrapper->listener;
+                    target.instrument = wrapper->instrument;
+                    
+                    if (! callback(target, chunkStart + j))
+                    {
+                        return;
+                    }
+                    
+                    lastValue = value;
+                }
+            }
+        }
+    }
+    
+    // Checks if a note, which is currently sounding, is going to be released
+    // by one of the remaining events; if not, the caller should release it itself
+    bool hasPendingNoteOff(const MidiMessageCollector *listener, int channel, int key) const
+    {
+        for (int i = 0; i < this->sequences.size(); ++i)
+        {
+            const SequenceWrapper *wrapper = this->sequences.getUnchecked(i);
+            
+            if (wrapper->listener != listener)
+            { continue; }
+            
+            const int numEvents = wrapper->sequence->messages.getNumEvents();
+            
+            for (int j = this->currentIndexes.getUnchecked(i); j < numEvents; ++j)
+            {
+                const MidiMessage &message = wrapper->sequence->messages.getEventPointer(j)->message;
+                
+                if (message.isNoteOnOrOff() &&
+                    message.getNoteNumber() == key &&
+                    message.getChannel() == channel)
+                {
+                    if (message.isNoteOff())
+                    { return true; }
+                    
+                    break;
+                }
+            }
+        }
+        
+        return false;
+    }
+    
     double getLastEventTimestamp() const
     {
         double lastEventTimestamp = 0.f;
@@ -206,7 +408,7 @@ public:
         for (int i = 0; i < this->sequences.size(); ++i)
         {
             const SequenceWrapper *wrapper = this->sequences.getUnchecked(i);
-            const double &endTime = wrapper->sequence.getEndTime();
+            const double endTime = wrapper->sequence->messages.getEndTime() + wrapper->timeOffset;
 
             if (lastEventTimestamp < endTime)
             {
@@ -217,5 +419,115 @@ public:
         return lastEventTimestamp;
     }
     
+private:
+    
+    //===------------------------------------------------------------------===//
+    // Merge heap
+    //===------------------------------------------------------------------===//
+    
+    inline double getCurrentTimeStamp(int sequenceIndex) const
+    {
+        const SequenceWrapper *wrapper = this->sequences.getUnchecked(sequenceIndex);
+        return wrapper->sequence->messages.getEventPointer(this->currentIndexes.getUnchecked(sequenceIndex))->message.getTimeStamp() + wrapper->timeOffset;
+    }
+    
+    // Same order as the former linear scan gave: the earliest timestamp,
+    // and for the equal timestamps, the sequence that was added first
+    inline bool isHeapEntryLess(int sequenceIndex1, int sequenceIndex2) const
+    {
+        const double t1 = this->getCurrentTimeStamp(sequenceIndex1);
+        const double t2 = this->getCurrentTimeStamp(sequenceIndex2);
+        return (t1 < t2) || (t1 == t2 && sequenceIndex1 < sequenceIndex2);
+    }
+    
+    void siftUp(int heapIndex)
+    {
+        while (heapIndex > 0)
+        {
+            const int parentIndex = (heapIndex - 1) / 2;
+            
+            if (! this->isHeapEntryLess(this->mergeHeap.getUnchecked(heapIndex),
+                                        this->mergeHeap.getUnchecked(parentIndex)))
+            {
+                break;
+            }
+            
+            this->mergeHeap.swap(heapIndex, parentIndex);
+            heapIndex = parentIndex;
+        }
+    }
+    
+    void siftDown(int heapIndex)
+    {
+        const int heapSize = this->mergeHeap.size();
+        
+        while (true)
+        {
+            const int leftIndex = heapIndex * 2 + 1;
+            const int rightIndex = leftIndex + 1;
+            int smallestIndex = heapIndex;
+            
+            if (leftIndex < heapSize &&
+                this->isHeapEntryLess(this->mergeHeap.getUnchecked(leftIndex),
+                                      this->mergeHeap.getUnchecked(smallestIndex)))
+            {
+                smallestIndex = leftIndex;
+            }
+            
+            if (rightIndex < heapSize &&
+                this->isHeapEntryLess(this->mergeHeap.getUnchecked(rightIndex),
+                                      this->mergeHeap.getUnchecked(smallestIndex)))
+            {
+                smallestIndex = rightIndex;
+            }
+            
+            if (smallestIndex == heapIndex)
+            {
+                break;
+            }
+            
+            this->mergeHeap.swap(heapIndex, smallestIndex);
+            heapIndex = smallestIndex;
+        }
+    }
+    
+    void pushToHeap(int sequenceIndex)
+    {
+        if (this->currentIndexes.getUnchecked(sequenceIndex) <
+            this->sequences.getUnchecked(sequenceIndex)->sequence->messages.getNumEvents())
+        {
+            this->mergeHeap.add(sequenceIndex);
+            this->siftUp(this->mergeHeap.size() - 1);
+        }
+    }
+    
+    void rebuildHeap()
+    {
+        this->mergeHeap.clearQuick();
+        
+        for (int i = 0; i < this->sequences.size(); ++i)
+        {
+            if (this->currentIndexes.getUnchecked(i) < this->sequences.getUnchecked(i)->sequence->messages.getNumEvents())
+            {
+                this->mergeHeap.add(i);
+            }
+        }
+        
+        for (int i = this->mergeHeap.size() / 2 - 1; i >= 0; --i)
+        {
+            this->siftDown(i);
+        }
+    }
+    
+    void updateUniqueInstruments()
+    {
+        this->uniqueInstruments.clearQuick();
+        
+        for (int i = 0; i < this->sequences.size(); ++i)
+        {
+            this->uniqueInstruments.addIfNotAlreadyThere(this->sequences.getUnchecked(i)->instrument);
+        }
+    }
+    
     JUCE_LEAK_DETECTOR(ProjectSequences)
 };
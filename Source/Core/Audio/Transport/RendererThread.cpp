@@ -21,15 +21,17 @@
 #include "Instrument.h"
 #include "Supervisor.h"
 #include "SerializationKeys.h"
-#include "App.h"
-#include "Workspace.h"
-#include "AudioCore.h"
+
+// The automation curves are sampled this often within each block
+#define RENDER_AUTOMATION_STEP_FRAMES 32
 
 RendererThread::RendererThread(Transport &parentTrasport) :
     Thread("RendererThread"),
     transport(parentTrasport),
     writer(nullptr),
-    percentsDone(0.f)
+    percentsDone(0.f),
+    blockSize(Transport::defaultRenderBlockSize),
+    numThreads(0)
 {
 }
 
@@ -45,10 +47,12 @@ float RendererThread::getPercentsComplete() const
 }
 
 
-void RendererThread::startRecording(const File &file)
+void RendererThread::startRecording(const File &file, int bitDepth, int renderBlockSize,
+                                    int numRenderThreads)
 {
     this->transport.rebuildSequencesIfNeeded();
-    const ProjectSequences sequences = this->transport.getSequences();
+    const PlaybackSnapshot::Ptr snapshot(this->transport.getPlaybackSnapshot());
+    const ProjectSequences &sequences = snapshot->sequences;
     
     if (sequences.empty())
     {
@@ -56,6 +60,8 @@ void RendererThread::startRecording(const File &file)
     }
 
     this->stop();
+    this->blockSize = jmax(1, renderBlockSize);
+    this->numThreads = jmax(0, numRenderThreads);
 
     double sampleRate = sequences.getSampleRate();
     int numChannels = sequences.getNumOutputChannels();
@@ -76,7 +82,9 @@ void RendererThread::startRecording(const File &file)
             Supervisor::track(Serialization::Activities::transportRenderWav);
             WavAudioFormat wavFormat;
             const ScopedLock sl(this->writerLock);
-            this->writer = wavFormat.createWriterFor(fileStream, sampleRate, numChannels, 16, StringPairArray(), 0);
+            // 32-bit wav is written as floating point, directly from the mixing buffer
+            const int wavBitDepth = (bitDepth >= 32) ? 32 : ((bitDepth >= 24) ? 24 : 16);
+            this->writer = wavFormat.createWriterFor(fileStream, sampleRate, numChannels, wavBitDepth, StringPairArray(), 0);
         }
         else if (file.getFileExtension().toLowerCase() == ".ogg")
         {
@@ -90,7 +98,8 @@ void RendererThread::startRecording(const File &file)
             Supervisor::track(Serialization::Activities::transportRenderFlac);
             FlacAudioFormat flacFormat;
             const ScopedLock sl(this->writerLock);
-            this->writer = flacFormat.createWriterFor(fileStream, sampleRate, numChannels, 16, StringPairArray(), 0);
+            const int flacBitDepth = (bitDepth >= 24) ? 24 : 16;
+            this->writer = flacFormat.createWriterFor(fileStream, sampleRate, numChannels, flacBitDepth, StringPairArray(), 0);
         }
 
         if (writer != nullptr)
@@ -123,41 +132,65 @@ bool RendererThread::isRecording() const
     return this->isThreadRunning();
 }
 
+RendererThread::Stats RendererThread::getLastStats() const
+{
+    const ScopedLock sl(this->statsLock);
+    return this->lastStats;
+}
+
 
 //===----------------------------------------------------------------------===//
 // Thread
 //===----------------------------------------------------------------------===//
 
-struct RenderBuffer
+// Instruments don't depend on each other, so their blocks are rendered
+// in parallel by the pool, each into its own buffer, and then mixed down
+// in the same order as before, so the result is identical to the serial rendering.
+
+struct RenderBuffer : public ThreadPoolJob
 {
+    RenderBuffer() : ThreadPoolJob("RenderBuffer"), processingTicks(0) {}
+
+    void processBlock()
+    {
+        const int64 startTicks = Time::getHighResolutionTicks();
+        AudioProcessorGraph *graph = this->instrument->getProcessorGraph();
+
+        {
+            const ScopedLock lock(graph->getCallbackLock());
+            graph->processBlock(this->sampleBuffer, this->midiBuffer);
+        }
+
+        this->processingTicks += (Time::getHighResolutionTicks() - startTicks);
+    }
+
+    JobStatus runJob() override
+    {
+        this->processBlock();
+        return jobHasFinished;
+    }
+
     Instrument *instrument;
     AudioSampleBuffer sampleBuffer;
     MidiBuffer midiBuffer;
+    int64 processingTicks;
 };
 
 void RendererThread::run()
 {
-    // step 0. init.
-    this->transport.rebuildSequencesIfNeeded();
-    ProjectSequences sequences = this->transport.getSequences();
-    const int bufferSize = 512;
-    const double TPQN = Transport::millisecondsPerBeat; // ticks-per-quarter-note
+    // step 0. init (the sequences have been rebuilt in startRecording).
+    const PlaybackSnapshot::Ptr snapshot(this->transport.getPlaybackSnapshot());
+    ProjectSequences sequences(snapshot->sequences);
+    TempoMap::Ptr tempoMap(snapshot->tempoMap);
+    const int bufferSize = this->blockSize;
 
     // assuming that number of channels and sample rate is equal for all instruments
     const int numOutChannels = sequences.getNumOutputChannels();
     const int numInChannels = sequences.getNumInputChannels();
     const double sampleRate = sequences.getSampleRate();
     
-    double tempoAtTheEndOfTrack = 0.0;
-    double totalTimeMs = 0.0;
-    this->transport.calcTimeAndTempoAt(1.0, totalTimeMs, tempoAtTheEndOfTrack);
-    
-    // грязный хак. calcTimeAndTempoAt считает темп для PlayerThread'а немного по-другому,
-    // чем нужно здесь. поэтому TPQN заменяю на 1000.
-    // рефакторить лень.
-    // когда-нибудь у меня будет куча времени и я все сделаю по-человечески.
-    const double lastFrame = totalTimeMs / 1000 * sampleRate;
-
+    const double totalTimeMs = tempoMap->getTimeMsAt(round(this->transport.getTotalTime()));
+    const double lastFrame = totalTimeMs * 0.001 * sampleRate;
 
     // step 1. create a list of unique instruments with audio buffers for them.
     OwnedArray<RenderBuffer> subBuffers;
@@ -182,12 +215,14 @@ void RendererThread::run()
         graph->setNonRealtime(true);
     }
 
+    // the current thread renders one of the instruments itself, so it needs one worker less
+    const int maxNumThreads = (this->numThreads > 0) ? this->numThreads : SystemStats::getNumCpus();
+    const int numWorkers = jmin(maxNumThreads, subBuffers.size()) - 1;
+    ScopedPointer<ThreadPool> workers((numWorkers > 0) ? new ThreadPool(numWorkers) : nullptr);
+
     // step 3. render loop itself.
-    double msPerTick = this->transport.findFirstTempoEvent().getTempoSecondsPerQuarterNote();
     double currentFrame = 0.0;
     
-    //double currentFrame = currentTimeMs / TPQN * sampleRate;
-    
     sequences.seekToTime(0.0);
     
     MessageWrapper nextMessage;
@@ -196,19 +231,22 @@ void RendererThread::run()
     
     AudioSampleBuffer mixingBuffer(numOutChannels, bufferSize);
     
-    double prevEventTimeStamp = 0.0;
-    double lastTick = 0.0;
-    double nextTickDelta = (nextMessage.message.getTimeStamp() - prevEventTimeStamp) * msPerTick / TPQN;
-    double nextEventTick = lastTick + nextTickDelta;
+    // the event's frame is taken from the tempo map directly,
+    // so that the rounding errors don't accumulate over the track
+    double nextEventFrame = tempoMap->getTimeMsAt(nextMessage.message.getTimeStamp()) * 0.001 * sampleRate;
 
-    int messageFrame = int((nextEventTick * sampleRate) - currentFrame);
+    // the tempo the instruments were last told, to send them the tempo curve's changes
+    double renderedMsPerTick = tempoMap->getMsPerTickAt(0.0);
+    const int numAutomationPoints = jmax(1, bufferSize / RENDER_AUTOMATION_STEP_FRAMES);
 
     // And here we go: send MidiStart
     for (auto subBuffer : subBuffers)
     {
-        subBuffer->midiBuffer.addEvent(MidiMessage::midiStart(), messageFrame);
+        subBuffer->midiBuffer.addEvent(MidiMessage::midiStart(), 0);
     }
 
+    const int64 renderStartTicks = Time::getHighResolutionTicks();
+
     while (currentFrame < lastFrame)
     {
         if (this->threadShouldExit())
@@ -216,16 +254,46 @@ void RendererThread::run()
             break;
         }
         
-        // step 3a. fill up the midi buffers.
-        while (hasNextMessage &&
-               ( (nextEventTick * sampleRate) >= currentFrame &&
-                 (nextEventTick * sampleRate) < (currentFrame + bufferSize) ))
+        // step 3a. sample the automation curves over the block, the ticks within it
+        // are considered linear, and the tempo curve at the block start.
+        const double blockStartTimeStamp = tempoMap->getTimeStampAtTimeMs(currentFrame / sampleRate * 1000.0);
+        const double blockEndTimeStamp = tempoMap->getTimeStampAtTimeMs((currentFrame + bufferSize) / sampleRate * 1000.0);
+        const double automationStep = (blockEndTimeStamp - blockStartTimeStamp) / numAutomationPoints;
+
+        sequences.sampleAutomation(blockStartTimeStamp, automationStep, numAutomationPoints,
+            [&](const MessageWrapper &automation, int pointIndex) -> bool
         {
-            messageFrame = int((nextEventTick * sampleRate) - currentFrame);
+            const int automationFrame = (pointIndex * bufferSize) / numAutomationPoints;
+
+            for (auto subBuffer : subBuffers)
+            {
+                if (automation.instrument == subBuffer->instrument)
+                {
+                    subBuffer->midiBuffer.addEvent(automation.message, automationFrame);
+                }
+            }
+
+            return true;
+        });
+
+        if (tempoMap->getMsPerTickAt(blockStartTimeStamp) != renderedMsPerTick)
+        {
+            renderedMsPerTick = tempoMap->getMsPerTickAt(blockStartTimeStamp);
+
+            for (auto subBuffer : subBuffers)
+            {
+                subBuffer->midiBuffer.addEvent(tempoMap->getTempoEventAt(blockStartTimeStamp), 0);
+            }
+        }
+
+        // step 3b. fill up the midi buffers.
+        while (hasNextMessage && nextEventFrame < (currentFrame + bufferSize))
+        {
+            const int messageFrame = jmax(0, int(nextEventFrame - currentFrame));
 
             if (nextMessage.message.isTempoMetaEvent())
             {
-                msPerTick = nextMessage.message.getTempoSecondsPerQuarterNote();
+                renderedMsPerTick = tempoMap->getMsPerTickAt(nextMessage.message.getTimeStamp());
 
                 // Sends this to everybody (need to do that for drum-machines) - TODO test
                 for (auto subBuffer : subBuffers)
@@ -245,30 +313,34 @@ void RendererThread::run()
                 }
             }
 
-            lastTick += nextTickDelta;
-            prevEventTimeStamp = nextMessage.message.getTimeStamp();
-            
             hasNextMessage = sequences.getNextMessage(nextMessage);
-            nextTickDelta = (nextMessage.message.getTimeStamp() - prevEventTimeStamp) * msPerTick / TPQN;
-            nextEventTick = lastTick + nextTickDelta;
+            nextEventFrame = tempoMap->getTimeMsAt(nextMessage.message.getTimeStamp()) * 0.001 * sampleRate;
         }
 
-        // step 3b. call processBlock for every instrument.
-        for (auto subBuffer : subBuffers)
+        // step 3c. call processBlock for every instrument.
+        if (workers != nullptr)
+        {
+            for (int i = 1; i < subBuffers.size(); ++i)
+            {
+                workers->addJob(subBuffers.getUnchecked(i), false);
+            }
+
+            subBuffers.getFirst()->processBlock();
+
+            for (int i = 1; i < subBuffers.size(); ++i)
+            {
+                workers->waitForJobToFinish(subBuffers.getUnchecked(i), -1);
+            }
+        }
+        else
         {
-            AudioProcessorGraph *graph = subBuffer->instrument->getProcessorGraph();
+            for (auto subBuffer : subBuffers)
             {
-                const ScopedLock lock(graph->getCallbackLock());
-                
-                //Logger::writeToLog("processBlock num midi events: " + String(subBuffers[i]->midiBuffer.getNumEvents()));
-                graph->processBlock(subBuffer->sampleBuffer, subBuffer->midiBuffer);
-                
-                // TODO test if I ever need this hack
-                //Thread::sleep(15);
+                subBuffer->processBlock();
             }
         }
 
-        // step 3c. mix them down to the render buffer.
+        // step 3d. mix them down to the render buffer.
         mixingBuffer.clear();
 
         for (auto subBuffer : subBuffers)
@@ -282,7 +354,7 @@ void RendererThread::run()
             }
         }
 
-        // step 3d. write resulting buffer to disk.
+        // step 3e. write resulting buffer to disk.
         {
             const ScopedLock sl(this->writerLock);
             bool writedSuccessfullty = false;
@@ -294,16 +366,43 @@ void RendererThread::run()
             }
         }
 
-        // step 3e. finally, update counters.
+        // step 3f. finally, update counters.
         currentFrame += bufferSize;
 
         {
             const ScopedWriteLock pl(this->percentsLock);
-            this->percentsDone = float(currentFrame / lastFrame);
+            // the last block is usually incomplete
+            this->percentsDone = float(jmin(1.0, currentFrame / lastFrame));
             //Logger::writeToLog("this->percentsDone : " + String(this->percentsDone));
         }
     }
 
+    workers = nullptr;
+
+    // step 3g. report the render speed, to keep an eye on the bounce performance.
+    const double renderSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - renderStartTicks);
+    const double renderedSeconds = currentFrame / sampleRate;
+
+    Logger::writeToLog("Rendered " + String(renderedSeconds, 2) + "s in " + String(renderSeconds, 2) +
+                       "s, realtime factor: " + String(renderedSeconds / jmax(0.001, renderSeconds), 2));
+
+    Stats stats;
+    stats.renderedSeconds = renderedSeconds;
+    stats.renderSeconds = renderSeconds;
+
+    for (auto subBuffer : subBuffers)
+    {
+        const double processingMs = Time::highResolutionTicksToSeconds(subBuffer->processingTicks) * 1000.0;
+        Logger::writeToLog(" - " + subBuffer->instrument->getName() + ": " + String(processingMs, 1) + "ms");
+        stats.instrumentNames.add(subBuffer->instrument->getName());
+        stats.instrumentProcessingMs.add(processingMs);
+    }
+
+    {
+        const ScopedLock sl(this->statsLock);
+        this->lastStats = stats;
+    }
+
     // step 4. setNonRealtime false.
     for (auto subBuffer : subBuffers)
     {
@@ -320,8 +419,6 @@ void RendererThread::run()
     
     if (! this->threadShouldExit())
     {
-        // dirty hack
-        App::Workspace().getAudioCore().unmute();
-        App::Workspace().getAudioCore().unmute();
+        this->transport.unmuteAudioCore();
     }
 }
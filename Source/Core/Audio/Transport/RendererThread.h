@@ -29,12 +29,28 @@ public:
     
     float getPercentsComplete() const;
 
-    void startRecording(const File &file);
+    // The instruments are rendered by up to numRenderThreads threads,
+    // or by one per CPU, if it is 0; the result is the same either way
+    void startRecording(const File &file, int bitDepth, int renderBlockSize,
+                        int numRenderThreads = 0);
 
     void stop();
 
     bool isRecording() const;
 
+    // The speed of the last finished render, as it's written to the log
+    struct Stats
+    {
+        Stats() : renderedSeconds(0.0), renderSeconds(0.0) {}
+
+        double renderedSeconds;
+        double renderSeconds;
+        StringArray instrumentNames;
+        Array<double> instrumentProcessingMs;
+    };
+
+    Stats getLastStats() const;
+
 private:
 
     //===------------------------------------------------------------------===//
@@ -52,6 +68,13 @@ private:
 
     ReadWriteLock percentsLock;
     float percentsDone;
+
+    int blockSize;
+
+    int numThreads;
+
+    CriticalSection statsLock;
+    Stats lastStats;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RendererThread)
 };
@@ -0,0 +1,457 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "ScheduledPlayerThread.h"
+#include "Instrument.h"
+#include "InstrumentProcessor.h"
+#include "AudioMonitor.h"
+
+// How often the scheduler wakes up to fill up the instruments' fifos
+#define SCHEDULER_UPDATE_TIME_MS 10
+
+// How far ahead of the audio callback the events are scheduled.
+// The edits made while playing are heard not earlier than in this time.
+#define SCHEDULER_LOOKAHEAD_MS 100
+
+
+ScheduledPlayerThread::ScheduledPlayerThread(Transport &parentTransport) :
+    PlayerThread(parentTransport)
+{
+}
+
+ScheduledPlayerThread::~ScheduledPlayerThread()
+{
+    this->stopThread(100);
+}
+
+
+//===----------------------------------------------------------------------===//
+// Thread
+//===----------------------------------------------------------------------===//
+
+void ScheduledPlayerThread::run()
+{
+    // the own copy of the sequences holds the cursors
+    int snapshotVersion = this->transport.getSnapshotVersion();
+    PlaybackSnapshot::Ptr snapshot(this->transport.getPlaybackSnapshot());
+    ProjectSequences sequences(snapshot->sequences);
+    TempoMap::Ptr tempoMap(snapshot->tempoMap);
+    Array<Instrument *> uniqueInstruments(sequences.getUniqueInstruments());
+    
+    const AudioMonitor *clock = uniqueInstruments.isEmpty() ? nullptr :
+        &uniqueInstruments.getFirst()->getInstrumentProcessor().getClock();
+    
+    if (clock == nullptr ||
+        ! clock->isDeviceRunning() ||
+        clock->getSampleRate() <= 0.0)
+    {
+        PlayerThread::run();
+        return;
+    }
+    
+    const double framesPerMs = clock->getSampleRate() * 0.001;
+    const int64 lookaheadFrames = int64(SCHEDULER_LOOKAHEAD_MS * framesPerMs);
+    
+    const double absStartPosition = this->transport.isLooped() ? this->transport.getLoopStart() : this->transport.getSeekPosition();
+    const double absEndPosition = this->transport.isLooped() ? this->transport.getLoopEnd() : 1.0;
+    
+    const double totalTime = round(this->transport.getTotalTime());
+    const double startPositionInTime = round(absStartPosition * this->transport.getTotalTime());
+    const double endPositionInTime = round(absEndPosition * this->transport.getTotalTime());
+    
+    // a loop shorter than a frame would never advance the schedule
+    const bool shouldLoop = this->transport.isLooped() &&
+        (tempoMap->getTimeMsAt(endPositionInTime) - tempoMap->getTimeMsAt(startPositionInTime)) * framesPerMs >= 1.0;
+    
+    double totalTimeMs = tempoMap->getTimeMsAt(totalTime);
+    double msPerTick = tempoMap->getMsPerTickAt(startPositionInTime);
+    this->transport.broadcastTempoChanged(msPerTick);
+    
+    // The events of the previous playbacks, still waiting in the fifos, are dropped
+    const int sessionId = InstrumentProcessor::createSessionId();
+    Array<Instrument *> activeInstruments;
+    
+    auto activateInstruments = [&]()
+    {
+        for (auto &instrument : uniqueInstruments)
+        {
+            instrument->getInstrumentProcessor().setActiveSession(sessionId);
+            activeInstruments.addIfNotAlreadyThere(instrument);
+        }
+    };
+    
+    activateInstruments();
+    
+    // Each anchor binds a timestamp to the device frame, at which it is played.
+    // A new anchor is added on every rewind and on every update of the tempo map,
+    // so that the already scheduled events are never shifted.
+    struct Anchor
+    {
+        int64 frame;
+        double timeStamp;
+    };
+    
+    Array<Anchor> anchors;
+    
+    // The first events should arrive before the next block starts
+    anchors.add({ clock->getBlockStartFrame() + clock->getBlockSize() * 2, startPositionInTime });
+    
+    auto getFrameAt = [&](double timeStamp) -> int64
+    {
+        const Anchor &anchor = anchors.getReference(anchors.size() - 1);
+        const double deltaMs = tempoMap->getTimeMsAt(timeStamp) - tempoMap->getTimeMsAt(anchor.timeStamp);
+        return anchor.frame + int64(deltaMs * framesPerMs + 0.5);
+    };
+    
+    auto getTimeStampAt = [&](int64 frame) -> double
+    {
+        const Anchor &anchor = anchors.getReference(anchors.size() - 1);
+        const double deltaMs = (frame - anchor.frame) / framesPerMs;
+        return tempoMap->getTimeStampAtTimeMs(tempoMap->getTimeMsAt(anchor.timeStamp) + deltaMs);
+    };
+    
+    // The notes which note-offs are not played yet, to release them when stopped.
+    // Note-offs scheduled in the session being stopped are dropped along with it.
+    struct HoldingNote
+    {
+        int key;
+        int channel;
+        MidiMessageCollector *listener;
+        int64 noteOffFrame;
+    };
+    
+    Array<HoldingNote> holdingNotes;
+    
+    // The tempo the instruments were last told, to send them the tempo curve's changes
+    double scheduledMsPerTick = msPerTick;
+    
+    auto scheduleMessage = [&](const MessageWrapper &wrapper, int64 frame) -> bool
+    {
+        // Master tempo event is sent to everybody
+        if (wrapper.message.isTempoMetaEvent())
+        {
+            for (auto &instrument : uniqueInstruments)
+            {
+                if (instrument->getInstrumentProcessor().isFifoFull())
+                {
+                    return false;
+                }
+            }
+            
+            for (auto &instrument : uniqueInstruments)
+            {
+                instrument->getInstrumentProcessor().scheduleEvent(wrapper.message, frame, sessionId);
+            }
+            
+            scheduledMsPerTick = tempoMap->getMsPerTickAt(wrapper.message.getTimeStamp());
+            return true;
+        }
+        
+        if (! wrapper.instrument->getInstrumentProcessor().scheduleEvent(wrapper.message, frame, sessionId))
+        {
+            return false;
+        }
+        
+        const int key = wrapper.message.getNoteNumber();
+        const int channel = wrapper.message.getChannel();
+        
+        if (wrapper.message.isNoteOn())
+        {
+            holdingNotes.add(HoldingNote({key, channel, wrapper.listener, -1}));
+        }
+        else if (wrapper.message.isNoteOff())
+        {
+            for (auto &holding : holdingNotes)
+            {
+                if (holding.noteOffFrame < 0 &&
+                    holding.key == key &&
+                    holding.channel == channel &&
+                    holding.listener == wrapper.listener)
+                {
+                    holding.noteOffFrame = frame;
+                    break;
+                }
+            }
+        }
+        
+        return true;
+    };
+    
+    // The automation curves and the tempo curve are sampled once per device block,
+    // interleaved with the events, since the fifos expect the frames in order
+    const int automationStepFrames = jmax(1, clock->getBlockSize());
+    int64 automationFrame = anchors.getReference(0).frame;
+    
+    auto scheduleAutomationUpTo = [&](int64 frame) -> bool
+    {
+        while (automationFrame < frame)
+        {
+            const double timeStamp = getTimeStampAt(automationFrame);
+            
+            if (timeStamp > endPositionInTime)
+            {
+                return true;
+            }
+            
+            bool automationScheduled = true;
+            
+            sequences.sampleAutomation(timeStamp, 0.0, 1,
+                [&](const MessageWrapper &automation, int) -> bool
+            {
+                automationScheduled = automation.instrument->getInstrumentProcessor().
+                    scheduleEvent(automation.message, automationFrame, sessionId);
+                
+                return automationScheduled;
+            });
+            
+            if (! automationScheduled)
+            {
+                return false;
+            }
+            
+            if (tempoMap->getMsPerTickAt(timeStamp) != scheduledMsPerTick)
+            {
+                MessageWrapper tempoEvent;
+                tempoEvent.message = tempoMap->getTempoEventAt(timeStamp);
+                tempoEvent.message.setTimeStamp(timeStamp);
+                
+                if (! scheduleMessage(tempoEvent, automationFrame))
+                {
+                    return false;
+                }
+            }
+            
+            automationFrame += automationStepFrames;
+        }
+        
+        return true;
+    };
+    
+    auto sendMidiStart = [&uniqueInstruments]()
+    {
+        for (auto &instrument : uniqueInstruments)
+        {
+            MidiMessage startPlayback(MidiMessage::midiStart());
+            startPlayback.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+            instrument->getProcessorPlayer().getMidiMessageCollector().addMessageToQueue(startPlayback);
+        }
+    };
+    
+    auto sendHoldingNotesOffAndMidiStop = [&]()
+    {
+        for (auto &instrument : activeInstruments)
+        {
+            instrument->getInstrumentProcessor().setActiveSession(0);
+        }
+        
+        const int64 currentFrame = clock->getBlockStartFrame();
+        
+        for (const auto &holding : holdingNotes)
+        {
+            if (holding.noteOffFrame < 0 || holding.noteOffFrame >= currentFrame)
+            {
+                MidiMessage noteOff(MidiMessage::noteOff(holding.channel, holding.key, 0.f));
+                noteOff.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+                holding.listener->addMessageToQueue(noteOff);
+            }
+        }
+        
+        MidiMessage stopPlayback(MidiMessage::midiStop());
+        stopPlayback.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+        
+        for (auto &instrument : activeInstruments)
+        {
+            instrument->getProcessorPlayer().getMidiMessageCollector().addMessageToQueue(stopPlayback);
+        }
+        
+        // Wait until all plugins process the messages in their queues
+        Time::waitForMillisecondCounter(Time::getMillisecondCounter() + SCHEDULER_UPDATE_TIME_MS * 2);
+    };
+    
+    sequences.seekToTime(startPositionInTime);
+    double prevTimeStamp = startPositionInTime;
+    
+    MessageWrapper nextMessage;
+    bool hasNextMessage = sequences.getNextMessage(nextMessage);
+    
+    // And here we go.
+    sendMidiStart();
+    
+    while (! this->threadShouldExit())
+    {
+        // step 1. pick up the recent snapshot, if the project was edited while playing.
+        // Events with the same timestamp are scheduled together,
+        // so it is only safe to switch the sequences between the different timestamps.
+        const bool canApplyUpdates = (! hasNextMessage ||
+                                      nextMessage.message.getTimeStamp() > prevTimeStamp);
+        
+        const int actualSnapshotVersion = this->transport.getSnapshotVersion();
+        PlaybackSnapshot::Ptr previousSnapshot(snapshot);
+        
+        if (canApplyUpdates && actualSnapshotVersion != snapshotVersion)
+        {
+            snapshotVersion = actualSnapshotVersion;
+            snapshot = this->transport.getPlaybackSnapshot();
+        }
+        
+        if (snapshot->tempoMapVersion != previousSnapshot->tempoMapVersion)
+        {
+            // the events scheduled so far keep their frames
+            anchors.add({ getFrameAt(prevTimeStamp), prevTimeStamp });
+            
+            tempoMap = snapshot->tempoMap;
+            totalTimeMs = tempoMap->getTimeMsAt(totalTime);
+        }
+        
+        if (snapshot->sequencesVersion != previousSnapshot->sequencesVersion)
+        {
+            const int64 prevFrame = getFrameAt(prevTimeStamp);
+            
+            sequences = snapshot->sequences;
+            uniqueInstruments = sequences.getUniqueInstruments();
+            activateInstruments();
+            
+            sequences.seekPastTime(prevTimeStamp);
+            hasNextMessage = sequences.getNextMessage(nextMessage);
+            
+            // The notes, which note-offs have been removed or moved before the playhead
+            // by the edit, would hang forever, so release them right after the last event
+            for (auto &holding : holdingNotes)
+            {
+                if (holding.noteOffFrame < 0 &&
+                    ! sequences.hasPendingNoteOff(holding.listener, holding.channel, holding.key))
+                {
+                    const MidiMessage noteOff(MidiMessage::noteOff(holding.channel, holding.key, 0.f));
+                    
+                    for (auto &instrument : activeInstruments)
+                    {
+                        if (&instrument->getProcessorPlayer().getMidiMessageCollector() == holding.listener &&
+                            instrument->getInstrumentProcessor().scheduleEvent(noteOff, prevFrame, sessionId))
+                        {
+                            holding.noteOffFrame = prevFrame;
+                        }
+                    }
+                }
+            }
+        }
+        
+        // step 2. schedule everything up to the lookahead horizon.
+        const int64 currentFrame = clock->getBlockStartFrame();
+        const int64 horizonFrame = currentFrame + lookaheadFrames;
+        
+        while (true)
+        {
+            const bool shouldRewind = shouldLoop &&
+                (! hasNextMessage || nextMessage.message.getTimeStamp() > endPositionInTime);
+            
+            if (shouldRewind)
+            {
+                const int64 loopEndFrame = getFrameAt(endPositionInTime);
+                
+                if (loopEndFrame >= horizonFrame)
+                {
+                    scheduleAutomationUpTo(horizonFrame);
+                    break;
+                }
+                
+                if (! scheduleAutomationUpTo(loopEndFrame))
+                {
+                    break;
+                }
+                
+                anchors.add({ loopEndFrame, startPositionInTime });
+                sequences.seekToTime(startPositionInTime);
+                prevTimeStamp = startPositionInTime;
+                hasNextMessage = sequences.getNextMessage(nextMessage);
+                continue;
+            }
+            
+            if (! hasNextMessage)
+            {
+                scheduleAutomationUpTo(horizonFrame);
+                break;
+            }
+            
+            const double nextTimeStamp = nextMessage.message.getTimeStamp();
+            const int64 nextFrame = getFrameAt(nextTimeStamp);
+            
+            if (nextFrame >= horizonFrame)
+            {
+                scheduleAutomationUpTo(horizonFrame);
+                break;
+            }
+            
+            // if the fifo is full, try again on the next wake up
+            if (! scheduleAutomationUpTo(nextFrame) ||
+                ! scheduleMessage(nextMessage, nextFrame))
+            {
+                break;
+            }
+            
+            prevTimeStamp = nextTimeStamp;
+            hasNextMessage = sequences.getNextMessage(nextMessage);
+        }
+        
+        // step 3. forget the played note-offs and anchors, and find the playhead.
+        for (int i = holdingNotes.size() - 1; i >= 0; --i)
+        {
+            const int64 noteOffFrame = holdingNotes.getReference(i).noteOffFrame;
+            
+            if (noteOffFrame >= 0 && noteOffFrame < currentFrame)
+            {
+                holdingNotes.remove(i);
+            }
+        }
+        
+        while (anchors.size() > 1 && anchors.getReference(1).frame <= currentFrame)
+        {
+            anchors.remove(0);
+        }
+        
+        const Anchor &playedAnchor = anchors.getReference(0);
+        const double playedMs = jmax(0.0, (currentFrame - playedAnchor.frame) / framesPerMs);
+        const double currentTimeMs = tempoMap->getTimeMsAt(playedAnchor.timeStamp) + playedMs;
+        const double currentTimeStamp = jmin(endPositionInTime, tempoMap->getTimeStampAtTimeMs(currentTimeMs));
+        
+        const double newMsPerTick = tempoMap->getMsPerTickAt(currentTimeStamp);
+        
+        if (newMsPerTick != msPerTick)
+        {
+            msPerTick = newMsPerTick;
+            this->transport.broadcastTempoChanged(msPerTick);
+        }
+        
+        this->transport.broadcastSeek(currentTimeStamp / this->transport.getTotalTime(),
+                                      currentTimeMs, totalTimeMs);
+        
+        // step 4. finish, when everything is scheduled and played.
+        if (! shouldLoop && ! hasNextMessage &&
+            currentFrame >= getFrameAt(endPositionInTime))
+        {
+            sendHoldingNotesOffAndMidiStop();
+            this->transport.allNotesControllersAndSoundOff();
+            this->transport.seekToPosition(this->transport.getSeekPosition());
+            this->transport.broadcastStop();
+            return;
+        }
+        
+        this->wait(SCHEDULER_UPDATE_TIME_MS);
+    }
+    
+    sendHoldingNotesOffAndMidiStop();
+}
@@ -0,0 +1,45 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "PlayerThread.h"
+
+// The player which doesn't wait for the events' time to send them:
+// it converts their timestamps into the device's sample frames instead,
+// and schedules them a bit ahead to the instruments' processors,
+// so that the audio callback plays them sample-accurately (see InstrumentProcessor).
+//
+// Falls back to PlayerThread's behaviour, if the audio device is not running.
+
+class ScheduledPlayerThread : public PlayerThread
+{
+public:
+
+    explicit ScheduledPlayerThread(Transport &parentTransport);
+
+    ~ScheduledPlayerThread() override;
+
+protected:
+
+    //===------------------------------------------------------------------===//
+    // Thread
+    //===------------------------------------------------------------------===//
+
+    void run() override;
+
+};
@@ -0,0 +1,191 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "TempoMap.h"
+#include "Transport.h"
+
+static double getMsPerTick(const MidiMessage &tempoEvent)
+{
+    const double TPQN = Transport::millisecondsPerBeat; // ticks-per-quarter-note
+    return tempoEvent.getTempoSecondsPerQuarterNote() * 1000.0 / TPQN;
+}
+
+TempoMap::TempoMap()
+{
+    // default 120 BPM, same as the player has always had with no tempo events
+    const Segment defaultSegment = { 0.0, 0.0, 500.0 / Transport::millisecondsPerBeat };
+    this->segments.add(defaultSegment);
+}
+
+void TempoMap::flattenCurve(const AutomationCurve &tempoCurve, double timeOffset, Points &result)
+{
+    Array<double> timeStamps;
+    Array<float> values;
+    tempoCurve.getResampledPoints(timeStamps, values);
+    result.ensureStorageAllocated(result.size() + timeStamps.size());
+    
+    for (int i = 0; i < timeStamps.size(); ++i)
+    {
+        const Point point =
+        {
+            timeStamps.getUnchecked(i) + timeOffset,
+            getMsPerTick(AutomationCurve::createTempoEvent(values.getUnchecked(i)))
+        };
+        
+        result.add(point);
+    }
+}
+
+TempoMap::TempoMap(const OwnedArray<Points> &tempoTracks) : TempoMap()
+{
+    struct PointsComparator
+    {
+        static int compareElements(const Point &first, const Point &second)
+        {
+            return (first.timeStamp < second.timeStamp) ? -1 : ((second.timeStamp < first.timeStamp) ? 1 : 0);
+        }
+    };
+    
+    Points points;
+    
+    for (auto track : tempoTracks)
+    {
+        points.addArray(*track);
+    }
+    
+    // the same order, as the merged tempo sequence had: the later tracks win the ties
+    PointsComparator comparator;
+    points.sort(comparator, true);
+    
+    bool foundFirstTempoPoint = false;
+    
+    for (const auto &point : points)
+    {
+        Segment &lastSegment = this->segments.getReference(this->segments.size() - 1);
+        
+        // the first tempo point also defines the tempo before it
+        if (! foundFirstTempoPoint || point.timeStamp <= lastSegment.timeStamp)
+        {
+            lastSegment.msPerTick = point.msPerTick;
+            foundFirstTempoPoint = true;
+            continue;
+        }
+        
+        const Segment segment =
+        {
+            point.timeStamp,
+            lastSegment.timeMs + lastSegment.msPerTick * (point.timeStamp - lastSegment.timeStamp),
+            point.msPerTick
+        };
+        
+        this->segments.add(segment);
+    }
+}
+
+double TempoMap::getTimeMsAt(double timeStamp) const noexcept
+{
+    const Segment &segment = this->findSegmentAt(timeStamp);
+    return segment.timeMs + segment.msPerTick * (timeStamp - segment.timeStamp);
+}
+
+double TempoMap::getMsPerTickAt(double timeStamp) const noexcept
+{
+    return this->findSegmentAt(timeStamp).msPerTick;
+}
+
+void TempoMap::getTimeAndTempoAt(double timeStamp,
+                                 double &outTimeMs,
+                                 double &outMsPerTick) const noexcept
+{
+    const Segment &segment = this->findSegmentAt(timeStamp);
+    outTimeMs = segment.timeMs + segment.msPerTick * (timeStamp - segment.timeStamp);
+    outMsPerTick = segment.msPerTick;
+}
+
+double TempoMap::getTimeStampAtTimeMs(double timeMs) const noexcept
+{
+    const Segment &segment = this->findSegmentAtTimeMs(timeMs);
+    return segment.timeStamp + (timeMs - segment.timeMs) / segment.msPerTick;
+}
+
+MidiMessage TempoMap::getTempoEventAt(double timeStamp) const
+{
+    return TempoMap::createTempoEvent(this->findSegmentAt(timeStamp));
+}
+
+MidiMessage TempoMap::createTempoEvent(const Segment &segment)
+{
+    const double TPQN = Transport::millisecondsPerBeat;
+    const double microsecondsPerQuarterNote = segment.msPerTick * TPQN * 1000.0;
+    return MidiMessage::tempoMetaEvent(roundDoubleToInt(microsecondsPerQuarterNote));
+}
+
+int TempoMap::getNumSegments() const noexcept
+{
+    return this->segments.size();
+}
+
+//===----------------------------------------------------------------------===//
+// Binary search
+//===----------------------------------------------------------------------===//
+
+const TempoMap::Segment &TempoMap::findSegmentAt(double timeStamp) const noexcept
+{
+    // the last segment starting at or before the timestamp,
+    // timestamps before the first segment are extrapolated from it
+    int start = 1;
+    int end = this->segments.size();
+    
+    while (start < end)
+    {
+        const int middle = start + (end - start) / 2;
+        
+        if (this->segments.getReference(middle).timeStamp <= timeStamp)
+        {
+            start = middle + 1;
+        }
+        else
+        {
+            end = middle;
+        }
+    }
+    
+    return this->segments.getReference(start - 1);
+}
+
+const TempoMap::Segment &TempoMap::findSegmentAtTimeMs(double timeMs) const noexcept
+{
+    int start = 1;
+    int end = this->segments.size();
+    
+    while (start < end)
+    {
+        const int middle = start + (end - start) / 2;
+        
+        if (this->segments.getReference(middle).timeMs <= timeMs)
+        {
+            start = middle + 1;
+        }
+        else
+        {
+            end = middle;
+        }
+    }
+    
+    return this->segments.getReference(start - 1);
+}
@@ -0,0 +1,89 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "AutomationCurve.h"
+
+// Piecewise-constant tempo curve, built from the tempo tracks' curves.
+// Each segment starts at a tempo point and stores the absolute time at its start,
+// so that converting a timestamp into milliseconds and back is a binary search,
+// instead of replaying the whole project sequence from zero.
+//
+// Timestamps here are the player's ticks, relative to the project start.
+// Before the first tempo point the tempo is considered equal to the first one's.
+// The curves are flattened at AUTOMATION_CURVE_RESOLUTION, the same points,
+// at which the interpolated tempo events were exported before.
+//
+// Immutable once built: Transport publishes the new map along with the sequences.
+
+class TempoMap : public ReferenceCountedObject
+{
+public:
+
+    // The flattened points of one tempo track. Transport keeps them between
+    // the rebuilds, so that an edit only resamples the tempo track it changed.
+    struct Point
+    {
+        double timeStamp;
+        double msPerTick;
+    };
+    
+    typedef Array<Point> Points;
+    
+    static void flattenCurve(const AutomationCurve &tempoCurve, double timeOffset, Points &result);
+    
+    TempoMap();
+
+    // The tracks come in the layers' order, the later ones win the ties
+    explicit TempoMap(const OwnedArray<Points> &tempoTracks);
+
+    typedef ReferenceCountedObjectPtr<TempoMap> Ptr;
+    
+    double getTimeMsAt(double timeStamp) const noexcept;
+    
+    double getMsPerTickAt(double timeStamp) const noexcept;
+    
+    void getTimeAndTempoAt(double timeStamp,
+                           double &outTimeMs,
+                           double &outMsPerTick) const noexcept;
+    
+    double getTimeStampAtTimeMs(double timeMs) const noexcept;
+    
+    MidiMessage getTempoEventAt(double timeStamp) const;
+    
+    int getNumSegments() const noexcept;
+    
+private:
+
+    struct Segment
+    {
+        double timeStamp;
+        double timeMs;
+        double msPerTick;
+    };
+    
+    Array<Segment> segments;
+    
+    const Segment &findSegmentAt(double timeStamp) const noexcept;
+    
+    const Segment &findSegmentAtTimeMs(double timeMs) const noexcept;
+    
+    static MidiMessage createTempoEvent(const Segment &segment);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TempoMap)
+};
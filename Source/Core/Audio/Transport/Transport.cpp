@@ -20,6 +20,7 @@
 #include "Instrument.h"
 #include "OrchestraPit.h"
 #include "PlayerThread.h"
+#include "ScheduledPlayerThread.h"
 #include "RendererThread.h"
 #include "MidiLayer.h"
 #include "MidiEvent.h"
@@ -28,6 +29,8 @@
 #include "Workspace.h"
 #include "AudioCore.h"
 #include "MidiRoll.h"
+#include "Config.h"
+#include "SerializationKeys.h"
 
 #if PLAYER_THREAD_SENDS_SEEK_EVENTS
 #   define PLAYER_THREAD_STOP_TIME_MS 1500
@@ -35,12 +38,25 @@
 #   define PLAYER_THREAD_STOP_TIME_MS 100
 #endif
 
+// the sample-accurate scheduling is opt-in, until the jitter benchmark
+// shows it works with the real devices and plugins; otherwise
+// the sleeping player thread is used, as it always has been
 Transport::Transport(OrchestraPit &orchestraPit) :
+    Transport(orchestraPit,
+              Config::get(Serialization::Core::scheduledPlaybackState) == Serialization::Core::enabledState)
+{
+}
+
+Transport::Transport(OrchestraPit &orchestraPit, bool usesScheduledPlayback) :
     orchestra(orchestraPit),
     seekPosition(0.0),
     trackStartMs(0.0),
     trackEndMs(0.0),
     sequencesAreOutdated(true),
+    tempoMap(new TempoMap()),
+    sequencesVersion(0),
+    tempoMapVersion(0),
+    tempoMapIsOutdated(true),
     totalTime(Transport::millisecondsPerBeat * 8),
     loopedMode(false),
     loopStart(0.0),
@@ -48,14 +64,28 @@ Transport::Transport(OrchestraPit &orchestraPit) :
     projectFirstBeat(0.f),
     projectLastBeat(DEFAULT_NUM_BARS * NUM_BEATS_IN_BAR)
 {
-    this->player = new PlayerThread(*this);
+    if (usesScheduledPlayback)
+    {
+        this->player = new ScheduledPlayerThread(*this);
+    }
+    else
+    {
+        this->player = new PlayerThread(*this);
+    }
+    
     this->renderer = new RendererThread(*this);
+    
+    // the empty one, so that the readers never get a null
+    this->snapshot = new PlaybackSnapshot(this->sequences, this->tempoMap,
+                                          this->sequencesVersion, this->tempoMapVersion);
+    this->publishedSnapshot.set(this->snapshot.get());
 
     this->orchestra.addOrchestraListener(this);
 }
 
 Transport::~Transport()
 {
+    this->cancelPendingUpdate();
     this->orchestra.removeOrchestraListener(this);
     
     if (this->player->isThreadRunning())
@@ -153,13 +183,6 @@ void Transport::setTotalTime(const double val)
 // Transport
 //===----------------------------------------------------------------------===//
 
-void Transport::rebuildSequencesInRealtime()
-{
-    // todo sequences write lock
-    //this->rebuildSequencesIfNeeded();
-    //this->sequences.seekToTime(this->lastSeekTimeStamp);
-}
-
 void Transport::seekToPosition(double absPosition)
 {
     double timeMs = 0.0;
@@ -178,27 +201,29 @@ void Transport::probeSoundAt(double absTrackPosition, const MidiLayer *limitToLa
     this->rebuildSequencesIfNeeded();
     
     const double targetFlatTime = round(this->getTotalTime() * absTrackPosition);
+    const float targetBeat = float((targetFlatTime + this->trackStartMs) / Transport::millisecondsPerBeat);
     const auto sequencesToProbe(this->sequences.getAllFor(limitToLayer));
     
+    Array<MidiEvent *> soundingEvents;
+    
     for (auto && i : sequencesToProbe)
     {
         SequenceWrapper::Ptr seq(i);
-
-        for (int j = 0; j < seq->sequence.getNumEvents(); ++j)
+        
+        // the notes sounding at the target beat are the ones
+        // overlapping the shortest possible range starting there
+        soundingEvents.clearQuick();
+        seq->layer->findEventsOverlappingRange(targetBeat, nextafterf(targetBeat, targetBeat + 1.f), soundingEvents);
+        
+        for (auto event : soundingEvents)
         {
-            MidiMessageSequence::MidiEventHolder *noteOnHolder = seq->sequence.getEventPointer(j);
+            const Array<MidiMessage> messages(event->getSequence());
             
-            if (MidiMessageSequence::MidiEventHolder *noteOffHolder = noteOnHolder->noteOffObject)
+            if (messages.size() > 0 && messages.getReference(0).isNoteOn())
             {
-                const double noteOn(noteOnHolder->message.getTimeStamp());
-                const double noteOff(noteOffHolder->message.getTimeStamp());
-                
-                if (noteOn <= targetFlatTime && noteOff > targetFlatTime)
-                {
-                    MidiMessage messageTimestampedAsNow(noteOnHolder->message);
-                    messageTimestampedAsNow.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
-                    seq->listener->addMessageToQueue(messageTimestampedAsNow);
-                }
+                MidiMessage messageTimestampedAsNow(messages.getReference(0));
+                messageTimestampedAsNow.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+                seq->listener->addMessageToQueue(messageTimestampedAsNow);
             }
         }
     }
@@ -274,17 +299,17 @@ double Transport::getLoopEnd() const
 }
 
 
-void Transport::startRender(const String &fileName)
+void Transport::startRender(const String &fileName, int bitDepth, int blockSize)
 {
     if (this->renderer->isRecording())
     {
         return;
     }
     
-    App::Workspace().getAudioCore().mute();
+    this->muteAudioCore();
     
     File file(File::getCurrentWorkingDirectory().getChildFile(fileName));
-    this->renderer->startRecording(file);
+    this->renderer->startRecording(file, bitDepth, blockSize);
 }
 
 void Transport::stopRender()
@@ -295,11 +320,7 @@ void Transport::stopRender()
     }
     
     this->renderer->stop();
-    
-    // a dirty hack
-    App::Workspace().getAudioCore().unmute();
-    //this->allNotesControllersAndSoundOff();
-    App::Workspace().getAudioCore().unmute();
+    this->unmuteAudioCore();
 }
 
 bool Transport::isRendering() const
@@ -312,6 +333,25 @@ float Transport::getRenderingPercentsComplete() const
     return this->renderer->getPercentsComplete();
 }
 
+// The instruments are detached from the device while rendering;
+// the headless tests render without the audio core at all
+
+void Transport::muteAudioCore()
+{
+    if (App::Helio() != nullptr)
+    {
+        App::Workspace().getAudioCore().mute();
+    }
+}
+
+void Transport::unmuteAudioCore()
+{
+    if (App::Helio() != nullptr)
+    {
+        App::Workspace().getAudioCore().unmute();
+    }
+}
+
 
 //===----------------------------------------------------------------------===//
 // Sending messages at realtime
@@ -400,7 +440,7 @@ void Transport::instrumentAdded(Instrument *instrument)
     this->stopPlayback();
     
     // invalidate sequences as they use pointers to the players too
-    this->sequencesAreOutdated = true;
+    this->invalidateAllSequences();
 
     for (int i = 0; i < this->layersCache.size(); ++i)
     {
@@ -417,7 +457,7 @@ void Transport::instrumentRemoved(Instrument *instrument)
 
 void Transport::instrumentRemovedPostAction()
 {
-    this->sequencesAreOutdated = true;
+    this->invalidateAllSequences();
 
     for (int i = 0; i < this->layersCache.size(); ++i)
     {
@@ -432,87 +472,61 @@ void Transport::instrumentRemovedPostAction()
 
 void Transport::onEventChanged(const MidiEvent &oldEvent, const MidiEvent &newEvent)
 {
-    // todo stop playback only if the event is in future and getControllerNumber == 0 (not an automation)
-    
-    if (this->player->isThreadRunning())
-    { this->stopPlayback(); }
+    this->invalidateSequenceFor(newEvent.getLayer());
     
     // a hack
     if (newEvent.getLayer()->getControllerNumber() == MidiLayer::tempoController)
     {
         this->seekToPosition(this->getSeekPosition());
     }
-    
-    this->sequencesAreOutdated = true;
 }
 
 void Transport::onEventAdded(const MidiEvent &event)
 {
-    // todo stop playback only if the event is in future and getControllerNumber == 0 (not an automation)
-
-    if (this->player->isThreadRunning())
-    { this->stopPlayback(); }
+    this->invalidateSequenceFor(event.getLayer());
     
     // a hack
     if (event.getLayer()->getControllerNumber() == MidiLayer::tempoController)
     {
         this->seekToPosition(this->getSeekPosition());
     }
-    
-    this->sequencesAreOutdated = true;
 }
 
 void Transport::onEventRemoved(const MidiEvent &event)
 {
-    // todo stop playback only if the event is in future and getControllerNumber == 0 (not an automation)
-
-    if (this->player->isThreadRunning())
-    { this->stopPlayback(); }
-    
-    this->sequencesAreOutdated = true;
+    this->invalidateSequenceFor(event.getLayer());
 }
 
 void Transport::onEventRemovedPostAction(const MidiLayer *layer)
 {
-    if (this->player->isThreadRunning())
-    { this->stopPlayback(); }
+    this->invalidateSequenceFor(layer);
     
     // a hack
     if (layer->getControllerNumber() == MidiLayer::tempoController)
     {
         this->seekToPosition(this->getSeekPosition());
     }
-    
-    this->sequencesAreOutdated = true;
 }
 
 void Transport::onLayerChanged(const MidiLayer *layer)
 {
-    if (this->player->isThreadRunning())
-    { this->stopPlayback(); }
-    
-    this->sequencesAreOutdated = true;
     this->updateLinkForLayer(layer);
+    this->invalidateSequenceFor(layer);
 }
 
 void Transport::onLayerAdded(const MidiLayer *layer)
 {
-    if (this->player->isThreadRunning())
-    {this->stopPlayback(); }
-    
-    this->sequencesAreOutdated = true;
     this->layersCache.addIfNotAlreadyThere(layer);
     this->updateLinkForLayer(layer);
+    this->invalidateAllSequences();
 }
 
 void Transport::onLayerRemoved(const MidiLayer *layer)
 {
-    if (this->player->isThreadRunning())
-    {this->stopPlayback(); }
-    
-    this->sequencesAreOutdated = true;
     this->layersCache.removeAllInstancesOf(layer);
+    this->outdatedLayers.removeAllInstancesOf(layer);
     this->removeLinkForLayer(layer);
+    this->invalidateAllSequences();
 }
 
 void Transport::onProjectBeatRangeChanged(float firstBeat, float lastBeat)
@@ -543,6 +557,7 @@ void Transport::onProjectBeatRangeChanged(float firstBeat, float lastBeat)
     // real track total time changed
     double tempo = 0.0;
     double realLengthMs = 0.0;
+    this->invalidateAllSequences();
     this->calcTimeAndTempoAt(1.0, realLengthMs, tempo);
     this->broadcastTotalTimeChanged(realLengthMs);
     
@@ -562,103 +577,204 @@ void Transport::onProjectBeatRangeChanged(float firstBeat, float lastBeat)
 void Transport::calcTimeAndTempoAt(const double targetAbsPosition,
                                    double &outTimeMs, double &outTempo)
 {
-    this->rebuildSequencesIfNeeded();
-    this->sequences.seekToZeroIndexes();
-    
-    const double TPQN = Transport::millisecondsPerBeat; // ticks-per-quarter-note
+    this->rebuildTempoMapIfNeeded();
     const double targetTime = round(targetAbsPosition * this->getTotalTime());
+    this->tempoMap->getTimeAndTempoAt(targetTime, outTimeMs, outTempo);
+}
+
+
+//===----------------------------------------------------------------------===//
+// Sequences management
+//===----------------------------------------------------------------------===//
+
+void Transport::rebuildSequencesIfNeeded()
+{
+    this->rebuildTempoMapIfNeeded();
     
-    outTimeMs = 0.0;
-    outTempo = 250.0 / TPQN; // default 240 BPM
-    
-    double prevTimestamp = 0.0;
-    double nextEventTimeDelta = 0.0;
-    bool foundFirstTempoEvent = false;
-    
-    MessageWrapper wrapper;
-    
-    while (this->sequences.getNextMessage(wrapper))
+    if (this->sequencesAreOutdated)
     {
-        const double nextAbsPosition = (wrapper.message.getTimeStamp() / this->getTotalTime());
+        ProjectSequences newSequences;
+        
+        for (int i = 0; i < this->layersCache.size(); ++i)
+        {
+            SequenceWrapper::Ptr wrapper(this->createSequenceFor(this->layersCache.getUnchecked(i)));
+            
+            if (wrapper->sequence->messages.getNumEvents() > 0)
+            {
+                newSequences.addWrapper(wrapper);
+            }
+        }
         
-        // foundFirstTempoEvent нужен для того, чтоб темп до первого события был равен темпу на первом событии
-        if (nextAbsPosition > targetAbsPosition &&
-            foundFirstTempoEvent)
+        this->sequences.swapWith(newSequences);
+        ++this->sequencesVersion;
+        this->sequencesAreOutdated = false;
+        this->outdatedLayers.clearQuick();
+    }
+    else if (this->outdatedLayers.size() > 0)
+    {
+        // patch only the edited layers, leaving the other sequences shared;
+        // the published snapshot has its own copy
+        for (int i = 0; i < this->outdatedLayers.size(); ++i)
         {
-            break;
+            this->sequences.updateWrapper(this->createSequenceFor(this->outdatedLayers.getUnchecked(i)));
         }
         
-        nextEventTimeDelta = outTempo * (wrapper.message.getTimeStamp() - prevTimestamp);
-        outTimeMs += nextEventTimeDelta;
-        prevTimestamp = wrapper.message.getTimeStamp();
+        ++this->sequencesVersion;
+        this->outdatedLayers.clearQuick();
+    }
+    
+    this->publishSnapshotIfNeeded();
+}
+
+void Transport::rebuildTempoMapIfNeeded()
+{
+    // the layers are only added and removed along with the full invalidation,
+    // so an edited tempo layer is always found among the flattened ones
+    if (this->tempoMapIsOutdated)
+    {
+        this->tempoLayers.clearQuick();
+        this->tempoTracks.clear();
         
-        if (wrapper.message.isTempoMetaEvent())
+        for (int i = 0; i < this->layersCache.size(); ++i)
         {
-            outTempo = wrapper.message.getTempoSecondsPerQuarterNote() * 1000.f / TPQN;
-            foundFirstTempoEvent = true;
+            const MidiLayer *layer = this->layersCache.getUnchecked(i);
+            
+            if (layer->isTempoLayer())
+            {
+                this->tempoLayers.add(layer);
+                this->tempoTracks.add(this->createTempoTrackFor(layer));
+            }
         }
     }
+    else if (this->outdatedTempoLayers.size() > 0)
+    {
+        for (int i = 0; i < this->outdatedTempoLayers.size(); ++i)
+        {
+            const MidiLayer *layer = this->outdatedTempoLayers.getUnchecked(i);
+            const int trackIndex = this->tempoLayers.indexOf(layer);
+            jassert(trackIndex >= 0);
+            
+            if (trackIndex >= 0)
+            {
+                this->tempoTracks.set(trackIndex, this->createTempoTrackFor(layer), true);
+            }
+        }
+    }
+    else
+    {
+        return;
+    }
     
-    nextEventTimeDelta = outTempo * (targetTime - prevTimestamp);
-    outTimeMs += nextEventTimeDelta;
+    this->tempoMap = new TempoMap(this->tempoTracks);
+    ++this->tempoMapVersion;
+    this->tempoMapIsOutdated = false;
+    this->outdatedTempoLayers.clearQuick();
 }
 
-MidiMessage Transport::findFirstTempoEvent()
+TempoMap::Points *Transport::createTempoTrackFor(const MidiLayer *layer) const
 {
-    this->rebuildSequencesIfNeeded();
-    this->sequences.seekToZeroIndexes();
+    auto track = new TempoMap::Points();
+    const MidiLayer::ExportedSequence::Ptr layerSequence(layer->exportMidi());
     
-    MessageWrapper wrapper;
+    if (layerSequence->curve != nullptr)
+    {
+        TempoMap::flattenCurve(*layerSequence->curve, -this->trackStartMs, *track);
+    }
     
-    while (this->sequences.getNextMessage(wrapper))
+    return track;
+}
+
+void Transport::invalidateSequenceFor(const MidiLayer *layer)
+{
+    this->outdatedLayers.addIfNotAlreadyThere(layer);
+    
+    if (layer->isTempoLayer())
     {
-        if (wrapper.message.isTempoMetaEvent())
-        {
-            return wrapper.message;
-        }
+        this->outdatedTempoLayers.addIfNotAlreadyThere(layer);
     }
     
-    return MidiMessage::tempoMetaEvent(Transport::millisecondsPerBeat * 1000);
+    if (this->player->isThreadRunning())
+    {
+        this->triggerAsyncUpdate();
+    }
 }
 
+void Transport::invalidateAllSequences()
+{
+    this->sequencesAreOutdated = true;
+    this->tempoMapIsOutdated = true;
+    
+    if (this->player->isThreadRunning())
+    {
+        this->triggerAsyncUpdate();
+    }
+}
 
-//===----------------------------------------------------------------------===//
-// Sequences management
-//===----------------------------------------------------------------------===//
+SequenceWrapper *Transport::createSequenceFor(const MidiLayer *layer)
+{
+    Instrument *targetInstrument = this->linksCache[layer->getLayerId().toString()];
+    auto wrapper = new SequenceWrapper();
+    wrapper->layer = layer;
+    wrapper->sequence = layer->exportMidi();
+    wrapper->timeOffset = -this->trackStartMs;
+    // the tempo curves are in the tempo map already
+    wrapper->automation = layer->isTempoLayer() ? nullptr : wrapper->sequence->curve;
+    wrapper->channel = layer->getChannel();
+    wrapper->controllerNumber = layer->getControllerNumber();
+    wrapper->instrument = targetInstrument;
+    wrapper->listener = &targetInstrument->getProcessorPlayer().getMidiMessageCollector();
+    return wrapper;
+}
 
-void Transport::rebuildSequencesIfNeeded()
+PlaybackSnapshot::Ptr Transport::getPlaybackSnapshot() const
 {
-    if (this->sequencesAreOutdated)
+    ++this->numSnapshotReaders;
+    const PlaybackSnapshot::Ptr result(this->publishedSnapshot.get());
+    --this->numSnapshotReaders;
+    return result;
+}
+
+int Transport::getSnapshotVersion() const noexcept
+{
+    return this->snapshotVersion.get();
+}
+
+// The calcTimeAndTempoAt may have rebuilt the tempo map, without the sequences
+void Transport::publishSnapshotIfNeeded()
+{
+    if (this->snapshot->sequencesVersion == this->sequencesVersion &&
+        this->snapshot->tempoMapVersion == this->tempoMapVersion)
     {
-        this->sequences.clear();
-        
-        for (int i = 0; i < this->layersCache.size(); ++i)
-        {
-            const MidiLayer *layer = this->layersCache.getUnchecked(i);
-            MidiMessageSequence sequence(layer->exportMidi());
-            sequence.addTimeToMessages(-this->trackStartMs);
-            
-            if (sequence.getNumEvents() > 0)
-            {
-                Instrument *targetInstrument = this->linksCache[layer->getLayerId().toString()];
-                auto wrapper = new SequenceWrapper();
-                wrapper->layer = layer;
-                wrapper->sequence = sequence;
-                wrapper->currentIndex = 0;
-                wrapper->instrument = targetInstrument;
-                wrapper->listener = &targetInstrument->getProcessorPlayer().getMidiMessageCollector();
-                this->sequences.addWrapper(wrapper);
-            }
-        }
-        
-        this->sequencesAreOutdated = false;
+        return;
     }
+    
+    this->retiredSnapshots.add(this->snapshot);
+    this->snapshot = new PlaybackSnapshot(this->sequences, this->tempoMap,
+                                          this->sequencesVersion, this->tempoMapVersion);
+    
+    this->publishedSnapshot.set(this->snapshot.get());
+    ++this->snapshotVersion; // also a full barrier before the readers are counted
+    
+    this->releaseRetiredSnapshots();
 }
 
-ProjectSequences Transport::getSequences()
+// A retired snapshot, retained by nobody else, can be released, if no reader
+// is in the middle of getPlaybackSnapshot: the ones coming later get the new pointer.
+// The rest are kept until the next publish, so the readers never free the snapshots.
+void Transport::releaseRetiredSnapshots()
 {
-    // todo add lock
-    return this->sequences;
+    if (this->numSnapshotReaders.get() != 0)
+    {
+        return;
+    }
+    
+    for (int i = this->retiredSnapshots.size(); --i >= 0; )
+    {
+        if (this->retiredSnapshots.getUnchecked(i)->getReferenceCount() == 1)
+        {
+            this->retiredSnapshots.remove(i);
+        }
+    }
 }
 
 void Transport::updateLinkForLayer(const MidiLayer *layer)
@@ -708,6 +824,21 @@ void Transport::removeLinkForLayer(const MidiLayer *layer)
 }
 
 
+//===----------------------------------------------------------------------===//
+// AsyncUpdater
+//===----------------------------------------------------------------------===//
+
+void Transport::handleAsyncUpdate()
+{
+    // the stopped transport rebuilds lazily, on the next play or seek;
+    // while playing, edits are coalesced here and published to the player
+    if (this->player->isThreadRunning())
+    {
+        this->rebuildSequencesIfNeeded();
+    }
+}
+
+
 //===----------------------------------------------------------------------===//
 // Transport Listeners
 //===----------------------------------------------------------------------===//
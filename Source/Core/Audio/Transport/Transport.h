@@ -24,19 +24,58 @@ class RendererThread;
 
 #include "TransportListener.h"
 #include "ProjectSequencesWrapper.h"
+#include "TempoMap.h"
 #include "ProjectListener.h"
 #include "OrchestraListener.h"
 
-class Transport : public ProjectListener, private OrchestraListener
+// What the players and the renderer play: the sequences, with their cursors
+// at the start, and the tempo map. Never modified once published;
+// each reader copies the sequences to move its own cursors.
+class PlaybackSnapshot : public ReferenceCountedObject
+{
+public:
+
+    PlaybackSnapshot(const ProjectSequences &snapshotSequences,
+                     TempoMap::Ptr snapshotTempoMap,
+                     int snapshotSequencesVersion,
+                     int snapshotTempoMapVersion) :
+        sequences(snapshotSequences),
+        tempoMap(snapshotTempoMap),
+        sequencesVersion(snapshotSequencesVersion),
+        tempoMapVersion(snapshotTempoMapVersion) {}
+
+    const ProjectSequences sequences;
+    const TempoMap::Ptr tempoMap;
+    
+    // The readers only pick up the parts which have changed
+    const int sequencesVersion;
+    const int tempoMapVersion;
+
+    typedef ReferenceCountedObjectPtr<PlaybackSnapshot> Ptr;
+
+private:
+
+    JUCE_DECLARE_NON_COPYABLE(PlaybackSnapshot)
+};
+
+class Transport : public ProjectListener,
+                  private OrchestraListener,
+                  private AsyncUpdater
 {
 public:
 
     explicit Transport(OrchestraPit &orchestraPit);
 
+    // The benchmarks pick the playback engine explicitly
+    Transport(OrchestraPit &orchestraPit, bool usesScheduledPlayback);
+
     ~Transport() override;
 
     static const int millisecondsPerBeat = 500;
     
+    // offline rendering doesn't need small blocks, the larger ones are processed faster
+    static const int defaultRenderBlockSize = 2048;
+    
     static String getTimeString(double timeMs, bool includeMilliseconds = false);
 
     static String getTimeString(const RelativeTime &relTime, bool includeMilliseconds = false);
@@ -63,7 +102,10 @@ public:
     bool isPlaying() const;
     void stopPlayback();
     
-    void startRender(const String &filename);
+    // WAV supports 16, 24 and 32 (floating point) bits, FLAC supports 16 and 24
+    void startRender(const String &filename,
+                     int bitDepth = 16,
+                     int blockSize = Transport::defaultRenderBlockSize);
     bool isRendering() const;
     void stopRender();
     
@@ -73,10 +115,6 @@ public:
                             double &outTimeMs,
                             double &outTempo);
 
-    MidiMessage findFirstTempoEvent();
-
-    void rebuildSequencesInRealtime();
-
     
     //===------------------------------------------------------------------===//
     // Sending messages at realtime
@@ -131,6 +169,12 @@ public:
 
 protected:
 
+    //===------------------------------------------------------------------===//
+    // AsyncUpdater
+    //===------------------------------------------------------------------===//
+
+    void handleAsyncUpdate() override;
+
     void setTotalTime(const double val);
     void setSeekPosition(const double absPosition);
 
@@ -150,15 +194,59 @@ private:
     ScopedPointer<RendererThread> renderer;
     
     friend class PlayerThread;
+    friend class ScheduledPlayerThread;
     friend class RendererThread;
 
 private:
 
-    ProjectSequences getSequences();
-    void rebuildSequencesIfNeeded();
+    // Thread-safe and lock-free, return the most recently published snapshot
+    PlaybackSnapshot::Ptr getPlaybackSnapshot() const;
+    int getSnapshotVersion() const noexcept;
+    
+    // The render detaches the instruments from the device
+    void muteAudioCore();
+    void unmuteAudioCore();
     
+    // Message thread only
+    void rebuildSequencesIfNeeded();
+    void rebuildTempoMapIfNeeded();
+    void invalidateSequenceFor(const MidiLayer *layer);
+    void invalidateAllSequences();
+    SequenceWrapper *createSequenceFor(const MidiLayer *layer);
+    TempoMap::Points *createTempoTrackFor(const MidiLayer *layer) const;
+    void publishSnapshotIfNeeded();
+    void releaseRetiredSnapshots();
+    
+    // The message thread's own copies, only published as a whole
     ProjectSequences sequences;
+    TempoMap::Ptr tempoMap;
+    int sequencesVersion;
+    
+    // The tempo map has its own version, so that the player doesn't reload
+    // the sequences when only the tempo has changed
+    int tempoMapVersion;
+    
+    // The player thread keeps playing the snapshot it has got,
+    // checking the version counter from time to time; each edit makes
+    // a new snapshot with only the affected layer's sequence re-exported.
+    // The readers never lock: the new snapshot is published with a pointer swap,
+    // and the replaced ones are retired, to be released here on the message thread,
+    // once no reader can be between loading the pointer and retaining it.
+    PlaybackSnapshot::Ptr snapshot;
+    Atomic<PlaybackSnapshot *> publishedSnapshot;
+    Atomic<int> snapshotVersion;
+    mutable Atomic<int> numSnapshotReaders;
+    ReferenceCountedArray<PlaybackSnapshot> retiredSnapshots;
+    
+    // The tempo map is only rebuilt when a tempo track changes,
+    // and only the edited tracks are flattened again
+    bool tempoMapIsOutdated;
+    Array<const MidiLayer *> outdatedTempoLayers;
+    Array<const MidiLayer *> tempoLayers;
+    OwnedArray<TempoMap::Points> tempoTracks;
+    
     bool sequencesAreOutdated;
+    Array<const MidiLayer *> outdatedLayers;
     
     Array<const MidiLayer *> layersCache;
     HashMap<String, Instrument *> linksCache; // layer id : instrument
@@ -50,15 +50,11 @@ AnnotationEvent::~AnnotationEvent()
 }
 
 
-Array<MidiMessage> AnnotationEvent::getSequence() const
+void AnnotationEvent::exportMessages(MidiMessageSequence &outSequence, double timeOffset) const
 {
-	Array<MidiMessage> result;
-
     // TODO(peterrudenko): 
     // text events
     // time signature events
-
-    return result;
 }
 
 AnnotationEvent AnnotationEvent::withDeltaBeat(float beatOffset) const
@@ -129,7 +125,7 @@ XmlElement *AnnotationEvent::serialize() const
     xml->setAttribute("text", this->description);
     xml->setAttribute("col", this->colour.toString());
     xml->setAttribute("beat", this->beat);
-    xml->setAttribute("id", this->id);
+    xml->setAttribute("id", MidiEvent::idToString(this->id));
     return xml;
 }
 
@@ -141,7 +137,7 @@ void AnnotationEvent::deserialize(const XmlElement &xml)
     this->description = xml.getStringAttribute("text");
     this->colour = Colour::fromString(xml.getStringAttribute("col"));
     this->beat = float(xml.getDoubleAttribute("beat"));
-    this->id = xml.getStringAttribute("id");
+    this->id = MidiEvent::idFromString(xml.getStringAttribute("id"));
 }
 
 void AnnotationEvent::reset()
@@ -153,7 +149,7 @@ void AnnotationEvent::reset()
 int AnnotationEvent::hashCode() const noexcept
 {
     return this->getDescription().hashCode() +
-           this->getID().hashCode();
+           MidiEvent::hashId(this->getID());
 }
 
 AnnotationEvent &AnnotationEvent::operator=(const AnnotationEvent &right)
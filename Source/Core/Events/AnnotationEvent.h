@@ -41,7 +41,7 @@ public:
     ~AnnotationEvent() override;
     
 
-	Array<MidiMessage> getSequence() const override;
+    void exportMessages(MidiMessageSequence &outSequence, double timeOffset) const override;
 
     
     AnnotationEvent copyWithNewId() const;
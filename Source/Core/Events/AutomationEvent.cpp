@@ -22,8 +22,6 @@
 #include "SerializationKeys.h"
 
 #define AUTOEVENT_DEFAULT_CURVATURE (0.5f)
-#define MIN_INTERPOLATED_CONTROLLER_DELTA (0.01f)
-#define INTERPOLATED_EVENTS_STEP_MS (350)
 
 AutomationEvent::AutomationEvent() : MidiEvent(nullptr, 0.f)
 {
@@ -51,121 +49,27 @@ AutomationEvent::~AutomationEvent()
 
 }
 
-float linearTween(float delta, float factor)
+// Only the nodes are exported: the curve between them is exported by the layer
+// as a whole, and it is sampled by the player and the renderer at their own rate
+void AutomationEvent::exportMessages(MidiMessageSequence &outSequence, double timeOffset) const
 {
-    return delta * factor;
-};
-
-float easeInExpo(float delta, float factor)
-{
-    return delta * powf(2.f, 16.f * (factor - 1.f));
-};
-
-float easeOutExpo(float delta, float factor)
-{
-    return delta * (-powf(2.f, -16.f * factor) + 1.f);
-};
-
-// easing == 0: ease out
-// easing == 1: ease in
-float exponentalInterpolation(float y0, float y1, float factor, float easing)
-{
-    const float delta = y1 - y0;
-    
-//    const float e = (easing * 2.f) - 1.f;
-//===----------------------------------------------------------------------===//
-//    if (e > 0)
-//    {
-//        const float easeIn = easeInExpo(delta, factor) * e;
-//        const float linear = linearTween(delta, factor) * (1.f - e);
-//        return y0 + (easeIn + linear);
-//    }
-//    
-//    const float easeOut = easeOutExpo(delta, factor) * -e;
-//    const float linear = linearTween(delta, factor) * (1.f + e);
-//    return y0 + (easeOut + linear);
-    
-    const float easeIn = easeInExpo(delta, factor) * easing;
-    const float easeOut = easeOutExpo(delta, factor) * (1.f - easing);
-    return y0 + (easeIn + easeOut);
-}
-
-
-Array<MidiMessage> AutomationEvent::getSequence() const
-{
-	Array<MidiMessage> result;
-    
     // теперь пусть все треки автоматизации ведут себя одинаково
-    //if (this->getLayer()->isTempoLayer())
+    MidiMessage cc;
+    
+    if (this->getLayer()->isTempoLayer())
     {
-        MidiMessage cc;
-        
-        if (this->getLayer()->isTempoLayer())
-        {
-            cc = MidiMessage::tempoMetaEvent(int((1.f - this->controllerValue) * Transport::millisecondsPerBeat * 1000));
-        }
-        else
-        {
-            cc = MidiMessage::controllerEvent(this->layer->getChannel(),
-                                              this->getLayer()->getControllerNumber(),
-                                              int(this->controllerValue * 127));
-        
-        }
-
-        const float &startTime = this->beat * Transport::millisecondsPerBeat;
-        cc.setTimeStamp(startTime);
-        result.add(cc);
-
-        
-        // добавить интерполированные события, если таковые должны быть
-        const int indexOfThis = this->getLayer()->indexOfSorted(this);
-        
-        if (indexOfThis >= 0 && indexOfThis < (this->getLayer()->size() - 1))
-        {
-            const AutomationEvent *nextEvent = static_cast<AutomationEvent *>(this->getLayer()->getUnchecked(indexOfThis + 1));
-            const float controllerDelta = fabs(this->controllerValue - nextEvent->controllerValue);
-            
-            if (controllerDelta > MIN_INTERPOLATED_CONTROLLER_DELTA)
-            {
-                const float nextTime = nextEvent->beat * Transport::millisecondsPerBeat;
-                float interpolatedEventTimeStamp = startTime + INTERPOLATED_EVENTS_STEP_MS;
-                
-                while (interpolatedEventTimeStamp < nextTime)
-                {
-                    const float lerpFactor = (interpolatedEventTimeStamp - startTime) / (nextTime - startTime);
-                    const float c = (this->controllerValue > nextEvent->controllerValue) ? this->curvature : (1.f - this->curvature);
-                    
-                    const float interpolatedControllerValue = exponentalInterpolation(this->controllerValue,
-                                                                                      nextEvent->controllerValue,
-                                                                                      lerpFactor,
-                                                                                      c);
-                    
-                    //Logger::writeToLog(String(this->curvature) + " :: " + String((interpolatedControllerValue - this->controllerValue) / (nextEvent->controllerValue - this->controllerValue) - lerpFactor));
-                    
-                    //Logger::writeToLog(String(this->controllerValue) + " - " + String(interpolatedControllerValue) + " - " + String(nextEvent->controllerValue));
-                    
-                    if (this->getLayer()->isTempoLayer())
-                    {
-                        MidiMessage ci(MidiMessage::tempoMetaEvent(int((1.f - interpolatedControllerValue) * Transport::millisecondsPerBeat * 1000)));
-                        ci.setTimeStamp(interpolatedEventTimeStamp);
-                        result.add(ci);
-                    }
-                    else
-                    {
-                        MidiMessage ci(MidiMessage::controllerEvent(this->getLayer()->getChannel(),
-                                                                    this->getLayer()->getControllerNumber(),
-                                                                    int(this->controllerValue * 127)));
-                        ci.setTimeStamp(interpolatedEventTimeStamp);
-                        result.add(ci);
-                    }
-                    
-                    interpolatedEventTimeStamp += INTERPOLATED_EVENTS_STEP_MS;
-                }
-            }
-        }
+        cc = AutomationCurve::createTempoEvent(this->controllerValue);
     }
-
-    return result;
+    else
+    {
+        cc = AutomationCurve::createControllerEvent(this->layer->getChannel(),
+                                                    this->getLayer()->getControllerNumber(),
+                                                    this->controllerValue);
+    }
+    
+    const float &startTime = this->beat * Transport::millisecondsPerBeat;
+    cc.setTimeStamp(startTime);
+    outSequence.addEvent(cc, timeOffset);
 }
 
 AutomationEvent AutomationEvent::copyWithNewId() const
@@ -280,7 +184,7 @@ XmlElement *AutomationEvent::serialize() const
     xml->setAttribute("beat", this->beat);
     xml->setAttribute("curve", this->curvature);
     //xml->setAttribute("id", this->id.toString());
-    xml->setAttribute("id", this->id);
+    xml->setAttribute("id", MidiEvent::idToString(this->id));
     return xml;
 }
 
@@ -292,7 +196,7 @@ void AutomationEvent::deserialize(const XmlElement &xml)
     this->controllerValue = float(xml.getDoubleAttribute("val"));
     this->curvature = float(xml.getDoubleAttribute("curve", AUTOEVENT_DEFAULT_CURVATURE));
     this->beat = float(xml.getDoubleAttribute("beat"));
-    this->id = xml.getStringAttribute("id");
+    this->id = MidiEvent::idFromString(xml.getStringAttribute("id"));
 }
 
 void AutomationEvent::reset()
@@ -308,7 +212,7 @@ int AutomationEvent::hashCode() const noexcept
     //       this->getID().toString().hashCode();
     return roundFloatToInt(this->getControllerValue() * 1000) +
            roundFloatToInt(this->getBeat() * 1000) +
-           this->getID().hashCode();
+           MidiEvent::hashId(this->getID());
 }
 
 AutomationEvent &AutomationEvent::operator=(const AutomationEvent &right)
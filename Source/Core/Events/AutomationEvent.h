@@ -35,7 +35,7 @@ public:
 
     ~AutomationEvent() override;
 
-	Array<MidiMessage> getSequence() const override;
+    void exportMessages(MidiMessageSequence &outSequence, double timeOffset) const override;
 
     
     AutomationEvent copyWithNewId() const;
@@ -22,7 +22,9 @@
 
 MidiEvent::MidiEvent(MidiLayer *owner, float beatVal) :
     layer(owner),
-    beat(beatVal)
+    beat(beatVal),
+    beatColumn(nullptr),
+    slot(-1)
 {
     this->id = this->createId();
 }
@@ -32,6 +34,22 @@ MidiEvent::~MidiEvent()
 
 }
 
+Array<MidiMessage> MidiEvent::getSequence() const
+{
+    MidiMessageSequence sequence;
+    this->exportMessages(sequence, 0.0);
+    
+    Array<MidiMessage> result;
+    result.ensureStorageAllocated(sequence.getNumEvents());
+    
+    for (int i = 0; i < sequence.getNumEvents(); ++i)
+    {
+        result.add(sequence.getEventPointer(i)->message);
+    }
+    
+    return result;
+}
+
 
 MidiLayer *MidiEvent::getLayer() const noexcept
 {
@@ -46,15 +64,29 @@ MidiEvent::Id MidiEvent::getID() const noexcept
 
 float MidiEvent::getBeat() const noexcept
 {
-    return this->beat;
+    return (this->beatColumn != nullptr) ? this->beatColumn->getUnchecked(this->slot) : this->beat;
 }
 
-//static MidiEvent::Id recentId = 0;
-
 MidiEvent::Id MidiEvent::createId() noexcept
 {
+    // the second half of a random uuid, the same bits the string ids were made of
     Uuid uuid;
-    return uuid.toString().substring(16, 32);
-//    return ++recentId;
+    return Id(ByteOrder::bigEndianInt64(uuid.getRawData() + 8));
+}
+
+String MidiEvent::idToString(Id id)
+{
+    return String::toHexString(id).paddedLeft('0', 16);
+}
+
+MidiEvent::Id MidiEvent::idFromString(const String &id) noexcept
+{
+    if (id.length() == 16 && id.containsOnly("0123456789abcdefABCDEF"))
+    {
+        return Id(id.getHexValue64());
+    }
+
+    // some other legacy format, still has to be unique and stable
+    return Id(id.hashCode64());
 }
 
@@ -25,20 +25,39 @@ class MidiEvent : public Serializable
 {
 public:
 
-    using Id = String;
-
     // 128 бит нам ни к чему, пусть будет 64,
     // с моими раскладами остается вероятность коллизии где-то 10^-8 .. 10^-11
     // при самых пессимистичных прогнозах,
     // а так, если на одном слое будет ~4000 нот, эта вероятность будет 4 * 10^-13
 
-    //using Id = int64;
+    using Id = int64;
+
+    // Ids are serialized as 16 hex digits, just like the string ids used to be,
+    // so the old projects and the VCS history load with the very same ids
+    static String idToString(Id id);
+
+    static Id idFromString(const String &id) noexcept;
+
+    static int compareIds(Id first, Id second) noexcept
+    {
+        return (first > second) - (first < second);
+    }
+
+    static int hashId(Id id) noexcept
+    {
+        return static_cast<int>(id ^ (id >> 32));
+    }
 
     MidiEvent(MidiLayer *owner, float beat);
 
     ~MidiEvent() override;
 
-    virtual Array<MidiMessage> getSequence() const = 0;
+    // Appends the event's messages right to the target sequence, shifted by timeOffset;
+    // the notes link their note-offs themselves, so no updateMatchedPairs is needed
+    virtual void exportMessages(MidiMessageSequence &outSequence, double timeOffset) const = 0;
+
+    // A convenience wrapper for the occasional one-off use, like probing the sound
+    Array<MidiMessage> getSequence() const;
 
 
     //===------------------------------------------------------------------===//
@@ -66,7 +85,7 @@ public:
         const int diffResult = (diff > 0.f) - (diff < 0.f);
         if (diffResult != 0) { return diffResult; }
         
-        return first->getID().compare(second->getID());
+        return MidiEvent::compareIds(first->getID(), second->getID());
     }
 
 protected:
@@ -78,5 +97,22 @@ protected:
     static Id createId() noexcept;
 
     Id id;
+
+    // While the event is stored in a layer that keeps the beats in a column,
+    // the beat is read from there, and the field above is not used
+    const Array<float> *beatColumn;
+
+    int slot;
+    
+};
+
+
+class MidiEventIdHashFunction
+{
+public:
     
+    static int generateHash(const MidiEvent::Id key, const int upperLimit) noexcept
+    {
+        return static_cast<int>((static_cast<uint32>(MidiEvent::hashId(key))) % static_cast<uint32>(upperLimit));
+    }
 };
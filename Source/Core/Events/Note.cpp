@@ -18,11 +18,14 @@
 #include "Common.h"
 #include "Note.h"
 #include "MidiLayer.h"
+#include "NoteColumns.h"
 #include "Transport.h"
 #include "SerializationKeys.h"
 
 
-Note::Note() : MidiEvent(nullptr, 0.f)
+Note::Note() :
+    MidiEvent(nullptr, 0.f),
+    storage(nullptr)
 {
     // needed for juce's Array
     // should never be called.
@@ -33,46 +36,48 @@ Note::Note(MidiLayer *owner, int keyVal, float beatVal, float lengthVal, float v
     MidiEvent(owner, beatVal),
     key(keyVal),
     length(lengthVal),
-    velocity(velocityVal)
+    velocity(velocityVal),
+    storage(nullptr)
 {
 
 }
 
 Note::Note(const Note &other) :
-    MidiEvent(other.layer, other.beat),
-    key(other.key),
-    length(other.length),
-    velocity(other.velocity)
+    MidiEvent(other.layer, other.getBeat()),
+    key(other.getKey()),
+    length(other.getLength()),
+    velocity(other.getVelocity()),
+    storage(nullptr)
 {
     this->id = other.getID();
 }
 
 Note::Note(MidiLayer *newOwner, const Note &parametersToCopy) :
-    MidiEvent(newOwner, parametersToCopy.beat),
-    key(parametersToCopy.key),
-    length(parametersToCopy.length),
-    velocity(parametersToCopy.velocity)
+    MidiEvent(newOwner, parametersToCopy.getBeat()),
+    key(parametersToCopy.getKey()),
+    length(parametersToCopy.getLength()),
+    velocity(parametersToCopy.getVelocity()),
+    storage(nullptr)
 {
     this->id = parametersToCopy.getID();
 }
 
 
-Array<MidiMessage> Note::getSequence() const
+void Note::exportMessages(MidiMessageSequence &outSequence, double timeOffset) const
 {
-	Array<MidiMessage> result;
+    const int noteKey = this->getKey();
+    const float noteBeat = this->getBeat();
 
-    MidiMessage eventNoteOn(MidiMessage::noteOn(this->layer->getChannel(), this->key, velocity));
-    const float &startTime = this->beat * Transport::millisecondsPerBeat;
+    MidiMessage eventNoteOn(MidiMessage::noteOn(this->layer->getChannel(), noteKey, this->getVelocity()));
+    const float &startTime = noteBeat * Transport::millisecondsPerBeat;
     eventNoteOn.setTimeStamp(startTime);
 
-    MidiMessage eventNoteOff(MidiMessage::noteOff(this->layer->getChannel(), this->key));
-    const float &endTime = (this->beat + this->length) * Transport::millisecondsPerBeat;
+    MidiMessage eventNoteOff(MidiMessage::noteOff(this->layer->getChannel(), noteKey));
+    const float &endTime = (noteBeat + this->getLength()) * Transport::millisecondsPerBeat;
     eventNoteOff.setTimeStamp(endTime);
 
-    result.add(eventNoteOn);
-    result.add(eventNoteOff);
-
-    return result;
+    MidiMessageSequence::MidiEventHolder *noteOnHolder = outSequence.addEvent(eventNoteOn, timeOffset);
+    noteOnHolder->noteOffObject = outSequence.addEvent(eventNoteOff, timeOffset);
 }
 
 Note Note::copyWithNewId(MidiLayer *newOwner) const
@@ -89,7 +94,7 @@ Note Note::copyWithNewId(MidiLayer *newOwner) const
 }
 
 
-static float roundBeat(float beat)
+float Note::roundBeat(float beat) noexcept
 {
     //return beat;
     return roundf(beat * 16.f) / 16.f;
@@ -128,21 +133,21 @@ Note Note::withDeltaKey(int deltaKey) const
     return other;
 }
 
-#define MIN_LENGTH 0.5f
+const float Note::minLength = 0.5f;
 
 Note Note::withLength(float newLength) const
 {
     Note other(*this);
-    //other.length = jmax(MIN_LENGTH, newLength);
-    other.length = jmax(MIN_LENGTH, roundBeat(newLength));
+    //other.length = jmax(minLength, newLength);
+    other.length = jmax(minLength, roundBeat(newLength));
     return other;
 }
 
 Note Note::withDeltaLength(float deltaLength) const
 {
     Note other(*this);
-    //other.length = jmax(MIN_LENGTH, other.length + deltaLength);
-    other.length = jmax(MIN_LENGTH, roundBeat(other.length + deltaLength));
+    //other.length = jmax(minLength, other.length + deltaLength);
+    other.length = jmax(minLength, roundBeat(other.length + deltaLength));
     return other;
 }
 
@@ -160,23 +165,33 @@ Note Note::withParameters(const XmlElement &xml) const
     return n;
 }
 
+Note Note::withParameters(int newKey, float newBeat, float newLength, float newVelocity) const
+{
+    Note other(*this);
+    other.key = newKey;
+    other.beat = newBeat;
+    other.length = newLength;
+    other.velocity = newVelocity;
+    return other;
+}
+
 //===----------------------------------------------------------------------===//
 // Accessors
 //===----------------------------------------------------------------------===//
 
 int Note::getKey() const noexcept
 {
-    return this->key;
+    return (this->storage != nullptr) ? this->storage->getKey(this->slot) : this->key;
 }
 
 float Note::getLength() const noexcept
 {
-    return this->length;
+    return (this->storage != nullptr) ? this->storage->getLength(this->slot) : this->length;
 }
 
 float Note::getVelocity() const noexcept
 {
-    return this->velocity;
+    return (this->storage != nullptr) ? this->storage->getVelocity(this->slot) : this->velocity;
 }
 
 //===----------------------------------------------------------------------===//
@@ -189,16 +204,17 @@ float Note::getVelocity() const noexcept
 XmlElement *Note::serialize() const
 {
     auto xml = new XmlElement(Serialization::Core::note);
-    xml->setAttribute("key", this->key);
-    xml->setAttribute("beat", this->beat);
-    xml->setAttribute("len", this->length);
-    xml->setAttribute("vel", roundFloatToInt(this->velocity * VELOCITY_SAVE_ACCURACY));
-    xml->setAttribute("id", this->id);
+    xml->setAttribute("key", this->getKey());
+    xml->setAttribute("beat", this->getBeat());
+    xml->setAttribute("len", this->getLength());
+    xml->setAttribute("vel", roundFloatToInt(this->getVelocity() * VELOCITY_SAVE_ACCURACY));
+    xml->setAttribute("id", MidiEvent::idToString(this->id));
     return xml;
 }
 
 void Note::deserialize(const XmlElement &xml)
 {
+    jassert(!this->isStored()); // the layer changes its notes itself
     this->reset();
 
     //const Note old(*this);
@@ -214,27 +230,150 @@ void Note::deserialize(const XmlElement &xml)
     this->beat = xmlBeat;
     this->length = xmlLength;
     this->velocity = jmax(jmin(xmlVelocity, 1.f), 0.f);
-    this->id = xmlId;
+    this->id = MidiEvent::idFromString(xmlId);
 }
 
 void Note::reset()
 {
 }
 
+void Note::writeBinary(OutputStream &out) const
+{
+    out.writeInt64(this->id);
+    out.writeCompressedInt(this->getKey());
+    out.writeFloat(this->getBeat());
+    out.writeFloat(this->getLength());
+    out.writeFloat(this->getVelocity());
+}
+
+void Note::readBinary(InputStream &in)
+{
+    jassert(!this->isStored());
+    this->id = in.readInt64();
+    this->key = in.readCompressedInt();
+    this->beat = in.readFloat();
+    this->length = in.readFloat();
+    this->velocity = in.readFloat();
+}
+
+
+//===----------------------------------------------------------------------===//
+// Storage
+//===----------------------------------------------------------------------===//
+
+bool Note::isStored() const noexcept
+{
+    return (this->storage != nullptr);
+}
+
+// A free list over the large blocks of slots, the blocks are never released:
+// a project that has once had that many notes is likely to have them again
+class NotePool
+{
+public:
+
+    void *allocate()
+    {
+        const SpinLock::ScopedLockType lock(this->poolLock);
+
+        if (this->freeList == nullptr)
+        {
+            this->addBlock();
+        }
+
+        FreeSlot *const slot = this->freeList;
+        this->freeList = slot->next;
+        return slot;
+    }
+
+    void release(void *ptr) noexcept
+    {
+        const SpinLock::ScopedLockType lock(this->poolLock);
+        FreeSlot *const slot = static_cast<FreeSlot *>(ptr);
+        slot->next = this->freeList;
+        this->freeList = slot;
+    }
+
+private:
+
+    struct FreeSlot
+    {
+        FreeSlot *next;
+    };
+
+    enum
+    {
+        slotsPerBlock = 1024,
+        slotSize = ((sizeof(Note) + 15) / 16) * 16
+    };
+
+    void addBlock()
+    {
+        char *const block = static_cast<char *>(std::malloc(slotSize * slotsPerBlock));
+
+        // pushed in the reverse order, so that the slots are given away in the ascending one
+        for (int i = slotsPerBlock - 1; i >= 0; --i)
+        {
+            FreeSlot *const slot = reinterpret_cast<FreeSlot *>(block + i * slotSize);
+            slot->next = this->freeList;
+            this->freeList = slot;
+        }
+    }
+
+    FreeSlot *freeList = nullptr;
+
+    SpinLock poolLock;
+
+};
+
+static NotePool &getNotePool()
+{
+    // never deleted, some notes may outlive the static destructors
+    static NotePool *const pool = new NotePool();
+    return *pool;
+}
+
+void *Note::operator new(size_t size)
+{
+    if (size != sizeof(Note))
+    {
+        return ::operator new(size);
+    }
+
+    return getNotePool().allocate();
+}
+
+void Note::operator delete(void *ptr, size_t size) noexcept
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    if (size != sizeof(Note))
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    getNotePool().release(ptr);
+}
+
 
 Note &Note::operator=(const Note &right)
 {
     //if (this == &right) { return *this; }
     //this->layer = right.layer; // never do this
+    jassert(!this->isStored()); // the layer changes its notes itself
     this->id = right.id;
-    this->beat = right.beat;
-    this->key = right.key;
-    this->length = right.length;
-    this->velocity = right.velocity;
+    this->beat = right.getBeat();
+    this->key = right.getKey();
+    this->length = right.getLength();
+    this->velocity = right.getVelocity();
     return *this;
 }
 
 int Note::hashCode() const noexcept
 {
-    return this->getID().hashCode();
+    return MidiEvent::hashId(this->getID());
 }
@@ -19,6 +19,8 @@
 
 #include "MidiEvent.h"
 
+class NoteStorage;
+
 class Note : public MidiEvent
 {
 public:
@@ -39,7 +41,7 @@ public:
     
     ~Note() override {}
 
-	Array<MidiMessage> getSequence() const override;
+    void exportMessages(MidiMessageSequence &outSequence, double timeOffset) const override;
     
     
     Note copyWithNewId(MidiLayer *newOwner = nullptr) const;
@@ -59,6 +61,14 @@ public:
     Note withVelocity(float newVelocity) const;
 
     Note withParameters(const XmlElement &xml) const;
+
+    // Takes the values as they are, the batch transforms have already clamped them
+    Note withParameters(int newKey, float newBeat, float newLength, float newVelocity) const;
+
+    static float roundBeat(float beat) noexcept;
+
+    // The shortest length the notes are clamped to
+    static const float minLength;
     
 
     //===------------------------------------------------------------------===//
@@ -82,6 +92,30 @@ public:
 
     void reset() override;
 
+    // A compact binary form, used by the undo history
+    void writeBinary(OutputStream &out) const;
+
+    void readBinary(InputStream &in);
+
+
+    //===------------------------------------------------------------------===//
+    // Storage
+    //===------------------------------------------------------------------===//
+
+    // A note stored in a layer is a view of its row in the layer's columns,
+    // the copies of it are plain values again
+    bool isStored() const noexcept;
+
+    // The layers' notes are allocated from the shared pool of fixed-size slots,
+    // so that the notes imported together lie next to each other in memory,
+    // and iterating a layer doesn't jump all over the heap; the addresses are stable
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size) noexcept;
+
+    // juce::Array constructs its elements in place
+    static void *operator new(size_t, void *where) noexcept { return where; }
+    static void operator delete(void *, void *) noexcept {}
+
 
     //===------------------------------------------------------------------===//
     // Stuff for hashtables
@@ -105,7 +139,7 @@ public:
         const int diffResult = (diff > 0.f) - (diff < 0.f);
         if (diffResult != 0) { return diffResult; }
         
-        return first->getID().compare(second->getID());
+        return MidiEvent::compareIds(first->getID(), second->getID());
     }
     
     static int compareElements(Note *const first, Note *const second)
@@ -120,7 +154,7 @@ public:
         const int keyResult = (keyDiff > 0) - (keyDiff < 0);
         if (keyResult != 0) { return keyResult; }
         
-        return first->getID().compare(second->getID());
+        return MidiEvent::compareIds(first->getID(), second->getID());
     }
     
     static int compareElements(const Note &first, const Note &second)
@@ -134,7 +168,7 @@ public:
         const int keyResult = (keyDiff > 0) - (keyDiff < 0);
         if (keyResult != 0) { return keyResult; }
         
-        return first.getID().compare(second.getID());
+        return MidiEvent::compareIds(first.getID(), second.getID());
     }
 
 protected:
@@ -145,6 +179,11 @@ protected:
 
 private:
 
+    // set by the storage, for as long as the note is in there
+    const NoteStorage *storage;
+
+    friend class NoteStorage;
+
     JUCE_LEAK_DETECTOR(Note);
 
 };
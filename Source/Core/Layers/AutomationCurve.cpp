@@ -0,0 +1,224 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "AutomationCurve.h"
+#include "Transport.h"
+
+AutomationCurve::AutomationCurve()
+{
+}
+
+void AutomationCurve::addNode(double timeStamp, float value, float curvature)
+{
+    jassert(this->timeStamps.size() == 0 || this->timeStamps.getLast() <= timeStamp);
+    
+    const int lastIndex = this->timeStamps.size() - 1;
+    
+    // now that the previous segment's end is known, set it up
+    if (lastIndex >= 0)
+    {
+        const float prevValue = this->values.getUnchecked(lastIndex);
+        const float prevCurvature = this->easings.getUnchecked(lastIndex);
+        const double length = timeStamp - this->timeStamps.getUnchecked(lastIndex);
+        const float delta = value - prevValue;
+        
+        if (fabs(delta) > AUTOMATION_CURVE_MIN_DELTA && length > 0.0)
+        {
+            this->deltas.set(lastIndex, delta);
+            this->easings.set(lastIndex, (prevValue > value) ? prevCurvature : (1.f - prevCurvature));
+            this->lengthsInv.set(lastIndex, 1.0 / length);
+        }
+    }
+    
+    this->timeStamps.add(timeStamp);
+    this->values.add(value);
+    this->deltas.add(0.f);
+    this->easings.add(curvature);
+    this->lengthsInv.add(0.0);
+}
+
+int AutomationCurve::getNumNodes() const noexcept
+{
+    return this->timeStamps.size();
+}
+
+double AutomationCurve::getStartTimeStamp() const noexcept
+{
+    return this->timeStamps.size() > 0 ? this->timeStamps.getUnchecked(0) : 0.0;
+}
+
+float AutomationCurve::getValueAt(double timeStamp) const noexcept
+{
+    float value = 0.f;
+    this->getValues(timeStamp, 0.0, &value, 1);
+    return value;
+}
+
+// easing == 0: ease out
+// easing == 1: ease in
+// the former exponentalInterpolation() for a run of points within one segment,
+// kept branchless, so that the compiler could vectorize it
+void AutomationCurve::getValues(double startTimeStamp, double step,
+                                float *outValues, int numValues) const noexcept
+{
+    const int numNodes = this->timeStamps.size();
+    
+    if (numNodes == 0)
+    {
+        FloatVectorOperations::clear(outValues, numValues);
+        return;
+    }
+    
+    int segment = this->findSegmentAt(startTimeStamp);
+    int i = 0;
+    
+    while (i < numValues)
+    {
+        const double timeStamp = startTimeStamp + step * i;
+        
+        while (segment < (numNodes - 1) &&
+               this->timeStamps.getUnchecked(segment + 1) <= timeStamp)
+        {
+            ++segment;
+        }
+        
+        // the points left within the current segment
+        int numPoints = numValues - i;
+        
+        if (segment < (numNodes - 1) && step > 0.0)
+        {
+            const double nextTimeStamp = this->timeStamps.getUnchecked(segment + 1);
+            numPoints = jmin(numPoints, int((nextTimeStamp - timeStamp) / step) + 1);
+            
+            while (numPoints > 1 && (startTimeStamp + step * (i + numPoints - 1)) >= nextTimeStamp)
+            {
+                --numPoints;
+            }
+        }
+        
+        float *out = outValues + i;
+        i += numPoints;
+        
+        if (segment < 0)
+        {
+            FloatVectorOperations::fill(out, this->values.getUnchecked(0), numPoints);
+            continue;
+        }
+        
+        const float y0 = this->values.getUnchecked(segment);
+        const float delta = this->deltas.getUnchecked(segment);
+        
+        if (delta == 0.f)
+        {
+            FloatVectorOperations::fill(out, y0, numPoints);
+            continue;
+        }
+        
+        const float easing = this->easings.getUnchecked(segment);
+        const float easeIn = delta * easing;
+        const float easeOut = delta * (1.f - easing);
+        const double lengthInv = this->lengthsInv.getUnchecked(segment);
+        const double firstFactor = (timeStamp - this->timeStamps.getUnchecked(segment)) * lengthInv;
+        const double factorStep = step * lengthInv;
+        
+        for (int j = 0; j < numPoints; ++j)
+        {
+            const float factor = float(firstFactor + factorStep * j);
+            out[j] = y0 + easeIn * std::exp2(16.f * (factor - 1.f)) + easeOut * (1.f - std::exp2(-16.f * factor));
+        }
+    }
+}
+
+void AutomationCurve::getResampledPoints(Array<double> &outTimeStamps, Array<float> &outValues) const
+{
+    const int numNodes = this->timeStamps.size();
+    
+    for (int i = 0; i < numNodes; ++i)
+    {
+        const double timeStamp = this->timeStamps.getUnchecked(i);
+        outTimeStamps.add(timeStamp);
+        outValues.add(this->values.getUnchecked(i));
+        
+        if (i == (numNodes - 1) || this->deltas.getUnchecked(i) == 0.f)
+        {
+            continue;
+        }
+        
+        const double nextTimeStamp = this->timeStamps.getUnchecked(i + 1);
+        int numPoints = 0;
+        
+        while ((timeStamp + AUTOMATION_CURVE_RESOLUTION * (numPoints + 1)) < nextTimeStamp)
+        {
+            outTimeStamps.add(timeStamp + AUTOMATION_CURVE_RESOLUTION * (numPoints + 1));
+            ++numPoints;
+        }
+        
+        const int offset = outValues.size();
+        outValues.insertMultiple(-1, 0.f, numPoints);
+        this->getValues(timeStamp + AUTOMATION_CURVE_RESOLUTION, AUTOMATION_CURVE_RESOLUTION,
+                        outValues.getRawDataPointer() + offset, numPoints);
+    }
+}
+
+
+//===----------------------------------------------------------------------===//
+// Messages
+//===----------------------------------------------------------------------===//
+
+int AutomationCurve::getControllerValue(float value) noexcept
+{
+    return int(value * 127);
+}
+
+MidiMessage AutomationCurve::createControllerEvent(int channel, int controllerNumber, float value)
+{
+    return MidiMessage::controllerEvent(channel, controllerNumber, AutomationCurve::getControllerValue(value));
+}
+
+MidiMessage AutomationCurve::createTempoEvent(float value)
+{
+    return MidiMessage::tempoMetaEvent(int((1.f - value) * Transport::millisecondsPerBeat * 1000));
+}
+
+
+//===----------------------------------------------------------------------===//
+// Binary search
+//===----------------------------------------------------------------------===//
+
+int AutomationCurve::findSegmentAt(double timeStamp) const noexcept
+{
+    // the last node at or before the timestamp, or -1 if there's none
+    int start = 0;
+    int end = this->timeStamps.size();
+    
+    while (start < end)
+    {
+        const int middle = start + (end - start) / 2;
+        
+        if (this->timeStamps.getUnchecked(middle) <= timeStamp)
+        {
+            start = middle + 1;
+        }
+        else
+        {
+            end = middle;
+        }
+    }
+    
+    return start - 1;
+}
@@ -0,0 +1,87 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// The automation segments, which values change less than this, are held flat
+#define AUTOMATION_CURVE_MIN_DELTA (0.01f)
+
+// The step, at which the curves are flattened into the tempo map and the MIDI files
+#define AUTOMATION_CURVE_RESOLUTION (350)
+
+// An automation layer's curve, exported along with its node events, so that
+// the playback and the rendering can sample it at their own rate,
+// instead of walking hundreds of the interpolated events.
+//
+// Timestamps here are the layer's ticks, the same as in its exported sequence.
+// Before the first node the curve is equal to its first value,
+// and after the last node it is equal to the last one.
+//
+// Immutable once built: an edit makes the layer export a new one.
+
+class AutomationCurve : public ReferenceCountedObject
+{
+public:
+
+    AutomationCurve();
+
+    typedef ReferenceCountedObjectPtr<AutomationCurve> Ptr;
+    
+    // Nodes should be added in the order of their timestamps
+    void addNode(double timeStamp, float value, float curvature);
+    
+    int getNumNodes() const noexcept;
+    
+    double getStartTimeStamp() const noexcept;
+    
+    float getValueAt(double timeStamp) const noexcept;
+    
+    // The block kernel: evaluates the curve at numValues points,
+    // starting from the timestamp, with the fixed step between them
+    void getValues(double startTimeStamp, double step,
+                   float *outValues, int numValues) const noexcept;
+    
+    // The nodes, and the points every AUTOMATION_CURVE_RESOLUTION ticks after
+    // each node of the segments, which values change noticeably, in order
+    void getResampledPoints(Array<double> &outTimeStamps, Array<float> &outValues) const;
+    
+    
+    //===------------------------------------------------------------------===//
+    // Messages
+    //===------------------------------------------------------------------===//
+    
+    static int getControllerValue(float value) noexcept;
+    
+    static MidiMessage createControllerEvent(int channel, int controllerNumber, float value);
+    
+    static MidiMessage createTempoEvent(float value);
+    
+private:
+    
+    // The segment starting at each node: value(f) = y0 + delta * ease(f),
+    // where f is the position within the segment, from 0 to 1
+    Array<double> timeStamps;
+    Array<float> values;
+    Array<float> deltas;
+    Array<float> easings;
+    Array<double> lengthsInv;
+    
+    int findSegmentAt(double timeStamp) const noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AutomationCurve);
+
+};
@@ -23,6 +23,7 @@
 #include "ProjectListener.h"
 #include "LayerTreeItem.h"
 #include "UndoStack.h"
+#include "Transport.h"
 
 
 AutomationLayer::AutomationLayer(MidiLayerOwner &parent) : MidiLayer(parent)
@@ -60,6 +61,20 @@ void AutomationLayer::importMidi(const MidiMessageSequence &sequence)
     this->notifyLayerChanged();
 }
 
+AutomationCurve::Ptr AutomationLayer::exportAutomationCurve() const
+{
+    AutomationCurve::Ptr curve(new AutomationCurve());
+    
+    for (auto event : this->midiEvents)
+    {
+        const AutomationEvent *autoEvent = static_cast<const AutomationEvent *>(event);
+        const float timeStamp = autoEvent->getBeat() * Transport::millisecondsPerBeat;
+        curve->addNode(timeStamp, autoEvent->getControllerValue(), autoEvent->getCurvature());
+    }
+    
+    return curve;
+}
+
 
 //===----------------------------------------------------------------------===//
 // Undoable track editing
@@ -56,6 +56,8 @@ public:
 
     void importMidi(const MidiMessageSequence &sequence) override;
 
+    AutomationCurve::Ptr exportAutomationCurve() const override;
+
 
     //===------------------------------------------------------------------===//
     // Serializable
@@ -28,7 +28,7 @@ MidiLayer::MidiLayer(MidiLayerOwner &parent) :
     colour(Colours::white),
     channel(1),
     muted(false),
-    cachedSequence(),
+    cachedSequence(nullptr),
     lastStartBeat(0.f),
     cacheIsOutdated(false),
     lastEndBeat(0.f),
@@ -60,6 +60,48 @@ void MidiLayer::sort()
     }
 }
 
+int MidiLayer::indexOfFirstEventAtOrAfter(float beat) const
+{
+    int start = 0;
+    int end = this->midiEvents.size();
+
+    while (start < end)
+    {
+        const int middle = (start + end) / 2;
+
+        if (this->midiEvents.getUnchecked(middle)->getBeat() < beat)
+        {
+            start = middle + 1;
+        }
+        else
+        {
+            end = middle;
+        }
+    }
+
+    return start;
+}
+
+void MidiLayer::findEventsInRange(float startBeat, float endBeat, Array<MidiEvent *> &result) const
+{
+    for (int i = this->indexOfFirstEventAtOrAfter(startBeat); i < this->midiEvents.size(); ++i)
+    {
+        MidiEvent *event = this->midiEvents.getUnchecked(i);
+
+        if (event->getBeat() >= endBeat)
+        {
+            break;
+        }
+
+        result.add(event);
+    }
+}
+
+void MidiLayer::findEventsOverlappingRange(float startBeat, float endBeat, Array<MidiEvent *> &result) const
+{
+    this->findEventsInRange(startBeat, endBeat, result);
+}
+
 void MidiLayer::allNotesOff()
 {
 //    for (int c = 1; c <= 16; ++c)
@@ -112,7 +154,10 @@ void MidiLayer::allControllersOff()
 
 void MidiLayer::checkpoint()
 {
-    this->getUndoStack()->beginNewTransaction(String::empty);
+    if (UndoStack *undoStack = this->getUndoStack())
+    {
+        undoStack->beginNewTransaction(String::empty);
+    }
 }
 
 void MidiLayer::undo()
@@ -135,7 +180,11 @@ void MidiLayer::redo()
 void MidiLayer::clearUndoHistory()
 {
     Logger::writeToLog(this->getXPath() + " clearUndoHistory");
-    this->getUndoStack()->clearUndoHistory();
+
+    if (UndoStack *undoStack = this->getUndoStack())
+    {
+        undoStack->clearUndoHistory();
+    }
 }
 
 
@@ -143,38 +192,38 @@ void MidiLayer::clearUndoHistory()
 // Import/export
 //
 
-MidiMessageSequence MidiLayer::exportMidi() const
+MidiLayer::ExportedSequence::Ptr MidiLayer::exportMidi() const
 {
     if (this->isMuted())
     {
-        return MidiMessageSequence();
+        return new ExportedSequence();
     }
     
-    if (this->cacheIsOutdated)
+    if (this->cacheIsOutdated || this->cachedSequence == nullptr)
     {
-        this->cachedSequence.clear();
+        // never touch the previous one, somebody may still be holding it
+        ExportedSequence::Ptr newSequence(new ExportedSequence());
 
+        // the events are sorted by beat, so the messages are mostly appended
+        // to the end, and the notes have already paired their note-offs
         for (auto event : this->midiEvents)
         {
-			const Array<MidiMessage> &track = event->getSequence();
-
-			for (auto &message : track)
-			{
-				this->cachedSequence.addEvent(message);
-			}
-
-			// need to call it here?
-			//this->cachedSequence.updateMatchedPairs();
+            event->exportMessages(newSequence->messages, 0.0);
         }
 
-        this->cachedSequence.updateMatchedPairs();
-        //this->cachedSequence.sort();
+        newSequence->curve = this->exportAutomationCurve();
+        this->cachedSequence = newSequence;
         this->cacheIsOutdated = false;
     }
 
     return this->cachedSequence;
 }
 
+AutomationCurve::Ptr MidiLayer::exportAutomationCurve() const
+{
+    return nullptr;
+}
+
 
 //===----------------------------------------------------------------------===//
 // Accessors
@@ -255,7 +304,9 @@ ProjectTreeItem *MidiLayer::getProject()
 
 UndoStack *MidiLayer::getUndoStack()
 {
-    return this->owner.getProject()->getUndoStack();
+    // the layers of the stress tests and benchmarks have no project
+    ProjectTreeItem *project = this->owner.getProject();
+    return (project != nullptr) ? project->getUndoStack() : nullptr;
 }
 
 
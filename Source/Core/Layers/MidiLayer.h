@@ -20,6 +20,7 @@
 #include "Serializable.h"
 #include "MidiLayerOwner.h"
 #include "MidiEvent.h"
+#include "AutomationCurve.h"
 
 class LayerTreeItem;
 class UndoStack;
@@ -59,8 +60,19 @@ public:
     // Import/export
     //===------------------------------------------------------------------===//
 
-    MidiMessageSequence exportMidi() const;
+    // The exported messages are immutable once built: an edit makes the layer
+    // build a new one, so the transport and the file writer just share the pointer.
+    // The automation layers export their nodes only, along with the curve between them.
+    struct ExportedSequence : public ReferenceCountedObject
+    {
+        MidiMessageSequence messages;
+        AutomationCurve::Ptr curve;
+        typedef ReferenceCountedObjectPtr<ExportedSequence> Ptr;
+    };
+
+    ExportedSequence::Ptr exportMidi() const;
     virtual void importMidi(const MidiMessageSequence &sequence) = 0;
+    virtual AutomationCurve::Ptr exportAutomationCurve() const;
 
     //===------------------------------------------------------------------===//
     // Track editing
@@ -113,6 +125,19 @@ public:
         return this->midiEvents.indexOfSorted(*event, event);
     }
 
+    //===------------------------------------------------------------------===//
+    // Range queries
+    //===------------------------------------------------------------------===//
+
+    // The events are always kept sorted by beat, so these are binary searches;
+    // both of the finders append to the result in the sorted order
+    int indexOfFirstEventAtOrAfter(float beat) const;
+    void findEventsInRange(float startBeat, float endBeat, Array<MidiEvent *> &result) const;
+
+    // Events which span over any part of [startBeat, endBeat),
+    // for the instant events it's the same as findEventsInRange
+    virtual void findEventsOverlappingRange(float startBeat, float endBeat, Array<MidiEvent *> &result) const;
+
     //===------------------------------------------------------------------===//
     // Events change listener
     //===------------------------------------------------------------------===//
@@ -167,7 +192,7 @@ protected:
 
 private:
 
-    mutable MidiMessageSequence cachedSequence;
+    mutable ExportedSequence::Ptr cachedSequence;
     mutable bool cacheIsOutdated;
 
     MidiLayerOwner &owner;
@@ -0,0 +1,339 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "NoteColumns.h"
+
+#include <float.h>
+
+//===----------------------------------------------------------------------===//
+// NoteStorage
+//===----------------------------------------------------------------------===//
+
+void NoteStorage::ensureStorageAllocated(int numNotes)
+{
+    this->keys.ensureStorageAllocated(numNotes);
+    this->beats.ensureStorageAllocated(numNotes);
+    this->lengths.ensureStorageAllocated(numNotes);
+    this->velocities.ensureStorageAllocated(numNotes);
+    this->handles.ensureStorageAllocated(numNotes);
+}
+
+void NoteStorage::add(Note &handle, const Note &parameters)
+{
+    jassert(!handle.isStored());
+
+    this->keys.add(parameters.getKey());
+    this->beats.add(parameters.getBeat());
+    this->lengths.add(parameters.getLength());
+    this->velocities.add(parameters.getVelocity());
+    this->handles.add(&handle);
+
+    handle.storage = this;
+    handle.beatColumn = &this->beats;
+    handle.slot = this->handles.size() - 1;
+}
+
+void NoteStorage::set(const Note &handle, const Note &parameters)
+{
+    jassert(handle.storage == this);
+
+    const int row = handle.slot;
+    this->keys.setUnchecked(row, parameters.getKey());
+    this->beats.setUnchecked(row, parameters.getBeat());
+    this->lengths.setUnchecked(row, parameters.getLength());
+    this->velocities.setUnchecked(row, parameters.getVelocity());
+}
+
+void NoteStorage::remove(Note &handle)
+{
+    jassert(handle.storage == this);
+
+    const int row = handle.slot;
+    const int lastRow = this->handles.size() - 1;
+
+    // the handle keeps its last values, so it can still be found among the sorted events
+    handle.key = this->keys.getUnchecked(row);
+    handle.beat = this->beats.getUnchecked(row);
+    handle.length = this->lengths.getUnchecked(row);
+    handle.velocity = this->velocities.getUnchecked(row);
+    handle.storage = nullptr;
+    handle.beatColumn = nullptr;
+    handle.slot = -1;
+
+    if (row != lastRow)
+    {
+        Note *const movedHandle = this->handles.getUnchecked(lastRow);
+        this->keys.setUnchecked(row, this->keys.getUnchecked(lastRow));
+        this->beats.setUnchecked(row, this->beats.getUnchecked(lastRow));
+        this->lengths.setUnchecked(row, this->lengths.getUnchecked(lastRow));
+        this->velocities.setUnchecked(row, this->velocities.getUnchecked(lastRow));
+        this->handles.setUnchecked(row, movedHandle);
+        movedHandle->slot = row;
+    }
+
+    this->keys.removeLast();
+    this->beats.removeLast();
+    this->lengths.removeLast();
+    this->velocities.removeLast();
+    this->handles.removeLast();
+}
+
+void NoteStorage::clear()
+{
+    this->keys.clearQuick();
+    this->beats.clearQuick();
+    this->lengths.clearQuick();
+    this->velocities.clearQuick();
+    this->handles.clearQuick();
+}
+
+float NoteStorage::findLastBeat() const
+{
+    const float *const beatsData = this->beats.begin();
+    const float *const lengthsData = this->lengths.begin();
+    const int numNotes = this->handles.size();
+
+    float lastBeat = -FLT_MAX;
+
+    for (int i = 0; i < numNotes; ++i)
+    {
+        lastBeat = jmax(lastBeat, beatsData[i] + lengthsData[i]);
+    }
+
+    return lastBeat;
+}
+
+float NoteStorage::findMaxLength() const
+{
+    if (this->lengths.size() == 0)
+    {
+        return 0.f;
+    }
+
+    return FloatVectorOperations::findMaximum(this->lengths.begin(), this->lengths.size());
+}
+
+
+//===----------------------------------------------------------------------===//
+// NoteColumns
+//===----------------------------------------------------------------------===//
+
+void NoteColumns::ensureStorageAllocated(int numNotes)
+{
+    this->notes.ensureStorageAllocated(numNotes);
+    this->keys.ensureStorageAllocated(numNotes);
+    this->beats.ensureStorageAllocated(numNotes);
+    this->lengths.ensureStorageAllocated(numNotes);
+    this->velocities.ensureStorageAllocated(numNotes);
+}
+
+void NoteColumns::add(const Note &note)
+{
+    this->add(note, note.getVelocity());
+}
+
+void NoteColumns::add(const Note &note, float startVelocity)
+{
+    this->notes.add(&note);
+    this->keys.add(note.getKey());
+    this->beats.add(note.getBeat());
+    this->lengths.add(note.getLength());
+    this->velocities.add(startVelocity);
+}
+
+void NoteColumns::addAll(const NoteStorage &storage)
+{
+    const int numNotes = storage.size();
+
+    this->notes.addArray(storage.handles.begin(), numNotes);
+    this->keys.addArray(storage.keys.begin(), numNotes);
+    this->beats.addArray(storage.beats.begin(), numNotes);
+    this->lengths.addArray(storage.lengths.begin(), numNotes);
+    this->velocities.addArray(storage.velocities.begin(), numNotes);
+}
+
+void NoteColumns::clear()
+{
+    this->notes.clearQuick();
+    this->keys.clearQuick();
+    this->beats.clearQuick();
+    this->lengths.clearQuick();
+    this->velocities.clearQuick();
+}
+
+int NoteColumns::size() const noexcept
+{
+    return this->notes.size();
+}
+
+
+//===----------------------------------------------------------------------===//
+// Batch transforms
+//===----------------------------------------------------------------------===//
+
+// All of these do the same clamping and rounding as Note::withDeltaKey and friends
+
+void NoteColumns::transpose(int keyDelta)
+{
+    int *const keysData = this->keys.getRawDataPointer();
+    const int numNotes = this->keys.size();
+
+    for (int i = 0; i < numNotes; ++i)
+    {
+        keysData[i] = jmin(jmax(keysData[i] + keyDelta, 0), 128);
+    }
+}
+
+void NoteColumns::shiftBeats(float beatDelta)
+{
+    float *const beatsData = this->beats.getRawDataPointer();
+    const int numNotes = this->beats.size();
+
+    FloatVectorOperations::add(beatsData, beatDelta, numNotes);
+
+    for (int i = 0; i < numNotes; ++i)
+    {
+        beatsData[i] = Note::roundBeat(beatsData[i]);
+    }
+}
+
+void NoteColumns::snapBeats(float snapsPerBeat)
+{
+    float *const beatsData = this->beats.getRawDataPointer();
+    float *const lengthsData = this->lengths.getRawDataPointer();
+    const int numNotes = this->beats.size();
+
+    for (int i = 0; i < numNotes; ++i)
+    {
+        const float startBeatSnap = roundf(beatsData[i] / snapsPerBeat) * snapsPerBeat;
+        const float endBeatSnap = roundf((beatsData[i] + lengthsData[i]) / snapsPerBeat) * snapsPerBeat;
+        beatsData[i] = Note::roundBeat(startBeatSnap);
+        lengthsData[i] = jmax(Note::minLength, Note::roundBeat(endBeatSnap - startBeatSnap));
+    }
+}
+
+void NoteColumns::addToVelocities(float delta)
+{
+    float *const velocitiesData = this->velocities.getRawDataPointer();
+    const int numNotes = this->velocities.size();
+
+    FloatVectorOperations::add(velocitiesData, delta, numNotes);
+    FloatVectorOperations::clip(velocitiesData, velocitiesData, 0.f, 1.f, numNotes);
+}
+
+void NoteColumns::scaleVelocities(float factor)
+{
+    float *const velocitiesData = this->velocities.getRawDataPointer();
+    const int numNotes = this->velocities.size();
+
+    FloatVectorOperations::multiply(velocitiesData, factor, numNotes);
+    FloatVectorOperations::clip(velocitiesData, velocitiesData, 0.f, 1.f, numNotes);
+}
+
+void NoteColumns::randomizeVelocities(Random &random, float factor)
+{
+    float *const velocitiesData = this->velocities.getRawDataPointer();
+    const int numNotes = this->velocities.size();
+
+    for (int i = 0; i < numNotes; ++i)
+    {
+        const float r = ((random.nextFloat() * 2.f) - 1.f) * factor; // (-1 .. 1) * factor
+        const float v = velocitiesData[i];
+        velocitiesData[i] = v + ((r < 0) ? (v * r) : ((1.f - v) * r));
+    }
+
+    FloatVectorOperations::clip(velocitiesData, velocitiesData, 0.f, 1.f, numNotes);
+}
+
+void NoteColumns::fadeOutVelocities(float factor)
+{
+    float *const velocitiesData = this->velocities.getRawDataPointer();
+    const float *const beatsData = this->beats.getRawDataPointer();
+    const int numNotes = this->velocities.size();
+
+    const Range<float> beatRange(FloatVectorOperations::findMinAndMax(beatsData, numNotes));
+
+    if (beatRange.getLength() <= 0.f)
+    {
+        return;
+    }
+
+    // 1 - ((x / sqrt(x)) * factor)
+    for (int i = 0; i < numNotes; ++i)
+    {
+        const float localX = ((beatsData[i] - beatRange.getStart()) / beatRange.getLength()) + 0.0001f; // not 0
+        velocitiesData[i] *= 1.f - (sqrtf(localX) * factor);
+    }
+
+    FloatVectorOperations::clip(velocitiesData, velocitiesData, 0.f, 1.f, numNotes);
+}
+
+void NoteColumns::blendVelocitiesWithSine(float factor, float midline,
+                                          float startBeat, float endBeat, float numSines)
+{
+    float *const velocitiesData = this->velocities.getRawDataPointer();
+    const float *const beatsData = this->beats.getRawDataPointer();
+    const int numNotes = this->velocities.size();
+
+    const float f = (factor < 0) ? (factor + 1.f) : factor;
+
+    if (factor < 0)
+    {
+        // -1 .. 0   ->   midline .. anchor
+        FloatVectorOperations::multiply(velocitiesData, f, numNotes);
+        FloatVectorOperations::add(velocitiesData, midline * (1.f - f), numNotes);
+    }
+    else
+    {
+        // 0 .. 1   ->   anchor .. sine
+        const float amplitude = jmin(midline, (1.f - midline));
+        const float phaseScale = float_Pi * 2.f * numSines / (endBeat - startBeat);
+
+        for (int i = 0; i < numNotes; ++i)
+        {
+            const float sine = cosf((beatsData[i] - startBeat) * phaseScale) * amplitude;
+            velocitiesData[i] = ((midline + sine) * f) + (velocitiesData[i] * (1.f - f));
+        }
+    }
+
+    FloatVectorOperations::clip(velocitiesData, velocitiesData, 0.f, 1.f, numNotes);
+}
+
+void NoteColumns::getChanges(Array<Note> &groupBefore, Array<Note> &groupAfter) const
+{
+    groupBefore.ensureStorageAllocated(groupBefore.size() + this->notes.size());
+    groupAfter.ensureStorageAllocated(groupAfter.size() + this->notes.size());
+
+    for (int i = 0; i < this->notes.size(); ++i)
+    {
+        const Note &note = *this->notes.getUnchecked(i);
+        const int key = this->keys.getUnchecked(i);
+        const float beat = this->beats.getUnchecked(i);
+        const float length = this->lengths.getUnchecked(i);
+        const float velocity = this->velocities.getUnchecked(i);
+
+        if (key != note.getKey() ||
+            beat != note.getBeat() ||
+            length != note.getLength() ||
+            velocity != note.getVelocity())
+        {
+            groupBefore.add(note);
+            groupAfter.add(note.withParameters(key, beat, length, velocity));
+        }
+    }
+}
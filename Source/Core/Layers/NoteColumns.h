@@ -0,0 +1,162 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Note.h"
+
+// The layer's own notes, as the structure-of-arrays columns.
+//
+// Each stored Note object is a handle to its row: its accessors read the columns,
+// and its address stays the same for as long as the note is in the layer,
+// so the editors and the selection can keep pointing to it.
+// The rows themselves are kept dense, a removed row is filled with the last one,
+// so that the columns can be processed in flat loops without any holes to skip.
+
+class NoteStorage
+{
+public:
+
+    NoteStorage() {}
+
+    void ensureStorageAllocated(int numNotes);
+
+    // Copies the parameters into a new row, and makes the handle a view of it
+    void add(Note &handle, const Note &parameters);
+
+    // The id of the handle stays as it is
+    void set(const Note &handle, const Note &parameters);
+
+    // The handle becomes a plain value again, and can be deleted
+    void remove(Note &handle);
+
+    // Drops all the rows, the handles are to be deleted right after
+    void clear();
+
+    int size() const noexcept
+    { return this->handles.size(); }
+
+    int getKey(int row) const noexcept
+    { return this->keys.getUnchecked(row); }
+
+    float getBeat(int row) const noexcept
+    { return this->beats.getUnchecked(row); }
+
+    float getLength(int row) const noexcept
+    { return this->lengths.getUnchecked(row); }
+
+    float getVelocity(int row) const noexcept
+    { return this->velocities.getUnchecked(row); }
+
+    Note *getHandle(int row) const noexcept
+    { return this->handles.getUnchecked(row); }
+
+    // The end of the longest-reaching note, or -FLT_MAX if there are none
+    float findLastBeat() const;
+
+    float findMaxLength() const;
+
+private:
+
+    Array<int> keys;
+
+    Array<float> beats;
+
+    Array<float> lengths;
+
+    Array<float> velocities;
+
+    // the ids are kept by the handles, which own them
+    Array<Note *> handles;
+
+    friend class NoteColumns;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NoteStorage)
+};
+
+
+// A structure-of-arrays copy of a group of notes, for the batch operations.
+//
+// The per-field arithmetic of transposing, shifting or scaling
+// runs here over the contiguous columns, one flat loop per field,
+// and the changed notes are only assembled back once, for the undo action.
+
+class NoteColumns
+{
+public:
+
+    NoteColumns() {}
+
+    void ensureStorageAllocated(int numNotes);
+
+    void add(const Note &note);
+
+    // The velocity column may start from other values than the notes' own ones,
+    // e.g. the volume tuning always starts over from the velocities it had at the beginning
+    void add(const Note &note, float startVelocity);
+
+    // Copies all the layer's columns at once, with no per-note gathering
+    void addAll(const NoteStorage &storage);
+
+    void clear();
+
+    int size() const noexcept;
+
+    //===------------------------------------------------------------------===//
+    // Batch transforms
+    //===------------------------------------------------------------------===//
+
+    void transpose(int keyDelta);
+
+    void shiftBeats(float beatDelta);
+
+    // Snaps both the start and the end of each note
+    void snapBeats(float snapsPerBeat);
+
+    void addToVelocities(float delta);
+
+    void scaleVelocities(float factor);
+
+    // Moves each velocity towards 0 or 1 by a random part of the factor
+    void randomizeVelocities(Random &random, float factor);
+
+    // A smooth fade out over the beat range of the whole group
+    void fadeOutVelocities(float factor);
+
+    // Blends the velocities with a sine wave around the midline (factor > 0),
+    // or with the midline itself (factor < 0)
+    void blendVelocitiesWithSine(float factor, float midline,
+                                 float startBeat, float endBeat, float numSines);
+
+    // Fills the groups for changeGroup with the notes that were actually changed
+    void getChanges(Array<Note> &groupBefore, Array<Note> &groupAfter) const;
+
+private:
+
+    // the notes are only read, never modified here
+    Array<const Note *> notes;
+
+    Array<int> keys;
+
+    Array<float> beats;
+
+    Array<float> lengths;
+
+    Array<float> velocities;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NoteColumns)
+};
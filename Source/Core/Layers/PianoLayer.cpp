@@ -20,6 +20,7 @@
 
 #include "PianoRoll.h"
 #include "Note.h"
+#include "NoteColumns.h"
 #include "NoteActions.h"
 #include "SerializationKeys.h"
 #include "ProjectTreeItem.h"
@@ -30,7 +31,9 @@
 // todo optimize data structures >_<
 // using std::dense_hash_map ?
 
-PianoLayer::PianoLayer(MidiLayerOwner &parent) : MidiLayer(parent)
+PianoLayer::PianoLayer(MidiLayerOwner &parent) :
+    MidiLayer(parent),
+    maxNoteLength(0.f)
 {
 }
 
@@ -44,39 +47,115 @@ void PianoLayer::importMidi(const MidiMessageSequence &sequence)
     this->checkpoint();
     this->reset();
 
-    for (int i = 0; i < sequence.getNumEvents(); ++i)
+    this->silentImportGroup(this->createNotesFrom(sequence));
+
+    this->notifyBeatRangeChanged();
+    this->notifyLayerChanged();
+}
+
+struct NotesConversionJob : public ThreadPoolJob
+{
+    NotesConversionJob(PianoLayer &targetLayer, const MidiMessageSequence &sourceTrack) :
+        ThreadPoolJob("NotesConversionJob"),
+        layer(targetLayer),
+        track(sourceTrack) {}
+
+    JobStatus runJob() override
+    {
+        this->notes = this->layer.createNotesFrom(this->track);
+        return jobHasFinished;
+    }
+
+    PianoLayer &layer;
+    const MidiMessageSequence &track;
+    Array<Note> notes;
+};
+
+void PianoLayer::importMidiTracks(const Array<PianoLayer *> &layers,
+                                  const Array<const MidiMessageSequence *> &tracks)
+{
+    jassert(layers.size() == tracks.size());
+
+    OwnedArray<NotesConversionJob> jobs;
+
+    for (int i = 0; i < layers.size(); ++i)
+    {
+        jobs.add(new NotesConversionJob(*layers.getUnchecked(i), *tracks.getUnchecked(i)));
+    }
+
+    if (jobs.size() == 0)
+    {
+        return;
+    }
+
+    // the current thread converts one of the tracks itself, so it needs one worker less
+    const int numWorkers = jmin(SystemStats::getNumCpus(), jobs.size()) - 1;
+
+    if (numWorkers > 0)
     {
-        const MidiMessage &messageOn = sequence.getEventPointer(i)->message;
+        ThreadPool workers(numWorkers);
 
-        if (messageOn.isNoteOn())
+        for (int i = 1; i < jobs.size(); ++i)
         {
-            const double startTimestamp = messageOn.getTimeStamp() / MIDI_IMPORT_SCALE;
-            const int key = messageOn.getNoteNumber();
-            const float velocity = messageOn.getVelocity() / 128.f;
-            const float beat = float(startTimestamp);
+            workers.addJob(jobs.getUnchecked(i), false);
+        }
 
-            // ищем соответствующий note-off:
-            const int noteOffIndex = sequence.getIndexOfMatchingKeyUp(i);
+        jobs.getFirst()->runJob();
 
-            if (noteOffIndex > 0)
-            {
-                const MidiMessage &messageOff = sequence.getEventPointer(noteOffIndex)->message;
-                const double endTimestamp = messageOff.getTimeStamp() / MIDI_IMPORT_SCALE;
+        for (int i = 1; i < jobs.size(); ++i)
+        {
+            workers.waitForJobToFinish(jobs.getUnchecked(i), -1);
+        }
+    }
+    else
+    {
+        for (auto job : jobs)
+        {
+            job->runJob();
+        }
+    }
+
+    // the layers themselves are only touched on the calling thread
+    for (auto job : jobs)
+    {
+        PianoLayer &layer = job->layer;
+        layer.clearUndoHistory();
+        layer.checkpoint();
+        layer.reset();
+        layer.silentImportGroup(job->notes);
+        layer.notifyBeatRangeChanged();
+        layer.notifyLayerChanged();
+    }
+}
 
-                if (endTimestamp > startTimestamp)
-                {
-                    const float length = float(endTimestamp - startTimestamp);
+Array<Note> PianoLayer::createNotesFrom(const MidiMessageSequence &sequence)
+{
+    Array<Note> notes;
+
+    for (int i = 0; i < sequence.getNumEvents(); ++i)
+    {
+        const MidiMessageSequence::MidiEventHolder *noteOnHolder = sequence.getEventPointer(i);
+        const MidiMessage &messageOn = noteOnHolder->message;
 
-                    // bottleneck warning!
-                    const Note note(this, key, beat, length, velocity);
-                    this->silentImport(note);
-                }
+        // the matching note-off is linked by the sequence itself,
+        // getIndexOfMatchingKeyUp would make it a linear search for every note
+        if (messageOn.isNoteOn() && noteOnHolder->noteOffObject != nullptr)
+        {
+            const double startTimestamp = messageOn.getTimeStamp() / MIDI_IMPORT_SCALE;
+            const double endTimestamp = noteOnHolder->noteOffObject->message.getTimeStamp() / MIDI_IMPORT_SCALE;
+
+            if (endTimestamp > startTimestamp)
+            {
+                const int key = messageOn.getNoteNumber();
+                const float velocity = messageOn.getVelocity() / 128.f;
+                const float beat = float(startTimestamp);
+                const float length = float(endTimestamp - startTimestamp);
+                notes.add(Note(this, key, beat, length, velocity));
             }
         }
     }
 
-    this->notifyBeatRangeChanged();
-    this->notifyLayerChanged();
+    return notes;
 }
 
 
@@ -88,22 +167,43 @@ void PianoLayer::silentImport(const MidiEvent &eventToImport)
 {
     const Note &note = static_cast<const Note &>(eventToImport);
 
-    if (this->notesHashTable.contains(note))
+    if (this->notesHashTable.contains(note.getID()))
     { return; }
 
-    auto const storedNote = new Note(this);
-    *storedNote = note;
+    Note *const storedNote = this->storeNote(note);
     
     // we need it to be sorted just because of sequence building performance?
     this->midiEvents.addSorted(*storedNote, storedNote); // bottleneck warning
-    this->notesHashTable.set(note, storedNote);
 
     this->updateBeatRange(false);
 }
 
+void PianoLayer::silentImportGroup(const Array<Note> &notes)
+{
+    const int expectedSize = this->midiEvents.size() + notes.size();
+    this->midiEvents.ensureStorageAllocated(expectedSize);
+    this->noteStorage.ensureStorageAllocated(expectedSize);
+
+    if (this->notesHashTable.getNumSlots() < expectedSize)
+    {
+        this->notesHashTable.remapTable(expectedSize);
+    }
+
+    for (const auto &note : notes)
+    {
+        if (this->notesHashTable.contains(note.getID()))
+        { continue; }
+
+        this->midiEvents.add(this->storeNote(note)); // sorted later
+    }
+
+    this->sort();
+    this->updateBeatRange(false);
+}
+
 MidiEvent *PianoLayer::insert(const Note &note, const bool undoable)
 {
-    if (this->notesHashTable.contains(note))
+    if (this->notesHashTable.contains(note.getID()))
     {
         return nullptr;
     }
@@ -116,10 +216,9 @@ MidiEvent *PianoLayer::insert(const Note &note, const bool undoable)
     }
     else
     {
-        auto storedNote = new Note(this, note);
+        Note *const storedNote = this->storeNote(note);
         
         this->midiEvents.addSorted(*storedNote, storedNote);
-        this->notesHashTable.set(note, storedNote);
 
         this->notifyEventAdded(*storedNote);
         this->updateBeatRange(true);
@@ -141,15 +240,10 @@ bool PianoLayer::remove(const Note &note, const bool undoable)
     else
     {
         // fixme! use dense_hash_map of <int noteHash, Note *objectPointer>
-        if (Note *matchingNote = this->notesHashTable[note])
+        if (Note *matchingNote = this->notesHashTable[note.getID()])
         {
             this->notifyEventRemoved(*matchingNote);
-            
-            const int matchingNoteIndex = this->indexOfSorted(matchingNote);
-            this->midiEvents.remove(matchingNoteIndex, true);
-            //this->midiEvents.removeObject(matchingNote);
-            
-            this->notesHashTable.remove(note);
+            this->deleteStoredNote(matchingNote);
             this->updateBeatRange(true);
             this->notifyEventRemovedPostAction();
             return true;
@@ -176,12 +270,11 @@ bool PianoLayer::change(const Note &note,
     }
     else
     {
-        if (Note *matchingNote = this->notesHashTable[note])
+        if (Note *matchingNote = this->notesHashTable[note.getID()])
         {
             // fixme - remove and addSorted instead?
-            (*matchingNote) = newNote;
-
-            this->notesHashTable.set(newNote, matchingNote);
+            this->noteStorage.set(*matchingNote, newNote);
+            this->updateMaxNoteLength(newNote);
 
             // fixme - remove and addSorted instead?
             this->sort();
@@ -212,11 +305,9 @@ bool PianoLayer::insertGroup(Array<Note> &notes, bool undoable)
     {
         for (int i = 0; i < notes.size(); ++i)
         {
-            const Note &note = notes.getUnchecked(i);
-            auto storedNote = new Note(this, note);
+            Note *const storedNote = this->storeNote(notes.getUnchecked(i));
             
             this->midiEvents.add(storedNote); // sorted later
-            this->notesHashTable.set(note, storedNote);
             this->notifyEventAdded(*storedNote);
         }
 
@@ -241,15 +332,10 @@ bool PianoLayer::removeGroup(Array<Note> &notes, bool undoable)
         {
             const Note &note = notes.getUnchecked(i);
 
-            if (Note *matchingNote = this->notesHashTable[note])
+            if (Note *matchingNote = this->notesHashTable[note.getID()])
             {
                 this->notifyEventRemoved(*matchingNote);
-                
-                const int matchingNoteIndex = this->indexOfSorted(matchingNote);
-                this->midiEvents.remove(matchingNoteIndex, true);
-                //this->midiEvents.removeObject(matchingNote);
-                
-                this->notesHashTable.remove(note);
+                this->deleteStoredNote(matchingNote);
             }
         }
 
@@ -280,11 +366,10 @@ bool PianoLayer::changeGroup(Array<Note> &notesBefore,
             const Note &note = notesBefore.getUnchecked(i);
             const Note &newNote = notesAfter.getUnchecked(i);
 
-            if (Note *matchingNote = this->notesHashTable[note])
+            if (Note *matchingNote = this->notesHashTable[note.getID()])
             {
-                (*matchingNote) = newNote;
-
-                this->notesHashTable.set(newNote, matchingNote);
+                this->noteStorage.set(*matchingNote, newNote);
+                this->updateMaxNoteLength(newNote);
                 this->notifyEventChanged(note, *matchingNote);
             }
         }
@@ -307,18 +392,16 @@ void PianoLayer::transposeAll(int keyDelta, bool shouldCheckpoint)
         return;
     }
 
+    NoteColumns columns;
+    columns.addAll(this->noteStorage);
+    columns.transpose(keyDelta);
+
     Array<Note> groupBefore, groupAfter;
+    columns.getChanges(groupBefore, groupAfter);
 
-    for (int i = 0; i < this->midiEvents.size(); ++i)
+    if (groupBefore.size() == 0)
     {
-        if (Note *n = dynamic_cast<Note *>(this->midiEvents.getUnchecked(i)))
-        {
-            Note n1 = *n;
-            Note n2 = n1.withDeltaKey(keyDelta);
-
-            groupBefore.add(n1);
-            groupAfter.add(n2);
-        }
+        return;
     }
 
     if (shouldCheckpoint)
@@ -336,18 +419,71 @@ void PianoLayer::transposeAll(int keyDelta, bool shouldCheckpoint)
 
 float PianoLayer::getLastBeat() const
 {
-    // todo fix
-    // сейчас тут скрыт один баг: последний бит считается по последнему событию
-    // но могут быть и предыдущие, которые длиннее его
-    // в общем, я пока закрою глаза на это
+    // not just the end of the last note, the earlier ones may be longer
+    return this->noteStorage.findLastBeat();
+}
 
-    if (this->midiEvents.size() == 0)
+
+//===----------------------------------------------------------------------===//
+// Range queries
+//===----------------------------------------------------------------------===//
+
+void PianoLayer::findEventsOverlappingRange(float startBeat, float endBeat, Array<MidiEvent *> &result) const
+{
+    // no note starting before this beat can reach the range
+    const float searchStartBeat = startBeat - this->maxNoteLength;
+
+    for (int i = this->indexOfFirstEventAtOrAfter(searchStartBeat); i < this->midiEvents.size(); ++i)
     {
-        return -FLT_MAX;
+        Note *note = static_cast<Note *>(this->midiEvents.getUnchecked(i));
+
+        if (note->getBeat() >= endBeat)
+        {
+            break;
+        }
+
+        if ((note->getBeat() + note->getLength()) > startBeat)
+        {
+            result.add(note);
+        }
     }
+}
+
+void PianoLayer::updateMaxNoteLength(const Note &note)
+{
+    this->maxNoteLength = jmax(this->maxNoteLength, note.getLength());
+}
 
-    const Note &note = static_cast<const Note &>(*this->midiEvents.getUnchecked(this->midiEvents.size() - 1));
-    return note.getBeat() + note.getLength();
+void PianoLayer::recalculateMaxNoteLength()
+{
+    this->maxNoteLength = this->noteStorage.findMaxLength();
+}
+
+
+//===----------------------------------------------------------------------===//
+// Storage
+//===----------------------------------------------------------------------===//
+
+const NoteStorage &PianoLayer::getNoteStorage() const noexcept
+{
+    return this->noteStorage;
+}
+
+Note *PianoLayer::storeNote(const Note &note)
+{
+    auto storedNote = new Note(this, note);
+    this->noteStorage.add(*storedNote, note);
+    this->notesHashTable.set(note.getID(), storedNote);
+    this->updateMaxNoteLength(note);
+    return storedNote;
+}
+
+void PianoLayer::deleteStoredNote(Note *storedNote)
+{
+    const int storedNoteIndex = this->indexOfSorted(storedNote);
+    this->notesHashTable.remove(storedNote->getID());
+    this->noteStorage.remove(*storedNote);
+    this->midiEvents.remove(storedNoteIndex, true);
 }
 
 
@@ -378,6 +514,7 @@ XmlElement *PianoLayer::serialize() const
 void PianoLayer::deserialize(const XmlElement &xml)
 {
     //this->reset(); // this will send change notifications
+    this->noteStorage.clear();
     this->midiEvents.clear();
     this->notesHashTable.clear();
 
@@ -397,29 +534,39 @@ void PianoLayer::deserialize(const XmlElement &xml)
     float lastBeat = 0;
     float firstBeat = 0;
 
+    const int numChildren = mainSlot->getNumChildElements();
+    this->midiEvents.ensureStorageAllocated(numChildren);
+    this->noteStorage.ensureStorageAllocated(numChildren);
+
+    if (this->notesHashTable.getNumSlots() < numChildren)
+    {
+        this->notesHashTable.remapTable(numChildren);
+    }
+
     forEachXmlChildElementWithTagName(*mainSlot, e, Serialization::Core::note)
     {
-        auto note = new Note(this);
-        note->deserialize(*e);
+        Note note(this);
+        note.deserialize(*e);
 
         //this->midiEvents.addSorted(*note, note); // sorted later
-        this->midiEvents.add(note);
+        this->midiEvents.add(this->storeNote(note));
 
-        const float noteEnd = (note->getBeat() + note->getLength());
+        const float noteEnd = (note.getBeat() + note.getLength());
         lastBeat = jmax(lastBeat, noteEnd);
-        firstBeat = jmin(firstBeat, note->getBeat());
-
-        this->notesHashTable.set(*note, note);
+        firstBeat = jmin(firstBeat, note.getBeat());
     }
 
     this->sort();
+    this->recalculateMaxNoteLength();
     this->updateBeatRange(false);
     this->notifyLayerChanged();
 }
 
 void PianoLayer::reset()
 {
+    this->noteStorage.clear();
     this->midiEvents.clear();
     this->notesHashTable.clear();
+    this->maxNoteLength = 0.f;
     this->notifyLayerChanged();
 }
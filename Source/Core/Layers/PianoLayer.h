@@ -19,6 +19,7 @@
 
 #include "MidiLayer.h"
 #include "Note.h"
+#include "NoteColumns.h"
 
 class PianoRoll;
 
@@ -35,12 +36,23 @@ public:
 
     void importMidi(const MidiMessageSequence &sequence) override;
 
+    // Converts the tracks on all cores, and then imports each one in bulk
+    static void importMidiTracks(const Array<PianoLayer *> &layers,
+                                 const Array<const MidiMessageSequence *> &tracks);
+
+    // Doesn't modify the layer, so it is safe to call from any thread
+    Array<Note> createNotesFrom(const MidiMessageSequence &sequence);
+
 
     //===------------------------------------------------------------------===//
     // Undoable track editing
     //===------------------------------------------------------------------===//
 
     void silentImport(const MidiEvent &eventToImport) override;
+
+    // Sorts and indexes the events once for the whole group;
+    // notifyLayerChanged() should be called afterwards, as with silentImport
+    void silentImportGroup(const Array<Note> &notes);
     
     
     MidiEvent *insert(const Note &note, const bool undoable);
@@ -72,6 +84,21 @@ public:
     float getLastBeat() const override; // overriding to set beat+length
     
     
+    //===------------------------------------------------------------------===//
+    // Range queries
+    //===------------------------------------------------------------------===//
+
+    void findEventsOverlappingRange(float startBeat, float endBeat, Array<MidiEvent *> &result) const override;
+    
+
+    //===------------------------------------------------------------------===//
+    // Storage
+    //===------------------------------------------------------------------===//
+
+    // The columns the stored notes are views of, in no particular order
+    const NoteStorage &getNoteStorage() const noexcept;
+    
+    
     //===------------------------------------------------------------------===//
     // Serializable
     //===------------------------------------------------------------------===//
@@ -84,9 +111,24 @@ public:
 
 private:
 
-    // быстрый доступ к указателю на событие по соответствующим ему параметрам
-    // todo вот прям быстрый? замени на dense_hash_map или flat_hash_map
-    HashMap<Note, Note *, NoteHashFunction> notesHashTable;
+    NoteStorage noteStorage;
+
+    // Adds the note's row and its handle, but not to the sorted events
+    Note *storeNote(const Note &note);
+
+    // Removes the note's row, and deletes its handle
+    void deleteStoredNote(Note *storedNote);
+
+    // Notes are equal if their ids are, so the ids are the keys,
+    // instead of the full copies of the notes
+    HashMap<MidiEvent::Id, Note *, MidiEventIdHashFunction> notesHashTable;
+
+    // Limits how far back the overlapping notes can start;
+    // grows on every edit, and is only shrunk on full reloads
+    float maxNoteLength;
+
+    void updateMaxNoteLength(const Note &note);
+    void recalculateMaxNoteLength();
 
 private:
 
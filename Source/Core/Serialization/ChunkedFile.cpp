@@ -0,0 +1,589 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "ChunkedFile.h"
+
+static const int kChunkedMagicNumber =
+    static_cast<int>(ByteOrder::littleEndianInt("HC::"));
+
+const int ChunkedFile::currentVersion = 3;
+
+// zlib never compresses better than that, which limits
+// the sections of the older versions, without the uncompressed size
+static const int64 kMaxCompressionRatio = 1032;
+
+// Element tree is encoded as follows:
+//   name, number of attributes, [attribute name, value], number of children, [child].
+// Tag and attribute names are interned per section: the first occurrence
+// is written as the next index followed by the string, the rest are just indices.
+// Text elements are written as an empty name followed by the text.
+//
+// Since version 2, the attribute values holding base64-encoded memory blocks,
+// like the packed undo actions, are written as the raw bytes: the marker byte,
+// which never starts a UTF-8 string, then the size and the data.
+
+struct NamesWriter
+{
+    void write(OutputStream &out, const String &name)
+    {
+        const int index = this->names.indexOf(name);
+
+        if (index >= 0)
+        {
+            out.writeCompressedInt(index);
+            return;
+        }
+
+        out.writeCompressedInt(this->names.size());
+        out.writeString(name);
+        this->names.add(name);
+    }
+
+    StringArray names;
+};
+
+static const uint8 kBinaryValueMarker = 0xff;
+
+// Only the values which MemoryBlock::toBase64Encoding gives back exactly are
+// written as binary; the short ones are not worth it, and most of them are numbers
+static bool decodeBinaryValue(const String &value, MemoryBlock &result)
+{
+    if (value.length() < 64 || ! CharacterFunctions::isDigit(value[0]))
+    {
+        return false;
+    }
+
+    return result.fromBase64Encoding(value) &&
+        (result.toBase64Encoding() == value);
+}
+
+static void writeAttributeValue(OutputStream &out, const String &value)
+{
+    MemoryBlock block;
+
+    if (decodeBinaryValue(value, block))
+    {
+        out.writeByte(static_cast<char>(kBinaryValueMarker));
+        out.writeCompressedInt(static_cast<int>(block.getSize()));
+        out.write(block.getData(), block.getSize());
+        return;
+    }
+
+    out.writeString(value);
+}
+
+static bool readAttributeValue(InputStream &in, String &result)
+{
+    const int64 position = in.getPosition();
+
+    if (static_cast<uint8>(in.readByte()) != kBinaryValueMarker)
+    {
+        in.setPosition(position);
+        result = in.readString();
+        return true;
+    }
+
+    const int numBytes = in.readCompressedInt();
+
+    if (numBytes < 0 || numBytes > in.getNumBytesRemaining())
+    {
+        return false;
+    }
+
+    MemoryBlock block;
+
+    if (in.readIntoMemoryBlock(block, numBytes) != size_t(numBytes))
+    {
+        return false;
+    }
+
+    result = block.toBase64Encoding();
+    return true;
+}
+
+static bool isValidName(const String &name)
+{
+    if (name.isEmpty())
+    {
+        return false;
+    }
+
+    String::CharPointerType c(name.getCharPointer());
+    const juce_wchar first = c.getAndAdvance();
+
+    if (! CharacterFunctions::isLetter(first) && first != '_' && first != ':')
+    {
+        return false;
+    }
+
+    while (! c.isEmpty())
+    {
+        const juce_wchar next = c.getAndAdvance();
+
+        if (! CharacterFunctions::isLetterOrDigit(next) &&
+            next != '_' && next != ':' && next != '-' && next != '.')
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The data comes from the disk, so any malformed index or name fails the load
+struct NamesReader
+{
+    bool read(InputStream &in, Identifier &result, bool allowsText)
+    {
+        const int index = in.readCompressedInt();
+
+        if (index == 0)
+        {
+            result = Identifier();
+            return allowsText;
+        }
+
+        if (index > 0 && index < this->names.size())
+        {
+            result = this->names.getReference(index);
+            return true;
+        }
+
+        if (index != this->names.size() || in.isExhausted())
+        {
+            return false;
+        }
+
+        const String name(in.readString());
+
+        if (! isValidName(name))
+        {
+            return false;
+        }
+
+        result = Identifier(name);
+        this->names.add(result);
+        return true;
+    }
+
+    Array<Identifier> names;
+};
+
+static void writeElement(OutputStream &out, const XmlElement &xml, NamesWriter &names, bool withChildren)
+{
+    if (xml.isTextElement())
+    {
+        out.writeCompressedInt(0);
+        out.writeString(xml.getText());
+        return;
+    }
+
+    names.write(out, xml.getTagName());
+
+    const int numAttributes = xml.getNumAttributes();
+    out.writeCompressedInt(numAttributes);
+
+    for (int i = 0; i < numAttributes; ++i)
+    {
+        names.write(out, xml.getAttributeName(i));
+        writeAttributeValue(out, xml.getAttributeValue(i));
+    }
+
+    const int numChildren = withChildren ? xml.getNumChildElements() : 0;
+    out.writeCompressedInt(numChildren);
+
+    for (int i = 0; i < numChildren; ++i)
+    {
+        writeElement(out, *xml.getChildElement(i), names, true);
+    }
+}
+
+static XmlElement *readElement(InputStream &in, NamesReader &names)
+{
+    Identifier tagName;
+
+    if (! names.read(in, tagName, true))
+    {
+        return nullptr;
+    }
+
+    // the empty name is never written, so index 0 always stands for a text element
+    if (tagName.isNull())
+    {
+        return XmlElement::createTextElement(in.readString());
+    }
+
+    ScopedPointer<XmlElement> xml(new XmlElement(tagName));
+
+    const int numAttributes = in.readCompressedInt();
+
+    if (numAttributes < 0)
+    {
+        return nullptr;
+    }
+
+    for (int i = 0; i < numAttributes; ++i)
+    {
+        Identifier attributeName;
+
+        if (! names.read(in, attributeName, false))
+        {
+            return nullptr;
+        }
+
+        String attributeValue;
+
+        if (! readAttributeValue(in, attributeValue))
+        {
+            return nullptr;
+        }
+
+        xml->setAttribute(attributeName, attributeValue);
+    }
+
+    const int numChildren = in.readCompressedInt();
+
+    if (numChildren < 0)
+    {
+        return nullptr;
+    }
+
+    for (int i = 0; i < numChildren; ++i)
+    {
+        // a truncated stream reads as zeros, which would make up the empty text elements
+        if (in.isExhausted())
+        {
+            return nullptr;
+        }
+
+        XmlElement *child = readElement(in, names);
+
+        if (child == nullptr)
+        {
+            return nullptr;
+        }
+
+        xml->addChildElement(child);
+    }
+
+    return xml.release();
+}
+
+static MemoryBlock encodeSection(const XmlElement &xml, bool withChildren, int64 &uncompressedSize)
+{
+    MemoryOutputStream plainOut;
+    NamesWriter names;
+    names.names.add(String::empty); // reserves index 0 for the text elements
+    writeElement(plainOut, xml, names, withChildren);
+    uncompressedSize = int64(plainOut.getDataSize());
+
+    MemoryOutputStream memOut;
+
+    {
+        GZIPCompressorOutputStream compressMemOut(&memOut, 1, false);
+        compressMemOut.write(plainOut.getData(), plainOut.getDataSize());
+        compressMemOut.flush();
+    }
+
+    return memOut.getMemoryBlock();
+}
+
+
+//===----------------------------------------------------------------------===//
+// ChunkedFile
+//===----------------------------------------------------------------------===//
+
+ChunkedFile::ChunkedFile(const File &file) :
+    version(0)
+{
+    this->rootSection.offset = 0;
+    this->rootSection.size = 0;
+    this->rootSection.uncompressedSize = 0;
+
+    this->mappedFile = new MemoryMappedFile(file, MemoryMappedFile::readOnly);
+
+    const void *data = this->mappedFile->getData();
+    const int64 dataSize = int64(this->mappedFile->getSize());
+
+    if (data == nullptr || dataSize < 12)
+    {
+        this->mappedFile = nullptr;
+        return;
+    }
+
+    MemoryInputStream in(data, size_t(dataSize), false);
+
+    if (in.readInt() != kChunkedMagicNumber)
+    {
+        this->mappedFile = nullptr;
+        return;
+    }
+
+    const int fileVersion = in.readInt();
+
+    if (fileVersion <= 0 || fileVersion > ChunkedFile::currentVersion)
+    {
+        Logger::writeToLog("ChunkedFile: unsupported version " + String(fileVersion));
+        this->mappedFile = nullptr;
+        return;
+    }
+
+    const int numSections = in.readInt();
+
+    if (numSections < 0)
+    {
+        this->mappedFile = nullptr;
+        return;
+    }
+
+    for (int i = 0; i <= numSections; ++i)
+    {
+        Section section;
+        section.tag = in.readString();
+        section.offset = in.readInt64();
+        section.size = in.readInt64();
+        section.uncompressedSize = (fileVersion >= 3) ? in.readInt64() : -1;
+
+        if (in.isExhausted() ||
+            section.offset < 0 || section.size < 0 ||
+            section.offset > dataSize || section.size > dataSize - section.offset ||
+            section.uncompressedSize > section.size * kMaxCompressionRatio ||
+            (fileVersion >= 3 && section.uncompressedSize < 0))
+        {
+            this->sections.clear();
+            this->mappedFile = nullptr;
+            return;
+        }
+
+        if (i == 0)
+        {
+            this->rootSection = section;
+        }
+        else
+        {
+            this->sections.add(section);
+        }
+    }
+
+    this->version = fileVersion;
+}
+
+bool ChunkedFile::isChunkedFile(const File &file)
+{
+    FileInputStream fileStream(file);
+    return fileStream.openedOk() && (fileStream.readInt() == kChunkedMagicNumber);
+}
+
+bool ChunkedFile::write(const XmlElement &xml, OutputStream &out)
+{
+    Array<MemoryBlock> blocks;
+    Array<int64> uncompressedSizes;
+    StringArray tags;
+    int64 uncompressedSize = 0;
+
+    blocks.add(encodeSection(xml, false, uncompressedSize));
+    uncompressedSizes.add(uncompressedSize);
+    tags.add(xml.getTagName());
+
+    forEachXmlChildElement(xml, child)
+    {
+        blocks.add(encodeSection(*child, true, uncompressedSize));
+        uncompressedSizes.add(uncompressedSize);
+        tags.add(child->isTextElement() ? String::empty : child->getTagName());
+    }
+
+    // the header size is known only when the tags are written
+    MemoryOutputStream header;
+    header.writeInt(kChunkedMagicNumber);
+    header.writeInt(ChunkedFile::currentVersion);
+    header.writeInt(blocks.size() - 1);
+
+    int64 headerSize = header.getDataSize();
+
+    for (int i = 0; i < blocks.size(); ++i)
+    {
+        headerSize += tags[i].getNumBytesAsUTF8() + 1 + sizeof(int64) * 3;
+    }
+
+    int64 offset = headerSize;
+
+    for (int i = 0; i < blocks.size(); ++i)
+    {
+        const int64 size = int64(blocks.getReference(i).getSize());
+        header.writeString(tags[i]);
+        header.writeInt64(offset);
+        header.writeInt64(size);
+        header.writeInt64(uncompressedSizes[i]);
+        offset += size;
+    }
+
+    jassert(int64(header.getDataSize()) == headerSize);
+
+    if (! out.write(header.getData(), header.getDataSize()))
+    {
+        return false;
+    }
+
+    for (const auto &block : blocks)
+    {
+        if (! out.write(block.getData(), block.getSize()))
+        {
+            return false;
+        }
+    }
+
+    out.flush();
+    return true;
+}
+
+MemoryBlock ChunkedFile::encodeElement(const XmlElement &xml)
+{
+    MemoryOutputStream out;
+    NamesWriter names;
+    names.names.add(String::empty);
+    writeElement(out, xml, names, true);
+    return out.getMemoryBlock();
+}
+
+XmlElement *ChunkedFile::decodeElement(const void *data, size_t numBytes)
+{
+    MemoryInputStream in(data, numBytes, false);
+    NamesReader names;
+    names.names.add(Identifier());
+    return readElement(in, names);
+}
+
+
+//===----------------------------------------------------------------------===//
+// Loading
+//===----------------------------------------------------------------------===//
+
+bool ChunkedFile::isValid() const noexcept
+{
+    return (this->mappedFile != nullptr);
+}
+
+int ChunkedFile::getVersion() const noexcept
+{
+    return this->version;
+}
+
+struct DecodeSectionJob : public ThreadPoolJob
+{
+    DecodeSectionJob(const ChunkedFile &targetFile, const ChunkedFile::Section &targetSection) :
+        ThreadPoolJob("DecodeSectionJob"),
+        file(targetFile),
+        section(targetSection) {}
+
+    JobStatus runJob() override
+    {
+        this->result = this->file.decodeSection(this->section);
+        return jobHasFinished;
+    }
+
+    const ChunkedFile &file;
+    ChunkedFile::Section section;
+    ScopedPointer<XmlElement> result;
+};
+
+XmlElement *ChunkedFile::createXml() const
+{
+    if (! this->isValid())
+    {
+        return nullptr;
+    }
+
+    // the sections are compressed independently and read from the mapping,
+    // so they are decoded in parallel, the root being the first job
+    OwnedArray<DecodeSectionJob> jobs;
+    jobs.add(new DecodeSectionJob(*this, this->rootSection));
+
+    for (const auto &section : this->sections)
+    {
+        jobs.add(new DecodeSectionJob(*this, section));
+    }
+
+    const int numWorkers = jmin(SystemStats::getNumCpus(), jobs.size()) - 1;
+
+    if (numWorkers > 0)
+    {
+        ThreadPool workers(numWorkers);
+
+        for (int i = 1; i < jobs.size(); ++i)
+        {
+            workers.addJob(jobs.getUnchecked(i), false);
+        }
+
+        jobs.getFirst()->runJob();
+
+        for (int i = 1; i < jobs.size(); ++i)
+        {
+            workers.waitForJobToFinish(jobs.getUnchecked(i), -1);
+        }
+    }
+    else
+    {
+        for (auto job : jobs)
+        {
+            job->runJob();
+        }
+    }
+
+    for (auto job : jobs)
+    {
+        if (job->result == nullptr)
+        {
+            return nullptr;
+        }
+    }
+
+    XmlElement *root = jobs.getFirst()->result.release();
+
+    for (int i = 1; i < jobs.size(); ++i)
+    {
+        root->addChildElement(jobs.getUnchecked(i)->result.release());
+    }
+
+    return root;
+}
+
+XmlElement *ChunkedFile::decodeSection(const Section &section) const
+{
+    const char *data = static_cast<const char *>(this->mappedFile->getData());
+    MemoryInputStream compressedIn(data + section.offset, size_t(section.size), false);
+    GZIPDecompressorInputStream decompressedIn(compressedIn);
+
+    const bool hasKnownSize = (section.uncompressedSize >= 0);
+    const int64 maxSize = hasKnownSize ? section.uncompressedSize : (section.size * kMaxCompressionRatio);
+
+    // reading the element tree byte by byte from the zlib stream is slow,
+    // so the section is unpacked at once, but never beyond its size
+    MemoryBlock sectionData;
+    decompressedIn.readIntoMemoryBlock(sectionData, ssize_t(maxSize));
+
+    if (hasKnownSize && int64(sectionData.getSize()) != section.uncompressedSize)
+    {
+        return nullptr;
+    }
+
+    MemoryInputStream in(sectionData, false);
+
+    NamesReader names;
+    names.names.add(Identifier());
+    return readElement(in, names);
+}
@@ -0,0 +1,90 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// A versioned binary container for the large documents, like projects.
+//
+// The root element is stored without its children, and each child of the root
+// (project info, layers, VCS, undo history, etc.) is stored as a separate section.
+// A section is a compact binary form of the element tree, gzipped,
+// which is much faster to read than the xml text.
+//
+// The section table goes right after the header, so the file is memory mapped
+// and the sections are decoded in parallel, straight from the mapping.
+//
+// Layout:
+//   magic, version, number of sections,
+//   section table: tag name, offset, size, uncompressed size for each section,
+//   root section, child sections.
+//
+// The uncompressed size is stored since version 3, and no section is
+// unpacked beyond it, so that a corrupted file can't exhaust the memory.
+
+class ChunkedFile
+{
+public:
+
+    explicit ChunkedFile(const File &file);
+
+    static const int currentVersion;
+
+    static bool isChunkedFile(const File &file);
+
+    static bool write(const XmlElement &xml, OutputStream &out);
+
+    // The same binary form for a single element tree, not compressed,
+    // for the small documents that are read often, like VCS deltas
+    static MemoryBlock encodeElement(const XmlElement &xml);
+
+    static XmlElement *decodeElement(const void *data, size_t numBytes);
+
+    //===------------------------------------------------------------------===//
+    // Loading
+    //===------------------------------------------------------------------===//
+
+    bool isValid() const noexcept;
+
+    int getVersion() const noexcept;
+
+    // Converts the whole document back to xml
+    XmlElement *createXml() const;
+
+private:
+
+    friend struct DecodeSectionJob;
+
+    struct Section
+    {
+        String tag;
+        int64 offset;
+        int64 size;
+        int64 uncompressedSize;
+    };
+
+    XmlElement *decodeSection(const Section &section) const;
+
+    ScopedPointer<MemoryMappedFile> mappedFile;
+
+    Array<Section> sections;
+
+    Section rootSection;
+
+    int version;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChunkedFile)
+};
@@ -17,6 +17,7 @@
 
 #include "Common.h"
 #include "DataEncoder.h"
+#include "ChunkedFile.h"
 
 static const std::string kBase64Chars =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -249,16 +250,9 @@ static inline String decompress(const MemoryBlock &str)
 {
     MemoryInputStream input(str.getData(), str.getSize(), false);
     GZIPDecompressorInputStream gzInput(input);
-    MemoryBlock decompressedData(0, true);
-    MemoryBlock buf(512);
-
-    while (!gzInput.isExhausted())
-    {
-        const int data = gzInput.read(buf.getData(), 512);
-        decompressedData.append(buf.getData(), data);
-    }
-
-    return decompressedData.toString();
+    MemoryOutputStream decompressedData;
+    decompressedData.writeFromInputStream(gzInput, -1);
+    return decompressedData.toUTF8();
 }
 
 String DataEncoder::obfuscateString(const String &buffer)
@@ -330,6 +324,34 @@ bool DataEncoder::saveObfuscated(const File &file, XmlElement *xml)
 //#endif
 }
 
+bool DataEncoder::saveChunked(const File &file, XmlElement *xml)
+{
+    if (! file.existsAsFile())
+    {
+        Result creationResult = file.create();
+    }
+    
+    TempFile tempFile(file);
+    
+    {
+        ScopedPointer <OutputStream> out(tempFile.getFile().createOutputStream());
+        
+        if (out == nullptr || ! ChunkedFile::write(*xml, *out))
+        {
+            Logger::writeToLog("DataEncoder::saveChunked failed");
+            return false;
+        }
+    }
+    
+    if (tempFile.overwriteTargetFileWithTemporary())
+    {
+        return true;
+    }
+    
+    Logger::writeToLog("DataEncoder::saveChunked failed overwriteTargetFileWithTemporary");
+    return false;
+}
+
 XmlElement *DataEncoder::loadObfuscated(const File &file)
 {
 //#if defined _DEBUG
@@ -360,6 +382,13 @@ XmlElement *DataEncoder::loadObfuscated(const File &file)
         }
     }
     
+    const ChunkedFile chunkedFile(file);
+    
+    if (chunkedFile.isValid())
+    {
+        return chunkedFile.createXml();
+    }
+    
     return nullptr;
 
 //#endif
@@ -367,109 +396,590 @@ XmlElement *DataEncoder::loadObfuscated(const File &file)
 
 #define KEY_BLOCK_SIZE 64
 
-MemoryBlock DataEncoder::encryptXml(const XmlElement &xmlTarget,
-        const MemoryBlock &key)
+// Should be a multiple of the cipher block, which is 8 bytes
+#define CIPHER_CHUNK_SIZE (256 * 1024)
+
+// The plain text size of a chunk of the streamed format
+#define STREAM_CHUNK_SIZE (1024 * 1024)
+
+//
+// The streamed format writes the encrypted documents as independent chunks,
+// so that the serialization, compression, encryption and writing are pipelined,
+// and the chunks are decrypted and decompressed in parallel on load:
+//
+//   magic,
+//   chunks: plain text size, payload size, payload,
+//   the chunk of zero sizes as the end mark.
+//
+// The payload is the chunk's text compressed on its own, padded with zeros
+// to the 8-byte cipher block and encrypted.
+//
+// The released clients only read the legacy format, which is a single
+// compressed stream encrypted as a whole, so encryptXml still writes it,
+// and the streamed format is only written where both sides are known to read it
+// (see encryptXmlStreamed); createDecryptedXml reads both.
+//
+
+static const int kStreamedMagicNumber =
+    static_cast<int>(ByteOrder::littleEndianInt("PRC:"));
+
+// Every 64 bytes of the key make a separate crypter,
+// and the crypters are applied to the consecutive 8-byte blocks in turn
+static bool createCrypters(const MemoryBlock &key, OwnedArray<BlowFish> &crypters)
 {
-    const String xmlString = xmlTarget.createDocument("", false, true, "UTF-8", 512);
-    MemoryBlock compressed = compress(xmlString);
-    
-    const int modulo = (compressed.getSize() % 4);
-    const int alignDelta = (modulo > 0) ? (4 - modulo) : 0;
-    compressed.ensureSize(compressed.getSize() + alignDelta, true);
-
-    MemoryInputStream xmlStream(compressed, false);
     MemoryInputStream keyStream(key, false);
-
-    MemoryBlock cipher;
-    MemoryOutputStream cipherStream(cipher, false);
-
-    int currentCrypter = 0;
-    OwnedArray<BlowFish> crypters;
+    bool keyIsValid = true;
 
     while (!keyStream.isExhausted())
     {
         MemoryBlock nextKey;
-        const int numBytesRead = keyStream.readIntoMemoryBlock(nextKey, KEY_BLOCK_SIZE);
+        const int numBytesRead = int(keyStream.readIntoMemoryBlock(nextKey, KEY_BLOCK_SIZE));
         jassert(numBytesRead == KEY_BLOCK_SIZE);
+        keyIsValid = keyIsValid && (numBytesRead == KEY_BLOCK_SIZE);
 
         crypters.add(new BlowFish(nextKey.getData(), nextKey.getSize()));
     }
 
     jassert(crypters.size() > 0);
+    return keyIsValid && (crypters.size() > 0);
+}
 
-    cipherStream.writeInt(kMagicNumber);
+// Encrypts or decrypts the data in place, the incomplete tail block is left untouched
+static void cipherBlocks(const OwnedArray<BlowFish> &crypters,
+                         char *data, size_t numBytes,
+                         size_t firstBlock, bool shouldEncrypt)
+{
+    const size_t numCrypters = size_t(crypters.size());
 
-    while (!xmlStream.isExhausted())
+    for (size_t i = 0; (i + 8) <= numBytes; i += 8)
     {
-        uint32 int1(xmlStream.readInt());
-        uint32 int2(xmlStream.readInt());
+        char *block = data + i;
+        uint32 int1 = ByteOrder::littleEndianInt(block);
+        uint32 int2 = ByteOrder::littleEndianInt(block + 4);
 
-        crypters[currentCrypter]->encrypt(int1, int2);
-        currentCrypter += 1;
+        const BlowFish *crypter = crypters.getUnchecked(int((firstBlock + i / 8) % numCrypters));
 
-        if (currentCrypter >= crypters.size())
-        { currentCrypter = 0; }
+        if (shouldEncrypt)
+        {
+            crypter->encrypt(int1, int2);
+        }
+        else
+        {
+            crypter->decrypt(int1, int2);
+        }
 
-        cipherStream.writeInt(int1);
-        cipherStream.writeInt(int2);
+        *reinterpret_cast<uint32 *>(block) = ByteOrder::swapIfBigEndian(int1);
+        *reinterpret_cast<uint32 *>(block + 4) = ByteOrder::swapIfBigEndian(int2);
     }
+}
 
-    // если этого не сделать, размер блока будет больше необходимого
-    cipherStream.flush();
+// The current thread runs the first job itself, so the pool needs one worker less
+static void runJobsInParallel(const Array<ThreadPoolJob *> &jobs)
+{
+    const int numWorkers = jmin(SystemStats::getNumCpus(), jobs.size()) - 1;
 
-    return cipher;
+    if (numWorkers <= 0)
+    {
+        for (auto job : jobs)
+        {
+            job->runJob();
+        }
+
+        return;
+    }
+
+    ThreadPool workers(numWorkers);
+
+    for (int i = 1; i < jobs.size(); ++i)
+    {
+        workers.addJob(jobs.getUnchecked(i), false);
+    }
+
+    jobs.getFirst()->runJob();
+
+    for (int i = 1; i < jobs.size(); ++i)
+    {
+        workers.waitForJobToFinish(jobs.getUnchecked(i), -1);
+    }
 }
 
-XmlElement *DataEncoder::createDecryptedXml(const MemoryBlock &buffer,
-        const MemoryBlock &key)
+// The blocks are independent of each other, so the chunks are processed in parallel
+struct CipherChunkJob : public ThreadPoolJob
 {
-    MemoryInputStream bufferStream(buffer, false);
-    MemoryInputStream keyStream(key, false);
+    CipherChunkJob(const OwnedArray<BlowFish> &targetCrypters,
+                   char *chunkData, size_t chunkSize,
+                   size_t chunkFirstBlock, bool shouldEncrypt) :
+        ThreadPoolJob("CipherChunkJob"),
+        crypters(targetCrypters),
+        data(chunkData),
+        numBytes(chunkSize),
+        firstBlock(chunkFirstBlock),
+        encrypting(shouldEncrypt) {}
+
+    JobStatus runJob() override
+    {
+        cipherBlocks(this->crypters, this->data, this->numBytes, this->firstBlock, this->encrypting);
+        return jobHasFinished;
+    }
 
-    MemoryBlock decipher;
-    MemoryOutputStream decipherStream(decipher, false);
+    const OwnedArray<BlowFish> &crypters;
+    char *data;
+    size_t numBytes;
+    size_t firstBlock;
+    bool encrypting;
+};
 
-    int currentCrypter = 0;
-    OwnedArray<BlowFish> crypters;
+static void applyCipher(const OwnedArray<BlowFish> &crypters,
+                        char *data, size_t numBytes, bool shouldEncrypt)
+{
+    if (crypters.size() == 0)
+    {
+        return;
+    }
 
-    while (!keyStream.isExhausted())
+    OwnedArray<CipherChunkJob> jobs;
+    Array<ThreadPoolJob *> jobsToRun;
+
+    for (size_t offset = 0; offset < numBytes; offset += CIPHER_CHUNK_SIZE)
     {
-        MemoryBlock nextKey;
-        const int numBytesRead = keyStream.readIntoMemoryBlock(nextKey, KEY_BLOCK_SIZE);
-        jassert(numBytesRead == KEY_BLOCK_SIZE);
-        
-        if (numBytesRead != KEY_BLOCK_SIZE)
+        const size_t chunkSize = jmin(size_t(CIPHER_CHUNK_SIZE), numBytes - offset);
+        jobsToRun.add(jobs.add(new CipherChunkJob(crypters, data + offset, chunkSize, offset / 8, shouldEncrypt)));
+    }
+
+    if (jobsToRun.size() > 0)
+    {
+        runJobsInParallel(jobsToRun);
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Streamed format
+//===----------------------------------------------------------------------===//
+
+struct EncodeChunkJob : public ThreadPoolJob
+{
+    EncodeChunkJob(const OwnedArray<BlowFish> &targetCrypters, MemoryBlock &chunkText) :
+        ThreadPoolJob("EncodeChunkJob"),
+        crypters(targetCrypters),
+        plainSize(int(chunkText.getSize()))
+    {
+        this->text.swapWith(chunkText);
+    }
+
+    JobStatus runJob() override
+    {
+        {
+            MemoryOutputStream payloadStream(this->payload, false);
+
+            {
+                GZIPCompressorOutputStream compressor(&payloadStream, 1, false);
+                compressor.write(this->text.getData(), this->text.getSize());
+                compressor.flush();
+            }
+
+            const int64 padding = (8 - (payloadStream.getPosition() % 8)) % 8;
+            payloadStream.writeRepeatedByte(0, size_t(padding));
+            payloadStream.flush();
+        }
+
+        this->text.reset();
+        cipherBlocks(this->crypters, static_cast<char *>(this->payload.getData()),
+                     this->payload.getSize(), 0, true);
+
+        return jobHasFinished;
+    }
+
+    const OwnedArray<BlowFish> &crypters;
+    MemoryBlock text;
+    MemoryBlock payload;
+    int plainSize;
+};
+
+// Cuts the document into chunks as it is being written, and sends them
+// to the workers; the finished chunks are written out in order, and at most
+// a couple of chunks per worker are kept in memory.
+// The workers are only started for the second chunk, so the small documents,
+// like the history sync objects, are encoded on the calling thread
+class ChunkEncodingStream : public OutputStream
+{
+public:
+
+    ChunkEncodingStream(OutputStream &targetStream,
+                        const OwnedArray<BlowFish> &targetCrypters) :
+        target(targetStream),
+        crypters(targetCrypters),
+        text(STREAM_CHUNK_SIZE),
+        numTextBytes(0),
+        position(0) {}
+
+    ~ChunkEncodingStream() override
+    {
+        // the jobs are owned here, so they should be done before deleting
+        for (auto job : this->jobs)
+        {
+            this->workers->waitForJobToFinish(job, -1);
+        }
+    }
+
+    bool finish()
+    {
+        if (this->workers == nullptr)
+        {
+            this->text.setSize(this->numTextBytes);
+            EncodeChunkJob job(this->crypters, this->text);
+            this->numTextBytes = 0;
+
+            if (job.plainSize > 0)
+            {
+                job.runJob();
+
+                if (! this->writeChunk(job))
+                {
+                    return false;
+                }
+            }
+
+            this->target.writeInt(0);
+            this->target.writeInt(0);
+            return true;
+        }
+
+        if (this->numTextBytes > 0)
+        {
+            this->sendChunk();
+        }
+
+        bool written = true;
+
+        while (this->jobs.size() > 0)
+        {
+            written = this->writeFirstChunk() && written;
+        }
+
+        this->target.writeInt(0);
+        this->target.writeInt(0);
+        return written;
+    }
+
+    //===------------------------------------------------------------------===//
+    // OutputStream
+    //===------------------------------------------------------------------===//
+
+    void flush() override {}
+
+    bool setPosition(int64) override
+    { return false; }
+
+    int64 getPosition() override
+    { return this->position; }
+
+    bool write(const void *data, size_t numBytes) override
+    {
+        const char *bytes = static_cast<const char *>(data);
+        this->position += int64(numBytes);
+
+        while (numBytes > 0)
+        {
+            const size_t freeSpace = STREAM_CHUNK_SIZE - this->numTextBytes;
+            const size_t numBytesToAppend = jmin(freeSpace, numBytes);
+
+            this->text.copyFrom(bytes, int(this->numTextBytes), numBytesToAppend);
+            this->numTextBytes += numBytesToAppend;
+            bytes += numBytesToAppend;
+            numBytes -= numBytesToAppend;
+
+            if (this->numTextBytes == STREAM_CHUNK_SIZE)
+            {
+                this->sendChunk();
+            }
+        }
+
+        return true;
+    }
+
+private:
+
+    void sendChunk()
+    {
+        if (this->workers == nullptr)
+        {
+            this->workers = new ThreadPool(SystemStats::getNumCpus());
+        }
+
+        // the job takes the filled buffer, and the new one is allocated
+        this->text.setSize(this->numTextBytes);
+        EncodeChunkJob *job = this->jobs.add(new EncodeChunkJob(this->crypters, this->text));
+        this->workers->addJob(job, false);
+        this->text.setSize(STREAM_CHUNK_SIZE);
+        this->numTextBytes = 0;
+
+        while (this->jobs.size() > this->workers->getNumThreads() * 2)
+        {
+            this->writeFirstChunk();
+        }
+    }
+
+    bool writeFirstChunk()
+    {
+        EncodeChunkJob *job = this->jobs.getFirst();
+        this->workers->waitForJobToFinish(job, -1);
+
+        const bool written = this->writeChunk(*job);
+        this->jobs.remove(0);
+        return written;
+    }
+
+    bool writeChunk(const EncodeChunkJob &job)
+    {
+        return this->target.writeInt(job.plainSize) &&
+               this->target.writeInt(int(job.payload.getSize())) &&
+               this->target.write(job.payload.getData(), job.payload.getSize());
+    }
+
+    OutputStream &target;
+    const OwnedArray<BlowFish> &crypters;
+    ScopedPointer<ThreadPool> workers;
+
+    MemoryBlock text;
+    size_t numTextBytes;
+    OwnedArray<EncodeChunkJob> jobs;
+    int64 position;
+
+    JUCE_DECLARE_NON_COPYABLE(ChunkEncodingStream)
+};
+
+// Decrypts its own copy of the payload, and decompresses it
+// right into its place in the document's text
+struct DecodeChunkJob : public ThreadPoolJob
+{
+    DecodeChunkJob(const OwnedArray<BlowFish> &targetCrypters,
+                   const char *chunkPayload, size_t chunkPayloadSize,
+                   char *chunkText, size_t chunkTextSize) :
+        ThreadPoolJob("DecodeChunkJob"),
+        crypters(targetCrypters),
+        payload(chunkPayload),
+        payloadSize(chunkPayloadSize),
+        text(chunkText),
+        textSize(chunkTextSize),
+        decoded(false) {}
+
+    JobStatus runJob() override
+    {
+        MemoryBlock deciphered(this->payload, this->payloadSize);
+        cipherBlocks(this->crypters, static_cast<char *>(deciphered.getData()),
+                     deciphered.getSize(), 0, false);
+
+        MemoryInputStream input(deciphered, false);
+        GZIPDecompressorInputStream decompressor(input);
+
+        size_t numBytesRead = 0;
+
+        while (numBytesRead < this->textSize)
+        {
+            const int numBytes = decompressor.read(this->text + numBytesRead,
+                                                   int(this->textSize - numBytesRead));
+
+            if (numBytes <= 0)
+            {
+                break;
+            }
+
+            numBytesRead += size_t(numBytes);
+        }
+
+        this->decoded = (numBytesRead == this->textSize);
+        return jobHasFinished;
+    }
+
+    const OwnedArray<BlowFish> &crypters;
+    const char *payload;
+    size_t payloadSize;
+    char *text;
+    size_t textSize;
+    bool decoded;
+};
+
+static XmlElement *createDecodedChunksXml(const MemoryBlock &buffer,
+                                          const OwnedArray<BlowFish> &crypters)
+{
+    struct ChunkInfo
+    {
+        size_t payloadOffset;
+        size_t payloadSize;
+        size_t textOffset;
+        size_t textSize;
+    };
+
+    // the headers are read first, so that the text is allocated once
+    Array<ChunkInfo> chunks;
+    MemoryInputStream headers(buffer, false);
+    headers.setPosition(4);
+    size_t totalTextSize = 0;
+
+    while (true)
+    {
+        if (headers.getNumBytesRemaining() < 8)
         {
             return nullptr;
         }
 
-        crypters.add(new BlowFish(nextKey.getData(), nextKey.getSize()));
+        const int textSize = headers.readInt();
+        const int payloadSize = headers.readInt();
+
+        if (textSize == 0 && payloadSize == 0)
+        {
+            break;
+        }
+
+        if (textSize <= 0 || payloadSize <= 0 ||
+            (payloadSize % 8) != 0 ||
+            payloadSize > headers.getNumBytesRemaining() ||
+            (totalTextSize + size_t(textSize)) > size_t(std::numeric_limits<int>::max()))
+        {
+            return nullptr;
+        }
+
+        const ChunkInfo chunk = { size_t(headers.getPosition()), size_t(payloadSize),
+                                  totalTextSize, size_t(textSize) };
+
+        chunks.add(chunk);
+        totalTextSize += size_t(textSize);
+        headers.skipNextBytes(payloadSize);
     }
 
-    jassert(crypters.size() > 0);
+    MemoryBlock text(totalTextSize);
+    OwnedArray<DecodeChunkJob> jobs;
+    Array<ThreadPoolJob *> jobsToRun;
 
-    const int magicNumber = bufferStream.readInt();
+    for (const auto &chunk : chunks)
+    {
+        jobsToRun.add(jobs.add(new DecodeChunkJob(crypters,
+            static_cast<const char *>(buffer.getData()) + chunk.payloadOffset, chunk.payloadSize,
+            static_cast<char *>(text.getData()) + chunk.textOffset, chunk.textSize)));
+    }
 
-    if (magicNumber != kMagicNumber)
-    { 
-		return nullptr;
-	}
+    if (jobsToRun.size() > 0)
+    {
+        runJobsInParallel(jobsToRun);
+    }
+
+    for (auto job : jobs)
+    {
+        if (! job->decoded)
+        {
+            return nullptr;
+        }
+    }
+
+    // XmlDocument wants the whole text anyway, so at least
+    // the decoded bytes are freed before the tree is built
+    const String document(String::fromUTF8(static_cast<const char *>(text.getData()),
+                                           int(text.getSize())));
+    text.reset();
+
+    return XmlDocument::parse(document);
+}
+
+MemoryBlock DataEncoder::encryptXml(const XmlElement &xmlTarget,
+        const MemoryBlock &key)
+{
+    OwnedArray<BlowFish> crypters;
+
+    if (! createCrypters(key, crypters))
+    {
+        return MemoryBlock();
+    }
+
+    MemoryBlock cipher;
 
-    while (!bufferStream.isExhausted())
     {
-        uint32 int1(bufferStream.readInt());
-        uint32 int2(bufferStream.readInt());
+        MemoryOutputStream cipherStream(cipher, false);
+        cipherStream.writeInt(kMagicNumber);
 
-        crypters[currentCrypter]->decrypt(int1, int2);
-        currentCrypter += 1;
+        // the document is written straight into the compressor, without the intermediate string,
+        // and the compressed data is then encrypted in place
+        {
+            GZIPCompressorOutputStream compressor(&cipherStream, 1, false);
+            xmlTarget.writeToStream(compressor, "", false, true, "UTF-8", 512);
+            compressor.flush();
+        }
 
-        if (currentCrypter >= crypters.size())
-        { currentCrypter = 0; }
+        // the last block is padded with zeros
+        const int64 payloadSize = cipherStream.getPosition() - 4;
+        const int padding = int((8 - (payloadSize % 8)) % 8);
+        cipherStream.writeRepeatedByte(0, size_t(padding));
 
-        decipherStream.writeInt(int1);
-        decipherStream.writeInt(int2);
+        // если этого не сделать, размер блока будет больше необходимого
+        cipherStream.flush();
     }
 
+    applyCipher(crypters, static_cast<char *>(cipher.getData()) + 4, cipher.getSize() - 4, true);
+    return cipher;
+}
+
+MemoryBlock DataEncoder::encryptXmlStreamed(const XmlElement &xmlTarget,
+        const MemoryBlock &key)
+{
+    OwnedArray<BlowFish> crypters;
+
+    if (! createCrypters(key, crypters))
+    {
+        return MemoryBlock();
+    }
+
+    MemoryBlock cipher;
+
+    {
+        MemoryOutputStream cipherStream(cipher, false);
+        cipherStream.writeInt(kStreamedMagicNumber);
+
+        ChunkEncodingStream encoder(cipherStream, crypters);
+        xmlTarget.writeToStream(encoder, "", false, true, "UTF-8", 512);
+
+        // a truncated cipher should never pass for a valid one
+        if (! encoder.finish())
+        {
+            return MemoryBlock();
+        }
+
+        // если этого не сделать, размер блока будет больше необходимого
+        cipherStream.flush();
+    }
+
+    return cipher;
+}
+
+XmlElement *DataEncoder::createDecryptedXml(const MemoryBlock &buffer,
+        const MemoryBlock &key)
+{
+    OwnedArray<BlowFish> crypters;
+
+    if (! createCrypters(key, crypters))
+    {
+        return nullptr;
+    }
+
+    if (buffer.getSize() < 4)
+    {
+        return nullptr;
+    }
+
+    const int magicNumber = int(ByteOrder::littleEndianInt(buffer.getData()));
+
+    if (magicNumber == kStreamedMagicNumber)
+    {
+        return createDecodedChunksXml(buffer, crypters);
+    }
+
+    if (magicNumber != kMagicNumber)
+    { 
+		return nullptr;
+	}
+
+    // only the payload is copied, and decrypted in place
+    MemoryBlock decipher(static_cast<const char *>(buffer.getData()) + 4, buffer.getSize() - 4);
+    applyCipher(crypters, static_cast<char *>(decipher.getData()), decipher.getSize(), false);
+
     const String &uncompressed = decompress(decipher);
     return XmlDocument::parse(uncompressed);
 }
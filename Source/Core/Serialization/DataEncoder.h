@@ -27,10 +27,21 @@ public:
     static bool saveObfuscated(const File &file, XmlElement *xml);
     static XmlElement *loadObfuscated(const File &file);
 
-    // Blowfish stuff
+    // Binary container for the large documents (see ChunkedFile),
+    // loadObfuscated reads it as well. The sections are not XOR'ed:
+    // they are compressed binary trees, which are no more readable than
+    // the obfuscated xml, and the XOR pass would cost a copy of each one
+    static bool saveChunked(const File &file, XmlElement *xml);
+
+    // Blowfish stuff, both return an empty block on failure
     static MemoryBlock encryptXml(const XmlElement &xmlTarget,
                                   const MemoryBlock &key);
 
+    // The chunked format, faster to write and to read,
+    // but not readable by the released clients
+    static MemoryBlock encryptXmlStreamed(const XmlElement &xmlTarget,
+                                          const MemoryBlock &key);
+
     static XmlElement *createDecryptedXml(const MemoryBlock &buffer,
                                           const MemoryBlock &key);
 };
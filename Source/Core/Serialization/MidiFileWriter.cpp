@@ -0,0 +1,182 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "MidiFileWriter.h"
+
+MidiFileWriter::MidiFileWriter(int ticksPerQuarterNote) :
+    timeFormat(ticksPerQuarterNote)
+{
+}
+
+void MidiFileWriter::addTrack(MidiLayer::ExportedSequence::Ptr track)
+{
+    if (track->curve != nullptr && track->messages.getNumEvents() > 0)
+    {
+        this->tracks.add(MidiFileWriter::flattenAutomation(*track));
+        return;
+    }
+
+    this->tracks.add(track);
+}
+
+// Other sequencers don't know the curves, so the file gets the nodes
+// and the points in between, the same as the layer used to export them
+MidiLayer::ExportedSequence::Ptr MidiFileWriter::flattenAutomation(const MidiLayer::ExportedSequence &track)
+{
+    const MidiMessage &firstNode = track.messages.getEventPointer(0)->message;
+    MidiLayer::ExportedSequence::Ptr flattened(new MidiLayer::ExportedSequence());
+
+    Array<double> timeStamps;
+    Array<float> values;
+    track.curve->getResampledPoints(timeStamps, values);
+
+    for (int i = 0; i < timeStamps.size(); ++i)
+    {
+        MidiMessage message(firstNode.isTempoMetaEvent() ?
+            AutomationCurve::createTempoEvent(values.getUnchecked(i)) :
+            AutomationCurve::createControllerEvent(firstNode.getChannel(),
+                                                   firstNode.getControllerNumber(),
+                                                   values.getUnchecked(i)));
+
+        message.setTimeStamp(timeStamps.getUnchecked(i));
+        flattened->messages.addEvent(message);
+    }
+
+    return flattened;
+}
+
+void MidiFileWriter::writeTo(OutputStream &out) const
+{
+    out.writeIntBigEndian((int) ByteOrder::bigEndianInt("MThd"));
+    out.writeIntBigEndian(6);
+    out.writeShortBigEndian(1); // multiple synchronous tracks
+    out.writeShortBigEndian((short) this->tracks.size());
+    out.writeShortBigEndian((short) this->timeFormat);
+
+    for (int i = 0; i < this->tracks.size(); ++i)
+    {
+        const MidiMessageSequence &track = this->tracks.getUnchecked(i)->messages;
+        const uint32 trackSize = MidiFileWriter::writeTrackEvents(nullptr, track);
+
+        out.writeIntBigEndian((int) ByteOrder::bigEndianInt("MTrk"));
+        out.writeIntBigEndian((int) trackSize);
+
+        MidiFileWriter::writeTrackEvents(&out, track);
+    }
+
+    out.flush();
+}
+
+
+//===----------------------------------------------------------------------===//
+// Encoding
+//===----------------------------------------------------------------------===//
+
+// The same encoding as juce::MidiFile uses: running status for the channel messages,
+// length-prefixed sysex, and the end-of-track event appended if there's none
+uint32 MidiFileWriter::writeTrackEvents(OutputStream *out, const MidiMessageSequence &track)
+{
+    uint32 numBytes = 0;
+    int lastTick = 0;
+    uint8 lastStatusByte = 0;
+    bool endOfTrackEventWritten = false;
+
+    for (int i = 0; i < track.getNumEvents(); ++i)
+    {
+        const MidiMessage &message = track.getEventPointer(i)->message;
+
+        if (message.isEndOfTrackMetaEvent())
+        {
+            endOfTrackEventWritten = true;
+        }
+
+        const int tick = roundToInt(message.getTimeStamp());
+        const int delta = jmax(0, tick - lastTick);
+        numBytes += MidiFileWriter::writeVariableLengthInt(out, (uint32) delta);
+        lastTick = tick;
+
+        const uint8 *data = message.getRawData();
+        int dataSize = message.getRawDataSize();
+        const uint8 statusByte = data[0];
+
+        if (statusByte == lastStatusByte && (statusByte & 0xf0) != 0xf0 && dataSize > 1 && i > 0)
+        {
+            ++data;
+            --dataSize;
+        }
+        else if (statusByte == 0xf0)
+        {
+            ++data;
+            --dataSize;
+
+            if (out != nullptr)
+            {
+                out->writeByte((char) statusByte);
+            }
+
+            numBytes += 1 + MidiFileWriter::writeVariableLengthInt(out, (uint32) dataSize);
+        }
+
+        if (out != nullptr)
+        {
+            out->write(data, (size_t) dataSize);
+        }
+
+        numBytes += (uint32) dataSize;
+        lastStatusByte = statusByte;
+    }
+
+    if (! endOfTrackEventWritten)
+    {
+        const MidiMessage endOfTrack(MidiMessage::endOfTrack());
+
+        if (out != nullptr)
+        {
+            out->writeByte(0); // the tick delta
+            out->write(endOfTrack.getRawData(), (size_t) endOfTrack.getRawDataSize());
+        }
+
+        numBytes += 1 + (uint32) endOfTrack.getRawDataSize();
+    }
+
+    return numBytes;
+}
+
+int MidiFileWriter::writeVariableLengthInt(OutputStream *out, uint32 value)
+{
+    uint8 buffer[5];
+    int numBytes = 0;
+
+    // the lowest 7 bits go last, and all the bytes but the last one have the high bit set
+    do
+    {
+        buffer[numBytes++] = (uint8) (value & 0x7f);
+        value >>= 7;
+    }
+    while (value != 0);
+
+    if (out != nullptr)
+    {
+        for (int i = numBytes - 1; i >= 0; --i)
+        {
+            out->writeByte((char) (buffer[i] | ((i > 0) ? 0x80 : 0)));
+        }
+    }
+
+    return numBytes;
+}
@@ -0,0 +1,53 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MidiLayer.h"
+
+// Writes a standard MIDI file straight to the output stream.
+//
+// Unlike juce::MidiFile, it doesn't copy the tracks: it keeps the layers'
+// exported sequences, and instead of buffering each track to know its size,
+// it measures the track first with the very same encoding pass, then writes it.
+// The automation tracks are the only ones copied, to expand their curves.
+
+class MidiFileWriter
+{
+public:
+
+    explicit MidiFileWriter(int ticksPerQuarterNote);
+
+    void addTrack(MidiLayer::ExportedSequence::Ptr track);
+
+    void writeTo(OutputStream &out) const;
+
+private:
+
+    static MidiLayer::ExportedSequence::Ptr flattenAutomation(const MidiLayer::ExportedSequence &track);
+
+    // Returns the number of bytes of the track's events, and only counts them if out is null
+    static uint32 writeTrackEvents(OutputStream *out, const MidiMessageSequence &track);
+
+    static int writeVariableLengthInt(OutputStream *out, uint32 value);
+
+    ReferenceCountedArray<MidiLayer::ExportedSequence> tracks;
+
+    int timeFormat;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MidiFileWriter)
+};
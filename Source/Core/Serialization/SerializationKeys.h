@@ -75,6 +75,8 @@ namespace Serialization
         static const String openGLState = "OpenGL";
         static const String enabledState = "Enabled";
         static const String disabledState = "Disabled";
+        static const String scheduledPlaybackState = "ScheduledPlayback";
+        static const String chunkedProjectsState = "ChunkedProjects";
 
         static const String pluginManager = "PluginManager";
         static const String audioSettings = "AudioSettings";
@@ -247,6 +249,10 @@ namespace Serialization
         static const String deltaType = "Type";
 
         static const String headStateDelta = "HeadState";
+
+        static const String historyManifest = "HistoryManifest";
+        static const String revisionHash = "Hash";
+        static const String subtreeHash = "SubtreeHash";
     }  // namespace VCS
     
     namespace Network
@@ -276,6 +282,18 @@ namespace Serialization
         static const String key = "vcsIdHash";
         static const String realKey = "vcsId";
         static const String title = "title";
+
+        static const String sync = "sync";
+        static const String syncManifest = "manifest";
+        static const String syncMissing = "missing";
+        static const String syncObjects = "objects";
+        static const String syncCommit = "commit";
+        static const String objects = "objects";
+        static const String manifest = "manifest";
+        static const String baseManifest = "base";
+
+        // the response header of the servers which know the sync request kinds
+        static const String syncProtocol = "Helio-Sync-Protocol";
     }  // namespace Network
     
     namespace Locales
@@ -343,6 +361,8 @@ namespace Serialization
         static const String noteAfter = "NoteAfter";
         static const String groupBefore = "GroupBefore";
         static const String groupAfter = "GroupAfter";
+        static const String numChanges = "NumChanges";
+        static const String packedChanges = "Changes";
 
         static const String pianoLayerTreeItemInsertAction = "PianoLayerTreeItemInsertAction";
         static const String pianoLayerTreeItemRemoveAction = "PianoLayerTreeItemRemoveAction";
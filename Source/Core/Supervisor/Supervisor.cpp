@@ -27,7 +27,13 @@
 
 void Supervisor::track(const String &key)
 {
-    App::Helio()->getSupervisor()->trackActivity(key);
+    // there's no app instance in the stress tests and benchmarks
+    App *app = App::Helio();
+
+    if (app != nullptr)
+    {
+        app->getSupervisor()->trackActivity(key);
+    }
 }
 
 Supervisor::Supervisor()
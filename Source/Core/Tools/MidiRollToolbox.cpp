@@ -25,6 +25,7 @@
 #include "NoteComponent.h"
 #include "AutomationLayer.h"
 #include "PianoLayer.h"
+#include "NoteColumns.h"
 #include "AnnotationsLayer.h"
 #include "InternalClipboard.h"
 #include "Arpeggiator.h"
@@ -449,9 +450,12 @@ void MidiRollToolbox::wipeSpace(Array<MidiLayer *> layers,
         if (nullptr != dynamic_cast<PianoLayer *>(layers.getUnchecked(i)))
         {
             PianoLayer *layer = dynamic_cast<PianoLayer *>(layers.getUnchecked(i));
-            for (int j = 0; j < layer->size(); ++j)
+            Array<MidiEvent *> affectedNotes;
+            layer->findEventsOverlappingRange(startBeat, endBeat, affectedNotes);
+
+            for (int j = 0; j < affectedNotes.size(); ++j)
             {
-                Note *note = static_cast<Note *>(layer->getUnchecked(j));
+                Note *note = static_cast<Note *>(affectedNotes.getUnchecked(j));
                 const float noteStartBeat = note->getBeat();
                 const float noteEndBeat = note->getBeat() + note->getLength();
                 
@@ -485,29 +489,25 @@ void MidiRollToolbox::wipeSpace(Array<MidiLayer *> layers,
         else if (nullptr != dynamic_cast<AnnotationsLayer *>(layers.getUnchecked(i)))
         {
             AnnotationsLayer *layer = dynamic_cast<AnnotationsLayer *>(layers.getUnchecked(i));
-            for (int j = 0; j < layer->size(); ++j)
+            Array<MidiEvent *> affectedAnnotations;
+            layer->findEventsInRange(startBeat, endBeat, affectedAnnotations);
+
+            for (int j = 0; j < affectedAnnotations.size(); ++j)
             {
-                AnnotationEvent *annotation = static_cast<AnnotationEvent *>(layer->getUnchecked(j));
-                const bool shouldBeDeleted = (annotation->getBeat() < endBeat && annotation->getBeat() >= startBeat);
-                
-                if (shouldBeDeleted)
-                {
-                    annotationsRemoveGroup.add(*annotation);
-                }
+                AnnotationEvent *annotation = static_cast<AnnotationEvent *>(affectedAnnotations.getUnchecked(j));
+                annotationsRemoveGroup.add(*annotation);
             }
         }
         else if (nullptr != dynamic_cast<AutomationLayer *>(layers.getUnchecked(i)))
         {
             AutomationLayer *layer = dynamic_cast<AutomationLayer *>(layers.getUnchecked(i));
-            for (int j = 0; j < layer->size(); ++j)
+            Array<MidiEvent *> affectedEvents;
+            layer->findEventsInRange(startBeat, endBeat, affectedEvents);
+
+            for (int j = 0; j < affectedEvents.size(); ++j)
             {
-                AutomationEvent *event = static_cast<AutomationEvent *>(layer->getUnchecked(j));
-                const bool shouldBeDeleted = (event->getBeat() < endBeat && event->getBeat() >= startBeat);
-                
-                if (shouldBeDeleted)
-                {
-                    autoRemoveGroup.add(*event);
-                }
+                AutomationEvent *event = static_cast<AutomationEvent *>(affectedEvents.getUnchecked(j));
+                autoRemoveGroup.add(*event);
             }
         }
     }
@@ -540,43 +540,31 @@ void MidiRollToolbox::shiftEventsToTheLeft(Array<MidiLayer *> layers, float targ
         if (nullptr != dynamic_cast<PianoLayer *>(layers.getUnchecked(i)))
         {
             PianoLayer *layer = dynamic_cast<PianoLayer *>(layers.getUnchecked(i));
-            for (int j = 0; j < layer->size(); ++j)
+            for (int j = 0, end = layer->indexOfFirstEventAtOrAfter(targetBeat); j < end; ++j)
             {
                 Note *note = static_cast<Note *>(layer->getUnchecked(j));
-
-                if (note->getBeat() < targetBeat)
-                {
-                    pianoGroupBefore.add(*note);
-                    pianoGroupAfter.add(note->withDeltaBeat(beatOffset));
-                }
+                pianoGroupBefore.add(*note);
+                pianoGroupAfter.add(note->withDeltaBeat(beatOffset));
             }
         }
         else if (nullptr != dynamic_cast<AnnotationsLayer *>(layers.getUnchecked(i)))
         {
             AnnotationsLayer *layer = dynamic_cast<AnnotationsLayer *>(layers.getUnchecked(i));
-            for (int j = 0; j < layer->size(); ++j)
+            for (int j = 0, end = layer->indexOfFirstEventAtOrAfter(targetBeat); j < end; ++j)
             {
                 AnnotationEvent *annotation = static_cast<AnnotationEvent *>(layer->getUnchecked(j));
-
-                if (annotation->getBeat() < targetBeat)
-                {
-                    annotationsGroupBefore.add(*annotation);
-                    annotationsGroupAfter.add(annotation->withDeltaBeat(beatOffset));
-                }
+                annotationsGroupBefore.add(*annotation);
+                annotationsGroupAfter.add(annotation->withDeltaBeat(beatOffset));
             }
         }
         else if (nullptr != dynamic_cast<AutomationLayer *>(layers.getUnchecked(i)))
         {
             AutomationLayer *layer = dynamic_cast<AutomationLayer *>(layers.getUnchecked(i));
-            for (int j = 0; j < layer->size(); ++j)
+            for (int j = 0, end = layer->indexOfFirstEventAtOrAfter(targetBeat); j < end; ++j)
             {
                 AutomationEvent *event = static_cast<AutomationEvent *>(layer->getUnchecked(j));
-                
-                if (event->getBeat() < targetBeat)
-                {
-                    autoGroupBefore.add(*event);
-                    autoGroupAfter.add(event->withDeltaBeat(beatOffset));
-                }
+                autoGroupBefore.add(*event);
+                autoGroupAfter.add(event->withDeltaBeat(beatOffset));
             }
         }
     }
@@ -604,43 +592,31 @@ void MidiRollToolbox::shiftEventsToTheRight(Array<MidiLayer *> layers, float tar
         if (nullptr != dynamic_cast<PianoLayer *>(layers.getUnchecked(i)))
         {
             PianoLayer *layer = dynamic_cast<PianoLayer *>(layers.getUnchecked(i));
-            for (int j = 0; j < layer->size(); ++j)
+            for (int j = layer->indexOfFirstEventAtOrAfter(targetBeat); j < layer->size(); ++j)
             {
                 Note *note = static_cast<Note *>(layer->getUnchecked(j));
-                
-                if (note->getBeat() >= targetBeat)
-                {
-                    groupBefore.add(*note);
-                    groupAfter.add(note->withDeltaBeat(beatOffset));
-                }
+                groupBefore.add(*note);
+                groupAfter.add(note->withDeltaBeat(beatOffset));
             }
         }
         else if (nullptr != dynamic_cast<AnnotationsLayer *>(layers.getUnchecked(i)))
         {
             AnnotationsLayer *layer = dynamic_cast<AnnotationsLayer *>(layers.getUnchecked(i));
-            for (int j = 0; j < layer->size(); ++j)
+            for (int j = layer->indexOfFirstEventAtOrAfter(targetBeat); j < layer->size(); ++j)
             {
                 AnnotationEvent *annotation = static_cast<AnnotationEvent *>(layer->getUnchecked(j));
-                
-                if (annotation->getBeat() >= targetBeat)
-                {
-                    annotationsGroupBefore.add(*annotation);
-                    annotationsGroupAfter.add(annotation->withDeltaBeat(beatOffset));
-                }
+                annotationsGroupBefore.add(*annotation);
+                annotationsGroupAfter.add(annotation->withDeltaBeat(beatOffset));
             }
         }
         else if (nullptr != dynamic_cast<AutomationLayer *>(layers.getUnchecked(i)))
         {
             AutomationLayer *layer = dynamic_cast<AutomationLayer *>(layers.getUnchecked(i));
-            for (int j = 0; j < layer->size(); ++j)
+            for (int j = layer->indexOfFirstEventAtOrAfter(targetBeat); j < layer->size(); ++j)
             {
                 AutomationEvent *event = static_cast<AutomationEvent *>(layer->getUnchecked(j));
-                
-                if (event->getBeat() >= targetBeat)
-                {
-                    autoGroupBefore.add(*event);
-                    autoGroupAfter.add(event->withDeltaBeat(beatOffset));
-                }
+                autoGroupBefore.add(*event);
+                autoGroupAfter.add(event->withDeltaBeat(beatOffset));
             }
         }
     }
@@ -660,283 +636,224 @@ void MidiRollToolbox::snapSelection(MidiEventSelection &selection, float snapsPe
     
     bool didCheckpoint = false;
     
-    PianoChangeGroup groupBefore, groupAfter;
+    NoteColumns columns;
+    columns.ensureStorageAllocated(selection.getNumSelected());
     
     for (int i = 0; i < selection.getNumSelected(); ++i)
     {
         NoteComponent *nc = static_cast<NoteComponent *>(selection.getSelectedItem(i));
-        
-        const float startBeat = nc->getBeat();
-        const float startBeatSnap = snappedBeat(startBeat, snapsPerBeat);
-        
-        const float endBeat = nc->getBeat() + nc->getLength();
-        const float endBeatSnap = snappedBeat(endBeat, snapsPerBeat);
-        const float lengthSnap = endBeatSnap - startBeatSnap;
-        
-        if (startBeat != startBeatSnap ||
-            endBeat != endBeatSnap)
-        {
-            groupBefore.add(nc->getNote());
-            groupAfter.add(nc->getNote().withBeat(startBeatSnap).withLength(lengthSnap));
-        }
+        columns.add(nc->getNote());
     }
     
+    columns.snapBeats(snapsPerBeat);
+    
+    PianoChangeGroup groupBefore, groupAfter;
+    columns.getChanges(groupBefore, groupAfter);
     applyPianoChanges(groupBefore, groupAfter, didCheckpoint, shouldCheckpoint);
 }
 
 
-void MidiRollToolbox::removeOverlaps(MidiEventSelection &selection, bool shouldCheckpoint)
+//===----------------------------------------------------------------------===//
+// Overlaps sweep
+//===----------------------------------------------------------------------===//
+
+// Both of the cleanups below sort the notes by key and beat just once,
+// and then sweep through each key's notes, only looking at their neighbours
+
+struct SweepNote
 {
-    if (selection.getNumSelected() == 0)
-    {
-        return;
-    }
-    
-    bool didCheckpoint = false;
-    
-    // 0 snap to 0.001 beat
-    PianoChangeGroup group0Before, group0After;
+    const Note *note;
+    int key;
+    float beat;
+    float end;
+    bool removed;
+};
+
+class SweepNoteSorter
+{
+public:
     
-    for (int i = 0; i < selection.getNumSelected(); ++i)
+    // by key, then by beat, and the longest note goes first among the ones starting together
+    static int compareElements(const SweepNote &first, const SweepNote &second)
     {
-        NoteComponent *nc = static_cast<NoteComponent *>(selection.getSelectedItem(i));
+        if (first.key != second.key)
+        { return (first.key > second.key) - (first.key < second.key); }
         
-        const float minSnap = 0.1f;
-        const float startBeat = nc->getBeat();
-        const float startBeatSnap = snappedBeat(startBeat, minSnap);
+        if (first.beat != second.beat)
+        { return (first.beat > second.beat) - (first.beat < second.beat); }
         
-        const float endBeat = nc->getBeat() + nc->getLength();
-        const float endBeatSnap = snappedBeat(endBeat, minSnap);
-        const float lengthSnap = endBeatSnap - startBeatSnap;
+        if (first.end != second.end)
+        { return (first.end < second.end) - (first.end > second.end); }
         
-        if (startBeat != startBeatSnap ||
-            endBeat != endBeatSnap)
-        {
-            //Logger::writeToLog("snap");
-            group0Before.add(nc->getNote());
-            group0After.add(nc->getNote().withBeat(startBeatSnap).withLength(lengthSnap));
-        }
+        return MidiEvent::compareIds(first.note->getID(), second.note->getID());
     }
+};
+
+static void sortNotes(const Array<Note> &notes, Array<SweepNote> &outNotes, float minSnap)
+{
+    outNotes.ensureStorageAllocated(notes.size());
     
-    applyPianoChanges(group0Before, group0After, didCheckpoint, shouldCheckpoint);
-    
-    
-    // 1 convert this
-    //    ----
-    // ------------
-    // into this
-    //    ---------
-    // ------------
-    
-    // todo repeat while does any changes
-    
-    bool step1HasChanges = false;
-    
-    do
+    for (const auto &note : notes)
     {
-        PianoChangeGroup group1Before, group1After;
+        SweepNote sweepNote = { &note, note.getKey(), note.getBeat(), note.getBeat() + note.getLength(), false };
         
-        for (int i = 0; i < selection.getNumSelected(); ++i)
+        if (minSnap > 0.f)
         {
-            NoteComponent *nc = static_cast<NoteComponent *>(selection.getSelectedItem(i));
-            
-            // для каждой ноты найти ноту, которая полностью перекрывает ее на максимальную длину
-            
-            float deltaBeats = -FLT_MAX;
-            const Note *overlappingNote = nullptr;
-            
-            for (int j = 0; j < selection.getNumSelected(); ++j)
-            {
-                NoteComponent *nc2 = static_cast<NoteComponent *>(selection.getSelectedItem(j));
-                
-                if (nc->getKey() == nc2->getKey() &&
-                    nc->getBeat() > nc2->getBeat() &&
-                    (nc->getBeat() + nc->getLength()) < (nc2->getBeat() + nc2->getLength()))
-                {
-                    const float currentDelta = (nc2->getBeat() + nc2->getLength()) - (nc->getBeat() + nc->getLength());
-                    
-                    if (deltaBeats < currentDelta)
-                    {
-                        deltaBeats = currentDelta;
-                        overlappingNote = &nc2->getNote();
-                    }
-                }
-            }
-            
-            if (overlappingNote != nullptr)
-            {
-                //Logger::writeToLog("edit1");
-                const float newLength = nc->getLength() + deltaBeats;
-                group1Before.add(nc->getNote());
-                group1After.add(nc->getNote().withLength(newLength));
-            }
+            // the same as note.withBeat(startBeatSnap).withLength(lengthSnap)
+            const float startBeatSnap = snappedBeat(sweepNote.beat, minSnap);
+            const float endBeatSnap = snappedBeat(sweepNote.end, minSnap);
+            sweepNote.beat = Note::roundBeat(startBeatSnap);
+            sweepNote.end = sweepNote.beat + jmax(Note::minLength, Note::roundBeat(endBeatSnap - startBeatSnap));
         }
         
-        step1HasChanges = applyPianoChanges(group1Before, group1After, didCheckpoint, shouldCheckpoint);
+        outNotes.add(sweepNote);
     }
-    while (step1HasChanges);
-    
     
-    // 1 convert this
-    //    -------------
-    // ------------
-    // into this
-    //    -------------
-    // ----------------
-    
-    bool step2HasChanges = false;
+    SweepNoteSorter sorter;
+    outNotes.sort(sorter);
+}
 
-    do
+static void collectSweepResults(const Array<SweepNote> &notes,
+                                PianoChangeGroup &groupBefore,
+                                PianoChangeGroup &groupAfter,
+                                PianoChangeGroup &removalGroup)
+{
+    for (const auto &sweepNote : notes)
     {
-        step2HasChanges = false;
-        PianoChangeGroup group2Before, group2After;
+        const Note &note = *sweepNote.note;
         
-        for (int i = 0; i < selection.getNumSelected(); ++i)
+        if (sweepNote.removed)
         {
-            NoteComponent *nc = static_cast<NoteComponent *>(selection.getSelectedItem(i));
-            
-            // для каждой ноты найти ноту, которая полностью перекрывает ее на максимальную длину
-            
-            float deltaBeats = -FLT_MAX;
-            const NoteComponent *overlappingNote = nullptr;
-            
-            for (int j = 0; j < selection.getNumSelected(); ++j)
-            {
-                NoteComponent *nc2 = static_cast<NoteComponent *>(selection.getSelectedItem(j));
-                
-                if (nc->getKey() == nc2->getKey() &&
-                    nc->getBeat() > nc2->getBeat() &&
-                    nc->getBeat() < (nc2->getBeat() + nc2->getLength()) &&
-                    (nc->getBeat() + nc->getLength()) > (nc2->getBeat() + nc2->getLength()))
-                {
-                    const float currentDelta = (nc->getBeat() + nc->getLength()) - (nc2->getBeat() + nc2->getLength());
-                    
-                    if (deltaBeats < currentDelta)
-                    {
-                        deltaBeats = currentDelta;
-                        overlappingNote = nc2;
-                    }
-                }
-            }
-            
-            if (overlappingNote != nullptr)
-            {
-                //Logger::writeToLog("edit2");
-                group2Before.add(overlappingNote->getNote());
-                group2After.add(overlappingNote->getNote().withDeltaLength(deltaBeats));
-            }
+            removalGroup.add(note);
+            continue;
         }
         
-        step2HasChanges = applyPianoChanges(group2Before, group2After, didCheckpoint, shouldCheckpoint);
+        const float length = sweepNote.end - sweepNote.beat;
+        
+        if (sweepNote.beat != note.getBeat() || length != note.getLength())
+        {
+            groupBefore.add(note);
+            groupAfter.add(note.withParameters(note.getKey(), sweepNote.beat, length, note.getVelocity()));
+        }
     }
-    while (step2HasChanges);
-    
+}
+
+static Array<Note> getSelectedNotes(const MidiEventSelection &selection)
+{
+    Array<Note> notes;
+    notes.ensureStorageAllocated(selection.getNumSelected());
     
-    // 3 convert this
-    // ------------    ------------
-    //    ---------       ---------
-    // into this
-    // ---             ---
-    //    ---------       ---------
+    for (int i = 0; i < selection.getNumSelected(); ++i)
+    {
+        const NoteComponent *nc = static_cast<NoteComponent *>(selection.getSelectedItem(i));
+        notes.add(nc->getNote());
+    }
     
-    bool step3HasChanges = false;
+    return notes;
+}
 
-    do
+void MidiRollToolbox::findOverlaps(const Array<Note> &notes,
+                                   Array<Note> &groupBefore,
+                                   Array<Note> &groupAfter,
+                                   Array<Note> &removalGroup)
+{
+    // snapped to 0.1 beat first, as the overlaps are hard to see otherwise
+    Array<SweepNote> sortedNotes;
+    sortNotes(notes, sortedNotes, 0.1f);
+    
+    // This one cuts each note where the next one on its key starts,
+    // and the next one lasts until the longest of them ends:
+    //
+    //    ----                          ---------
+    // ------------   turns into     ---
+    //
+    //    -------------                 -------------
+    // ------------   turns into     ---
+    //
+    // a note is never cut shorter than the minimum length, so it might still
+    // overlap the next one a bit; of the notes starting on the same beat,
+    // only the longest one is left
+    
+    int lastKeptIndex = -1;
+    
+    for (int i = 0; i < sortedNotes.size(); ++i)
     {
-        step3HasChanges = false;
-        PianoChangeGroup group3Before, group3After;
+        SweepNote &note = sortedNotes.getReference(i);
         
-        for (int i = 0; i < selection.getNumSelected(); ++i)
+        if (lastKeptIndex < 0 || sortedNotes.getReference(lastKeptIndex).key != note.key)
         {
-            NoteComponent *nc = static_cast<NoteComponent *>(selection.getSelectedItem(i));
-            
-            // для каждой ноты найти ноту, которая перекрывает ее максимально
-            
-            float overlappingBeats = -FLT_MAX;
-            const NoteComponent *overlappingNote = nullptr;
-            
-            for (int j = 0; j < selection.getNumSelected(); ++j)
-            {
-                NoteComponent *nc2 = static_cast<NoteComponent *>(selection.getSelectedItem(j));
-                
-                if (nc->getKey() == nc2->getKey() &&
-                    nc->getBeat() < nc2->getBeat() &&
-                    (nc->getBeat() + nc->getLength()) >= (nc2->getBeat() + nc2->getLength()))
-                {
-                    // >0 : has overlap
-                    const float overlapsWith = (nc->getBeat() + nc->getLength()) - nc2->getBeat();
-                    
-                    if (overlapsWith > overlappingBeats)
-                    {
-                        overlappingBeats = overlapsWith;
-                        overlappingNote = nc2;
-                    }
-                }
-            }
-            
-            if (overlappingNote != nullptr)
-            {
-                const float newLength = nc->getLength() - overlappingBeats;
-                //Logger::writeToLog("edit3 " + String(nc->getNote().getLength()) + ":" + String(newLength));
-                group3Before.add(nc->getNote());
-                group3After.add(nc->getNote().withLength(newLength));
-            }
+            lastKeptIndex = i;
+            continue;
+        }
+        
+        SweepNote &lastKept = sortedNotes.getReference(lastKeptIndex);
+        
+        if (note.beat == lastKept.beat)
+        {
+            note.removed = true;
+            continue;
+        }
+        
+        if (note.beat < lastKept.end)
+        {
+            note.end = jmax(note.end, lastKept.end);
+            lastKept.end = lastKept.beat + jmax(Note::minLength, note.beat - lastKept.beat);
         }
         
-        step3HasChanges = applyPianoChanges(group3Before, group3After, didCheckpoint, shouldCheckpoint);
+        lastKeptIndex = i;
     }
-    while (step3HasChanges);
     
+    collectSweepResults(sortedNotes, groupBefore, groupAfter, removalGroup);
+}
+
+void MidiRollToolbox::findDuplicates(const Array<Note> &notes, Array<Note> &removalGroup)
+{
+    Array<SweepNote> sortedNotes;
+    sortNotes(notes, sortedNotes, 0.f);
     
-    // remove duplicates
+    // A note is removed if it covers some other note, i.e. that one starts
+    // no earlier and ends no later; so the shortest of the nested notes is left,
+    // and one of the exact copies. All the notes after it in the sorted order
+    // start no earlier, so it is enough to know the nearest end of them
     
-    HashMap<MidiEvent::Id, Note> deferredRemoval;
-    HashMap<MidiEvent::Id, Note> unremovableNotes;
+    float nearestEnd = FLT_MAX;
     
-    for (int i = 0; i < selection.getNumSelected(); ++i)
+    for (int i = sortedNotes.size(); --i >= 0;)
     {
-        NoteComponent *nc = static_cast<NoteComponent *>(selection.getSelectedItem(i));
+        SweepNote &note = sortedNotes.getReference(i);
         
-        for (int j = 0; j < selection.getNumSelected(); ++j)
+        if (i == sortedNotes.size() - 1 || sortedNotes.getReference(i + 1).key != note.key)
         {
-            if (i == j)
-            {
-                continue;
-            }
-            
-            NoteComponent *nc2 = static_cast<NoteComponent *>(selection.getSelectedItem(j));
-            
-            // full overlap
-            //const bool isOverlappingNote = (nc->getKey() == nc2->getKey() &&
-            //                                nc->getBeat() >= nc2->getBeat() &&
-            //                                (nc->getBeat() + nc->getLength()) <= (nc2->getBeat() + nc2->getLength()));
-
-            // partial overlaps also
-            const bool isOverlappingNote = (nc->getKey() == nc2->getKey() &&
-                                            nc->getBeat() >= nc2->getBeat() &&
-                                            nc->getBeat() < (nc2->getBeat() + nc2->getLength()));
-            
-            const bool startsFromTheSameBeat = (nc->getKey() == nc2->getKey() &&
-                                                nc->getBeat() == nc2->getBeat());
-            
-            const bool isOriginalNote = unremovableNotes.contains(nc2->getNote().getID());
-            
-            if (! isOriginalNote &&
-                (isOverlappingNote || startsFromTheSameBeat))
-            {
-                unremovableNotes.set(nc->getNote().getID(), nc->getNote());
-                deferredRemoval.set(nc2->getNote().getID(), nc2->getNote());
-            }
+            nearestEnd = FLT_MAX;
         }
+        
+        // the ones starting on the same beat are sorted longest first,
+        // so the longer of them gets here as well
+        if (note.end >= nearestEnd)
+        {
+            note.removed = true;
+        }
+        
+        nearestEnd = jmin(nearestEnd, note.end);
     }
     
-    PianoChangeGroup removalGroup;
-    HashMap<MidiEvent::Id, Note>::Iterator deferredRemovalIterator(deferredRemoval);
-    while (deferredRemovalIterator.next())
+    PianoChangeGroup groupBefore, groupAfter;
+    collectSweepResults(sortedNotes, groupBefore, groupAfter, removalGroup);
+}
+
+void MidiRollToolbox::removeOverlaps(MidiEventSelection &selection, bool shouldCheckpoint)
+{
+    if (selection.getNumSelected() == 0)
     {
-        removalGroup.add(deferredRemovalIterator.getValue());
+        return;
     }
-
+    
+    bool didCheckpoint = false;
+    
+    PianoChangeGroup groupBefore, groupAfter, removalGroup;
+    findOverlaps(getSelectedNotes(selection), groupBefore, groupAfter, removalGroup);
+    
+    applyPianoChanges(groupBefore, groupAfter, didCheckpoint, shouldCheckpoint);
     applyPianoRemovals(removalGroup, didCheckpoint, shouldCheckpoint);
 }
 
@@ -945,54 +862,14 @@ void MidiRollToolbox::removeDuplicates(MidiEventSelection &selection, bool shoul
     if (selection.getNumSelected() == 0)
     { return; }
     
-    HashMap<MidiEvent::Id, Note> deferredRemoval;
-    HashMap<MidiEvent::Id, Note> unremovableNotes;
-    
     bool didCheckpoint = false;
-
-    for (int i = 0; i < selection.getNumSelected(); ++i)
-    {
-        NoteComponent *nc = static_cast<NoteComponent *>(selection.getSelectedItem(i));
-        
-        for (int j = 0; j < selection.getNumSelected(); ++j)
-        {
-            if (i == j)
-            {
-                continue;
-            }
-            
-            NoteComponent *nc2 = static_cast<NoteComponent *>(selection.getSelectedItem(j));
-            
-            // full overlap
-            const bool isOverlappingNote = (nc->getKey() == nc2->getKey() &&
-                                            nc->getBeat() >= nc2->getBeat() &&
-                                            (nc->getBeat() + nc->getLength()) <= (nc2->getBeat() + nc2->getLength()));
-
-            const bool startsFromTheSameBeat = (nc->getKey() == nc2->getKey() &&
-                                                nc->getBeat() == nc2->getBeat());
-            
-            const bool isOriginalNote = unremovableNotes.contains(nc2->getNote().getID());
-
-            if (! isOriginalNote &&
-                (isOverlappingNote || startsFromTheSameBeat))
-            {
-                unremovableNotes.set(nc->getNote().getID(), nc->getNote());
-                deferredRemoval.set(nc2->getNote().getID(), nc2->getNote());
-            }
-        }
-    }
     
     PianoChangeGroup removalGroup;
-    HashMap<MidiEvent::Id, Note>::Iterator deferredRemovalIterator(deferredRemoval);
-    while (deferredRemovalIterator.next())
-    {
-        removalGroup.add(deferredRemovalIterator.getValue());
-    }
+    findDuplicates(getSelectedNotes(selection), removalGroup);
     
     applyPianoRemovals(removalGroup, didCheckpoint, shouldCheckpoint);
 }
 
-
 void MidiRollToolbox::moveToLayer(MidiEventSelection &selection, MidiLayer *layer, bool shouldCheckpoint)
 {
     if (selection.getNumSelected() == 0)
@@ -1337,22 +1214,21 @@ void MidiRollToolbox::randomizeVolume(MidiEventSelection &selection, float facto
     bool didCheckpoint = false;
     Random random(Time::currentTimeMillis());
 
-    PianoChangeGroup groupBefore, groupAfter;
+    NoteColumns columns;
+    columns.ensureStorageAllocated(selection.getNumSelected());
     
     for (int i = 0; i < selection.getNumSelected(); ++i)
     {
         if (NoteComponent *nc = dynamic_cast<NoteComponent *>(selection.getSelectedItem(i)))
         {
-            const float r = ((random.nextFloat() * 2.f) - 1.f) * factor; // (-1 .. 1) * factor
-            const float v = nc->getNote().getVelocity();
-            const float deltaV = (r < 0) ? (v * r) : ((1.f - v) * r);
-            const float newVelocity = nc->getNote().getVelocity() + deltaV;
-            
-            groupBefore.add(nc->getNote());
-            groupAfter.add(nc->getNote().withVelocity(newVelocity));
+            columns.add(nc->getNote());
         }
     }
     
+    columns.randomizeVelocities(random, factor);
+    
+    PianoChangeGroup groupBefore, groupAfter;
+    columns.getChanges(groupBefore, groupAfter);
     applyPianoChanges(groupBefore, groupAfter, didCheckpoint, shouldCheckpoint);
 }
 
@@ -1366,41 +1242,23 @@ void MidiRollToolbox::fadeOutVolume(MidiEventSelection &selection, float factor,
         return;
     }
     
-    float minBeat = FLT_MAX;
-    float maxBeat = -FLT_MAX;
     bool didCheckpoint = false;
-    PianoChangeGroup groupBefore, groupAfter;
-    
-    for (int i = 0; i < selection.getNumSelected(); ++i)
-    {
-        if (NoteComponent *nc = dynamic_cast<NoteComponent *>(selection.getSelectedItem(i)))
-        {
-            minBeat = jmin(minBeat, nc->getBeat());
-            maxBeat = jmax(maxBeat, nc->getBeat());
-        }
-    }
     
-    const float selectionBeatLength = maxBeat - minBeat;
-    
-    if (selectionBeatLength <= 0)
-    {
-        return;
-    }
+    NoteColumns columns;
+    columns.ensureStorageAllocated(selection.getNumSelected());
     
     for (int i = 0; i < selection.getNumSelected(); ++i)
     {
         if (NoteComponent *nc = dynamic_cast<NoteComponent *>(selection.getSelectedItem(i)))
         {
-            const float localBeat = nc->getBeat() - minBeat;
-            const float localX = (localBeat / selectionBeatLength) + 0.0001f; // not 0
-            const float velocityMultiplier = 1.f - ((localX / sqrtf(localX)) * factor);
-            const float newVelocity = nc->getNote().getVelocity() * velocityMultiplier;
-            
-            groupBefore.add(nc->getNote());
-            groupAfter.add(nc->getNote().withVelocity(newVelocity));
+            columns.add(nc->getNote());
         }
     }
     
+    columns.fadeOutVelocities(factor);
+    
+    PianoChangeGroup groupBefore, groupAfter;
+    columns.getChanges(groupBefore, groupAfter);
     applyPianoChanges(groupBefore, groupAfter, didCheckpoint, shouldCheckpoint);
 }
 
@@ -1432,15 +1290,19 @@ void MidiRollToolbox::changeVolumeLinear(MidiEventSelection &selection, float vo
         PianoLayer *pianoLayer = static_cast<PianoLayer *>(midiLayer);
         jassert(pianoLayer);
 
-        PianoChangeGroup groupBefore, groupAfter;
+        NoteColumns columns;
+        columns.ensureStorageAllocated(layerSelection->size());
 
         for (int i = 0; i < layerSelection->size(); ++i)
         {
             NoteComponent *nc = static_cast<NoteComponent *>(layerSelection->getUnchecked(i));
-            groupBefore.add(nc->getNote());
-            groupAfter.add(nc->continueTuningLinear(volumeDelta));
+            columns.add(nc->getNote(), nc->anchor.getVelocity());
         }
         
+        columns.addToVelocities(-volumeDelta);
+        
+        PianoChangeGroup groupBefore, groupAfter;
+        columns.getChanges(groupBefore, groupAfter);
         pianoLayer->changeGroup(groupBefore, groupAfter, true);
     }
 }
@@ -1461,23 +1323,22 @@ void MidiRollToolbox::changeVolumeMultiplied(MidiEventSelection &selection, floa
         PianoLayer *pianoLayer = static_cast<PianoLayer *>(midiLayer);
         jassert(pianoLayer);
 
-        PianoChangeGroup groupBefore, groupAfter;
-        
-        //const double t1 = Time::getMillisecondCounterHiRes();
+        NoteColumns columns;
+        columns.ensureStorageAllocated(layerSelection->size());
         
         for (int i = 0; i < layerSelection->size(); ++i)
         {
             NoteComponent *nc = static_cast<NoteComponent *>(layerSelection->getUnchecked(i));
-            groupBefore.add(nc->getNote());
-            groupAfter.add(nc->continueTuningMultiplied(volumeFactor));
+            columns.add(nc->getNote(), nc->anchor.getVelocity());
         }
         
-        pianoLayer->changeGroup(groupBefore, groupAfter, true);
+        // -1 .. 0   ->   0 .. anchor
+        // 0 .. 1    ->   anchor .. 3 * anchor
+        columns.scaleVelocities((volumeFactor < 0) ? (volumeFactor + 1.f) : (1.f + volumeFactor * 2.f));
         
-        //const double t2 = Time::getMillisecondCounterHiRes();
-        //const double t3 = t2 - t1;
-        
-        //Logger::writeToLog(String(t3));
+        PianoChangeGroup groupBefore, groupAfter;
+        columns.getChanges(groupBefore, groupAfter);
+        pianoLayer->changeGroup(groupBefore, groupAfter, true);
     }
 }
 
@@ -1508,16 +1369,19 @@ void MidiRollToolbox::changeVolumeSine(MidiEventSelection &selection, float volu
         PianoLayer *pianoLayer = static_cast<PianoLayer *>(midiLayer);
         jassert(pianoLayer);
         
-        PianoChangeGroup groupBefore, groupAfter;
+        NoteColumns columns;
+        columns.ensureStorageAllocated(layerSelection->size());
         
         for (int i = 0; i < layerSelection->size(); ++i)
         {
             NoteComponent *nc = static_cast<NoteComponent *>(layerSelection->getUnchecked(i));
-            const float phase = ((nc->getBeat() - startBeat) / (endBeat - startBeat)) * M_PI * 2.f * numSines;
-            groupBefore.add(nc->getNote());
-            groupAfter.add(nc->continueTuningSine(volumeFactor, midline, phase));
+            columns.add(nc->getNote(), nc->anchor.getVelocity());
         }
         
+        columns.blendVelocitiesWithSine(volumeFactor, midline, startBeat, endBeat, numSines);
+        
+        PianoChangeGroup groupBefore, groupAfter;
+        columns.getChanges(groupBefore, groupAfter);
         pianoLayer->changeGroup(groupBefore, groupAfter, true);
     }
 }
@@ -1583,17 +1447,23 @@ void MidiRollToolbox::shiftKeyRelative(MidiEventSelection &selection, int deltaK
         jassert(pianoLayer);
 
         const int numSelected = layerSelection->size();
-        PianoChangeGroup groupBefore, groupAfter;
+        NoteColumns columns;
+        columns.ensureStorageAllocated(numSelected);
         
         for (int i = 0; i < numSelected; ++i)
         {
             NoteComponent *nc = static_cast<NoteComponent *>(layerSelection->getUnchecked(i));
-            groupBefore.add(nc->getNote());
-            
-            Note newNote(nc->getNote().withDeltaKey(deltaKey));
-            groupAfter.add(newNote);
-            
-            if (numSelected < 8)
+            columns.add(nc->getNote());
+        }
+        
+        columns.transpose(deltaKey);
+        
+        PianoChangeGroup groupBefore, groupAfter;
+        columns.getChanges(groupBefore, groupAfter);
+        
+        if (numSelected < 8)
+        {
+            for (const auto &newNote : groupAfter)
             {
                 pianoLayer->sendMidiMessage(MidiMessage::noteOn(pianoLayer->getChannel(), newNote.getKey(), newNote.getVelocity()));
             }
@@ -1634,17 +1504,20 @@ void MidiRollToolbox::shiftBeatRelative(MidiEventSelection &selection, float del
         jassert(pianoLayer);
 
         const int numSelected = layerSelection->size();
-        PianoChangeGroup groupBefore, groupAfter;
+        NoteColumns columns;
+        columns.ensureStorageAllocated(numSelected);
         
         for (int i = 0; i < numSelected; ++i)
         {
             NoteComponent *nc = static_cast<NoteComponent *>(layerSelection->getUnchecked(i));
-            groupBefore.add(nc->getNote());
-            
-            Note newNote(nc->getNote().withDeltaBeat(deltaBeat));
-            groupAfter.add(newNote);
+            columns.add(nc->getNote());
         }
         
+        columns.shiftBeats(deltaBeat);
+        
+        PianoChangeGroup groupBefore, groupAfter;
+        columns.getChanges(groupBefore, groupAfter);
+        
         if (groupBefore.size() > 0)
         {
             if (! didCheckpoint)
@@ -52,6 +52,13 @@ public:
     static void removeOverlaps(MidiEventSelection &selection, bool shouldCheckpoint = true);
     static void removeDuplicates(MidiEventSelection &selection, bool shouldCheckpoint = true);
     
+    // The changes which removeOverlaps and removeDuplicates make to these notes
+    static void findOverlaps(const Array<Note> &notes,
+                             Array<Note> &groupBefore,
+                             Array<Note> &groupAfter,
+                             Array<Note> &removalGroup);
+    static void findDuplicates(const Array<Note> &notes, Array<Note> &removalGroup);
+    
     static void moveToLayer(MidiEventSelection &selection, MidiLayer *layer, bool shouldCheckpoint = true);
     
     static bool arpeggiateUsingClipboardAsPattern(MidiEventSelection &selection, bool shouldCheckpoint = true);
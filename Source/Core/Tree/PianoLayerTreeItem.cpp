@@ -330,8 +330,12 @@ void PianoLayerTreeItem::resetEventsDelta(const XmlElement *state)
     this->reset();
     this->getLayer()->reset();
 
+    Array<Note> notes;
+
     forEachXmlChildElementWithTagName(*state, e, Serialization::Core::note)
     {
-        this->getLayer()->silentImport(Note(this->getLayer()).withParameters(*e));
+        notes.add(Note(this->getLayer()).withParameters(*e));
     }
+
+    static_cast<PianoLayer *>(this->getLayer())->silentImportGroup(notes);
 }
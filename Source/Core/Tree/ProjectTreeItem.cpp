@@ -41,6 +41,7 @@
 #include "ProjectInfo.h"
 #include "ProjectAnnotations.h"
 #include "DataEncoder.h"
+#include "MidiFileWriter.h"
 
 #include "TrackedItem.h"
 #include "VersionControlTreeItem.h"
@@ -684,15 +685,20 @@ void ProjectTreeItem::importMidi(File &file)
     // ‚‡ÊÌÓ.
     //tempFile.convertTimestampTicksToSeconds();
     
+    Array<PianoLayer *> layers;
+    Array<const MidiMessageSequence *> tracks;
+    
     for (int trackNum = 0; trackNum < tempFile.getNumTracks(); trackNum++)
     {
-        const MidiMessageSequence *currentTrack = tempFile.getTrack(trackNum);
         const String trackName = "Track " + String(trackNum);
         LayerTreeItem *layer = new PianoLayerTreeItem(trackName);
         this->addChildTreeItem(layer);
-        layer->importMidi(*currentTrack);
+        layers.add(static_cast<PianoLayer *>(layer->getLayer()));
+        tracks.add(tempFile.getTrack(trackNum));
     }
     
+    PianoLayer::importMidiTracks(layers, tracks);
+    
     this->broadcastBeatRangeChanged();
     this->getDocument()->save();
 }
@@ -726,6 +732,7 @@ void ProjectTreeItem::removeAllListeners()
 
 void ProjectTreeItem::broadcastEventChanged(const MidiEvent &oldEvent, const MidiEvent &newEvent)
 {
+    this->markVcsItemChanged(newEvent.getLayer());
     //if (this->changeListeners.size() == 0) { return; }
     this->changeListeners.call(&ProjectListener::onEventChanged, oldEvent, newEvent);
     this->sendChangeMessage();
@@ -733,24 +740,28 @@ void ProjectTreeItem::broadcastEventChanged(const MidiEvent &oldEvent, const Mid
 
 void ProjectTreeItem::broadcastEventAdded(const MidiEvent &event)
 {
+    this->markVcsItemChanged(event.getLayer());
     this->changeListeners.call(&ProjectListener::onEventAdded, event);
     this->sendChangeMessage();
 }
 
 void ProjectTreeItem::broadcastEventRemoved(const MidiEvent &event)
 {
+    this->markVcsItemChanged(event.getLayer());
     this->changeListeners.call(&ProjectListener::onEventRemoved, event);
     this->sendChangeMessage();
 }
 
 void ProjectTreeItem::broadcastEventRemovedPostAction(const MidiLayer *layer)
 {
+    this->markVcsItemChanged(layer);
     this->changeListeners.call(&ProjectListener::onEventRemovedPostAction, layer);
     this->sendChangeMessage();
 }
 
 void ProjectTreeItem::broadcastLayerChanged(const MidiLayer *layer)
 {
+    this->markVcsItemChanged(layer);
     this->changeListeners.call(&ProjectListener::onLayerChanged, layer);
     this->sendChangeMessage();
 }
@@ -773,12 +784,14 @@ void ProjectTreeItem::broadcastLayerRemoved(const MidiLayer *layer)
 
 void ProjectTreeItem::broadcastLayerMoved(const MidiLayer *layer)
 {
+    this->markVcsItemChanged(layer);
     this->changeListeners.call(&ProjectListener::onLayerMoved, layer);
     this->sendChangeMessage();
 }
 
 void ProjectTreeItem::broadcastInfoChanged(const ProjectInfo *info)
 {
+    info->markVCSChanged();
     this->changeListeners.call(&ProjectListener::onInfoChanged, info);
     this->sendChangeMessage();
 }
@@ -836,6 +849,18 @@ void ProjectTreeItem::onDocumentDidLoad(File &file)
 bool ProjectTreeItem::onDocumentSave(File &file)
 {
     ScopedPointer<XmlElement> xml(this->save());
+
+    // projects with long histories are too slow to be saved and loaded as one xml,
+    // but the released builds can't open the chunked files, so it is opt-in for now;
+    // both formats are loaded by loadObfuscated
+    const bool savesChunked =
+        (Config::get(Serialization::Core::chunkedProjectsState) == Serialization::Core::enabledState);
+
+    if (savesChunked)
+    {
+        return DataEncoder::saveChunked(file, xml);
+    }
+
     return DataEncoder::saveObfuscated(file, xml);
 }
 
@@ -860,18 +885,17 @@ bool ProjectTreeItem::onDocumentExport(File &file)
 
 void ProjectTreeItem::exportMidi(File &file) const
 {
-    MidiFile tempFile;
-    tempFile.setTicksPerQuarterNote(Transport::millisecondsPerBeat);
+    MidiFileWriter writer(Transport::millisecondsPerBeat);
     
     const Array<MidiLayer *> &layers = this->getLayersList();
     
     for (auto layer : layers)
     {
-        tempFile.addTrack(layer->exportMidi());
+        writer.addTrack(layer->exportMidi());
     }
     
     ScopedPointer<OutputStream> out(new FileOutputStream(file));
-    tempFile.writeTo(*out);
+    writer.writeTo(*out);
 }
 
 
@@ -975,6 +999,19 @@ void ProjectTreeItem::unregisterVcsItem(const MidiLayer *layer)
     }
 }
 
+void ProjectTreeItem::markVcsItemChanged(const MidiLayer *layer)
+{
+    if (layer == nullptr)
+    {
+        return;
+    }
+    
+    if (const VCS::TrackedItem *item = dynamic_cast<const VCS::TrackedItem *>(layer->getOwner()))
+    {
+        item->markVCSChanged();
+    }
+}
+
 void ProjectTreeItem::rebuildLayersHashIfNeeded()
 {
     if (this->isLayersHashOutdated)
@@ -309,6 +309,7 @@ private:
 
     void registerVcsItem(const MidiLayer *layer);
     void unregisterVcsItem(const MidiLayer *layer);
+    void markVcsItemChanged(const MidiLayer *layer);
 
     ReadWriteLock vcsInfoLock;
     Array<const VCS::TrackedItem *> vcsItems;
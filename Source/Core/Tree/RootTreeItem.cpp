@@ -29,6 +29,7 @@
 #include "DataEncoder.h"
 #include "Icons.h"
 #include "MidiLayer.h"
+#include "PianoLayer.h"
 #include "AutomationEvent.h"
 #include "RecentFilesList.h"
 #include "ProjectInfo.h"
@@ -108,14 +109,19 @@ void RootTreeItem::importMidi(File &file)
     this->addChildTreeItem(project);
     this->addVCS(project);
 
+    Array<PianoLayer *> layers;
+    Array<const MidiMessageSequence *> tracks;
+
     for (int trackNum = 0; trackNum < tempFile.getNumTracks(); trackNum++)
     {
-        const MidiMessageSequence *currentTrack = tempFile.getTrack(trackNum);
         String trackName = "Track " + String(trackNum);
         LayerTreeItem *layer = this->addPianoLayer(project, trackName);
-        layer->importMidi(*currentTrack);
+        layers.add(static_cast<PianoLayer *>(layer->getLayer()));
+        tracks.add(tempFile.getTrack(trackNum));
     }
 
+    PianoLayer::importMidiTracks(layers, tracks);
+
     //this->addAutoLayer(project, "Tempo", 81);
 
     // todo сохранить по умолчанию рядом - или куда?
@@ -56,11 +56,6 @@ bool AnnotationEventInsertAction::undo()
     return false;
 }
 
-int AnnotationEventInsertAction::getSizeInUnits()
-{
-    return sizeof(AnnotationEvent);
-}
-
 XmlElement *AnnotationEventInsertAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::annotationEventInsertAction);
@@ -116,11 +111,6 @@ bool AnnotationEventRemoveAction::undo()
     return false;
 }
 
-int AnnotationEventRemoveAction::getSizeInUnits()
-{
-    return sizeof(AnnotationEvent);
-}
-
 XmlElement *AnnotationEventRemoveAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::annotationEventRemoveAction);
@@ -178,11 +168,6 @@ bool AnnotationEventChangeAction::undo()
     return false;
 }
 
-int AnnotationEventChangeAction::getSizeInUnits()
-{
-    return sizeof(AnnotationEvent) * 2;
-}
-
 UndoAction *AnnotationEventChangeAction::createCoalescedAction(UndoAction *nextAction)
 {
     if (AnnotationsLayer *layer = this->project.getLayerWithId<AnnotationsLayer>(this->layerId))
@@ -274,11 +259,6 @@ bool AnnotationEventsGroupInsertAction::undo()
     return false;
 }
 
-int AnnotationEventsGroupInsertAction::getSizeInUnits()
-{
-    return (sizeof(AnnotationEvent) * this->annotations.size());
-}
-
 XmlElement *AnnotationEventsGroupInsertAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::annotationEventsGroupInsertAction);
@@ -346,11 +326,6 @@ bool AnnotationEventsGroupRemoveAction::undo()
     return false;
 }
 
-int AnnotationEventsGroupRemoveAction::getSizeInUnits()
-{
-    return (sizeof(AnnotationEvent) * this->annotations.size());
-}
-
 XmlElement *AnnotationEventsGroupRemoveAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::annotationEventsGroupRemoveAction);
@@ -420,12 +395,6 @@ bool AnnotationEventsGroupChangeAction::undo()
     return false;
 }
 
-int AnnotationEventsGroupChangeAction::getSizeInUnits()
-{
-    return (sizeof(AnnotationEvent) * this->eventsBefore.size()) +
-           (sizeof(AnnotationEvent) * this->eventsAfter.size());
-}
-
 UndoAction *AnnotationEventsGroupChangeAction::createCoalescedAction(UndoAction *nextAction)
 {
     if (AnnotationsLayer *layer = this->project.getLayerWithId<AnnotationsLayer>(this->layerId))
@@ -63,11 +63,6 @@ bool AutoLayerTreeItemInsertAction::undo()
     return false;
 }
 
-int AutoLayerTreeItemInsertAction::getSizeInUnits()
-{
-    return this->xPath.length();
-}
-
 XmlElement *AutoLayerTreeItemInsertAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::autoLayerTreeItemInsertAction);
@@ -99,8 +94,7 @@ void AutoLayerTreeItemInsertAction::reset()
 AutoLayerTreeItemRemoveAction::AutoLayerTreeItemRemoveAction(ProjectTreeItem &parentProject,
                                                              String targetLayerId) :
     UndoAction(parentProject),
-    layerId(std::move(targetLayerId)),
-    numEvents(0)
+    layerId(std::move(targetLayerId))
 {
 }
 
@@ -109,7 +103,6 @@ bool AutoLayerTreeItemRemoveAction::perform()
     if (AutomationLayerTreeItem *treeItem =
         this->project.findChildByLayerId<AutomationLayerTreeItem>(this->layerId))
     {
-        this->numEvents = treeItem->getLayer()->size();
         this->serializedTreeItem = treeItem->serialize();
         this->xPath = treeItem->getXPath();
         return TreeItem::deleteItem(treeItem);
@@ -132,16 +125,6 @@ bool AutoLayerTreeItemRemoveAction::undo()
     return false;
 }
 
-int AutoLayerTreeItemRemoveAction::getSizeInUnits()
-{
-    if (this->serializedTreeItem != nullptr)
-    {
-        return (this->numEvents * sizeof(MidiEvent));
-    }
-    
-    return 1;
-}
-
 XmlElement *AutoLayerTreeItemRemoveAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::autoLayerTreeItemRemoveAction);
@@ -40,7 +40,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -73,7 +72,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
 
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -82,7 +80,6 @@ public:
 private:
 
     String layerId;
-    int numEvents;
     
     ScopedPointer<XmlElement> serializedTreeItem;
     String xPath;
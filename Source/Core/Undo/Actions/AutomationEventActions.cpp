@@ -56,11 +56,6 @@ bool AutomationEventInsertAction::undo()
     return false;
 }
 
-int AutomationEventInsertAction::getSizeInUnits()
-{
-    return sizeof(AutomationEvent);
-}
-
 XmlElement *AutomationEventInsertAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::automationEventInsertAction);
@@ -116,11 +111,6 @@ bool AutomationEventRemoveAction::undo()
     return false;
 }
 
-int AutomationEventRemoveAction::getSizeInUnits()
-{
-    return sizeof(AutomationEvent);
-}
-
 XmlElement *AutomationEventRemoveAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::automationEventRemoveAction);
@@ -178,11 +168,6 @@ bool AutomationEventChangeAction::undo()
     return false;
 }
 
-int AutomationEventChangeAction::getSizeInUnits()
-{
-    return sizeof(AutomationEvent) * 2;
-}
-
 UndoAction *AutomationEventChangeAction::createCoalescedAction(UndoAction *nextAction)
 {
     if (AutomationLayer *layer = this->project.getLayerWithId<AutomationLayer>(this->layerId))
@@ -274,11 +259,6 @@ bool AutomationEventsGroupInsertAction::undo()
     return false;
 }
 
-int AutomationEventsGroupInsertAction::getSizeInUnits()
-{
-    return (sizeof(AutomationEvent) * this->events.size());
-}
-
 XmlElement *AutomationEventsGroupInsertAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::automationEventsGroupInsertAction);
@@ -346,11 +326,6 @@ bool AutomationEventsGroupRemoveAction::undo()
     return false;
 }
 
-int AutomationEventsGroupRemoveAction::getSizeInUnits()
-{
-    return (sizeof(AutomationEvent) * this->events.size());
-}
-
 XmlElement *AutomationEventsGroupRemoveAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::automationEventsGroupRemoveAction);
@@ -420,12 +395,6 @@ bool AutomationEventsGroupChangeAction::undo()
     return false;
 }
 
-int AutomationEventsGroupChangeAction::getSizeInUnits()
-{
-    return (sizeof(AutomationEvent) * this->eventsBefore.size()) +
-           (sizeof(AutomationEvent) * this->eventsAfter.size());
-}
-
 UndoAction *AutomationEventsGroupChangeAction::createCoalescedAction(UndoAction *nextAction)
 {
     if (AutomationLayer *layer = this->project.getLayerWithId<AutomationLayer>(this->layerId))
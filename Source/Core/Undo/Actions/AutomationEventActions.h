@@ -41,7 +41,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -73,7 +72,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -106,7 +104,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     UndoAction *createCoalescedAction(UndoAction *nextAction) override;
     
     XmlElement *serialize() const override;
@@ -142,7 +139,6 @@ public:
     
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -175,7 +171,6 @@ public:
     
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -209,7 +204,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     UndoAction *createCoalescedAction(UndoAction *nextAction) override;
     
     XmlElement *serialize() const override;
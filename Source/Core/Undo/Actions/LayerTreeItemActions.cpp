@@ -59,11 +59,6 @@ bool LayerTreeItemRenameAction::undo()
     return false;
 }
 
-int LayerTreeItemRenameAction::getSizeInUnits()
-{
-    return this->xPathBefore.length() + this->xPathAfter.length();
-}
-
 XmlElement *LayerTreeItemRenameAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::layerTreeItemRenameAction);
@@ -38,7 +38,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
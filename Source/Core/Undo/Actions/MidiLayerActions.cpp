@@ -63,11 +63,6 @@ bool MidiLayerChangeColourAction::undo()
     return false;
 }
 
-int MidiLayerChangeColourAction::getSizeInUnits()
-{
-    return sizeof(this->colourBefore) + sizeof(this->colourAfter);
-}
-
 XmlElement *MidiLayerChangeColourAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::midiLayerChangeColourAction);
@@ -128,11 +123,6 @@ bool MidiLayerChangeInstrumentAction::undo()
     return false;
 }
 
-int MidiLayerChangeInstrumentAction::getSizeInUnits()
-{
-    return this->instrumentIdAfter.length() + this->instrumentIdBefore.length();
-}
-
 XmlElement *MidiLayerChangeInstrumentAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::midiLayerChangeInstrumentAction);
@@ -193,11 +183,6 @@ bool MidiLayerMuteAction::undo()
     return false;
 }
 
-int MidiLayerMuteAction::getSizeInUnits()
-{
-    return 1;
-}
-
 String boolToString(bool val)
 {
     return val ? "yes" : "no";
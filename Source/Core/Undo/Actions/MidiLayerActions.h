@@ -38,7 +38,6 @@ public:
     
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -72,7 +71,6 @@ public:
     
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -106,7 +104,6 @@ public:
     
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
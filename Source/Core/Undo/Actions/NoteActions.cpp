@@ -56,11 +56,6 @@ bool NoteInsertAction::undo()
     return false;
 }
 
-int NoteInsertAction::getSizeInUnits()
-{
-    return sizeof(Note);
-}
-
 XmlElement *NoteInsertAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::noteInsertAction);
@@ -116,11 +111,6 @@ bool NoteRemoveAction::undo()
     return false;
 }
 
-int NoteRemoveAction::getSizeInUnits()
-{
-    return sizeof(Note);
-}
-
 XmlElement *NoteRemoveAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::noteRemoveAction);
@@ -178,11 +168,6 @@ bool NoteChangeAction::undo()
     return false;
 }
 
-int NoteChangeAction::getSizeInUnits()
-{
-    return sizeof(Note) * 2;
-}
-
 UndoAction *NoteChangeAction::createCoalescedAction(UndoAction *nextAction)
 {
     if (PianoLayer *layer = this->project.getLayerWithId<PianoLayer>(this->layerId))
@@ -273,11 +258,6 @@ bool NotesGroupInsertAction::undo()
     return false;
 }
 
-int NotesGroupInsertAction::getSizeInUnits()
-{
-    return (sizeof(Note) * this->notes.size());
-}
-
 XmlElement *NotesGroupInsertAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::notesGroupInsertAction);
@@ -345,11 +325,6 @@ bool NotesGroupRemoveAction::undo()
     return false;
 }
 
-int NotesGroupRemoveAction::getSizeInUnits()
-{
-    return (sizeof(Note) * this->notes.size());
-}
-
 XmlElement *NotesGroupRemoveAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::notesGroupRemoveAction);
@@ -393,17 +368,19 @@ NotesGroupChangeAction::NotesGroupChangeAction(ProjectTreeItem &parentProject,
                                                Array<Note> &state1,
                                                Array<Note> &state2) :
     UndoAction(parentProject),
-    layerId(std::move(targetLayerId))
+    layerId(std::move(targetLayerId)),
+    numChanges(0)
 {
-    this->notesBefore.swapWith(state1);
-    this->notesAfter.swapWith(state2);
+    this->packChanges(state1, state2);
 }
 
 bool NotesGroupChangeAction::perform()
 {
     if (PianoLayer *layer = this->project.getLayerWithId<PianoLayer>(this->layerId))
     {
-        return layer->changeGroup(this->notesBefore, this->notesAfter, false);
+        Array<Note> notesBefore, notesAfter;
+        this->unpackChanges(notesBefore, notesAfter);
+        return layer->changeGroup(notesBefore, notesAfter, false);
     }
     
     return false;
@@ -413,17 +390,14 @@ bool NotesGroupChangeAction::undo()
 {
     if (PianoLayer *layer = this->project.getLayerWithId<PianoLayer>(this->layerId))
     {
-        return layer->changeGroup(this->notesAfter, this->notesBefore, false);
+        Array<Note> notesBefore, notesAfter;
+        this->unpackChanges(notesBefore, notesAfter);
+        return layer->changeGroup(notesAfter, notesBefore, false);
     }
     
     return false;
 }
 
-int NotesGroupChangeAction::getSizeInUnits()
-{
-    return (sizeof(Note) * this->notesBefore.size()) + (sizeof(Note) * this->notesAfter.size());
-}
-
 UndoAction *NotesGroupChangeAction::createCoalescedAction(UndoAction *nextAction)
 {
     if (PianoLayer *layer = this->project.getLayerWithId<PianoLayer>(this->layerId))
@@ -435,21 +409,27 @@ UndoAction *NotesGroupChangeAction::createCoalescedAction(UndoAction *nextAction
                 return nullptr;
             }
             
-            if (this->notesBefore.size() != nextChanger->notesAfter.size())
+            if (this->numChanges != nextChanger->numChanges)
             {
                 return nullptr;
             }
             
-            for (int i = 0; i < this->notesBefore.size(); ++i)
+            Array<Note> notesBefore, notesAfter;
+            this->unpackChanges(notesBefore, notesAfter);
+            
+            Array<Note> nextNotesBefore, nextNotesAfter;
+            nextChanger->unpackChanges(nextNotesBefore, nextNotesAfter);
+            
+            for (int i = 0; i < notesBefore.size(); ++i)
             {
-                if (this->notesBefore.getUnchecked(i).getID() != nextChanger->notesAfter.getUnchecked(i).getID())
+                if (notesBefore.getUnchecked(i).getID() != nextNotesAfter.getUnchecked(i).getID())
                 {
                     return nullptr;
                 }
             }
             
             auto newChanger =
-            new NotesGroupChangeAction(this->project, this->layerId, this->notesBefore, nextChanger->notesAfter);
+            new NotesGroupChangeAction(this->project, this->layerId, notesBefore, nextNotesAfter);
             
             return newChanger;
         }
@@ -461,30 +441,80 @@ UndoAction *NotesGroupChangeAction::createCoalescedAction(UndoAction *nextAction
 
 
 //===----------------------------------------------------------------------===//
-// Serializable
+// Packing
 //===----------------------------------------------------------------------===//
 
-XmlElement *NotesGroupChangeAction::serialize() const
+enum ChangedNoteFields
 {
-    auto xml = new XmlElement(Serialization::Undo::notesGroupChangeAction);
-    xml->setAttribute(Serialization::Undo::layerId, this->layerId);
+    keyChanged = 1,
+    beatChanged = 2,
+    lengthChanged = 4,
+    velocityChanged = 8
+};
+
+void NotesGroupChangeAction::packChanges(const Array<Note> &notesBefore, const Array<Note> &notesAfter)
+{
+    jassert(notesBefore.size() == notesAfter.size());
     
-    auto groupBeforeChild = new XmlElement(Serialization::Undo::groupBefore);
-    auto groupAfterChild = new XmlElement(Serialization::Undo::groupAfter);
+    MemoryOutputStream out(this->packedChanges, false);
+    this->numChanges = jmin(notesBefore.size(), notesAfter.size());
     
-    for (int i = 0; i < this->notesBefore.size(); ++i)
+    for (int i = 0; i < this->numChanges; ++i)
     {
-        groupBeforeChild->prependChildElement(this->notesBefore.getUnchecked(i).serialize());
+        const Note &before = notesBefore.getReference(i);
+        const Note &after = notesAfter.getReference(i);
+        
+        const int changedFields =
+            ((before.getKey() != after.getKey()) ? keyChanged : 0) |
+            ((before.getBeat() != after.getBeat()) ? beatChanged : 0) |
+            ((before.getLength() != after.getLength()) ? lengthChanged : 0) |
+            ((before.getVelocity() != after.getVelocity()) ? velocityChanged : 0);
+        
+        before.writeBinary(out);
+        out.writeByte(char(changedFields));
+        
+        if (changedFields & keyChanged)         { out.writeCompressedInt(after.getKey()); }
+        if (changedFields & beatChanged)        { out.writeFloat(after.getBeat()); }
+        if (changedFields & lengthChanged)      { out.writeFloat(after.getLength()); }
+        if (changedFields & velocityChanged)    { out.writeFloat(after.getVelocity()); }
     }
     
-    for (int i = 0; i < this->notesAfter.size(); ++i)
+    out.flush();
+}
+
+void NotesGroupChangeAction::unpackChanges(Array<Note> &notesBefore, Array<Note> &notesAfter) const
+{
+    MemoryInputStream in(this->packedChanges, false);
+    notesBefore.ensureStorageAllocated(this->numChanges);
+    notesAfter.ensureStorageAllocated(this->numChanges);
+    
+    for (int i = 0; i < this->numChanges; ++i)
     {
-        groupAfterChild->prependChildElement(this->notesAfter.getUnchecked(i).serialize());
+        Note before;
+        before.readBinary(in);
+        
+        const int changedFields = in.readByte();
+        const int key = (changedFields & keyChanged) ? in.readCompressedInt() : before.getKey();
+        const float beat = (changedFields & beatChanged) ? in.readFloat() : before.getBeat();
+        const float length = (changedFields & lengthChanged) ? in.readFloat() : before.getLength();
+        const float velocity = (changedFields & velocityChanged) ? in.readFloat() : before.getVelocity();
+        
+        notesBefore.add(before);
+        notesAfter.add(before.withParameters(key, beat, length, velocity));
     }
-    
-    xml->prependChildElement(groupBeforeChild);
-    xml->prependChildElement(groupAfterChild);
-    
+}
+
+
+//===----------------------------------------------------------------------===//
+// Serializable
+//===----------------------------------------------------------------------===//
+
+XmlElement *NotesGroupChangeAction::serialize() const
+{
+    auto xml = new XmlElement(Serialization::Undo::notesGroupChangeAction);
+    xml->setAttribute(Serialization::Undo::layerId, this->layerId);
+    xml->setAttribute(Serialization::Undo::numChanges, this->numChanges);
+    xml->setAttribute(Serialization::Undo::packedChanges, this->packedChanges.toBase64Encoding());
     return xml;
 }
 
@@ -494,27 +524,44 @@ void NotesGroupChangeAction::deserialize(const XmlElement &xml)
     
     this->layerId = xml.getStringAttribute(Serialization::Undo::layerId);
     
+    if (xml.hasAttribute(Serialization::Undo::packedChanges))
+    {
+        this->numChanges = xml.getIntAttribute(Serialization::Undo::numChanges);
+        this->packedChanges.fromBase64Encoding(xml.getStringAttribute(Serialization::Undo::packedChanges));
+        return;
+    }
+    
+    // the older projects store the whole notes
     XmlElement *groupBeforeChild = xml.getChildByName(Serialization::Undo::groupBefore);
     XmlElement *groupAfterChild = xml.getChildByName(Serialization::Undo::groupAfter);
+    
+    if (groupBeforeChild == nullptr || groupAfterChild == nullptr)
+    {
+        return;
+    }
+    
+    Array<Note> notesBefore, notesAfter;
 
     forEachXmlChildElement(*groupBeforeChild, noteXml)
     {
         Note n;
         n.deserialize(*noteXml);
-        this->notesBefore.add(n);
+        notesBefore.add(n);
     }
 
     forEachXmlChildElement(*groupAfterChild, noteXml)
     {
         Note n;
         n.deserialize(*noteXml);
-        this->notesAfter.add(n);
+        notesAfter.add(n);
     }
+    
+    this->packChanges(notesBefore, notesAfter);
 }
 
 void NotesGroupChangeAction::reset()
 {
-    this->notesBefore.clear();
-    this->notesAfter.clear();
+    this->packedChanges.reset();
+    this->numChanges = 0;
     this->layerId.clear();
 }
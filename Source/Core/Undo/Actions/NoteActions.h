@@ -41,7 +41,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -73,7 +72,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -106,7 +104,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     UndoAction *createCoalescedAction(UndoAction *nextAction) override;
     
     XmlElement *serialize() const override;
@@ -142,7 +139,6 @@ public:
     
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -175,7 +171,6 @@ public:
     
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     
     XmlElement *serialize() const override;
     void deserialize(const XmlElement &xml) override;
@@ -200,7 +195,7 @@ class NotesGroupChangeAction : public UndoAction
 public:
     
     explicit NotesGroupChangeAction(ProjectTreeItem &project) :
-    UndoAction(project) {}
+    UndoAction(project), numChanges(0) {}
 
     NotesGroupChangeAction(ProjectTreeItem &project,
                            String layerId,
@@ -209,7 +204,6 @@ public:
 
     bool perform() override;
     bool undo() override;
-    int getSizeInUnits() override;
     UndoAction *createCoalescedAction(UndoAction *nextAction) override;
     
     XmlElement *serialize() const override;
@@ -220,8 +214,13 @@ private:
 
     String layerId;
 
-    Array<Note> notesBefore;
-    Array<Note> notesAfter;
+    // The notes before the change, followed by only the fields that were changed,
+    // since most of the group edits touch just one or two of them
+    MemoryBlock packedChanges;
+    int numChanges;
+
+    void packChanges(const Array<Note> &notesBefore, const Array<Note> &notesAfter);
+    void unpackChanges(Array<Note> &notesBefore, Array<Note> &notesAfter) const;
 
     JUCE_DECLARE_NON_COPYABLE(NotesGroupChangeAction)
 
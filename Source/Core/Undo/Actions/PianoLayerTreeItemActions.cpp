@@ -62,11 +62,6 @@ bool PianoLayerTreeItemInsertAction::undo()
     return false;
 }
 
-int PianoLayerTreeItemInsertAction::getSizeInUnits()
-{
-    return this->xPath.length();
-}
-
 XmlElement *PianoLayerTreeItemInsertAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::pianoLayerTreeItemInsertAction);
@@ -98,8 +93,7 @@ void PianoLayerTreeItemInsertAction::reset()
 PianoLayerTreeItemRemoveAction::PianoLayerTreeItemRemoveAction(ProjectTreeItem &parentProject,
                                                                String targetLayerId) :
     UndoAction(parentProject),
-    layerId(std::move(targetLayerId)),
-    numEvents(0)
+    layerId(std::move(targetLayerId))
 {
 }
 
@@ -107,7 +101,6 @@ bool PianoLayerTreeItemRemoveAction::perform()
 {
     if (PianoLayerTreeItem *treeItem = this->project.findChildByLayerId<PianoLayerTreeItem>(this->layerId))
     {
-        this->numEvents = treeItem->getLayer()->size();
         this->serializedTreeItem = treeItem->serialize();
         this->xPath = treeItem->getXPath();
         return TreeItem::deleteItem(treeItem);
@@ -130,16 +123,6 @@ bool PianoLayerTreeItemRemoveAction::undo()
     return false;
 }
 
-int PianoLayerTreeItemRemoveAction::getSizeInUnits()
-{
-    if (this->serializedTreeItem != nullptr)
-    {
-        return (this->numEvents * sizeof(MidiEvent));
-    }
-    
-    return 1;
-}
-
 XmlElement *PianoLayerTreeItemRemoveAction::serialize() const
 {
     auto xml = new XmlElement(Serialization::Undo::pianoLayerTreeItemRemoveAction);
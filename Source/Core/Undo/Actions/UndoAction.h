@@ -20,12 +20,15 @@
 class ProjectTreeItem;
 
 #include "Serializable.h"
+#include "ChunkedFile.h"
 
 class UndoAction : public Serializable
 {
 public:
 
-    explicit UndoAction(ProjectTreeItem &parentProject) noexcept : project(parentProject) {}
+    explicit UndoAction(ProjectTreeItem &parentProject) noexcept :
+        project(parentProject),
+        sizeInUnits(-1) {}
 
     ~UndoAction() override {}
 
@@ -33,9 +36,18 @@ public:
 
     virtual bool undo() = 0;
 
+    // The size of the action in the binary form the undo history is spilled
+    // and saved in; it is measured once, after the action is first performed,
+    // so that the undo stack always subtracts what it has added
     virtual int getSizeInUnits()
     {
-        return 10;
+        if (this->sizeInUnits < 0)
+        {
+            ScopedPointer<XmlElement> xml(this->serialize());
+            this->sizeInUnits = int(ChunkedFile::encodeElement(*xml).getSize());
+        }
+
+        return this->sizeInUnits;
     }
 
     virtual UndoAction *createCoalescedAction(UndoAction* nextAction)
@@ -48,4 +60,8 @@ protected:
     
     ProjectTreeItem &project;
 
+private:
+
+    int sizeInUnits;
+
 };
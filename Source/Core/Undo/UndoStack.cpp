@@ -19,6 +19,8 @@
 #include "UndoStack.h"
 #include "UndoAction.h"
 #include "SerializationKeys.h"
+#include "ChunkedFile.h"
+#include "FileUtils.h"
 
 #include "ProjectTreeItem.h"
 
@@ -32,12 +34,32 @@
 
 #define MAX_TRANSACTIONS_TO_STORE 10
 
+// The oldest transactions are dropped when the spill file grows larger than that
+#define MAX_BYTES_TO_SPILL (64 * 1024 * 1024)
+
+// The spill file is rewritten when it's mostly holes and bigger than that
+#define MIN_BYTES_TO_COMPACT (1024 * 1024)
+
+//
+// The transactions which don't fit into the memory budget are spilled
+// into a temporary file, in ChunkedFile's compact binary element encoding,
+// and are loaded back when undo or redo reaches them.
+//
+// The ranges freed by the restored or removed transactions are reused
+// by the next spills, the free tail is truncated, and the file is compacted
+// when its holes take more space than the live data, so that the cap
+// is checked against the real file length; the file is removed
+// as soon as nothing is spilled anymore.
+//
 
 struct UndoStack::ActionSet
 {
     ActionSet (ProjectTreeItem &parentProject, String  transactionName) :
+    name(std::move(transactionName)),
     project(parentProject),
-    name(std::move(transactionName))
+    spilled(false),
+    spillOffset(0),
+    spillSize(0)
     {}
     
     bool perform() const
@@ -146,6 +168,11 @@ struct UndoStack::ActionSet
     String name;
     
     ProjectTreeItem &project;
+    
+    // The name is kept in memory, the actions are not
+    bool spilled;
+    int64 spillOffset;
+    int spillSize;
 };
 
 //==============================================================================
@@ -156,7 +183,9 @@ project(parentProject),
 totalUnitsStored(0),
 nextIndex(0),
 newTransaction(true),
-reentrancyCheck(false)
+reentrancyCheck(false),
+totalBytesSpilled(0),
+spillFileLength(0)
 {
     setMaxNumberOfStoredUnits (maxNumberOfUnitsToKeep,
                                minimumTransactions);
@@ -164,6 +193,7 @@ reentrancyCheck(false)
 
 UndoStack::~UndoStack()
 {
+    this->resetSpillFile();
 }
 
 //==============================================================================
@@ -172,6 +202,7 @@ void UndoStack::clearUndoHistory()
     transactions.clear();
     totalUnitsStored = 0;
     nextIndex = 0;
+    this->resetSpillFile();
     sendChangeMessage();
 }
 
@@ -223,6 +254,12 @@ bool UndoStack::perform (UndoAction* const newAction)
             
             if (actionSet != nullptr && ! newTransaction)
             {
+                if (actionSet->spilled && ! this->restoreTransaction(actionSet))
+                {
+                    clearUndoHistory();
+                    return false;
+                }
+                
                 // здесь имеет смысл пробежаться по всему стеку, вызывая createCoalescedAction,
                 // так как если в транзакции повторяются несколько разнородных событий,
                 // то стек будет распухать
@@ -277,17 +314,61 @@ void UndoStack::clearFutureTransactions()
 {
     while (nextIndex < transactions.size())
     {
-        totalUnitsStored -= transactions.getLast()->getTotalSize();
-        transactions.removeLast();
+        removeTransaction (transactions.size() - 1);
     }
     
+    this->spillTransactionsOverBudget();
+    
+    // only happens if the spill file cannot be written
     while (nextIndex > 0
            && totalUnitsStored > maxNumUnitsToKeep
+           && transactions.size() > minimumTransactionsToKeep
+           && ! transactions.getFirst()->spilled)
+    {
+        removeTransaction (0);
+        --nextIndex;
+    }
+    
+    while (nextIndex > 0
+           && totalBytesSpilled > MAX_BYTES_TO_SPILL
            && transactions.size() > minimumTransactionsToKeep)
     {
-        totalUnitsStored -= transactions.getFirst()->getTotalSize();
-        transactions.remove (0);
+        removeTransaction (0);
         --nextIndex;
+    }
+    
+    this->compactSpillFileIfNeeded();
+    
+    // only happens if the spill file cannot be compacted
+    while (nextIndex > 0
+           && spillFileLength > MAX_BYTES_TO_SPILL
+           && transactions.size() > minimumTransactionsToKeep)
+    {
+        removeTransaction (0);
+        --nextIndex;
+    }
+    
+    if (totalBytesSpilled == 0)
+    {
+        this->resetSpillFile();
+    }
+}
+
+void UndoStack::removeTransaction (int index)
+{
+    if (const ActionSet *const s = transactions[index])
+    {
+        if (s->spilled)
+        {
+            totalBytesSpilled -= s->spillSize;
+            this->releaseSpillRange(s->spillOffset, s->spillSize);
+        }
+        else
+        {
+            totalUnitsStored -= s->getTotalSize();
+        }
+        
+        transactions.remove (index);
         
         // if this fails, then some actions may not be returning
         // consistent results from their getSizeInUnits() method
@@ -324,12 +405,15 @@ bool UndoStack::canRedo() const noexcept   { return getNextSet()    != nullptr;
 
 bool UndoStack::undo()
 {
-    if (const ActionSet* const s = getCurrentSet())
+    if (ActionSet* const s = getCurrentSet())
     {
         const ScopedValueSetter<bool> setter (reentrancyCheck, true);
         
-        if (s->undo()) {
+        if (s->spilled && ! this->restoreTransaction(s)) {
+            clearUndoHistory();
+        } else if (s->undo()) {
             --nextIndex;
+            this->spillTransactionsOverBudget();
         } else {
             clearUndoHistory();
         }
@@ -344,12 +428,15 @@ bool UndoStack::undo()
 
 bool UndoStack::redo()
 {
-    if (const ActionSet* const s = getNextSet())
+    if (ActionSet* const s = getNextSet())
     {
         const ScopedValueSetter<bool> setter (reentrancyCheck, true);
         
-        if (s->perform()) {
+        if (s->spilled && ! this->restoreTransaction(s)) {
+            clearUndoHistory();
+        } else if (s->perform()) {
             ++nextIndex;
+            this->spillTransactionsOverBudget();
         } else {
             clearUndoHistory();
         }
@@ -424,7 +511,15 @@ XmlElement *UndoStack::serialize() const
     {
         if (ActionSet *action = this->transactions[currentIndex])
         {
-            xml->prependChildElement(action->serialize());
+            XmlElement *actionXml = action->spilled ?
+                this->readSpilledTransaction(action) : action->serialize();
+            
+            if (actionXml == nullptr)
+            {
+                break;
+            }
+            
+            xml->prependChildElement(actionXml);
         }
         
         --currentIndex;
@@ -449,11 +544,282 @@ void UndoStack::deserialize(const XmlElement &xml)
         auto actionSet = new ActionSet(this->project, String::empty);
         actionSet->deserialize(*childTransactionXml);
         this->transactions.insert(this->nextIndex, actionSet);
+        this->totalUnitsStored += actionSet->getTotalSize();
         ++this->nextIndex;
     }
+    
+    this->spillTransactionsOverBudget();
 }
 
 void UndoStack::reset()
 {
     this->clearUndoHistory();
 }
+
+
+//===----------------------------------------------------------------------===//
+// Spilling
+//===----------------------------------------------------------------------===//
+
+void UndoStack::spillTransactionsOverBudget()
+{
+    // The transactions right before and after the current position
+    // always stay in memory, so that a single undo or redo never touches the disk.
+    // The oldest ones go first, then the farthest redo steps.
+    int oldest = 0;
+    int farthest = this->transactions.size() - 1;
+    
+    while (this->totalUnitsStored > this->maxNumUnitsToKeep)
+    {
+        ActionSet *candidate = nullptr;
+        
+        for (; candidate == nullptr && oldest < (this->nextIndex - 1); ++oldest)
+        {
+            ActionSet *s = this->transactions.getUnchecked(oldest);
+            candidate = s->spilled ? nullptr : s;
+        }
+        
+        for (; candidate == nullptr && farthest > this->nextIndex; --farthest)
+        {
+            ActionSet *s = this->transactions.getUnchecked(farthest);
+            candidate = s->spilled ? nullptr : s;
+        }
+        
+        if (candidate == nullptr || ! this->spillTransaction(candidate))
+        {
+            break;
+        }
+    }
+    
+    this->compactSpillFileIfNeeded();
+}
+
+bool UndoStack::spillTransaction(ActionSet *actionSet)
+{
+    if (this->spillFile.getFullPathName().isEmpty())
+    {
+        this->spillFile = FileUtils::getTempSlot("undo_" + Uuid().toString() + ".tmp");
+    }
+    
+    ScopedPointer<XmlElement> xml(actionSet->serialize());
+    const MemoryBlock block(ChunkedFile::encodeElement(*xml));
+    
+    const int numBytes = int(block.getSize());
+    const int64 offset = this->allocateSpillRange(numBytes);
+    
+    {
+        FileOutputStream out(this->spillFile);
+        
+        if (out.failedToOpen() ||
+            ! out.setPosition(offset) ||
+            ! out.write(block.getData(), block.getSize()))
+        {
+            this->releaseSpillRange(offset, numBytes);
+            return false;
+        }
+        
+        out.flush();
+    }
+    
+    this->totalUnitsStored -= actionSet->getTotalSize();
+    this->totalBytesSpilled += numBytes;
+    
+    actionSet->reset();
+    actionSet->spilled = true;
+    actionSet->spillOffset = offset;
+    actionSet->spillSize = int(block.getSize());
+    return true;
+}
+
+bool UndoStack::restoreTransaction(ActionSet *actionSet)
+{
+    ScopedPointer<XmlElement> xml(this->readSpilledTransaction(actionSet));
+    
+    if (xml == nullptr)
+    {
+        return false;
+    }
+    
+    actionSet->deserialize(*xml);
+    actionSet->spilled = false;
+    
+    this->totalBytesSpilled -= actionSet->spillSize;
+    this->totalUnitsStored += actionSet->getTotalSize();
+    this->releaseSpillRange(actionSet->spillOffset, actionSet->spillSize);
+    
+    if (this->totalBytesSpilled == 0)
+    {
+        this->resetSpillFile();
+    }
+    
+    return true;
+}
+
+XmlElement *UndoStack::readSpilledTransaction(const ActionSet *actionSet) const
+{
+    FileInputStream in(this->spillFile);
+    
+    if (in.failedToOpen() || ! in.setPosition(actionSet->spillOffset))
+    {
+        return nullptr;
+    }
+    
+    MemoryBlock block;
+    const size_t numBytes = size_t(actionSet->spillSize);
+    
+    if (in.readIntoMemoryBlock(block, actionSet->spillSize) != numBytes)
+    {
+        return nullptr;
+    }
+    
+    return ChunkedFile::decodeElement(block.getData(), block.getSize());
+}
+
+// First fit among the holes, or the end of the file
+int64 UndoStack::allocateSpillRange(int numBytes)
+{
+    for (int i = 0; i < this->freeSpillRanges.size(); ++i)
+    {
+        Range<int64> &range = this->freeSpillRanges.getReference(i);
+        
+        if (range.getLength() >= numBytes)
+        {
+            const int64 offset = range.getStart();
+            range.setStart(offset + numBytes);
+            
+            if (range.isEmpty())
+            {
+                this->freeSpillRanges.remove(i);
+            }
+            
+            return offset;
+        }
+    }
+    
+    const int64 offset = this->spillFileLength;
+    this->spillFileLength += numBytes;
+    return offset;
+}
+
+// The free ranges are kept sorted and merged with their neighbours
+void UndoStack::releaseSpillRange(int64 offset, int numBytes)
+{
+    Range<int64> released(offset, offset + numBytes);
+    int index = 0;
+    
+    while (index < this->freeSpillRanges.size() &&
+           this->freeSpillRanges.getReference(index).getStart() < released.getStart())
+    {
+        ++index;
+    }
+    
+    if (index > 0 && this->freeSpillRanges.getReference(index - 1).getEnd() == released.getStart())
+    {
+        --index;
+        released = released.getUnionWith(this->freeSpillRanges.getReference(index));
+        this->freeSpillRanges.remove(index);
+    }
+    
+    if (index < this->freeSpillRanges.size() &&
+        this->freeSpillRanges.getReference(index).getStart() == released.getEnd())
+    {
+        released = released.getUnionWith(this->freeSpillRanges.getReference(index));
+        this->freeSpillRanges.remove(index);
+    }
+    
+    if (released.getEnd() < this->spillFileLength)
+    {
+        this->freeSpillRanges.insert(index, released);
+        return;
+    }
+    
+    // the free tail is cut off
+    this->spillFileLength = released.getStart();
+    
+    FileOutputStream out(this->spillFile);
+    
+    if (! out.failedToOpen() && out.setPosition(this->spillFileLength))
+    {
+        out.truncate();
+    }
+}
+
+void UndoStack::compactSpillFileIfNeeded()
+{
+    const int64 numFreeBytes = this->spillFileLength - this->totalBytesSpilled;
+    
+    const bool isFragmented =
+        this->spillFileLength > MIN_BYTES_TO_COMPACT &&
+        numFreeBytes > this->totalBytesSpilled;
+    
+    if (numFreeBytes > 0 &&
+        (isFragmented || this->spillFileLength > MAX_BYTES_TO_SPILL))
+    {
+        this->compactSpillFile();
+    }
+}
+
+// Copies the live transactions into a new file, one after another
+bool UndoStack::compactSpillFile()
+{
+    const File compactedFile(FileUtils::getTempSlot("undo_" + Uuid().toString() + ".tmp"));
+    Array<int64> newOffsets;
+    bool copied = true;
+    
+    {
+        FileInputStream in(this->spillFile);
+        FileOutputStream out(compactedFile);
+        copied = ! in.failedToOpen() && ! out.failedToOpen();
+        
+        for (int i = 0; copied && i < this->transactions.size(); ++i)
+        {
+            const ActionSet *s = this->transactions.getUnchecked(i);
+            
+            if (! s->spilled)
+            {
+                continue;
+            }
+            
+            MemoryBlock block;
+            newOffsets.add(out.getPosition());
+            
+            copied = in.setPosition(s->spillOffset) &&
+                (in.readIntoMemoryBlock(block, s->spillSize) == size_t(s->spillSize)) &&
+                out.write(block.getData(), block.getSize());
+        }
+        
+        out.flush();
+    }
+    
+    if (! copied || ! compactedFile.moveFileTo(this->spillFile))
+    {
+        compactedFile.deleteFile();
+        return false;
+    }
+    
+    for (int i = 0, j = 0; i < this->transactions.size(); ++i)
+    {
+        ActionSet *s = this->transactions.getUnchecked(i);
+        
+        if (s->spilled)
+        {
+            s->spillOffset = newOffsets.getUnchecked(j++);
+        }
+    }
+    
+    this->spillFileLength = this->totalBytesSpilled;
+    this->freeSpillRanges.clearQuick();
+    return true;
+}
+
+void UndoStack::resetSpillFile()
+{
+    if (this->spillFile.existsAsFile())
+    {
+        this->spillFile.deleteFile();
+    }
+    
+    this->totalBytesSpilled = 0;
+    this->spillFileLength = 0;
+    this->freeSpillRanges.clearQuick();
+}
@@ -26,8 +26,10 @@ class UndoStack : public ChangeBroadcaster, public Serializable
 {
 public:
 
+    // The units are the bytes the actions take in their serialized binary form;
+    // the transactions beyond that budget are spilled to a temporary file
     explicit UndoStack(ProjectTreeItem &parentProject,
-              int maxNumberOfUnitsToKeep = 30000,
+              int maxNumberOfUnitsToKeep = 8 * 1024 * 1024,
               int minimumTransactionsToKeep = 30);
 
     ~UndoStack() override;
@@ -79,6 +81,27 @@ private:
     ActionSet *getNextSet() const noexcept;
     
     void clearFutureTransactions();
+    void removeTransaction(int index);
+    
+    //===------------------------------------------------------------------===//
+    // Spilling
+    //===------------------------------------------------------------------===//
+    
+    File spillFile;
+    int64 totalBytesSpilled;
+    int64 spillFileLength;
+    Array<Range<int64>> freeSpillRanges;
+    
+    void spillTransactionsOverBudget();
+    bool spillTransaction(ActionSet *actionSet);
+    bool restoreTransaction(ActionSet *actionSet);
+    XmlElement *readSpilledTransaction(const ActionSet *actionSet) const;
+    
+    int64 allocateSpillRange(int numBytes);
+    void releaseSpillRange(int64 offset, int numBytes);
+    void compactSpillFileIfNeeded();
+    bool compactSpillFile();
+    void resetSpillFile();
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UndoStack)
 };
@@ -20,31 +20,18 @@
 #include "ProjectAnnotations.h"
 #include "AnnotationDeltas.h"
 
-#include "AnnotationEvent.h"
-#include "AnnotationsLayer.h"
-#include "MidiLayerOwner.h"
 #include "SerializationKeys.h"
 
 using namespace VCS;
 
-class EmptyLayerOwner : public MidiLayerOwner
-{
-public:
-    Transport *getTransport() const override { return nullptr; }
-    String getXPath() const override { return ""; }
-    void setXPath(const String &path) override {}
-    void onEventChanged(const MidiEvent &oldEvent, const MidiEvent &newEvent) override {}
-    void onEventAdded(const MidiEvent &event) override {}
-    void onEventRemoved(const MidiEvent &event) override {}
-    void onLayerChanged(const MidiLayer *layer) override {}
-    void onBeatRangeChanged() override {}
-};
-
-
 AnnotationsLayerDiffLogic::AnnotationsLayerDiffLogic(TrackedItem &targetItem) :
-    DiffLogic(targetItem)
+    DiffLogic(targetItem),
+    eventsDiff(Serialization::Core::annotation)
 {
-
+    this->eventsDiff
+        .compareNumber("beat")
+        .compareString("col")
+        .compareString("text");
 }
 
 AnnotationsLayerDiffLogic::~AnnotationsLayerDiffLogic()
@@ -208,114 +195,17 @@ Diff *AnnotationsLayerDiffLogic::createMergedItem(const TrackedItem &initialStat
 
 XmlElement *AnnotationsLayerDiffLogic::mergeAnnotationsAdded(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    AnnotationsLayer emptyLayer(emptyOwner);
-    OwnedArray<MidiEvent> stateNotes;
-    OwnedArray<MidiEvent> changesNotes;
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
-    Array<const MidiEvent *> result;
-
-    result.addArray(stateNotes);
-
-    // на всякий пожарный, ищем, нет ли в состоянии нот с теми же id, где нет - добавляем
-    for (int i = 0; i < changesNotes.size(); ++i)
-    {
-        bool foundNoteInState = false;
-        const AnnotationEvent *changesNote = static_cast<AnnotationEvent *>(changesNotes.getUnchecked(i));
-
-        for (int j = 0; j < stateNotes.size(); ++j)
-        {
-            const AnnotationEvent *stateNote = static_cast<AnnotationEvent *>(stateNotes.getUnchecked(j));
-
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInState = true;
-                break;
-            }
-        }
-
-        if (! foundNoteInState)
-        {
-            result.add(changesNote);
-        }
-    }
-
-    return this->serializeLayer(result, AnnotationDeltas::annotationsAdded);
+    return this->eventsDiff.mergeAdded(state, changes, AnnotationDeltas::annotationsAdded);
 }
 
 XmlElement *AnnotationsLayerDiffLogic::mergeAnnotationsRemoved(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    AnnotationsLayer emptyLayer(emptyOwner);
-    OwnedArray<MidiEvent> stateNotes;
-    OwnedArray<MidiEvent> changesNotes;
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
-    Array<const MidiEvent *> result;
-
-    // добавляем все ноты из состояния, которых нет в изменениях
-    for (int i = 0; i < stateNotes.size(); ++i)
-    {
-        bool foundNoteInChanges = false;
-        const AnnotationEvent *stateNote = static_cast<AnnotationEvent *>(stateNotes.getUnchecked(i));
-
-        for (int j = 0; j < changesNotes.size(); ++j)
-        {
-            const AnnotationEvent *changesNote = static_cast<AnnotationEvent *>(changesNotes.getUnchecked(j));
-
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInChanges = true;
-                break;
-            }
-        }
-
-        if (! foundNoteInChanges)
-        {
-            result.add(stateNote);
-        }
-    }
-
-    return this->serializeLayer(result, AnnotationDeltas::annotationsAdded);
+    return this->eventsDiff.mergeRemoved(state, changes, AnnotationDeltas::annotationsAdded);
 }
 
 XmlElement *AnnotationsLayerDiffLogic::mergeAnnotationsChanged(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    AnnotationsLayer emptyLayer(emptyOwner);
-    OwnedArray<MidiEvent> stateNotes;
-    OwnedArray<MidiEvent> changesNotes;
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
-    Array<const MidiEvent *> result;
-
-    result.addArray(stateNotes);
-
-    // снова ищем по id и заменяем
-    for (int i = 0; i < stateNotes.size(); ++i)
-    {
-        bool foundNoteInChanges = false;
-        const AnnotationEvent *stateNote = static_cast<AnnotationEvent *>(stateNotes.getUnchecked(i));
-
-        for (int j = 0; j < changesNotes.size(); ++j)
-        {
-            const AnnotationEvent *changesNote = static_cast<AnnotationEvent *>(changesNotes.getUnchecked(j));
-
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInChanges = true;
-                result.removeAllInstancesOf(stateNote);
-                result.addIfNotAlreadyThere(changesNote);
-
-                break;
-            }
-        }
-
-        //jassert(foundNoteInChanges);
-    }
-
-    return this->serializeLayer(result, AnnotationDeltas::annotationsAdded);
+    return this->eventsDiff.mergeChanged(state, changes, AnnotationDeltas::annotationsAdded);
 }
 
 
@@ -325,155 +215,46 @@ XmlElement *AnnotationsLayerDiffLogic::mergeAnnotationsChanged(const XmlElement
 
 Array<NewSerializedDelta> AnnotationsLayerDiffLogic::createAnnotationsDiffs(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    AnnotationsLayer emptyLayer(emptyOwner);
-    OwnedArray<MidiEvent> stateEvents;
-    OwnedArray<MidiEvent> changesEvents;
-
-    // вот здесь по уму надо десериализовать слои
-    // а для этого надо, чтоб в слоях не было ничего, кроме нот
-    // поэтому пока есть, как есть, и это не критично
-    this->deserializeChanges(emptyLayer, state, changes, stateEvents, changesEvents);
-
     Array<NewSerializedDelta> res;
 
+    const SerializedEventsDiff::Result diff(this->eventsDiff.createDiff(state, changes));
 
-    Array<const MidiEvent *> addedEvents;
-    Array<const MidiEvent *> removedEvents;
-    Array<const MidiEvent *> changedEvents;
-
-    // собственно, само сравнение
-    for (int i = 0; i < stateEvents.size(); ++i)
-    {
-        bool foundNoteInChanges = false;
-        const AnnotationEvent *stateEvent = static_cast<AnnotationEvent *>(stateEvents.getUnchecked(i));
-
-        for (int j = 0; j < changesEvents.size(); ++j)
-        {
-            const AnnotationEvent *changesEvent = static_cast<AnnotationEvent *>(changesEvents.getUnchecked(j));
-
-            // нота из состояния - существует в изменениях. добавляем запись changed, если нужно.
-            if (stateEvent->getID() == changesEvent->getID())
-            {
-                foundNoteInChanges = true;
-
-                const bool eventHasChanged = (stateEvent->getBeat() != changesEvent->getBeat() ||
-                                              stateEvent->getColour() != changesEvent->getColour() ||
-                                              stateEvent->getDescription() != changesEvent->getDescription());
-
-                if (eventHasChanged)
-                {
-                    changedEvents.add(changesEvent);
-                }
-
-                break;
-            }
-        }
-
-        // нота из состояния - в изменениях не найдена. добавляем запись removed.
-        if (! foundNoteInChanges)
-        {
-            removedEvents.add(stateEvent);
-        }
-    }
-
-    // теперь ищем в изменениях ноты, которые отсутствуют в состоянии
-    for (int i = 0; i < changesEvents.size(); ++i)
-    {
-        bool foundNoteInState = false;
-        const AnnotationEvent *changesNote = static_cast<AnnotationEvent *>(changesEvents.getUnchecked(i));
-
-        for (int j = 0; j < stateEvents.size(); ++j)
-        {
-            const AnnotationEvent *stateNote = static_cast<AnnotationEvent *>(stateEvents.getUnchecked(j));
-
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInState = true;
-                break;
-            }
-        }
-
-        // и пишем ее в список добавленных
-        if (! foundNoteInState)
-        {
-            addedEvents.add(changesNote);
-        }
-    }
-
-    // сериализуем диффы, если таковые есть
-
-    if (addedEvents.size() > 0)
+    if (diff.added.size() > 0)
     {
-        res.add(this->serializeChanges(addedEvents,
+        res.add(this->serializeChanges(diff.added,
                                        "added {x} annotations",
-                                       addedEvents.size(),
+                                       diff.added.size(),
                                        AnnotationDeltas::annotationsAdded));
     }
 
-    if (removedEvents.size() > 0)
+    if (diff.removed.size() > 0)
     {
-        res.add(this->serializeChanges(removedEvents,
+        res.add(this->serializeChanges(diff.removed,
                                        "removed {x} annotations",
-                                       removedEvents.size(),
+                                       diff.removed.size(),
                                        AnnotationDeltas::annotationsRemoved));
     }
 
-    if (changedEvents.size() > 0)
+    if (diff.changed.size() > 0)
     {
-        res.add(this->serializeChanges(changedEvents,
+        res.add(this->serializeChanges(diff.changed,
                                        "changed {x} annotations",
-                                       changedEvents.size(),
+                                       diff.changed.size(),
                                        AnnotationDeltas::annotationsChanged));
     }
 
     return res;
 }
 
-void AnnotationsLayerDiffLogic::deserializeChanges(MidiLayer &layer,
-        const XmlElement *state,
-        const XmlElement *changes,
-        OwnedArray<MidiEvent> &stateNotes,
-        OwnedArray<MidiEvent> &changesNotes) const
-{
-    forEachXmlChildElementWithTagName(*state, e, Serialization::Core::annotation)
-    {
-        AnnotationEvent *event = new AnnotationEvent(&layer);
-        event->deserialize(*e);
-        stateNotes.addSorted(*event, event);
-    }
-
-    forEachXmlChildElementWithTagName(*changes, e, Serialization::Core::annotation)
-    {
-        AnnotationEvent *event = new AnnotationEvent(&layer);
-        event->deserialize(*e);
-        changesNotes.addSorted(*event, event);
-    }
-}
-
-NewSerializedDelta AnnotationsLayerDiffLogic::serializeChanges(Array<const MidiEvent *> changes,
+NewSerializedDelta AnnotationsLayerDiffLogic::serializeChanges(const Array<const XmlElement *> &changes,
         const String &description, int64 numChanges, const String &deltaType) const
 {
     NewSerializedDelta changesFullDelta;
     changesFullDelta.delta = new Delta(DeltaDescription(description, numChanges), deltaType);
-    changesFullDelta.deltaData = this->serializeLayer(changes, deltaType);
+    changesFullDelta.deltaData = SerializedEventsDiff::serialize(changes, deltaType);
     return changesFullDelta;
 }
 
-XmlElement *AnnotationsLayerDiffLogic::serializeLayer(Array<const MidiEvent *> changes,
-        const String &tag) const
-{
-    auto xml = new XmlElement(tag);
-
-    for (int i = 0; i < changes.size(); ++i)
-    {
-        const MidiEvent *event = changes.getUnchecked(i);
-        xml->addChildElement(event->serialize());
-    }
-
-    return xml;
-}
-
 bool AnnotationsLayerDiffLogic::checkIfDeltaIsEventsType(const Delta *delta) const
 {
     return (delta->getType() == AnnotationDeltas::annotationsAdded ||
@@ -20,31 +20,20 @@
 #include "AutomationLayerTreeItem.h"
 #include "AutoLayerDeltas.h"
 
-#include "AutomationEvent.h"
-#include "AutomationLayer.h"
-#include "MidiLayerOwner.h"
+#include "MidiLayer.h"
 #include "SerializationKeys.h"
 
 using namespace VCS;
 
-class EmptyLayerOwner : public MidiLayerOwner
-{
-public:
-    Transport *getTransport() const override { return nullptr; }
-    String getXPath() const override { return ""; }
-    void setXPath(const String &path) override {}
-    void onEventChanged(const MidiEvent &oldEvent, const MidiEvent &newEvent) override {}
-    void onEventAdded(const MidiEvent &event) override {}
-    void onEventRemoved(const MidiEvent &event) override {}
-    void onLayerChanged(const MidiLayer *layer) override {}
-    void onBeatRangeChanged() override {}
-};
-
-
 AutomationLayerDiffLogic::AutomationLayerDiffLogic(TrackedItem &targetItem) :
-    DiffLogic(targetItem)
+    DiffLogic(targetItem),
+    eventsDiff(Serialization::Core::event)
 {
-
+    // the default curvature is the same as in AutomationEvent::deserialize
+    this->eventsDiff
+        .compareNumber("beat")
+        .compareNumber("curve", 0.5)
+        .compareNumber("val");
 }
 
 AutomationLayerDiffLogic::~AutomationLayerDiffLogic()
@@ -287,114 +276,17 @@ XmlElement *AutomationLayerDiffLogic::mergeController(const XmlElement *state, c
 
 XmlElement *AutomationLayerDiffLogic::mergeEventsAdded(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    AutomationLayer emptyLayer(emptyOwner);
-    OwnedArray<MidiEvent> stateNotes;
-    OwnedArray<MidiEvent> changesNotes;
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
-    Array<const MidiEvent *> result;
-
-    result.addArray(stateNotes);
-
-    // на всякий пожарный, ищем, нет ли в состоянии нот с теми же id, где нет - добавляем
-    for (int i = 0; i < changesNotes.size(); ++i)
-    {
-        bool foundNoteInState = false;
-        const AutomationEvent *changesNote = static_cast<AutomationEvent *>(changesNotes.getUnchecked(i));
-
-        for (int j = 0; j < stateNotes.size(); ++j)
-        {
-            const AutomationEvent *stateNote = static_cast<AutomationEvent *>(stateNotes.getUnchecked(j));
-
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInState = true;
-                break;
-            }
-        }
-
-        if (! foundNoteInState)
-        {
-            result.add(changesNote);
-        }
-    }
-
-    return this->serializeLayer(result, AutoLayerDeltas::eventsAdded);
+    return this->eventsDiff.mergeAdded(state, changes, AutoLayerDeltas::eventsAdded);
 }
 
 XmlElement *AutomationLayerDiffLogic::mergeEventsRemoved(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    AutomationLayer emptyLayer(emptyOwner);
-    OwnedArray<MidiEvent> stateNotes;
-    OwnedArray<MidiEvent> changesNotes;
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
-    Array<const MidiEvent *> result;
-
-    // добавляем все ноты из состояния, которых нет в изменениях
-    for (int i = 0; i < stateNotes.size(); ++i)
-    {
-        bool foundNoteInChanges = false;
-        const AutomationEvent *stateNote = static_cast<AutomationEvent *>(stateNotes.getUnchecked(i));
-
-        for (int j = 0; j < changesNotes.size(); ++j)
-        {
-            const AutomationEvent *changesNote = static_cast<AutomationEvent *>(changesNotes.getUnchecked(j));
-
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInChanges = true;
-                break;
-            }
-        }
-
-        if (! foundNoteInChanges)
-        {
-            result.add(stateNote);
-        }
-    }
-
-    return this->serializeLayer(result, AutoLayerDeltas::eventsAdded);
+    return this->eventsDiff.mergeRemoved(state, changes, AutoLayerDeltas::eventsAdded);
 }
 
 XmlElement *AutomationLayerDiffLogic::mergeEventsChanged(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    AutomationLayer emptyLayer(emptyOwner);
-    OwnedArray<MidiEvent> stateNotes;
-    OwnedArray<MidiEvent> changesNotes;
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
-    Array<const MidiEvent *> result;
-
-    result.addArray(stateNotes);
-
-    // снова ищем по id и заменяем
-    for (int i = 0; i < stateNotes.size(); ++i)
-    {
-        bool foundNoteInChanges = false;
-        const AutomationEvent *stateNote = static_cast<AutomationEvent *>(stateNotes.getUnchecked(i));
-
-        for (int j = 0; j < changesNotes.size(); ++j)
-        {
-            const AutomationEvent *changesNote = static_cast<AutomationEvent *>(changesNotes.getUnchecked(j));
-
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInChanges = true;
-                result.removeAllInstancesOf(stateNote);
-                result.addIfNotAlreadyThere(changesNote);
-
-                break;
-            }
-        }
-
-        //jassert(foundNoteInChanges);
-    }
-
-    return this->serializeLayer(result, AutoLayerDeltas::eventsAdded);
+    return this->eventsDiff.mergeChanged(state, changes, AutoLayerDeltas::eventsAdded);
 }
 
 
@@ -446,105 +338,31 @@ NewSerializedDelta AutomationLayerDiffLogic::createControllerDiff(const XmlEleme
 
 Array<NewSerializedDelta> AutomationLayerDiffLogic::createEventsDiffs(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    AutomationLayer emptyLayer(emptyOwner);
-    OwnedArray<MidiEvent> stateEvents;
-    OwnedArray<MidiEvent> changesEvents;
-
-    // вот здесь по уму надо десериализовать слои
-    // а для этого надо, чтоб в слоях не было ничего, кроме нот
-    // поэтому пока есть, как есть, и это не критично
-    this->deserializeChanges(emptyLayer, state, changes, stateEvents, changesEvents);
-
     Array<NewSerializedDelta> res;
 
+    const SerializedEventsDiff::Result diff(this->eventsDiff.createDiff(state, changes));
 
-    Array<const MidiEvent *> addedEvents;
-    Array<const MidiEvent *> removedEvents;
-    Array<const MidiEvent *> changedEvents;
-
-    // собственно, само сравнение
-    for (int i = 0; i < stateEvents.size(); ++i)
-    {
-        bool foundNoteInChanges = false;
-        const AutomationEvent *stateEvent = static_cast<AutomationEvent *>(stateEvents.getUnchecked(i));
-
-        for (int j = 0; j < changesEvents.size(); ++j)
-        {
-            const AutomationEvent *changesEvent = static_cast<AutomationEvent *>(changesEvents.getUnchecked(j));
-
-            // нота из состояния - существует в изменениях. добавляем запись changed, если нужно.
-            if (stateEvent->getID() == changesEvent->getID())
-            {
-                foundNoteInChanges = true;
-
-                const bool eventHasChanged = (stateEvent->getBeat() != changesEvent->getBeat() ||
-                                              stateEvent->getCurvature() != changesEvent->getCurvature() ||
-                                              stateEvent->getControllerValue() != changesEvent->getControllerValue());
-
-                if (eventHasChanged)
-                {
-                    changedEvents.add(changesEvent);
-                }
-
-                break;
-            }
-        }
-
-        // нота из состояния - в изменениях не найдена. добавляем запись removed.
-        if (! foundNoteInChanges)
-        {
-            removedEvents.add(stateEvent);
-        }
-    }
-
-    // теперь ищем в изменениях ноты, которые отсутствуют в состоянии
-    for (int i = 0; i < changesEvents.size(); ++i)
-    {
-        bool foundNoteInState = false;
-        const AutomationEvent *changesNote = static_cast<AutomationEvent *>(changesEvents.getUnchecked(i));
-
-        for (int j = 0; j < stateEvents.size(); ++j)
-        {
-            const AutomationEvent *stateNote = static_cast<AutomationEvent *>(stateEvents.getUnchecked(j));
-
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInState = true;
-                break;
-            }
-        }
-
-        // и пишем ее в список добавленных
-        if (! foundNoteInState)
-        {
-            addedEvents.add(changesNote);
-        }
-    }
-
-    // сериализуем диффы, если таковые есть
-
-    if (addedEvents.size() > 0)
+    if (diff.added.size() > 0)
     {
-        res.add(this->serializeChanges(addedEvents,
+        res.add(this->serializeChanges(diff.added,
                                        "added {x} events",
-                                       addedEvents.size(),
+                                       diff.added.size(),
                                        AutoLayerDeltas::eventsAdded));
     }
 
-    if (removedEvents.size() > 0)
+    if (diff.removed.size() > 0)
     {
-        res.add(this->serializeChanges(removedEvents,
+        res.add(this->serializeChanges(diff.removed,
                                        "removed {x} events",
-                                       removedEvents.size(),
+                                       diff.removed.size(),
                                        AutoLayerDeltas::eventsRemoved));
     }
 
-    if (changedEvents.size() > 0)
+    if (diff.changed.size() > 0)
     {
-        res.add(this->serializeChanges(changedEvents,
+        res.add(this->serializeChanges(diff.changed,
                                        "changed {x} events",
-                                       changedEvents.size(),
+                                       diff.changed.size(),
                                        AutoLayerDeltas::eventsChanged));
     }
 
@@ -552,50 +370,15 @@ Array<NewSerializedDelta> AutomationLayerDiffLogic::createEventsDiffs(const XmlE
 }
 
 
-void AutomationLayerDiffLogic::deserializeChanges(MidiLayer &layer,
-        const XmlElement *state,
-        const XmlElement *changes,
-        OwnedArray<MidiEvent> &stateNotes,
-        OwnedArray<MidiEvent> &changesNotes) const
-{
-    forEachXmlChildElementWithTagName(*state, e, Serialization::Core::event)
-    {
-        auto event = new AutomationEvent(&layer, 0.f, 0.f);
-        event->deserialize(*e);
-        stateNotes.addSorted(*event, event);
-    }
-
-    forEachXmlChildElementWithTagName(*changes, e, Serialization::Core::event)
-    {
-        auto event = new AutomationEvent(&layer, 0.f, 0.f);
-        event->deserialize(*e);
-        changesNotes.addSorted(*event, event);
-    }
-}
-
-NewSerializedDelta AutomationLayerDiffLogic::serializeChanges(Array<const MidiEvent *> changes,
+NewSerializedDelta AutomationLayerDiffLogic::serializeChanges(const Array<const XmlElement *> &changes,
         const String &description, int64 numChanges, const String &deltaType) const
 {
     NewSerializedDelta changesFullDelta;
     changesFullDelta.delta = new Delta(DeltaDescription(description, numChanges), deltaType);
-    changesFullDelta.deltaData = this->serializeLayer(changes, deltaType);
+    changesFullDelta.deltaData = SerializedEventsDiff::serialize(changes, deltaType);
     return changesFullDelta;
 }
 
-XmlElement *AutomationLayerDiffLogic::serializeLayer(Array<const MidiEvent *> changes,
-        const String &tag) const
-{
-    auto xml = new XmlElement(tag);
-
-    for (int i = 0; i < changes.size(); ++i)
-    {
-        const MidiEvent *event = changes.getUnchecked(i);
-        xml->addChildElement(event->serialize());
-    }
-
-    return xml;
-}
-
 bool AutomationLayerDiffLogic::checkIfDeltaIsEventsType(const Delta *delta) const
 {
     return (delta->getType() == AutoLayerDeltas::eventsAdded ||
@@ -17,12 +17,11 @@
 
 #pragma once
 
-class MidiEvent;
-class MidiLayer;
 class AutomationLayerTreeItem;
 
 #include "Diff.h"
 #include "DiffLogic.h"
+#include "SerializedEventsDiff.h"
 
 namespace VCS
 {
@@ -80,21 +79,14 @@ namespace VCS
 
     private:
 
-        void deserializeChanges(MidiLayer &layer,
-                                const XmlElement *state,
-                                const XmlElement *changes,
-                                OwnedArray<MidiEvent> &stateNotes,
-                                OwnedArray<MidiEvent> &changesNotes) const;
-
-        NewSerializedDelta serializeChanges(Array<const MidiEvent *> changes,
+        NewSerializedDelta serializeChanges(const Array<const XmlElement *> &changes,
                                             const String &description,
                                             int64 numChanges,
                                             const String &deltaType) const;
 
-        XmlElement *serializeLayer(Array<const MidiEvent *> changes,
-                                   const String &tag) const;
-
         bool checkIfDeltaIsEventsType(const Delta *delta) const;
 
+        SerializedEventsDiff eventsDiff;
+
     };
 } // namespace VCS
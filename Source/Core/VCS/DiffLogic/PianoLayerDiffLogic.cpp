@@ -20,31 +20,20 @@
 #include "PianoLayerTreeItem.h"
 #include "PianoLayerDeltas.h"
 
-#include "Note.h"
-#include "PianoLayer.h"
-#include "MidiLayerOwner.h"
+#include "MidiLayer.h"
 #include "SerializationKeys.h"
 
 using namespace VCS;
 
-class EmptyLayerOwner : public MidiLayerOwner
-{
-public:
-    Transport *getTransport() const override { return nullptr; }
-    String getXPath() const override { return ""; }
-    void setXPath(const String &path) override {}
-    void onEventChanged(const MidiEvent &oldEvent, const MidiEvent &newEvent) override {}
-    void onEventAdded(const MidiEvent &event) override {}
-    void onEventRemoved(const MidiEvent &event) override {}
-    void onLayerChanged(const MidiLayer *layer) override {}
-    void onBeatRangeChanged() override {}
-};
-
-
 PianoLayerDiffLogic::PianoLayerDiffLogic(TrackedItem &targetItem) :
-    DiffLogic(targetItem)
+    DiffLogic(targetItem),
+    eventsDiff(Serialization::Core::note)
 {
-
+    this->eventsDiff
+        .compareNumber("key")
+        .compareNumber("beat")
+        .compareNumber("len")
+        .compareNumber("vel");
 }
 
 PianoLayerDiffLogic::~PianoLayerDiffLogic()
@@ -282,148 +271,17 @@ XmlElement *PianoLayerDiffLogic::mergeInstrument(const XmlElement *state, const
 
 XmlElement *PianoLayerDiffLogic::mergeNotesAdded(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    PianoLayer emptyLayer(emptyOwner);
-    OwnedArray<Note> stateNotes;
-    OwnedArray<Note> changesNotes;
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
-    Array<const MidiEvent *> result;
-
-    result.addArray(stateNotes);
-
-    // на всякий пожарный, ищем, нет ли в состоянии нот с теми же id, где нет - добавляем
-    HashMap<MidiEvent::Id, int> stateIDs;
-    
-    for (int j = 0; j < stateNotes.size(); ++j)
-    {
-        const Note *stateNote(stateNotes.getUnchecked(j));
-        stateIDs.set(stateNote->getID(), j);
-    }
-
-    for (int i = 0; i < changesNotes.size(); ++i)
-    {
-        //bool foundNoteInState = false;
-
-        const Note *changesNote(changesNotes.getUnchecked(i));
-        bool foundNoteInState = stateIDs.contains(changesNote->getID());
-
-        //for (int j = 0; j < stateNotes.size(); ++j)
-        //{
-        //    const Note *stateNote = static_cast<Note *>(stateNotes.getUnchecked(j));
-
-        //    if (stateNote->getID() == changesNote->getID())
-        //    {
-        //        foundNoteInState = true;
-        //        break;
-        //    }
-        //}
-
-        if (! foundNoteInState)
-        {
-            result.add(changesNote);
-        }
-    }
-
-    return this->serializeLayer(result, PianoLayerDeltas::notesAdded);
+    return this->eventsDiff.mergeAdded(state, changes, PianoLayerDeltas::notesAdded);
 }
 
 XmlElement *PianoLayerDiffLogic::mergeNotesRemoved(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    PianoLayer emptyLayer(emptyOwner);
-    OwnedArray<Note> stateNotes;
-    OwnedArray<Note> changesNotes;
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
-    Array<const MidiEvent *> result;
-
-    // добавляем все ноты из состояния, которых нет в изменениях
-    HashMap<MidiEvent::Id, int> changesIDs;
-
-    for (int j = 0; j < changesNotes.size(); ++j)
-    {
-        const Note *changesNote(changesNotes.getUnchecked(j));
-        changesIDs.set(changesNote->getID(), j);
-    }
-    
-    for (int i = 0; i < stateNotes.size(); ++i)
-    {
-        const Note *stateNote(stateNotes.getUnchecked(i));
-        //bool foundNoteInChanges = false;
-        bool foundNoteInChanges = changesIDs.contains(stateNote->getID());
-
-        //for (int j = 0; j < changesNotes.size(); ++j)
-        //{
-        //    const Note *changesNote = static_cast<Note *>(changesNotes.getUnchecked(j));
-
-        //    if (stateNote->getID() == changesNote->getID())
-        //    {
-        //        foundNoteInChanges = true;
-        //        break;
-        //    }
-        //}
-
-        if (! foundNoteInChanges)
-        {
-            result.add(stateNote);
-        }
-    }
-
-    return this->serializeLayer(result, PianoLayerDeltas::notesAdded);
+    return this->eventsDiff.mergeRemoved(state, changes, PianoLayerDeltas::notesAdded);
 }
 
 XmlElement *PianoLayerDiffLogic::mergeNotesChanged(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    PianoLayer emptyLayer(emptyOwner);
-    OwnedArray<Note> stateNotes;
-    OwnedArray<Note> changesNotes;
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
-    Array<const MidiEvent *> result;
-
-    result.addArray(stateNotes);
-
-    // снова ищем по id и заменяем
-    HashMap<MidiEvent::Id, const Note *> changesIDs;
-    
-    for (int j = 0; j < changesNotes.size(); ++j)
-    {
-        const Note *changesNote(changesNotes.getUnchecked(j));
-        changesIDs.set(changesNote->getID(), changesNote);
-    }
-
-    for (int i = 0; i < stateNotes.size(); ++i)
-    {
-        const Note *stateNote(stateNotes.getUnchecked(i));
-        //bool foundNoteInChanges = false;
-
-        if (changesIDs.contains(stateNote->getID()))
-        {
-            const Note *changesNote = changesIDs[stateNote->getID()];
-            result.removeAllInstancesOf(stateNote);
-            result.addIfNotAlreadyThere(changesNote);
-        }
-
-        //for (int j = 0; j < changesNotes.size(); ++j)
-        //{
-        //    const Note *changesNote = static_cast<Note *>(changesNotes.getUnchecked(j));
-
-        //    if (stateNote->getID() == changesNote->getID())
-        //    {
-        //        foundNoteInChanges = true;
-        //        result.removeAllInstancesOf(stateNote);
-        //        result.addIfNotAlreadyThere(changesNote);
-
-        //        break;
-        //    }
-        //}
-
-        //jassert(foundNoteInChanges);
-    }
-
-    return this->serializeLayer(result, PianoLayerDeltas::notesAdded);
+    return this->eventsDiff.mergeChanged(state, changes, PianoLayerDeltas::notesAdded);
 }
 
 
@@ -467,106 +325,31 @@ NewSerializedDelta PianoLayerDiffLogic::createInstrumentDiff(const XmlElement *s
 
 Array<NewSerializedDelta> PianoLayerDiffLogic::createEventsDiffs(const XmlElement *state, const XmlElement *changes) const
 {
-    EmptyLayerOwner emptyOwner;
-    PianoLayer emptyLayer(emptyOwner);
-    OwnedArray<Note> stateNotes;
-    OwnedArray<Note> changesNotes;
-
-    // вот здесь по уму надо десериализовать слои
-    // а для этого надо, чтоб в слоях не было ничего, кроме нот
-    // поэтому пока есть, как есть, и это не критично
-    this->deserializeChanges(emptyLayer, state, changes, stateNotes, changesNotes);
-
     Array<NewSerializedDelta> res;
 
+    const SerializedEventsDiff::Result diff(this->eventsDiff.createDiff(state, changes));
 
-    Array<const MidiEvent *> addedNotes;
-    Array<const MidiEvent *> removedNotes;
-    Array<const MidiEvent *> changedNotes;
-
-    // собственно, само сравнение
-    for (int i = 0; i < stateNotes.size(); ++i)
+    if (diff.added.size() > 0)
     {
-        bool foundNoteInChanges = false;
-        const Note *stateNote(stateNotes.getUnchecked(i));
-
-        for (int j = 0; j < changesNotes.size(); ++j)
-        {
-            const Note *changesNote(changesNotes.getUnchecked(j));
-
-            // нота из состояния - существует в изменениях. добавляем запись changed, если нужно.
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInChanges = true;
-
-                const bool noteHasChanged = (stateNote->getKey() != changesNote->getKey() ||
-                                             stateNote->getBeat() != changesNote->getBeat() ||
-                                             stateNote->getLength() != changesNote->getLength() ||
-                                             stateNote->getVelocity() != changesNote->getVelocity());
-
-                if (noteHasChanged)
-                {
-                    changedNotes.add(changesNote);
-                }
-
-                break;
-            }
-        }
-
-        // нота из состояния - в изменениях не найдена. добавляем запись removed.
-        if (! foundNoteInChanges)
-        {
-            removedNotes.add(stateNote);
-        }
-    }
-
-    // теперь ищем в изменениях ноты, которые отсутствуют в состоянии
-    for (int i = 0; i < changesNotes.size(); ++i)
-    {
-        bool foundNoteInState = false;
-        const Note *changesNote(changesNotes.getUnchecked(i));
-
-        for (int j = 0; j < stateNotes.size(); ++j)
-        {
-            const Note *stateNote(stateNotes.getUnchecked(j));
-
-            if (stateNote->getID() == changesNote->getID())
-            {
-                foundNoteInState = true;
-                break;
-            }
-        }
-
-        // и пишем ее в список добавленных
-        if (! foundNoteInState)
-        {
-            addedNotes.add(changesNote);
-        }
-    }
-
-    // сериализуем диффы, если таковые есть
-
-    if (addedNotes.size() > 0)
-    {
-        res.add(this->serializeChanges(addedNotes,
+        res.add(this->serializeChanges(diff.added,
                                        "added {x} notes",
-                                       addedNotes.size(),
+                                       diff.added.size(),
                                        PianoLayerDeltas::notesAdded));
     }
 
-    if (removedNotes.size() > 0)
+    if (diff.removed.size() > 0)
     {
-        res.add(this->serializeChanges(removedNotes,
+        res.add(this->serializeChanges(diff.removed,
                                        "removed {x} notes",
-                                       removedNotes.size(),
+                                       diff.removed.size(),
                                        PianoLayerDeltas::notesRemoved));
     }
 
-    if (changedNotes.size() > 0)
+    if (diff.changed.size() > 0)
     {
-        res.add(this->serializeChanges(changedNotes,
+        res.add(this->serializeChanges(diff.changed,
                                        "changed {x} notes",
-                                       changedNotes.size(),
+                                       diff.changed.size(),
                                        PianoLayerDeltas::notesChanged));
     }
 
@@ -574,50 +357,15 @@ Array<NewSerializedDelta> PianoLayerDiffLogic::createEventsDiffs(const XmlElemen
 }
 
 
-void PianoLayerDiffLogic::deserializeChanges(MidiLayer &layer,
-        const XmlElement *state,
-        const XmlElement *changes,
-        OwnedArray<Note> &stateNotes,
-        OwnedArray<Note> &changesNotes) const
-{
-    forEachXmlChildElementWithTagName(*state, e, Serialization::Core::note)
-    {
-        auto note = new Note(&layer, 0, 0, 0, 0);
-        note->deserialize(*e);
-        stateNotes.addSorted(*note, note);
-    }
-
-    forEachXmlChildElementWithTagName(*changes, e, Serialization::Core::note)
-    {
-        auto note = new Note(&layer, 0, 0, 0, 0);
-        note->deserialize(*e);
-        changesNotes.addSorted(*note, note);
-    }
-}
-
-NewSerializedDelta PianoLayerDiffLogic::serializeChanges(Array<const MidiEvent *> changes,
+NewSerializedDelta PianoLayerDiffLogic::serializeChanges(const Array<const XmlElement *> &changes,
         const String &description, int64 numChanges, const String &deltaType) const
 {
     NewSerializedDelta changesFullDelta;
     changesFullDelta.delta = new Delta(DeltaDescription(description, numChanges), deltaType);
-    changesFullDelta.deltaData = this->serializeLayer(changes, deltaType);
+    changesFullDelta.deltaData = SerializedEventsDiff::serialize(changes, deltaType);
     return changesFullDelta;
 }
 
-XmlElement *PianoLayerDiffLogic::serializeLayer(Array<const MidiEvent *> changes,
-        const String &tag) const
-{
-    auto xml = new XmlElement(tag);
-
-    for (int i = 0; i < changes.size(); ++i)
-    {
-        const MidiEvent *event = changes.getUnchecked(i);
-        xml->addChildElement(event->serialize());
-    }
-
-    return xml;
-}
-
 bool PianoLayerDiffLogic::checkIfDeltaIsNotesType(const Delta *delta) const
 {
     return (delta->getType() == PianoLayerDeltas::notesAdded ||
@@ -17,13 +17,11 @@
 
 #pragma once
 
-class Note;
-class MidiEvent;
-class MidiLayer;
 class PianoLayerTreeItem;
 
 #include "Diff.h"
 #include "DiffLogic.h"
+#include "SerializedEventsDiff.h"
 
 namespace VCS
 {
@@ -77,22 +75,14 @@ namespace VCS
 
     private:
 
-        void deserializeChanges(MidiLayer &layer,
-                                const XmlElement *state,
-                                const XmlElement *changes,
-                                OwnedArray<Note> &stateNotes,
-                                OwnedArray<Note> &changesNotes) const;
-
-        NewSerializedDelta serializeChanges(Array<const MidiEvent *> changes,
+        NewSerializedDelta serializeChanges(const Array<const XmlElement *> &changes,
                                             const String &description,
                                             int64 numChanges,
                                             const String &deltaType) const;
 
-        XmlElement *serializeLayer(Array<const MidiEvent *> changes,
-                                   const String &tag) const;
-
         bool checkIfDeltaIsNotesType(const Delta *delta) const;
 
+        SerializedEventsDiff eventsDiff;
 
     };
 } // namespace VCS
@@ -0,0 +1,220 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "SerializedEventsDiff.h"
+
+using namespace VCS;
+
+SerializedEventsDiff::SerializedEventsDiff(const String &tag) :
+    eventTag(tag),
+    idAttribute("id")
+{
+}
+
+SerializedEventsDiff &SerializedEventsDiff::compareNumber(const Identifier &attribute, double defaultValue)
+{
+    const ComparedAttribute comparedAttribute = { attribute, true, defaultValue };
+    this->comparedAttributes.add(comparedAttribute);
+    return *this;
+}
+
+SerializedEventsDiff &SerializedEventsDiff::compareString(const Identifier &attribute)
+{
+    const ComparedAttribute comparedAttribute = { attribute, false, 0.0 };
+    this->comparedAttributes.add(comparedAttribute);
+    return *this;
+}
+
+SerializedEventsDiff::Result SerializedEventsDiff::createDiff(const XmlElement *state, const XmlElement *changes) const
+{
+    Events stateEvents;
+    Events changesEvents;
+    this->collectEvents(state, stateEvents);
+    this->collectEvents(changes, changesEvents);
+
+    Result result;
+
+    for (auto stateEvent : stateEvents.list)
+    {
+        const MidiEvent::Id id = this->getId(*stateEvent);
+
+        if (! changesEvents.indexById.contains(id))
+        {
+            result.removed.add(stateEvent);
+            continue;
+        }
+
+        const XmlElement *changesEvent = changesEvents.list.getUnchecked(changesEvents.indexById[id]);
+
+        if (this->hasChanged(*stateEvent, *changesEvent))
+        {
+            result.changed.add(changesEvent);
+        }
+    }
+
+    for (auto changesEvent : changesEvents.list)
+    {
+        if (! stateEvents.indexById.contains(this->getId(*changesEvent)))
+        {
+            result.added.add(changesEvent);
+        }
+    }
+
+    return result;
+}
+
+
+//===----------------------------------------------------------------------===//
+// Merge
+//===----------------------------------------------------------------------===//
+
+XmlElement *SerializedEventsDiff::mergeAdded(const XmlElement *state,
+    const XmlElement *changes, const String &resultTag) const
+{
+    Events stateEvents;
+    Events changesEvents;
+    this->collectEvents(state, stateEvents);
+    this->collectEvents(changes, changesEvents);
+
+    Array<const XmlElement *> result(stateEvents.list);
+
+    for (auto changesEvent : changesEvents.list)
+    {
+        if (! stateEvents.indexById.contains(this->getId(*changesEvent)))
+        {
+            result.add(changesEvent);
+        }
+    }
+
+    return SerializedEventsDiff::serialize(result, resultTag);
+}
+
+XmlElement *SerializedEventsDiff::mergeRemoved(const XmlElement *state,
+    const XmlElement *changes, const String &resultTag) const
+{
+    Events stateEvents;
+    Events changesEvents;
+    this->collectEvents(state, stateEvents);
+    this->collectEvents(changes, changesEvents);
+
+    Array<const XmlElement *> result;
+
+    for (auto stateEvent : stateEvents.list)
+    {
+        if (! changesEvents.indexById.contains(this->getId(*stateEvent)))
+        {
+            result.add(stateEvent);
+        }
+    }
+
+    return SerializedEventsDiff::serialize(result, resultTag);
+}
+
+XmlElement *SerializedEventsDiff::mergeChanged(const XmlElement *state,
+    const XmlElement *changes, const String &resultTag) const
+{
+    Events stateEvents;
+    Events changesEvents;
+    this->collectEvents(state, stateEvents);
+    this->collectEvents(changes, changesEvents);
+
+    Array<const XmlElement *> result(stateEvents.list);
+
+    for (int i = 0; i < result.size(); ++i)
+    {
+        const MidiEvent::Id id = this->getId(*result.getUnchecked(i));
+
+        if (changesEvents.indexById.contains(id))
+        {
+            result.setUnchecked(i, changesEvents.list.getUnchecked(changesEvents.indexById[id]));
+        }
+    }
+
+    return SerializedEventsDiff::serialize(result, resultTag);
+}
+
+XmlElement *SerializedEventsDiff::serialize(const Array<const XmlElement *> &events, const String &tag)
+{
+    auto xml = new XmlElement(tag);
+
+    for (auto event : events)
+    {
+        xml->addChildElement(new XmlElement(*event));
+    }
+
+    return xml;
+}
+
+
+//===----------------------------------------------------------------------===//
+// Private
+//===----------------------------------------------------------------------===//
+
+void SerializedEventsDiff::collectEvents(const XmlElement *xml, Events &result) const
+{
+    if (xml == nullptr)
+    {
+        return;
+    }
+
+    forEachXmlChildElementWithTagName(*xml, e, this->eventTag)
+    {
+        // if the ids are duplicated, the first event wins
+        const MidiEvent::Id id = this->getId(*e);
+
+        if (! result.indexById.contains(id))
+        {
+            result.indexById.set(id, result.list.size());
+        }
+
+        result.list.add(e);
+
+        if (result.indexById.size() > result.indexById.getNumSlots() * 2)
+        {
+            result.indexById.remapTable(result.indexById.getNumSlots() * 4);
+        }
+    }
+}
+
+MidiEvent::Id SerializedEventsDiff::getId(const XmlElement &event) const
+{
+    return MidiEvent::idFromString(event.getStringAttribute(this->idAttribute));
+}
+
+bool SerializedEventsDiff::hasChanged(const XmlElement &before, const XmlElement &after) const
+{
+    for (const auto &attribute : this->comparedAttributes)
+    {
+        if (attribute.isNumber)
+        {
+            const float valueBefore = float(before.getDoubleAttribute(attribute.name, attribute.defaultValue));
+            const float valueAfter = float(after.getDoubleAttribute(attribute.name, attribute.defaultValue));
+
+            if (valueBefore != valueAfter)
+            {
+                return true;
+            }
+        }
+        else if (before.getStringAttribute(attribute.name) != after.getStringAttribute(attribute.name))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,98 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MidiEvent.h"
+
+namespace VCS
+{
+    // Diffs and merges the serialized events (notes, automation events, annotations)
+    // without deserializing them into the actual events and layers.
+    //
+    // The events of both deltas are matched by their ids with a hash join,
+    // so that all the operations are linear, and two events with the same id
+    // are considered changed, if any of the compared attributes differ.
+    // All the result lists point to the xml of the input deltas.
+
+    class SerializedEventsDiff
+    {
+    public:
+
+        explicit SerializedEventsDiff(const String &eventTag);
+
+        // Numbers are compared as floats, the same way the events deserialize them
+        SerializedEventsDiff &compareNumber(const Identifier &attribute, double defaultValue = 0.0);
+
+        SerializedEventsDiff &compareString(const Identifier &attribute);
+
+        struct Result
+        {
+            Array<const XmlElement *> added;
+            Array<const XmlElement *> removed;
+            Array<const XmlElement *> changed;
+        };
+
+        Result createDiff(const XmlElement *state, const XmlElement *changes) const;
+
+        //===------------------------------------------------------------------===//
+        // Merge
+        //
+
+        // State events, plus the added events which are not there yet
+        XmlElement *mergeAdded(const XmlElement *state, const XmlElement *changes, const String &resultTag) const;
+
+        // State events, except the removed ones
+        XmlElement *mergeRemoved(const XmlElement *state, const XmlElement *changes, const String &resultTag) const;
+
+        // State events, with the changed ones replaced
+        XmlElement *mergeChanged(const XmlElement *state, const XmlElement *changes, const String &resultTag) const;
+
+        static XmlElement *serialize(const Array<const XmlElement *> &events, const String &tag);
+
+    private:
+
+        // The events of a delta, and their positions by id
+        struct Events
+        {
+            Array<const XmlElement *> list;
+            HashMap<MidiEvent::Id, int> indexById;
+        };
+
+        void collectEvents(const XmlElement *xml, Events &result) const;
+
+        MidiEvent::Id getId(const XmlElement &event) const;
+
+        bool hasChanged(const XmlElement &before, const XmlElement &after) const;
+
+        String eventTag;
+
+        Identifier idAttribute;
+
+        struct ComparedAttribute
+        {
+            Identifier name;
+            bool isNumber;
+            double defaultValue;
+        };
+
+        Array<ComparedAttribute> comparedAttributes;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SerializedEventsDiff)
+
+    };
+} // namespace VCS
@@ -26,6 +26,11 @@
 #include "Diff.h"
 #include "DiffLogic.h"
 
+// Every N-th revision on the path from the root gets its state materialized
+#define HEAD_CHECKPOINT_INTERVAL 32
+#define HEAD_MAX_PERIODIC_CHECKPOINTS 64
+#define HEAD_MAX_RECENT_CHECKPOINTS 8
+
 using namespace VCS;
 
 Head::Head(const Head &other) :
@@ -36,7 +41,8 @@ Head::Head(const Head &other) :
     rebuildingDiffMode(false),
     diff(other.diff),
     headingAt(other.headingAt),
-    state(new HeadState(other.state))
+    state(new HeadState(other.state)),
+    checkpointsClock(0)
 {
     
 }
@@ -49,7 +55,8 @@ Head::Head(Pack::Ptr packPtr, WeakReference<TrackedItemsSource> targetProject) :
     rebuildingDiffMode(false),
     diff(packPtr, ""),
     headingAt(packPtr, ""),
-    state(nullptr)
+    state(nullptr),
+    checkpointsClock(0)
 {
     if (targetVcsItemsSource != nullptr)
     {
@@ -175,59 +182,60 @@ bool Head::moveTo(const Revision &revision)
 
     if (this->targetVcsItemsSource != nullptr)
     {
-        // здесь надо будет пройтись до корня и запомнить все ревизии
+        // идем до корня или до ближайшего сохраненного состояния и запоминаем все ревизии
         Array<Revision> treePath;
         Revision currentRevision(revision);
-
-        // сначала обнуляем состояние
-        {
-            ScopedWriteLock lock(this->stateLock);
-            this->state = new HeadState();
-        }
+        StateCheckpoint *checkpoint = nullptr;
 
         Logger::writeToLog("Head::moveTo " + currentRevision.getUuid());
 
         while (currentRevision.isValid())
         {
+            checkpoint = this->checkpointsIndex[currentRevision.getUuid()];
+
+            if (checkpoint != nullptr)
+            {
+                break;
+            }
+
             treePath.insert(0, currentRevision);
             currentRevision = Revision(currentRevision.getParent());
         }
 
-        // затем, идти по ним в обратном порядке - от корня
-        for (auto && i : treePath)
+        int depth = 0;
+        ScopedPointer<HeadState> newState;
+
+        if (checkpoint != nullptr)
         {
-            const Revision rev(i);
+            checkpoint->lastUsed = ++this->checkpointsClock;
+            newState = new HeadState(*checkpoint->state);
+            depth = checkpoint->depth;
+        }
+        else
+        {
+            newState = new HeadState();
+        }
 
+        // затем, идти по ним в обратном порядке - от корня или от найденного состояния
+        for (const auto &rev : treePath)
+        {
             Logger::writeToLog("Head::moveTo -> " + rev.getUuid());
+            applyRevision(*newState, rev);
+            ++depth;
 
-            // собираем все дельты и применяем их к текущему состоянию
-            for (int j = 0; j < rev.getNumProperties(); ++j)
+            if ((depth % HEAD_CHECKPOINT_INTERVAL) == 0)
             {
-                Identifier id = rev.getPropertyName(j);
-                const var &property = rev.getProperty(id);
-
-                if (RevisionItem *item = dynamic_cast<RevisionItem *>(property.getObject()))
-                {
-                    if (item->getType() == RevisionItem::Added)
-                    {
-                        // ::Ptr сам создастся конструктором из указателя и увеличит его счетчик ссылок
-                        this->state->addItem(item);
-                    }
-                    else if (item->getType() == RevisionItem::Removed)
-                    {
-                        this->state->removeItem(item);
-                    }
-                    else if (item->getType() == RevisionItem::Changed)
-                    {
-                        this->state->mergeItem(item);
-                    }
-                    else
-                    {
-                        jassertfalse;
-                    }
-                }
+                this->storeCheckpoint(rev.getUuid(), *newState, depth, true);
             }
         }
+
+        if (! treePath.isEmpty())
+        {
+            this->storeCheckpoint(revision.getUuid(), *newState, depth, false);
+        }
+
+        ScopedWriteLock lock(this->stateLock);
+        this->state = newState.release();
     }
 
     this->headingAt = revision;
@@ -242,6 +250,103 @@ void Head::pointTo(const Revision &revision)
 }
 
 
+//===----------------------------------------------------------------------===//
+// Checkpoints
+//===----------------------------------------------------------------------===//
+
+void Head::clearStateCheckpoints()
+{
+    this->checkpointsIndex.clear();
+    this->checkpoints.clear();
+}
+
+void Head::storeCheckpoint(const String &revisionId, const HeadState &targetState, int depth, bool isPeriodic)
+{
+    if (StateCheckpoint *existing = this->checkpointsIndex[revisionId])
+    {
+        existing->lastUsed = ++this->checkpointsClock;
+        existing->isPeriodic = existing->isPeriodic || isPeriodic;
+        return;
+    }
+
+    // the state items are immutable and shared, so the copy only takes the references
+    auto checkpoint = new StateCheckpoint();
+    checkpoint->revisionId = revisionId;
+    checkpoint->state = new HeadState(targetState);
+    checkpoint->depth = depth;
+    checkpoint->lastUsed = ++this->checkpointsClock;
+    checkpoint->isPeriodic = isPeriodic;
+
+    this->checkpoints.add(checkpoint);
+    this->checkpointsIndex.set(revisionId, checkpoint);
+
+    this->evictCheckpoints(isPeriodic,
+        isPeriodic ? HEAD_MAX_PERIODIC_CHECKPOINTS : HEAD_MAX_RECENT_CHECKPOINTS);
+}
+
+void Head::evictCheckpoints(bool isPeriodic, int maxToKeep)
+{
+    int numCheckpoints = 0;
+    
+    for (const auto checkpoint : this->checkpoints)
+    {
+        numCheckpoints += (checkpoint->isPeriodic == isPeriodic) ? 1 : 0;
+    }
+
+    while (numCheckpoints > maxToKeep)
+    {
+        int leastRecentlyUsed = -1;
+
+        for (int i = 0; i < this->checkpoints.size(); ++i)
+        {
+            const StateCheckpoint *checkpoint = this->checkpoints.getUnchecked(i);
+
+            if (checkpoint->isPeriodic == isPeriodic &&
+                (leastRecentlyUsed < 0 ||
+                 checkpoint->lastUsed < this->checkpoints.getUnchecked(leastRecentlyUsed)->lastUsed))
+            {
+                leastRecentlyUsed = i;
+            }
+        }
+
+        this->checkpointsIndex.remove(this->checkpoints.getUnchecked(leastRecentlyUsed)->revisionId);
+        this->checkpoints.remove(leastRecentlyUsed);
+        --numCheckpoints;
+    }
+}
+
+void Head::applyRevision(HeadState &targetState, const Revision &revision)
+{
+    // собираем все дельты и применяем их к текущему состоянию
+    for (int j = 0; j < revision.getNumProperties(); ++j)
+    {
+        Identifier id = revision.getPropertyName(j);
+        const var &property = revision.getProperty(id);
+
+        if (RevisionItem *item = dynamic_cast<RevisionItem *>(property.getObject()))
+        {
+            if (item->getType() == RevisionItem::Added)
+            {
+                // ::Ptr сам создастся конструктором из указателя и увеличит его счетчик ссылок
+                targetState.addItem(item);
+            }
+            else if (item->getType() == RevisionItem::Removed)
+            {
+                targetState.removeItem(item);
+            }
+            else if (item->getType() == RevisionItem::Changed)
+            {
+                targetState.mergeItem(item);
+            }
+            else
+            {
+                jassertfalse;
+            }
+        }
+    }
+}
+
+
 bool Head::resetChangedItemToState(const VCS::RevisionItem::Ptr diffItem)
 {
     if (this->targetVcsItemsSource == nullptr)
@@ -285,6 +390,7 @@ bool Head::resetChangedItemToState(const VCS::RevisionItem::Ptr diffItem)
         if (targetItem)
         {
             targetItem->getDiffLogic()->resetStateTo(*sourceItem);
+            targetItem->markVCSChanged();
             return true;
         }
     }
@@ -320,6 +426,7 @@ bool Head::resetChangedItemToState(const VCS::RevisionItem::Ptr diffItem)
         if (newItem)
         {
             newItem->getDiffLogic()->resetStateTo(*sourceItem);
+            newItem->markVCSChanged();
         }
         return true;
     }
@@ -431,6 +538,7 @@ void Head::checkoutItem(VCS::RevisionItem::Ptr stateItem)
         if (targetItem)
         {
             targetItem->getDiffLogic()->resetStateTo(*stateItem);
+            targetItem->markVCSChanged();
         }
     }
     else if (stateItem->getType() == RevisionItem::Added)
@@ -450,11 +558,13 @@ void Head::checkoutItem(VCS::RevisionItem::Ptr stateItem)
             if (newItem)
             {
                 newItem->getDiffLogic()->resetStateTo(*stateItem);
+                newItem->markVCSChanged();
             }
         }
         else
         {
             targetItem->getDiffLogic()->resetStateTo(*stateItem);
+            targetItem->markVCSChanged();
         }
     }
     else if (stateItem->getType() == RevisionItem::Removed)
@@ -566,6 +676,7 @@ void Head::deserialize(const XmlElement &xml)
 
 void Head::reset()
 {
+    this->clearStateCheckpoints();
     this->state = new HeadState();
     this->setDiffOutdated(true);
 }
@@ -596,213 +707,257 @@ void Head::run()
     this->setRebuildingDiffMode(true);
     this->sendChangeMessage();
 
+    if (this->buildDiff(true))
     {
-        ScopedWriteLock lock(this->diffLock);
-        this->diff.removeAllChildren(nullptr);
-        this->diff.removeAllProperties(nullptr);
+        this->setDiffOutdated(false);
     }
 
-    ScopedReadLock threadStateLock(this->stateLock);
+    this->setRebuildingDiffMode(false);
+    this->sendChangeMessage();
+}
 
-    for (int i = 0; i < this->state->getNumTrackedItems(); ++i)
-    {
-        if (this->threadShouldExit())
-        {
-            this->setRebuildingDiffMode(false);
-            this->sendChangeMessage();
-            return;
-        }
+void Head::rebuildDiffSynchronously()
+{
+    if (this->targetVcsItemsSource == nullptr)
+    { return; }
+    
+    if (this->state == nullptr)
+    { return; }
+    
+    if (this->isRebuildingDiff())
+    { return; }
+    
+    this->setRebuildingDiffMode(true);
+    this->buildDiff(false);
+    this->setDiffOutdated(false);
+    this->setRebuildingDiffMode(false);
+    this->sendChangeMessage();
+}
 
-        bool foundItemInTarget = false;
-        const RevisionItem::Ptr stateItem = static_cast<RevisionItem *>(this->state->getTrackedItem(i));
 
-        // записи удаления рассматриваем позже
-        if (stateItem->getType() == RevisionItem::Removed) { continue; }
+//===----------------------------------------------------------------------===//
+// Stage diff
+//===----------------------------------------------------------------------===//
 
-        for (int j = 0; j < this->targetVcsItemsSource->getNumTrackedItems(); ++j)
+namespace VCS
+{
+    struct StageDiffTask
+    {
+        String itemId;
+        RevisionItem::Ptr stateItem;
+        TrackedItem *targetItem;
+        int modificationStamp;
+    };
+
+    // Each worker takes the next pending item until there are none left,
+    // checking for the cancellation between the items
+    struct StageDiffJob : public ThreadPoolJob
+    {
+        StageDiffJob(Head &parentHead,
+                     const Array<StageDiffTask> &stageTasks,
+                     Atomic<int> &nextTaskIndex) :
+            ThreadPoolJob("StageDiffJob"),
+            head(parentHead),
+            tasks(stageTasks),
+            nextTask(nextTaskIndex) {}
+
+        JobStatus runJob() override
         {
-            if (this->threadShouldExit())
+            while (! this->shouldExit())
             {
-                this->setRebuildingDiffMode(false);
-                this->sendChangeMessage();
-                return;
+                const int taskIndex = (++this->nextTask) - 1;
+
+                if (taskIndex >= this->tasks.size())
+                {
+                    break;
+                }
+
+                this->stageItem(this->tasks.getReference(taskIndex));
             }
 
-            TrackedItem *targetItem = this->targetVcsItemsSource->getTrackedItem(j); // i.e. LayerTreeItem
+            return jobHasFinished;
+        }
+
+        void stageItem(const StageDiffTask &task)
+        {
+            Head::StagedItem result;
+            result.stateItem = task.stateItem;
+            result.modificationStamp = task.modificationStamp;
 
-            // айтем из состояния - существует в проекте. добавляем запись changed, если нужно.
-            if (stateItem->getUuid() == targetItem->getUuid())
+            if (task.stateItem != nullptr)
             {
-                foundItemInTarget = true;
-
-                ScopedPointer<Diff> itemDiff(targetItem->getDiffLogic()->createDiff(*stateItem));
+                ScopedPointer<Diff> itemDiff(task.targetItem->getDiffLogic()->createDiff(*task.stateItem));
 
                 if (itemDiff->hasAnyChanges())
                 {
-                    RevisionItem::Ptr revisionRecord(new RevisionItem(this->pack, RevisionItem::Changed, itemDiff));
-                    var revisionVar(revisionRecord);
-
-                    ScopedWriteLock itemDiffLock(this->diffLock);
-                    this->diff.setProperty(stateItem->getUuid().toString(), revisionVar, nullptr);
+                    result.record = new RevisionItem(this->head.pack, RevisionItem::Changed, itemDiff);
                 }
-
-                break;
             }
-        }
+            else
+            {
+                // the item is missing in the head state: the deltas are just copied from the project
+                result.record = new RevisionItem(this->head.pack, RevisionItem::Added, task.targetItem);
+            }
 
-        // айтем из состояния - в проекте не найден. добавляем запись removed.
-        if (! foundItemInTarget)
-        {
-            ScopedPointer<Diff> emptyDiff(new Diff(*stateItem));
+            this->head.publishStagedItem(task.itemId, result);
+        }
 
-            RevisionItem::Ptr revisionRecord(new RevisionItem(this->pack, RevisionItem::Removed, emptyDiff));
-            var revisionVar(revisionRecord);
+        Head &head;
+        const Array<StageDiffTask> &tasks;
+        Atomic<int> &nextTask;
+    };
+} // namespace VCS
 
-            ScopedWriteLock emptyDiffLock(this->diffLock);
-            this->diff.setProperty(stateItem->getUuid().toString(), revisionVar, nullptr);
-        }
+// Returns false if cancelled
+bool Head::buildDiff(bool canBeCancelled)
+{
+    {
+        ScopedWriteLock lock(this->diffLock);
+        this->diff.removeAllChildren(nullptr);
+        this->diff.removeAllProperties(nullptr);
     }
 
-    // теперь ищем айтемы в проекте, которые отсутствуют - или удалены - в состоянии
+    ScopedReadLock threadStateLock(this->stateLock);
+
+    // both sides are matched by uuid
+    HashMap<String, TrackedItem *> targetItems;
+    HashMap<String, RevisionItem *> stateItems;
+
     for (int i = 0; i < this->targetVcsItemsSource->getNumTrackedItems(); ++i)
     {
-        if (this->threadShouldExit())
-        {
-            this->setRebuildingDiffMode(false);
-            this->sendChangeMessage();
-            return;
-        }
-
-        bool foundItemInState = false;
-        TrackedItem *targetItem = this->targetVcsItemsSource->getTrackedItem(i);
+        TrackedItem *targetItem = this->targetVcsItemsSource->getTrackedItem(i); // i.e. LayerTreeItem
+        targetItems.set(targetItem->getUuid().toString(), targetItem);
+    }
 
-        for (int j = 0; j < this->state->getNumTrackedItems(); ++j)
-        {
-            const RevisionItem::Ptr stateItem = static_cast<RevisionItem *>(this->state->getTrackedItem(j));
+    // only the items, changed since the last pass, are diffed again
+    Array<StageDiffTask> tasks;
 
-            if (stateItem->getType() == RevisionItem::Removed) { continue; }
+    auto stageItem = [&](const String &itemId, RevisionItem *stateItem, TrackedItem *targetItem)
+    {
+        const int modificationStamp = targetItem->getVCSModificationStamp();
+        StagedItem staged;
 
-            if (stateItem->getUuid() == targetItem->getUuid())
-            {
-                foundItemInState = true;
-                break;
-            }
+        {
+            ScopedLock lock(this->stagedItemsLock);
+            staged = this->stagedItems[itemId];
         }
 
-        // и добавляем запись - added, с дельтами, которые тупо копируем у targetItem
-        if (! foundItemInState)
+        if (staged.stateItem.get() == stateItem &&
+            staged.modificationStamp == modificationStamp)
         {
-            RevisionItem::Ptr revisionRecord(new RevisionItem(this->pack, RevisionItem::Added, targetItem));
-            var revisionVar(revisionRecord);
-
-            ScopedWriteLock lock(this->diffLock);
-            this->diff.setProperty(targetItem->getUuid().toString(), revisionVar, nullptr);
+            this->addDiffRecord(itemId, staged.record);
         }
-    }
-
-    this->setDiffOutdated(false);
-    this->setRebuildingDiffMode(false);
-    this->sendChangeMessage();
-}
+        else
+        {
+            const StageDiffTask task = { itemId, stateItem, targetItem, modificationStamp };
+            tasks.add(task);
+        }
+    };
 
-// warning код практически дублирует Head::run
-void Head::rebuildDiffSynchronously()
-{
-    if (this->targetVcsItemsSource == nullptr)
-    { return; }
-    
-    if (this->state == nullptr)
-    { return; }
-    
-    if (this->isRebuildingDiff())
-    { return; }
-    
-    this->setRebuildingDiffMode(true);
-    
-    {
-        ScopedWriteLock lock(this->diffLock);
-        this->diff.removeAllChildren(nullptr);
-        this->diff.removeAllProperties(nullptr);
-    }
-    
-    ScopedReadLock rebuildStateLock(this->stateLock);
-    
     for (int i = 0; i < this->state->getNumTrackedItems(); ++i)
     {
-        bool foundItemInTarget = false;
         const RevisionItem::Ptr stateItem = static_cast<RevisionItem *>(this->state->getTrackedItem(i));
-        
+
         // записи удаления рассматриваем позже
         if (stateItem->getType() == RevisionItem::Removed) { continue; }
-        
-        for (int j = 0; j < this->targetVcsItemsSource->getNumTrackedItems(); ++j)
+
+        const String itemId(stateItem->getUuid().toString());
+        stateItems.set(itemId, stateItem);
+
+        // айтем из состояния - существует в проекте. добавляем запись changed, если нужно.
+        if (TrackedItem *targetItem = targetItems[itemId])
         {
-            TrackedItem *targetItem = this->targetVcsItemsSource->getTrackedItem(j); // i.e. LayerTreeItem
-            
-            // айтем из состояния - существует в проекте. добавляем запись changed, если нужно.
-            if (stateItem->getUuid() == targetItem->getUuid())
-            {
-                foundItemInTarget = true;
-                
-                ScopedPointer<Diff> itemDiff(targetItem->getDiffLogic()->createDiff(*stateItem));
-                
-                if (itemDiff->hasAnyChanges())
-                {
-                    RevisionItem::Ptr revisionRecord(new RevisionItem(this->pack, RevisionItem::Changed, itemDiff));
-                    var revisionVar(revisionRecord);
-                    
-                    ScopedWriteLock lock(this->diffLock);
-                    this->diff.setProperty(stateItem->getUuid().toString(), revisionVar, nullptr);
-                }
-                
-                break;
-            }
+            stageItem(itemId, stateItem, targetItem);
         }
-        
         // айтем из состояния - в проекте не найден. добавляем запись removed.
-        if (! foundItemInTarget)
+        else
         {
             ScopedPointer<Diff> emptyDiff(new Diff(*stateItem));
-            
-            RevisionItem::Ptr revisionRecord(new RevisionItem(this->pack, RevisionItem::Removed, emptyDiff));
-            var revisionVar(revisionRecord);
-            
-            ScopedWriteLock lock(this->diffLock);
-            this->diff.setProperty(stateItem->getUuid().toString(), revisionVar, nullptr);
+            this->addDiffRecord(itemId, new RevisionItem(this->pack, RevisionItem::Removed, emptyDiff));
         }
     }
-    
+
     // теперь ищем айтемы в проекте, которые отсутствуют - или удалены - в состоянии
     for (int i = 0; i < this->targetVcsItemsSource->getNumTrackedItems(); ++i)
     {
-        bool foundItemInState = false;
         TrackedItem *targetItem = this->targetVcsItemsSource->getTrackedItem(i);
-        
-        for (int j = 0; j < this->state->getNumTrackedItems(); ++j)
+        const String itemId(targetItem->getUuid().toString());
+
+        if (! stateItems.contains(itemId))
         {
-            const RevisionItem::Ptr stateItem = static_cast<RevisionItem *>(this->state->getTrackedItem(j));
-            
-            if (stateItem->getType() == RevisionItem::Removed) { continue; }
-            
-            if (stateItem->getUuid() == targetItem->getUuid())
+            stageItem(itemId, nullptr, targetItem);
+        }
+    }
+
+    if (tasks.size() > 0)
+    {
+        Atomic<int> nextTask;
+        OwnedArray<StageDiffJob> jobs;
+        const int numWorkers = jmin(SystemStats::getNumCpus(), tasks.size());
+        ThreadPool workers(numWorkers);
+
+        for (int i = 0; i < numWorkers; ++i)
+        {
+            workers.addJob(jobs.add(new StageDiffJob(*this, tasks, nextTask)), false);
+        }
+
+        for (auto job : jobs)
+        {
+            while (! workers.waitForJobToFinish(job, 20))
             {
-                foundItemInState = true;
-                break;
+                if (canBeCancelled && this->threadShouldExit())
+                {
+                    // the jobs stop after their current items,
+                    // and they must be finished before they are deleted
+                    workers.removeAllJobs(true, -1);
+                    return false;
+                }
             }
         }
-        
-        // и добавляем запись - added, с дельтами, которые тупо копируем у targetItem
-        if (! foundItemInState)
+    }
+
+    // forget the records of the items which are gone from both sides
+    ScopedLock lock(this->stagedItemsLock);
+    StringArray staleItems;
+
+    for (HashMap<String, StagedItem>::Iterator i(this->stagedItems); i.next();)
+    {
+        if (! targetItems.contains(i.getKey()))
         {
-            RevisionItem::Ptr revisionRecord(new RevisionItem(this->pack, RevisionItem::Added, targetItem));
-            var revisionVar(revisionRecord);
-            
-            ScopedWriteLock lock(this->diffLock);
-            this->diff.setProperty(targetItem->getUuid().toString(), revisionVar, nullptr);
+            staleItems.add(i.getKey());
         }
     }
-    
-    this->setDiffOutdated(false);
-    this->setRebuildingDiffMode(false);
+
+    for (const auto &itemId : staleItems)
+    {
+        this->stagedItems.remove(itemId);
+    }
+
+    return true;
+}
+
+void Head::publishStagedItem(const String &itemId, const StagedItem &item)
+{
+    {
+        ScopedLock lock(this->stagedItemsLock);
+        this->stagedItems.set(itemId, item);
+    }
+
+    this->addDiffRecord(itemId, item.record);
+}
+
+void Head::addDiffRecord(const String &itemId, RevisionItem::Ptr record)
+{
+    if (record == nullptr)
+    {
+        return;
+    }
+
+    {
+        ScopedWriteLock lock(this->diffLock);
+        this->diff.setProperty(itemId, var(record.get()), nullptr);
+    }
+
+    // the stage is updated as soon as each item is ready, not after the whole pass
     this->sendChangeMessage();
 }
@@ -27,6 +27,7 @@ namespace VCS
     class TrackedItem;
     class TrackedItemsSource;
     class DeltaDataSource;
+    struct StageDiffJob;
 
     class Head :
         private Thread,
@@ -62,6 +63,9 @@ namespace VCS
         
         void pointTo(const Revision &revision); // не перестраивает индекс
         
+        // Should be called whenever the existing revisions are modified in place
+        void clearStateCheckpoints();
+        
         bool resetChangedItemToState(const VCS::RevisionItem::Ptr diffItem);
 
         void checkout();
@@ -105,6 +109,30 @@ namespace VCS
 
         void checkoutItem(VCS::RevisionItem::Ptr stateItem);
 
+        //===------------------------------------------------------------------===//
+        // Stage diff
+        //
+
+        // The diff record of a tracked item, reused until either the item itself
+        // or its head state record changes; the record is null when nothing has changed
+        struct StagedItem
+        {
+            StagedItem() : modificationStamp(0) {}
+
+            RevisionItem::Ptr stateItem;
+            int modificationStamp;
+            RevisionItem::Ptr record;
+        };
+
+        CriticalSection stagedItemsLock;
+        HashMap<String, StagedItem> stagedItems;
+
+        bool buildDiff(bool canBeCancelled);
+        void publishStagedItem(const String &itemId, const StagedItem &item);
+        void addDiffRecord(const String &itemId, RevisionItem::Ptr record);
+
+        friend struct StageDiffJob;
+
         ReadWriteLock outdatedMarkerLock;
         bool diffOutdated;
 
@@ -122,6 +150,32 @@ namespace VCS
 
         ScopedPointer<HeadState> state;
 
+    private:
+
+        //===------------------------------------------------------------------===//
+        // Checkpoints
+        //
+
+        // The materialized head states, which moveTo replays the path from,
+        // instead of going all the way from the root
+        struct StateCheckpoint
+        {
+            String revisionId;
+            ScopedPointer<HeadState> state;
+            int depth;
+            uint32 lastUsed;
+            bool isPeriodic;
+        };
+
+        OwnedArray<StateCheckpoint> checkpoints;
+        HashMap<String, StateCheckpoint *> checkpointsIndex;
+        uint32 checkpointsClock;
+
+        void storeCheckpoint(const String &revisionId, const HeadState &targetState, int depth, bool isPeriodic);
+        void evictCheckpoints(bool isPeriodic, int maxToKeep);
+
+        static void applyRevision(HeadState &targetState, const Revision &revision);
+
     private:
 
         WeakReference<TrackedItemsSource> targetVcsItemsSource; // ProjectTreeItem
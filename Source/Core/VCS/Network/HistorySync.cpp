@@ -0,0 +1,823 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "HistorySync.h"
+#include "VersionControl.h"
+#include "DataEncoder.h"
+#include "SerializationKeys.h"
+
+using namespace VCS;
+
+//
+// The remote history is stored as the manifest and the objects.
+//
+// The manifest is the tree of revisions without their data: for each revision,
+// its id, its own hash and the hash of its subtree, as VersionControl calculates them.
+// The objects are the revisions without children, and the pack entries.
+// Everything is encrypted, and the objects are named by the salted hashes of their ids.
+//
+// Both pull and push walk the local tree along with the remote manifest,
+// skipping the subtrees with the same hashes, so only the revisions which differ
+// are compared; the server is asked which of the objects it lacks,
+// and the pull only asks for the pack entries missing in the local pack.
+//
+// The released clients can't read the manifests, so the histories they have
+// pushed as one encrypted blob are still pulled and pushed as the blobs,
+// and so is everything on the servers which don't answer with the protocol header.
+//
+
+template <typename HashMapType>
+static void growIfNeeded(HashMapType &hashMap)
+{
+    if (hashMap.size() > hashMap.getNumSlots() * 2)
+    {
+        hashMap.remapTable(hashMap.getNumSlots() * 4);
+    }
+}
+
+static SyncThread::State getErrorState(SyncTransport::Status status,
+                                       SyncThread::State otherwise)
+{
+    switch (status)
+    {
+        case SyncTransport::unauthorized:
+            return SyncThread::unauthorizedError;
+
+        case SyncTransport::forbidden:
+            return SyncThread::forbiddenError;
+
+        // someone has pushed since the manifest was fetched
+        case SyncTransport::outdated:
+            return SyncThread::mergeError;
+
+        default:
+            return otherwise;
+    }
+}
+
+static Revision findChildById(const Revision &parent, const String &id)
+{
+    for (int i = 0; i < parent.getNumChildren(); ++i)
+    {
+        const Revision child(parent.getChild(i));
+
+        if (child.getUuid() == id)
+        {
+            return child;
+        }
+    }
+
+    return Revision(ValueTree());
+}
+
+// The same as VersionControl::getSubtreeHash, for the manifest node
+static String calculateSubtreeHash(const XmlElement &node)
+{
+    StringArray childrenHashes;
+
+    forEachXmlChildElementWithTagName(node, child, Serialization::VCS::revision)
+    {
+        childrenHashes.add(child->getStringAttribute(Serialization::VCS::commitId) +
+                           child->getStringAttribute(Serialization::VCS::subtreeHash));
+    }
+
+    childrenHashes.sort(true);
+
+    const String sum(node.getStringAttribute(Serialization::VCS::revisionHash) + childrenHashes.joinIntoString(""));
+    return MD5(sum.toUTF8()).toHexString();
+}
+
+HistorySync::HistorySync(SyncTransport &syncTransport,
+                         const MemoryBlock &historyKey,
+                         SyncThread *progressThread) :
+    transport(syncTransport),
+    key(historyKey),
+    namesSalt(SHA256(historyKey).toHexString()),
+    thread(progressThread)
+{
+}
+
+
+//===----------------------------------------------------------------------===//
+// Push
+//===----------------------------------------------------------------------===//
+
+SyncThread::State HistorySync::push(VersionControl &history)
+{
+    this->setState(SyncThread::fetchHistory);
+
+    MemoryBlock manifestData;
+    SyncTransport::Protocol serverProtocol = SyncTransport::wholeHistory;
+    const SyncTransport::Status manifestStatus = this->transport.fetchManifest(manifestData, serverProtocol);
+
+    // there's no manifest yet when pushing a new project
+    if (manifestStatus != SyncTransport::ok &&
+        manifestStatus != SyncTransport::notFound)
+    {
+        return getErrorState(manifestStatus, SyncThread::fetchHistoryError);
+    }
+
+    if (serverProtocol == SyncTransport::wholeHistory)
+    {
+        return this->pushWholeHistory(history, manifestData, manifestStatus == SyncTransport::ok);
+    }
+
+    // the history pushed by the released clients is kept as the blob they can read
+    if (manifestStatus == SyncTransport::notFound)
+    {
+        MemoryBlock historyData;
+        const SyncTransport::Status historyStatus = this->transport.fetchHistory(historyData);
+
+        if (historyStatus == SyncTransport::ok)
+        {
+            return this->pushWholeHistory(history, historyData, true);
+        }
+
+        if (historyStatus != SyncTransport::notFound)
+        {
+            return getErrorState(historyStatus, SyncThread::fetchHistoryError);
+        }
+    }
+
+    ScopedPointer<XmlElement> remoteManifest;
+    const XmlElement *remoteRoot = nullptr;
+    String baseManifestHash;
+
+    if (manifestStatus == SyncTransport::ok)
+    {
+        remoteManifest = DataEncoder::createDecryptedXml(manifestData, this->key);
+        remoteRoot = (remoteManifest != nullptr) ?
+            remoteManifest->getChildByName(Serialization::VCS::revision) : nullptr;
+
+        if (remoteRoot == nullptr)
+        {
+            Logger::writeToLog("Wrong key!");
+            return SyncThread::fetchHistoryError;
+        }
+
+        baseManifestHash = MD5(manifestData).toHexString();
+    }
+
+
+    //===------------------------------------------------------------------===//
+    // Do some checks
+    //===------------------------------------------------------------------===//
+
+    this->setState(SyncThread::merge);
+
+    // the missing remote history is compared as the empty one
+    const String emptyRootHash(Revision().calculateHash().toHexString());
+
+    const int64 remoteVersion = (remoteManifest != nullptr) ?
+        remoteManifest->getStringAttribute(Serialization::VCS::vcsHistoryVersion).getLargeIntValue() : 1;
+
+    const String remoteHash = (remoteRoot != nullptr) ?
+        remoteRoot->getStringAttribute(Serialization::VCS::subtreeHash) : MD5(emptyRootHash.toUTF8()).toHexString();
+
+    const String localHash(history.calculateHash().toHexString());
+
+    Logger::writeToLog("Local version: " + String(history.getVersion()));
+    Logger::writeToLog("Remote version: " + String(remoteVersion));
+    Logger::writeToLog("Local hash: " + localHash);
+    Logger::writeToLog("Remote hash: " + remoteHash);
+
+    if (history.getVersion() == remoteVersion && localHash == remoteHash)
+    {
+        return SyncThread::upToDate;
+    }
+
+    // пуш разрешен, только если локальная версия больше, либо версии равны, но не равны хэши
+    if (history.getVersion() < remoteVersion)
+    {
+        return SyncThread::mergeError;
+    }
+
+
+    //===------------------------------------------------------------------===//
+    // Merge two trees
+    //===------------------------------------------------------------------===//
+
+    Array<Revision> revisionsToSend;
+
+    XmlElement mergedManifest(Serialization::VCS::historyManifest);
+    mergedManifest.setAttribute(Serialization::VCS::vcsHistoryVersion, String(history.getVersion() + 1));
+    mergedManifest.setAttribute(Serialization::VCS::vcsHistoryId, history.getPublicId());
+    mergedManifest.setAttribute(Serialization::VCS::headRevisionId, history.head.getHeadingRevision().getUuid());
+    mergedManifest.addChildElement(this->createMergedNode(history, history.root, remoteRoot, revisionsToSend));
+
+    StringArray revisionNames;
+    Array<PackEntry> packEntries;
+    HashMap<String, int> packEntriesIndex;
+
+    for (const auto &revision : revisionsToSend)
+    {
+        revisionNames.add(this->getRevisionObjectName(revision.getUuid(), revision.calculateHash().toHexString()));
+        this->collectPackEntries(revision, nullptr, packEntries, packEntriesIndex);
+    }
+
+    StringArray names(revisionNames);
+
+    for (const auto &entry : packEntries)
+    {
+        names.add(entry.name);
+    }
+
+
+    //===------------------------------------------------------------------===//
+    // Push the objects the server doesn't have
+    //===------------------------------------------------------------------===//
+
+    this->setState(SyncThread::sync);
+
+    StringArray missingNames;
+
+    if (names.size() > 0)
+    {
+        const SyncTransport::Status status = this->transport.findMissingObjects(names, missingNames);
+
+        if (status != SyncTransport::ok)
+        {
+            return getErrorState(status, SyncThread::syncError);
+        }
+    }
+
+    HashMap<String, bool> missingObjects;
+
+    for (const auto &name : missingNames)
+    {
+        missingObjects.set(name, true);
+        growIfNeeded(missingObjects);
+    }
+
+    SyncObjects objects;
+
+    for (int i = 0; i < revisionsToSend.size(); ++i)
+    {
+        if (missingObjects.contains(revisionNames[i]))
+        {
+            ScopedPointer<XmlElement> revisionXml(revisionsToSend.getReference(i).serializeWithoutChildren());
+            const MemoryBlock revisionData(DataEncoder::encryptXmlStreamed(*revisionXml, this->key));
+
+            if (revisionData.getSize() == 0)
+            {
+                return SyncThread::syncError;
+            }
+
+            objects.add(revisionNames[i], revisionData);
+        }
+    }
+
+    for (const auto &entry : packEntries)
+    {
+        if (missingObjects.contains(entry.name))
+        {
+            ScopedPointer<XmlElement> deltaData(entry.item->createDeltaDataFor(entry.deltaIndex));
+
+            if (deltaData != nullptr)
+            {
+                const MemoryBlock packData(DataEncoder::encryptXmlStreamed(*deltaData, this->key));
+
+                if (packData.getSize() == 0)
+                {
+                    return SyncThread::syncError;
+                }
+
+                objects.add(entry.name, packData);
+            }
+        }
+    }
+
+    const MemoryBlock encryptedManifest(DataEncoder::encryptXmlStreamed(mergedManifest, this->key));
+
+    if (encryptedManifest.getSize() == 0)
+    {
+        return SyncThread::syncError;
+    }
+
+    const SyncTransport::Status status = this->transport.pushObjects(objects, encryptedManifest, baseManifestHash);
+
+    if (status != SyncTransport::ok)
+    {
+        return getErrorState(status, SyncThread::syncError);
+    }
+
+    return SyncThread::allDone;
+}
+
+// Mirrors remoteHistory.mergeWith(localHistory) on the manifest:
+// the remote revisions are kept, the local ones are added,
+// and the local revision wins where their own hashes differ
+XmlElement *HistorySync::createMergedNode(const VersionControl &history,
+                                          const Revision &localRevision,
+                                          const XmlElement *remoteNode,
+                                          Array<Revision> &revisionsToSend) const
+{
+    const String localHash(localRevision.calculateHash().toHexString());
+    const String localSubtreeHash(history.getSubtreeHash(localRevision).toHexString());
+
+    if (remoteNode != nullptr &&
+        remoteNode->getStringAttribute(Serialization::VCS::subtreeHash) == localSubtreeHash)
+    {
+        return new XmlElement(*remoteNode);
+    }
+
+    const bool remoteHasSameRevision = (remoteNode != nullptr &&
+        remoteNode->getStringAttribute(Serialization::VCS::revisionHash) == localHash);
+
+    auto node = new XmlElement(Serialization::VCS::revision);
+
+    node->setAttribute(Serialization::VCS::commitId, remoteHasSameRevision ?
+        remoteNode->getStringAttribute(Serialization::VCS::commitId) : localRevision.getUuid());
+
+    node->setAttribute(Serialization::VCS::revisionHash, localHash);
+
+    if (! remoteHasSameRevision)
+    {
+        revisionsToSend.add(localRevision);
+    }
+
+    if (remoteNode != nullptr)
+    {
+        forEachXmlChildElementWithTagName(*remoteNode, remoteChild, Serialization::VCS::revision)
+        {
+            const Revision localChild(findChildById(localRevision,
+                remoteChild->getStringAttribute(Serialization::VCS::commitId)));
+
+            node->addChildElement(localChild.isValid() ?
+                this->createMergedNode(history, localChild, remoteChild, revisionsToSend) :
+                new XmlElement(*remoteChild));
+        }
+    }
+
+    for (int i = 0; i < localRevision.getNumChildren(); ++i)
+    {
+        const Revision localChild(localRevision.getChild(i));
+
+        if (remoteNode == nullptr ||
+            remoteNode->getChildByAttribute(Serialization::VCS::commitId, localChild.getUuid()) == nullptr)
+        {
+            node->addChildElement(this->createMergedNode(history, localChild, nullptr, revisionsToSend));
+        }
+    }
+
+    node->setAttribute(Serialization::VCS::subtreeHash, calculateSubtreeHash(*node));
+    return node;
+}
+
+
+//===----------------------------------------------------------------------===//
+// Pull
+//===----------------------------------------------------------------------===//
+
+SyncThread::State HistorySync::pull(VersionControl &history)
+{
+    this->setState(SyncThread::fetchHistory);
+
+    MemoryBlock manifestData;
+    SyncTransport::Protocol serverProtocol = SyncTransport::wholeHistory;
+    const SyncTransport::Status manifestStatus = this->transport.fetchManifest(manifestData, serverProtocol);
+
+    if (serverProtocol == SyncTransport::wholeHistory)
+    {
+        if (manifestStatus != SyncTransport::ok)
+        {
+            return getErrorState(manifestStatus, SyncThread::fetchHistoryError);
+        }
+
+        return this->pullWholeHistory(history, manifestData);
+    }
+
+    if (manifestStatus == SyncTransport::notFound)
+    {
+        MemoryBlock historyData;
+        const SyncTransport::Status historyStatus = this->transport.fetchHistory(historyData);
+
+        if (historyStatus != SyncTransport::ok)
+        {
+            return getErrorState(historyStatus, SyncThread::fetchHistoryError);
+        }
+
+        return this->pullWholeHistory(history, historyData);
+    }
+
+    if (manifestStatus != SyncTransport::ok)
+    {
+        return getErrorState(manifestStatus, SyncThread::fetchHistoryError);
+    }
+
+    ScopedPointer<XmlElement> remoteManifest(DataEncoder::createDecryptedXml(manifestData, this->key));
+
+    const XmlElement *remoteRoot = (remoteManifest != nullptr) ?
+        remoteManifest->getChildByName(Serialization::VCS::revision) : nullptr;
+
+    if (remoteRoot == nullptr)
+    {
+        // видимо, неверный ключ
+        return SyncThread::fetchHistoryError;
+    }
+
+
+    //===------------------------------------------------------------------===//
+    // Do some checks
+    //===------------------------------------------------------------------===//
+
+    this->setState(SyncThread::merge);
+
+    const int64 remoteVersion =
+        remoteManifest->getStringAttribute(Serialization::VCS::vcsHistoryVersion).getLargeIntValue();
+
+    const String remoteHash(remoteRoot->getStringAttribute(Serialization::VCS::subtreeHash));
+    const String localHash(history.calculateHash().toHexString());
+
+    Logger::writeToLog("Local version: " + String(history.getVersion()));
+    Logger::writeToLog("Remote version: " + String(remoteVersion));
+    Logger::writeToLog("Local hash: " + localHash);
+    Logger::writeToLog("Remote hash: " + remoteHash);
+
+    // итак, пулл разрешен только если серверная версия больше.
+    // если версии равны и равны хэши - up to date
+    // остальное - ошибка.
+
+    if (history.getVersion() == remoteVersion && localHash == remoteHash)
+    {
+        return SyncThread::upToDate;
+    }
+
+    if (remoteVersion <= history.getVersion())
+    {
+        return SyncThread::mergeError;
+    }
+
+
+    //===------------------------------------------------------------------===//
+    // Fetch the revisions which differ, and the missing pack entries
+    //===------------------------------------------------------------------===//
+
+    this->setState(SyncThread::sync);
+
+    StringArray revisionNames;
+    this->findRevisionsToFetch(history, history.root, *remoteRoot, revisionNames);
+
+    SyncObjects revisionObjects;
+
+    if (revisionNames.size() > 0)
+    {
+        const SyncTransport::Status status = this->transport.fetchObjects(revisionNames, revisionObjects);
+
+        if (status != SyncTransport::ok)
+        {
+            return getErrorState(status, SyncThread::syncError);
+        }
+    }
+
+    HashMap<String, Revision> fetchedRevisions;
+    Array<PackEntry> packEntries;
+    HashMap<String, int> packEntriesIndex;
+
+    for (const auto &name : revisionNames)
+    {
+        const int index = revisionObjects.indexOf(name);
+
+        ScopedPointer<XmlElement> revisionXml((index >= 0) ?
+            DataEncoder::createDecryptedXml(revisionObjects.getData(index), this->key) : nullptr);
+
+        if (revisionXml == nullptr)
+        {
+            return SyncThread::syncError;
+        }
+
+        Revision revision(history.pack, "");
+        revision.deserialize(*revisionXml);
+
+        fetchedRevisions.set(revision.getUuid(), revision);
+        growIfNeeded(fetchedRevisions);
+
+        this->collectPackEntries(revision, history.pack, packEntries, packEntriesIndex);
+    }
+
+    if (packEntries.size() > 0)
+    {
+        StringArray packNames;
+
+        for (const auto &entry : packEntries)
+        {
+            packNames.add(entry.name);
+        }
+
+        SyncObjects packObjects;
+        const SyncTransport::Status status = this->transport.fetchObjects(packNames, packObjects);
+
+        if (status != SyncTransport::ok)
+        {
+            return getErrorState(status, SyncThread::syncError);
+        }
+
+        for (const auto &entry : packEntries)
+        {
+            const int index = packObjects.indexOf(entry.name);
+
+            ScopedPointer<XmlElement> deltaData((index >= 0) ?
+                DataEncoder::createDecryptedXml(packObjects.getData(index), this->key) : nullptr);
+
+            if (deltaData == nullptr)
+            {
+                return SyncThread::syncError;
+            }
+
+            history.pack->setDeltaDataFor(entry.item->getUuid(),
+                                          entry.item->getDelta(entry.deltaIndex)->getUuid(),
+                                          *deltaData);
+        }
+    }
+
+
+    //===------------------------------------------------------------------===//
+    // Merge two trees
+    //===------------------------------------------------------------------===//
+
+    this->applyFetchedRevisions(history, history.root, *remoteRoot, fetchedRevisions);
+
+    history.finishMerge(remoteManifest->getStringAttribute(Serialization::VCS::vcsHistoryId, history.getPublicId()),
+                        remoteVersion,
+                        remoteManifest->getStringAttribute(Serialization::VCS::headRevisionId));
+
+    return SyncThread::allDone;
+}
+
+// The dry run of applyFetchedRevisions, which only collects the names
+void HistorySync::findRevisionsToFetch(const VersionControl &history,
+                                       const Revision &localRevision,
+                                       const XmlElement &remoteNode,
+                                       StringArray &names) const
+{
+    const bool existsLocally = localRevision.isValid();
+
+    if (existsLocally &&
+        history.getSubtreeHash(localRevision).toHexString() == remoteNode.getStringAttribute(Serialization::VCS::subtreeHash))
+    {
+        return;
+    }
+
+    const String remoteHash(remoteNode.getStringAttribute(Serialization::VCS::revisionHash));
+
+    if (! existsLocally || localRevision.calculateHash().toHexString() != remoteHash)
+    {
+        names.add(this->getRevisionObjectName(remoteNode.getStringAttribute(Serialization::VCS::commitId), remoteHash));
+    }
+
+    forEachXmlChildElementWithTagName(remoteNode, remoteChild, Serialization::VCS::revision)
+    {
+        const Revision localChild(existsLocally ?
+            findChildById(localRevision, remoteChild->getStringAttribute(Serialization::VCS::commitId)) :
+            Revision(ValueTree()));
+
+        this->findRevisionsToFetch(history, localChild, *remoteChild, names);
+    }
+}
+
+// Mirrors localHistory.mergeWith(remoteHistory) on the manifest:
+// the remote revision wins where their own hashes differ,
+// and the revisions missing locally are copied
+void HistorySync::applyFetchedRevisions(VersionControl &history,
+                                        Revision localRevision,
+                                        const XmlElement &remoteNode,
+                                        const HashMap<String, Revision> &fetchedRevisions) const
+{
+    if (history.getSubtreeHash(localRevision).toHexString() ==
+        remoteNode.getStringAttribute(Serialization::VCS::subtreeHash))
+    {
+        return;
+    }
+
+    const String remoteId(remoteNode.getStringAttribute(Serialization::VCS::commitId));
+    const String remoteHash(remoteNode.getStringAttribute(Serialization::VCS::revisionHash));
+
+    if (localRevision.calculateHash().toHexString() != remoteHash &&
+        fetchedRevisions.contains(remoteId))
+    {
+        localRevision.copyPropertiesFrom(fetchedRevisions[remoteId]);
+        localRevision.flushData();
+    }
+
+    forEachXmlChildElementWithTagName(remoteNode, remoteChild, Serialization::VCS::revision)
+    {
+        const String childId(remoteChild->getStringAttribute(Serialization::VCS::commitId));
+        const Revision localChild(findChildById(localRevision, childId));
+
+        if (localChild.isValid())
+        {
+            this->applyFetchedRevisions(history, localChild, *remoteChild, fetchedRevisions);
+        }
+        else if (fetchedRevisions.contains(childId))
+        {
+            Revision newLocalChild(history.pack, "");
+            newLocalChild.copyPropertiesFrom(fetchedRevisions[childId]);
+            newLocalChild.flushData();
+            localRevision.addChild(newLocalChild, -1, nullptr);
+            this->applyFetchedRevisions(history, newLocalChild, *remoteChild, fetchedRevisions);
+        }
+        else
+        {
+            jassertfalse;
+        }
+    }
+}
+
+
+//===----------------------------------------------------------------------===//
+// Private
+//===----------------------------------------------------------------------===//
+
+void HistorySync::setState(SyncThread::State state)
+{
+    if (this->thread != nullptr)
+    {
+        this->thread->setState(state);
+    }
+}
+
+String HistorySync::getRevisionObjectName(const String &revisionId, const String &revisionHash) const
+{
+    const String name("revision" + revisionId + revisionHash + this->namesSalt);
+    return SHA256(name.toUTF8()).toHexString();
+}
+
+String HistorySync::getPackObjectName(const Uuid &itemId, const Uuid &deltaId) const
+{
+    const String name("pack" + itemId.toString() + deltaId.toString() + this->namesSalt);
+    return SHA256(name.toUTF8()).toHexString();
+}
+
+// Adds the pack entries of the revision's items, except those the local pack already has
+void HistorySync::collectPackEntries(const Revision &revision,
+                                     Pack::Ptr localPack,
+                                     Array<PackEntry> &entries,
+                                     HashMap<String, int> &entriesIndex) const
+{
+    for (int i = 0; i < revision.getNumProperties(); ++i)
+    {
+        const var property(revision.getProperty(revision.getPropertyName(i)));
+        RevisionItem *revItem = dynamic_cast<RevisionItem *>(property.getObject());
+
+        if (revItem == nullptr)
+        {
+            continue;
+        }
+
+        for (int j = 0; j < revItem->getNumDeltas(); ++j)
+        {
+            const Uuid deltaId(revItem->getDelta(j)->getUuid());
+
+            if (localPack != nullptr && localPack->containsDeltaDataFor(revItem->getUuid(), deltaId))
+            {
+                continue;
+            }
+
+            const String name(this->getPackObjectName(revItem->getUuid(), deltaId));
+
+            if (! entriesIndex.contains(name))
+            {
+                entriesIndex.set(name, entries.size());
+                growIfNeeded(entriesIndex);
+
+                const PackEntry entry = { revItem, j, name };
+                entries.add(entry);
+            }
+        }
+    }
+}
+
+
+//===----------------------------------------------------------------------===//
+// Whole history
+//===----------------------------------------------------------------------===//
+
+SyncThread::State HistorySync::pushWholeHistory(VersionControl &history,
+                                                const MemoryBlock &remoteData,
+                                                bool remoteHistoryExists)
+{
+    VersionControl remoteHistory(nullptr);
+
+    if (remoteHistoryExists && remoteData.getSize() > 0)
+    {
+        ScopedPointer<XmlElement> remoteXml(DataEncoder::createDecryptedXml(remoteData, this->key));
+
+        if (remoteXml == nullptr)
+        {
+            Logger::writeToLog("Wrong key!");
+            return SyncThread::fetchHistoryError;
+        }
+
+        remoteHistory.deserialize(*remoteXml);
+    }
+    else
+    {
+        remoteHistory.reset();
+    }
+
+
+    //===------------------------------------------------------------------===//
+    // Do some checks
+    //===------------------------------------------------------------------===//
+
+    this->setState(SyncThread::merge);
+
+    Logger::writeToLog("Local version: " + String(history.getVersion()));
+    Logger::writeToLog("Remote version: " + String(remoteHistory.getVersion()));
+    Logger::writeToLog("Local hash: " + history.calculateHash().toHexString());
+    Logger::writeToLog("Remote hash: " + remoteHistory.calculateHash().toHexString());
+
+    if (history.getVersion() == remoteHistory.getVersion() &&
+        history.calculateHash() == remoteHistory.calculateHash())
+    {
+        return SyncThread::upToDate;
+    }
+
+    if (history.getVersion() < remoteHistory.getVersion())
+    {
+        return SyncThread::mergeError;
+    }
+
+
+    //===------------------------------------------------------------------===//
+    // Merge two trees and push the result
+    //===------------------------------------------------------------------===//
+
+    remoteHistory.mergeWith(history);
+    remoteHistory.incrementVersion();
+
+    ScopedPointer<XmlElement> xmlToPush(remoteHistory.serialize());
+    const MemoryBlock encryptedHistory(DataEncoder::encryptXml(*xmlToPush, this->key));
+
+    if (encryptedHistory.getSize() == 0)
+    {
+        return SyncThread::syncError;
+    }
+
+    this->setState(SyncThread::sync);
+
+    const SyncTransport::Status status = this->transport.pushHistory(encryptedHistory);
+
+    if (status != SyncTransport::ok)
+    {
+        return getErrorState(status, SyncThread::syncError);
+    }
+
+    return SyncThread::allDone;
+}
+
+SyncThread::State HistorySync::pullWholeHistory(VersionControl &history,
+                                                const MemoryBlock &remoteData)
+{
+    ScopedPointer<XmlElement> remoteXml(DataEncoder::createDecryptedXml(remoteData, this->key));
+
+    if (remoteXml == nullptr)
+    {
+        // видимо, неверный ключ
+        return SyncThread::fetchHistoryError;
+    }
+
+
+    //===------------------------------------------------------------------===//
+    // Do some checks
+    //===------------------------------------------------------------------===//
+
+    this->setState(SyncThread::merge);
+
+    VersionControl remoteHistory(nullptr);
+    remoteHistory.deserialize(*remoteXml);
+
+    Logger::writeToLog("Local version: " + String(history.getVersion()));
+    Logger::writeToLog("Remote version: " + String(remoteHistory.getVersion()));
+    Logger::writeToLog("Local hash: " + history.calculateHash().toHexString());
+    Logger::writeToLog("Remote hash: " + remoteHistory.calculateHash().toHexString());
+
+    if (history.getVersion() == remoteHistory.getVersion() &&
+        history.calculateHash() == remoteHistory.calculateHash())
+    {
+        return SyncThread::upToDate;
+    }
+
+    if (remoteHistory.getVersion() <= history.getVersion())
+    {
+        return SyncThread::mergeError;
+    }
+
+    history.mergeWith(remoteHistory);
+    return SyncThread::allDone;
+}
@@ -0,0 +1,97 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+class VersionControl;
+
+#include "SyncThread.h"
+#include "SyncTransport.h"
+#include "Revision.h"
+
+namespace VCS
+{
+    // Pushes and pulls the history by exchanging only the revisions
+    // and the pack entries, which the other side doesn't have.
+    // The merge rules are the same as in VersionControl::mergeWith.
+    // Falls back to the whole history exchange for the servers
+    // which don't support it, and for the histories stored as one blob.
+    class HistorySync
+    {
+    public:
+
+        HistorySync(SyncTransport &syncTransport,
+                    const MemoryBlock &historyKey,
+                    SyncThread *progressThread = nullptr);
+
+        SyncThread::State push(VersionControl &history);
+
+        SyncThread::State pull(VersionControl &history);
+
+    private:
+
+        struct PackEntry
+        {
+            RevisionItem::Ptr item;
+            int deltaIndex;
+            String name;
+        };
+
+        void setState(SyncThread::State state);
+
+        SyncThread::State pushWholeHistory(VersionControl &history,
+                                           const MemoryBlock &remoteData,
+                                           bool remoteHistoryExists);
+
+        SyncThread::State pullWholeHistory(VersionControl &history,
+                                           const MemoryBlock &remoteData);
+
+        String getRevisionObjectName(const String &revisionId, const String &revisionHash) const;
+
+        String getPackObjectName(const Uuid &itemId, const Uuid &deltaId) const;
+
+        void collectPackEntries(const Revision &revision,
+                                Pack::Ptr localPack,
+                                Array<PackEntry> &entries,
+                                HashMap<String, int> &entriesIndex) const;
+
+        XmlElement *createMergedNode(const VersionControl &history,
+                                     const Revision &localRevision,
+                                     const XmlElement *remoteNode,
+                                     Array<Revision> &revisionsToSend) const;
+
+        void findRevisionsToFetch(const VersionControl &history,
+                                  const Revision &localRevision,
+                                  const XmlElement &remoteNode,
+                                  StringArray &names) const;
+
+        void applyFetchedRevisions(VersionControl &history,
+                                   Revision localRevision,
+                                   const XmlElement &remoteNode,
+                                   const HashMap<String, Revision> &fetchedRevisions) const;
+
+        SyncTransport &transport;
+
+        MemoryBlock key;
+
+        // makes the object names unrelated to the ids, and different for each history
+        String namesSalt;
+
+        SyncThread *thread;
+
+    };
+}  // namespace VCS
@@ -0,0 +1,206 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "HttpSyncTransport.h"
+#include "SyncThread.h"
+#include "DataEncoder.h"
+#include "HelioServerDefines.h"
+#include "SerializationKeys.h"
+
+using namespace VCS;
+
+HttpSyncTransport::HttpSyncTransport(URL syncUrl,
+                                     const String &projectId,
+                                     SyncThread *progressThread) :
+    url(std::move(syncUrl)),
+    id(projectId),
+    thread(progressThread)
+{
+    const String saltedId = this->id + HELIO_SALT;
+    this->clientCheck = SHA256(saltedId.toUTF8()).toHexString();
+}
+
+void HttpSyncTransport::setPushParameter(const String &name, const String &value)
+{
+    this->pushParameters.set(name, value);
+}
+
+SyncTransport::Status HttpSyncTransport::fetchManifest(MemoryBlock &result,
+                                                       Protocol &serverProtocol)
+{
+    StringPairArray responseHeaders;
+    const Status status = this->performRequest(this->createFetchRequest(Serialization::Network::syncManifest),
+                                               result, &responseHeaders);
+
+    serverProtocol = responseHeaders[Serialization::Network::syncProtocol].isNotEmpty() ?
+        historyObjects : wholeHistory;
+
+    return status;
+}
+
+SyncTransport::Status HttpSyncTransport::findMissingObjects(const StringArray &names,
+                                                            StringArray &missingNames)
+{
+    URL request(this->createFetchRequest(Serialization::Network::syncMissing));
+    request = request.withParameter(Serialization::Network::objects, names.joinIntoString("\n"));
+
+    MemoryBlock response;
+    const Status status = this->performRequest(request, response);
+
+    if (status == ok)
+    {
+        missingNames.addLines(response.toString());
+        missingNames.removeEmptyStrings();
+    }
+
+    return status;
+}
+
+SyncTransport::Status HttpSyncTransport::fetchObjects(const StringArray &names,
+                                                      SyncObjects &objects)
+{
+    URL request(this->createFetchRequest(Serialization::Network::syncObjects));
+    request = request.withParameter(Serialization::Network::objects, names.joinIntoString("\n"));
+
+    MemoryBlock response;
+    const Status status = this->performRequest(request, response);
+
+    if (status == ok && ! objects.fromMemoryBlock(response))
+    {
+        return failed;
+    }
+
+    return status;
+}
+
+SyncTransport::Status HttpSyncTransport::pushObjects(const SyncObjects &objects,
+                                                     const MemoryBlock &manifest,
+                                                     const String &baseManifestHash)
+{
+    TemporaryFile objectsFile("vcs");
+    TemporaryFile manifestFile("vcs");
+
+    {
+        const MemoryBlock bundle(objects.toMemoryBlock());
+        objectsFile.getFile().replaceWithData(bundle.getData(), bundle.getSize());
+        manifestFile.getFile().replaceWithData(manifest.getData(), manifest.getSize());
+    }
+
+    URL request(this->url);
+    request = request.withFileToUpload(Serialization::Network::objects, objectsFile.getFile(), "application/octet-stream");
+    request = request.withFileToUpload(Serialization::Network::manifest, manifestFile.getFile(), "application/octet-stream");
+    request = request.withParameter(Serialization::Network::sync, Serialization::Network::syncCommit);
+    request = request.withParameter(Serialization::Network::baseManifest, baseManifestHash);
+
+    MemoryBlock response;
+    return this->performRequest(this->createPushRequest(request), response);
+}
+
+SyncTransport::Status HttpSyncTransport::fetchHistory(MemoryBlock &history)
+{
+    URL request(this->url);
+    request = request.withParameter(Serialization::Network::fetch, this->id);
+    request = request.withParameter(Serialization::Network::clientCheck, this->clientCheck);
+    return this->performRequest(request, history);
+}
+
+SyncTransport::Status HttpSyncTransport::pushHistory(const MemoryBlock &history)
+{
+    TemporaryFile historyFile("vcs");
+    historyFile.getFile().replaceWithData(history.getData(), history.getSize());
+
+    URL request(this->url);
+    request = request.withFileToUpload(Serialization::Network::file, historyFile.getFile(), "application/octet-stream");
+
+    MemoryBlock response;
+    const Status status = this->performRequest(this->createPushRequest(request), response);
+
+    const String rawResult = response.toString().trim();
+    Logger::writeToLog("Upload, raw result: " + rawResult);
+    Logger::writeToLog("Upload, result: " + DataEncoder::deobfuscateString(rawResult));
+
+    return status;
+}
+
+URL HttpSyncTransport::createFetchRequest(const String &requestType) const
+{
+    URL request(this->url);
+    request = request.withParameter(Serialization::Network::sync, requestType);
+    request = request.withParameter(Serialization::Network::fetch, this->id);
+    request = request.withParameter(Serialization::Network::clientCheck, this->clientCheck);
+    return request;
+}
+
+URL HttpSyncTransport::createPushRequest(const URL &uploadRequest) const
+{
+    URL request(uploadRequest);
+
+    for (int i = 0; i < this->pushParameters.size(); ++i)
+    {
+        request = request.withParameter(this->pushParameters.getAllKeys()[i],
+                                        this->pushParameters.getAllValues()[i]);
+    }
+
+    request = request.withParameter(Serialization::Network::push, this->id);
+    request = request.withParameter(Serialization::Network::clientCheck, this->clientCheck);
+    return request;
+}
+
+SyncTransport::Status HttpSyncTransport::performRequest(const URL &request, MemoryBlock &response,
+                                                        StringPairArray *responseHeaders)
+{
+    int statusCode = 0;
+    StringPairArray headers;
+
+    ScopedPointer<InputStream> stream(
+        request.createInputStream(true,
+            (this->thread != nullptr) ? syncProgressCallback : nullptr,
+            static_cast<void *>(this->thread),
+            HELIO_USERAGENT,
+            0,
+            (responseHeaders != nullptr) ? responseHeaders : &headers,
+            &statusCode));
+
+    if (stream == nullptr)
+    {
+        return failed;
+    }
+
+    stream->readIntoMemoryBlock(response);
+
+    switch (statusCode)
+    {
+        case 200:
+            return ok;
+
+        case 401:
+            return unauthorized;
+
+        case 403:
+            return forbidden;
+
+        case 404:
+            return notFound;
+
+        case 409:
+            return outdated;
+
+        default:
+            return failed;
+    }
+}
@@ -0,0 +1,79 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "SyncTransport.h"
+
+namespace VCS
+{
+    class SyncThread;
+
+    // The sync requests to the same endpoint as the whole history is pushed to,
+    // with the sync parameter telling the request kind; the names of the objects
+    // are sent joined by the line breaks, the objects are sent in one bundle.
+    // The servers which know the request kinds answer with the protocol header,
+    // the older ones ignore the sync parameter, and answer as to the history fetch
+    class HttpSyncTransport : public SyncTransport
+    {
+    public:
+
+        HttpSyncTransport(URL syncUrl,
+                          const String &projectId,
+                          SyncThread *progressThread);
+
+        // Additional parameters of the push request, like the project title
+        void setPushParameter(const String &name, const String &value);
+
+        Status fetchManifest(MemoryBlock &result,
+                             Protocol &serverProtocol) override;
+
+        Status findMissingObjects(const StringArray &names,
+                                  StringArray &missingNames) override;
+
+        Status fetchObjects(const StringArray &names,
+                            SyncObjects &objects) override;
+
+        Status pushObjects(const SyncObjects &objects,
+                           const MemoryBlock &manifest,
+                           const String &baseManifestHash) override;
+
+        Status fetchHistory(MemoryBlock &history) override;
+
+        Status pushHistory(const MemoryBlock &history) override;
+
+    private:
+
+        URL createFetchRequest(const String &requestType) const;
+
+        URL createPushRequest(const URL &uploadRequest) const;
+
+        Status performRequest(const URL &request, MemoryBlock &response,
+                              StringPairArray *responseHeaders = nullptr);
+
+        URL url;
+
+        String id;
+
+        String clientCheck;
+
+        SyncThread *thread;
+
+        StringPairArray pushParameters;
+
+    };
+}  // namespace VCS
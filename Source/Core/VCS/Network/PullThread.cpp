@@ -18,9 +18,8 @@
 #include "Common.h"
 #include "PullThread.h"
 #include "VersionControl.h"
-#include "Client.h"
-#include "DataEncoder.h"
-#include "HelioServerDefines.h"
+#include "HistorySync.h"
+#include "HttpSyncTransport.h"
 #include "Supervisor.h"
 #include "SerializationKeys.h"
 
@@ -43,116 +42,31 @@ XmlElement *PullThread::createMergedStateData()
 
 void PullThread::run()
 {
-    const String saltedId = this->localId + HELIO_SALT;
-    const String saltedIdHash = SHA256(saltedId.toUTF8()).toHexString();
-
-    //===------------------------------------------------------------------===//
-    // Fetch remote history
-    //===------------------------------------------------------------------===//
-
-    this->setState(SyncThread::fetchHistory);
-
-    ScopedPointer<XmlElement> remoteXml;
-
-    URL fetchUrl(this->url);
-    fetchUrl = fetchUrl.withParameter(Serialization::Network::fetch, this->localId);
-    fetchUrl = fetchUrl.withParameter(Serialization::Network::clientCheck, saltedIdHash);
-
-    {
-		int statusCode = 0;
-		StringPairArray responseHeaders;
-
-        ScopedPointer<InputStream> downloadStream(
-			fetchUrl.createInputStream(true,
-                syncProgressCallback,
-                static_cast<void *>(this),
-                HELIO_USERAGENT,
-				0,
-				&responseHeaders,
-				&statusCode));
-
-        if (downloadStream == nullptr || statusCode != 200)
-        {
-			//Logger::writeToLog("downloadStream " + String(statusCode));
-            //Logger::writeToLog(downloadStream->readEntireStreamAsString());
-            this->setState(SyncThread::fetchHistoryError);
-            return;
-        }
-
-        MemoryBlock fetchData;
-        downloadStream->readIntoMemoryBlock(fetchData);
-        remoteXml = DataEncoder::createDecryptedXml(fetchData, this->localKey);
-
-        if (remoteXml == nullptr)
-        {
-            // видимо, неверный ключ
-            //const String obfustatedKey = DataEncoder::obfuscateString(this->localKey.toBase64Encoding());
-            //Logger::writeToLog("Possible, wrong key: " + obfustatedKey);
-
-            Supervisor::track(Serialization::Activities::vcsPullError);
-            this->setState(SyncThread::fetchHistoryError);
-            return;
-        }
-    }
-
-    Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 350);
-
-
-    //===------------------------------------------------------------------===//
-    // Do some checks
-    //===------------------------------------------------------------------===//
-
-    this->setState(SyncThread::merge);
+    HttpSyncTransport transport(this->url, this->localId, this);
 
     this->mergedVCS = new VersionControl(nullptr);
     this->mergedVCS->deserialize(*this->localXml);
 
-    VersionControl remoteVCS(nullptr);
+    // only the revisions which differ and the missing pack entries are downloaded,
+    // if the server supports that, otherwise the whole history is
+    HistorySync sync(transport, this->localKey, this);
+    const SyncThread::State result = sync.pull(*this->mergedVCS);
 
-    if (remoteXml != nullptr)
+    if (result == SyncThread::fetchHistoryError)
     {
-        remoteVCS.deserialize(*remoteXml);
+        Supervisor::track(Serialization::Activities::vcsPullError);
     }
-
-    Logger::writeToLog("Local version: " + String(this->mergedVCS->getVersion()));
-    Logger::writeToLog("Remote version: " + String(remoteVCS.getVersion()));
-    Logger::writeToLog("Local hash: " + this->mergedVCS->calculateHash().toHexString());
-    Logger::writeToLog("Remote hash: " + remoteVCS.calculateHash().toHexString());
-
-    // итак, пулл разрешен только если серверная версия больше.
-    // если версии равны и равны хэши - up to date
-    // остальное - ошибка.
-
-    if (this->mergedVCS->getVersion() == remoteVCS.getVersion() &&
-            this->mergedVCS->calculateHash() == remoteVCS.calculateHash())
+    else if (result == SyncThread::mergeError)
     {
-        this->setState(SyncThread::upToDate);
-        return;
+        Supervisor::track(Serialization::Activities::vcsMergeError);
     }
 
-    if (remoteVCS.getVersion() > this->mergedVCS->getVersion())
+    if (result != SyncThread::allDone)
     {
-        Logger::writeToLog("Remote history is ok.");
-    }
-    else
-    {
-        Supervisor::track(Serialization::Activities::vcsMergeError);
-        this->setState(SyncThread::mergeError);
+        this->setState(result);
         return;
     }
 
-
-    //===------------------------------------------------------------------===//
-    // Merge two trees
-    //===------------------------------------------------------------------===//
-
-    this->mergedVCS->mergeWith(remoteVCS);
-
-    // debug
-    //ScopedPointer<XmlElement> localXmlForDebug(this->mergedVCS->serialize());
-    //File debugFile(File::getSpecialLocation(File::currentExecutableFile).getParentDirectory().getChildFile("debug.vcs"));
-    //debugFile.replaceWithText(localXmlForDebug->createDocument("", false, true, "UTF-8", 512));
-
     Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 350);
 
     Supervisor::track(Serialization::Activities::vcsPull);
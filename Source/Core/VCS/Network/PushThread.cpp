@@ -18,9 +18,9 @@
 #include "Common.h"
 #include "PushThread.h"
 #include "VersionControl.h"
-#include "Client.h"
+#include "HistorySync.h"
+#include "HttpSyncTransport.h"
 #include "DataEncoder.h"
-#include "HelioServerDefines.h"
 #include "App.h"
 #include "AuthorizationManager.h"
 #include "Config.h"
@@ -41,195 +41,43 @@ PushThread::PushThread(URL pushUrl,
 
 void PushThread::run()
 {
-    const String saltedId = this->localId + HELIO_SALT;
-    const String saltedIdHash = SHA256(saltedId.toUTF8()).toHexString();
-    const String keyHash = SHA256(this->localKey.toString().toUTF8()).toHexString();
-	
-    //===------------------------------------------------------------------===//
-    // Fetch remote history
-    //===------------------------------------------------------------------===//
-
-    this->setState(SyncThread::fetchHistory);
+    HttpSyncTransport transport(this->url, this->localId, this);
 
-    ScopedPointer<XmlElement> remoteXml;
+    const String keyHash = SHA256(this->localKey.toString().toUTF8()).toHexString();
+    transport.setPushParameter(Serialization::Network::key, keyHash);
 
-    URL fetchUrl(this->url);
-    fetchUrl = fetchUrl.withParameter(Serialization::Network::fetch, this->localId);
-    fetchUrl = fetchUrl.withParameter(Serialization::Network::clientCheck, saltedIdHash);
+    const bool loggedIn = (App::Helio()->getAuthManager()->getAuthorizationState() == AuthorizationManager::LoggedIn);
 
+    if (loggedIn)
     {
-		int statusCode = 0;
-		StringPairArray responseHeaders;
-
-        ScopedPointer<InputStream> downloadStream(
-			fetchUrl.createInputStream(true,
-                syncProgressCallback,
-                static_cast<void *>(this),
-                HELIO_USERAGENT,
-				0,
-				&responseHeaders,
-				&statusCode));
-
-		// statusCode can be 404 when pushing new project
-        if (downloadStream == nullptr ||
-			(statusCode != 200 && statusCode != 404))
-        {
-            this->setState(SyncThread::fetchHistoryError);
-            return;
-        }
-
-        MemoryBlock fetchData;
-        downloadStream->readIntoMemoryBlock(fetchData);
-        //Logger::writeToLog(fetchData.toString());
-
-        remoteXml = DataEncoder::createDecryptedXml(fetchData, this->localKey);
-
-		const bool fileExists = (fetchData.getSize() != 0) && (statusCode != 404);
-		const bool fileCanBeDecrypted = (remoteXml != nullptr);
-        if (fileExists && !fileCanBeDecrypted)
-        {
-            Logger::writeToLog("Wrong key!");
-            Supervisor::track(Serialization::Activities::vcsPushError);
-            this->setState(SyncThread::fetchHistoryError);
-            return;
-        }
+        const String deviceId(Config::getMachineId());
+        const String obfustatedKey = DataEncoder::obfuscateString(this->localKey.toBase64Encoding());
+        transport.setPushParameter(Serialization::Network::realKey, obfustatedKey);
+        transport.setPushParameter(Serialization::Network::title, this->title);
+        transport.setPushParameter(Serialization::Network::deviceId, deviceId);
     }
 
-    Time::waitForMillisecondCounter(Time::getMillisecondCounter() + 350);
-
-
-    //===------------------------------------------------------------------===//
-    // Do some checks
-    //===------------------------------------------------------------------===//
-
-    this->setState(SyncThread::merge);
-
     VersionControl localVCS(nullptr);
     localVCS.deserialize(*this->localXml);
 
-    VersionControl remoteVCS(nullptr);
+    // only the revisions and the pack entries missing on the server are uploaded,
+    // if the server supports that, otherwise the whole history is
+    HistorySync sync(transport, this->localKey, this);
+    const SyncThread::State result = sync.push(localVCS);
 
-    if (remoteXml != nullptr)
+    if (result == SyncThread::fetchHistoryError)
     {
-        remoteVCS.deserialize(*remoteXml);
+        Supervisor::track(Serialization::Activities::vcsPushError);
     }
-    else
-    {
-        remoteVCS.reset();
-    }
-
-    Logger::writeToLog("Local version: " + String(localVCS.getVersion()));
-    Logger::writeToLog("Remote version: " + String(remoteVCS.getVersion()));
-    Logger::writeToLog("Local hash: " + localVCS.calculateHash().toHexString());
-    Logger::writeToLog("Remote hash: " + remoteVCS.calculateHash().toHexString());
-
-    if (localVCS.getVersion() == remoteVCS.getVersion() &&
-        localVCS.calculateHash() == remoteVCS.calculateHash())
-    {
-        this->setState(SyncThread::upToDate);
-        return;
-    }
-
-    if ((localVCS.getVersion() > remoteVCS.getVersion()) ||
-        (localVCS.getVersion() == remoteVCS.getVersion() && localVCS.calculateHash() != remoteVCS.calculateHash()))
-    {
-        Logger::writeToLog("Remote history is ok.");
-    }
-    else
+    else if (result == SyncThread::mergeError)
     {
         Supervisor::track(Serialization::Activities::vcsMergeError);
-        this->setState(SyncThread::mergeError);
-        return;
     }
 
-
-    //===------------------------------------------------------------------===//
-    // Merge two trees
-    //===------------------------------------------------------------------===//
-
-    remoteVCS.mergeWith(localVCS);
-    remoteVCS.incrementVersion();
-
-    TemporaryFile tempFile("vcs");
-
-    {
-        ScopedPointer<XmlElement> xmlToPush(remoteVCS.serialize());
-        MemoryBlock encryptedRemoteXml(DataEncoder::encryptXml(*xmlToPush, this->localKey));
-        tempFile.getFile().replaceWithData(encryptedRemoteXml.getData(), encryptedRemoteXml.getSize());
-    }
-
-    // debug
-    //ScopedPointer<XmlElement> localXmlForDebug(localVCS.serialize());
-    //File debugFile(File::getSpecialLocation(File::currentExecutableFile).getParentDirectory().getChildFile("debug.vcs"));
-    //debugFile.replaceWithText(localXmlForDebug->createDocument("", false, true, "UTF-8", 512));
-
-
-    //===------------------------------------------------------------------===//
-    // Push merged tree to the server
-    //===------------------------------------------------------------------===//
-
-    this->setState(SyncThread::sync);
-
-    URL pushUrl(this->url);
-    pushUrl = pushUrl.withFileToUpload(Serialization::Network::file, tempFile.getFile(), "application/octet-stream");
-    pushUrl = pushUrl.withParameter(Serialization::Network::key, keyHash);
-
-    const bool loggedIn = (App::Helio()->getAuthManager()->getAuthorizationState() == AuthorizationManager::LoggedIn);
-
-    if (loggedIn)
+    if (result != SyncThread::allDone)
     {
-        const String deviceId(Config::getMachineId());
-        const String obfustatedKey = DataEncoder::obfuscateString(this->localKey.toBase64Encoding());
-        //Logger::writeToLog(">>" + obfustatedKey + "<<");
-        pushUrl = pushUrl.withParameter(Serialization::Network::realKey, obfustatedKey);
-        pushUrl = pushUrl.withParameter(Serialization::Network::title, this->title);
-        pushUrl = pushUrl.withParameter(Serialization::Network::deviceId, deviceId);
-    }
-
-
-    pushUrl = pushUrl.withParameter(Serialization::Network::push, this->localId);
-    pushUrl = pushUrl.withParameter(Serialization::Network::clientCheck, saltedIdHash);
-
-    {
-		int statusCode = 0;
-		StringPairArray responseHeaders;
-
-		ScopedPointer<InputStream> pushStream(
-			pushUrl.createInputStream(true,
-                syncProgressCallback,
-                static_cast<void *>(this),
-                HELIO_USERAGENT,
-				0,
-				&responseHeaders,
-				&statusCode));
-
-        if (pushStream == nullptr)
-        {
-            this->setState(SyncThread::syncError);
-            return;
-        }
-
-        const String rawResult = pushStream->readEntireStreamAsString().trim();
-        const String result = DataEncoder::deobfuscateString(rawResult);
-
-        Logger::writeToLog("Upload, raw result: " + rawResult);
-        Logger::writeToLog("Upload, result: " + result);
-
-        if (statusCode == 401)
-        {
-            this->setState(SyncThread::unauthorizedError);
-            return;
-        }
-        if (statusCode == 403)
-        {
-            this->setState(SyncThread::forbiddenError);
-            return;
-        }
-        else if (statusCode != 200)
-        {
-            this->setState(SyncThread::syncError);
-            return;
-        }
+        this->setState(result);
+        return;
     }
 
     Supervisor::track(Serialization::Activities::vcsPush);
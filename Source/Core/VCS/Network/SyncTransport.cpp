@@ -0,0 +1,109 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "SyncTransport.h"
+
+using namespace VCS;
+
+void SyncObjects::add(const String &name, const MemoryBlock &data)
+{
+    this->namesIndex.set(name, this->names.size());
+    this->names.add(name);
+    this->blobs.add(data);
+
+    // a sync may send thousands of objects
+    if (this->namesIndex.size() > this->namesIndex.getNumSlots() * 2)
+    {
+        this->namesIndex.remapTable(this->namesIndex.getNumSlots() * 4);
+    }
+}
+
+int SyncObjects::size() const noexcept
+{
+    return this->names.size();
+}
+
+const String &SyncObjects::getName(int index) const noexcept
+{
+    return this->names.getReference(index);
+}
+
+const MemoryBlock &SyncObjects::getData(int index) const noexcept
+{
+    return this->blobs.getReference(index);
+}
+
+int SyncObjects::indexOf(const String &name) const
+{
+    return this->namesIndex.contains(name) ? this->namesIndex[name] : -1;
+}
+
+MemoryBlock SyncObjects::toMemoryBlock() const
+{
+    MemoryBlock block;
+
+    {
+        MemoryOutputStream stream(block, false);
+        stream.writeInt(this->names.size());
+
+        for (int i = 0; i < this->names.size(); ++i)
+        {
+            const MemoryBlock &data = this->blobs.getReference(i);
+            stream.writeString(this->names[i]);
+            stream.writeInt64(int64(data.getSize()));
+            stream.write(data.getData(), data.getSize());
+        }
+
+        stream.flush();
+    }
+
+    return block;
+}
+
+bool SyncObjects::fromMemoryBlock(const MemoryBlock &block)
+{
+    this->names.clear();
+    this->blobs.clear();
+    this->namesIndex.clear();
+
+    MemoryInputStream stream(block, false);
+
+    if (stream.getNumBytesRemaining() < 4)
+    {
+        return false;
+    }
+
+    const int numObjects = stream.readInt();
+
+    for (int i = 0; i < numObjects; ++i)
+    {
+        const String name(stream.readString());
+        const int64 numBytes = stream.readInt64();
+
+        if (name.isEmpty() || numBytes < 0 || numBytes > stream.getNumBytesRemaining())
+        {
+            return false;
+        }
+
+        MemoryBlock data;
+        stream.readIntoMemoryBlock(data, ssize_t(numBytes));
+        this->add(name, data);
+    }
+
+    return stream.isExhausted();
+}
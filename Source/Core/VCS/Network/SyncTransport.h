@@ -0,0 +1,112 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+namespace VCS
+{
+    // The named blobs, which are sent and received in one request
+    class SyncObjects
+    {
+    public:
+
+        SyncObjects() {}
+
+        void add(const String &name, const MemoryBlock &data);
+
+        int size() const noexcept;
+
+        const String &getName(int index) const noexcept;
+
+        const MemoryBlock &getData(int index) const noexcept;
+
+        // -1 if there's no such object
+        int indexOf(const String &name) const;
+
+        // [int count]{[string name][int64 size][bytes]}
+        MemoryBlock toMemoryBlock() const;
+
+        bool fromMemoryBlock(const MemoryBlock &block);
+
+    private:
+
+        StringArray names;
+
+        Array<MemoryBlock> blobs;
+
+        HashMap<String, int> namesIndex;
+
+        JUCE_DECLARE_NON_COPYABLE(SyncObjects)
+
+    };
+
+    // The remote side of the history sync: the history manifest and the objects,
+    // which are the revisions and the pack entries. The server only stores
+    // the encrypted blobs under the names which don't reveal their ids.
+    //
+    // The servers which don't know the object sync, and the histories pushed
+    // by the released clients, store the whole history as one encrypted blob,
+    // which is still fetched and pushed as it was before.
+    class SyncTransport
+    {
+    public:
+
+        enum Protocol
+        {
+            wholeHistory,
+            historyObjects
+        };
+
+        enum Status
+        {
+            ok,
+            notFound,
+            unauthorized,
+            forbidden,
+            outdated,
+            failed
+        };
+
+        virtual ~SyncTransport() {}
+
+        // The first request of every sync, which also tells what the server can do:
+        // the older servers answer it as the whole history fetch, and then
+        // the result is the history blob, and not the manifest
+        virtual Status fetchManifest(MemoryBlock &result,
+                                     Protocol &serverProtocol) = 0;
+
+        // Returns those of the given names, which the server doesn't store
+        virtual Status findMissingObjects(const StringArray &names,
+                                          StringArray &missingNames) = 0;
+
+        virtual Status fetchObjects(const StringArray &names,
+                                    SyncObjects &objects) = 0;
+
+        // Stores the objects and replaces the manifest; if the stored manifest
+        // has changed since it was fetched, that is, its MD5 is not the base hash
+        // (which is empty for a new history), nothing is stored and outdated is returned
+        virtual Status pushObjects(const SyncObjects &objects,
+                                   const MemoryBlock &manifest,
+                                   const String &baseManifestHash) = 0;
+
+        // The whole encrypted history, as the released clients sync it
+        virtual Status fetchHistory(MemoryBlock &history) = 0;
+
+        virtual Status pushHistory(const MemoryBlock &history) = 0;
+
+    };
+}  // namespace VCS
@@ -19,28 +19,49 @@
 #include "Pack.h"
 
 #include "FileUtils.h"
-#include "DataEncoder.h"
+#include "ChunkedFile.h"
 #include "SerializationKeys.h"
 
 using namespace VCS;
 
-#define VCS_PACK_DEBUGGING 0
-
 //
-// пак - это такая штука, где хранятся все тяжеловесные данные,
-// которые можно достать по требованию, по id revisionItem + его дельты
-// и все это - в самом файле проекта
+// The pack keeps all the heavyweight delta data, which is loaded on demand
+// by the id of the revision item and the id of its delta.
+//
+// On deserialization, the whole pack is dumped into a temporary file.
+// New data is kept in memory until flush(), which appends it to that file.
+// On serialization, everything is written back into the project.
 //
-// при загрузке\десериализации - скидываем все содержимое пака во временный файл.
-// при добавлении данных - добавляем в память (+ метод flush(), который скидывает все на диск)
-// при сохранении\сериализации - сохраняем еще несохраненное и записываем данные файла
+// Only the headers are kept in memory: the id pair and the position in the file.
+// Both the headers and the unsaved blocks are indexed by the id pair,
+// and the payloads are stored in ChunkedFile's compact binary element encoding.
 //
-// минусы: надо следить, чтоб файл не исчез (блокируем его открытыми потоками на чтение и запись)
-// файл будет во временном каталоге
+// The pack file is append-only and content-addressed: the identical deltas
+// (revision items copied by merges and stashes, reloaded packs) are written once,
+// and their headers just point to the same bytes. The content hash only finds
+// the candidate, the bytes are compared before they are shared.
 //
-// в памяти держим только хэдер, где записано: пара id и смещения в файле.
+// Nothing is ever removed from the file, and it is rebuilt from the project
+// on every load, so there is no garbage for a separate compaction to collect.
 //
 
+int PackDataKeyHash::generateHash(const PackDataKey &key, int upperLimit) noexcept
+{
+    // uuids are random, so their first bytes are already a good hash
+    const uint32 itemHash = ByteOrder::littleEndianInt(key.itemId.getRawData());
+    const uint32 deltaHash = ByteOrder::littleEndianInt(key.deltaId.getRawData());
+    return int((itemHash * 31 + deltaHash) % uint32(upperLimit));
+}
+
+template <typename HashMapType>
+static void growIfNeeded(HashMapType &hashMap)
+{
+    if (hashMap.size() > hashMap.getNumSlots() * 2)
+    {
+        hashMap.remapTable(hashMap.getNumSlots() * 4);
+    }
+}
+
 Pack::Pack()
 {
     // todo иногда пишет в корень диска c: ? wtf
@@ -64,54 +85,30 @@ Pack::~Pack()
 bool Pack::containsDeltaDataFor(const Uuid &itemId,
                                 const Uuid &deltaId) const
 {
-    if (this->packStream != nullptr)
-    {
-        // данные могут быть на диске
-        for (auto header : this->headers)
-        {
-            if (header->itemId == itemId && header->deltaId == deltaId)
-            {
-                return true;
-            }
-        }
-        
-        // а могут быть и в памяти
-        for (auto block : this->unsavedData)
-        {
-            if (block->itemId == itemId && block->deltaId == deltaId)
-            {
-                return true;
-            }
-        }
-    }
-    
-    return false;
+    ScopedLock lock(this->packLocker);
+
+    const PackDataKey key = { itemId, deltaId };
+    return this->headersIndex.contains(key) || this->unsavedDataIndex.contains(key);
 }
 
 XmlElement *Pack::createDeltaDataFor(const Uuid &itemId,
                                      const Uuid &deltaId) const
 {
     ScopedLock lock(this->packLocker);
-    
-    if (this->packStream != nullptr)
+
+    const PackDataKey key = { itemId, deltaId };
+
+    // the data may be on disk
+    if (this->headersIndex.contains(key))
     {
-        // данные могут быть на диске
-        for (auto header : this->headers)
-        {
-            if (header->itemId == itemId && header->deltaId == deltaId)
-            {
-                return this->createXmlData(header);
-            }
-        }
+        return this->createXmlData(this->headers.getUnchecked(this->headersIndex[key]));
+    }
 
-        // а могут быть и в памяти
-        for (auto block : this->unsavedData)
-        {
-            if (block->itemId == itemId && block->deltaId == deltaId)
-            {
-                return XmlDocument::parse(block->data.toString());
-            }
-        }
+    // or still in memory
+    if (this->unsavedDataIndex.contains(key))
+    {
+        const MemoryBlock &data = this->unsavedData.getUnchecked(this->unsavedDataIndex[key])->data;
+        return ChunkedFile::decodeElement(data.getData(), data.getSize());
     }
 
     jassertfalse;
@@ -124,15 +121,21 @@ void Pack::setDeltaDataFor(const Uuid &itemId,
 {
     ScopedLock lock(this->packLocker);
 
+    const PackDataKey key = { itemId, deltaId };
+
+    // the first stored data wins, as it always did
+    if (this->headersIndex.contains(key) || this->unsavedDataIndex.contains(key))
+    {
+        return;
+    }
+
     auto block = new PackDataBlock();
     block->itemId = itemId;
     block->deltaId = deltaId;
+    block->data = ChunkedFile::encodeElement(data);
 
-    // несохраненные данные в памяти незачем обфусцировать
-    MemoryOutputStream ms(block->data, false);
-    data.writeToStream(ms, "", true, false);
-    ms.flush();
-
+    this->unsavedDataIndex.set(key, this->unsavedData.size());
+    growIfNeeded(this->unsavedDataIndex);
     this->unsavedData.add(block);
 }
 
@@ -148,25 +151,22 @@ XmlElement *Pack::serialize() const
     auto xml = new XmlElement(Serialization::VCS::pack);
 
     // скидываем временный файл
-    if (this->packStream != nullptr)
+    for (auto header : this->headers)
     {
-        for (auto header : this->headers)
-        {
-            XmlElement *deltaData = this->createXmlData(header);
+        XmlElement *deltaData = this->createXmlData(header);
 
-            auto packItem = new XmlElement(Serialization::VCS::packItem);
-            packItem->setAttribute(Serialization::VCS::packItemRevId, header->itemId.toString());
-            packItem->setAttribute(Serialization::VCS::packItemDeltaId, header->deltaId.toString());
-            packItem->addChildElement(deltaData);
+        auto packItem = new XmlElement(Serialization::VCS::packItem);
+        packItem->setAttribute(Serialization::VCS::packItemRevId, header->itemId.toString());
+        packItem->setAttribute(Serialization::VCS::packItemDeltaId, header->deltaId.toString());
+        packItem->addChildElement(deltaData);
 
-            xml->prependChildElement(packItem);
-        }
+        xml->prependChildElement(packItem);
     }
 
     // и все новые данные
     for (auto block : this->unsavedData)
     {
-        XmlElement *deltaData = XmlDocument::parse(block->data.toString());
+        XmlElement *deltaData = ChunkedFile::decodeElement(block->data.getData(), block->data.getSize());
 
         auto packItem = new XmlElement(Serialization::VCS::packItem);
         packItem->setAttribute(Serialization::VCS::packItemRevId, block->itemId.toString());
@@ -192,21 +192,13 @@ void Pack::deserialize(const XmlElement &xml)
 
     forEachXmlChildElementWithTagName(*root, e, Serialization::VCS::packItem)
     {
-        // грузим все в память
-        auto block = new PackDataBlock();
-        block->itemId = e->getStringAttribute(Serialization::VCS::packItemRevId);
-        block->deltaId = e->getStringAttribute(Serialization::VCS::packItemDeltaId);
-
-        MemoryOutputStream ms(block->data, false);
-
         if (XmlElement *firstChild = e->getFirstChildElement())
         {
-            firstChild->writeToStream(ms, "", true, false);
+            // грузим все в память
+            this->setDeltaDataFor(Uuid(e->getStringAttribute(Serialization::VCS::packItemRevId)),
+                                  Uuid(e->getStringAttribute(Serialization::VCS::packItemDeltaId)),
+                                  *firstChild);
         }
-
-        ms.flush();
-
-        this->unsavedData.add(block);
     }
 
     // и сливаем на диск
@@ -215,10 +207,14 @@ void Pack::deserialize(const XmlElement &xml)
 
 void Pack::reset()
 {
-    ScopedLock lock(this->packStreamLock);
+    ScopedLock lock(this->packLocker);
+    ScopedLock streamLock(this->packStreamLock);
 
     this->headers.clear();
     this->unsavedData.clear();
+    this->headersIndex.clear();
+    this->unsavedDataIndex.clear();
+    this->blobsIndex.clear();
     this->packStream = nullptr;
     this->packWriteLocker = nullptr;
     this->packFile->deleteFile();
@@ -231,80 +227,94 @@ void Pack::reset()
 
 void Pack::flush()
 {
-    ScopedLock lock(this->packStreamLock);
-
-    TemporaryFile tempFile(*this->packFile);
-    ScopedPointer<FileOutputStream> tempOutputStream(tempFile.getFile().createOutputStream());
-
-    jassert(tempOutputStream->openedOk());
-
-    this->packWriteLocker = nullptr;
+    ScopedLock lock(this->packLocker);
+    ScopedLock streamLock(this->packStreamLock);
 
-    // если нужно - скопируем существующий файл,
-    // и сразу закроем входной поток
-    if (this->packStream != nullptr)
+    if (this->unsavedData.size() == 0)
     {
-        this->packStream->setPosition(0);
-        tempOutputStream->writeFromInputStream(*this->packStream, -1);
-        this->packStream = nullptr;
+        return;
     }
 
-    // добавляем unsavedData
-    // достаточно обфусцировать их, дописать в конец файла
-    // и добавить в свой список PackDataHeader'ы с получившимися смещениями
-    for (auto block : this->unsavedData)
+    // the file is only appended to, so there is no need to copy it every time;
+    // both streams are kept open to lock the file
+    if (this->packWriteLocker == nullptr)
     {
-        
-#if VCS_PACK_DEBUGGING
-        const String &obfuscated = block->data.toString();
-#else
-        const String &obfuscated = DataEncoder::obfuscateString(block->data.toString());
-#endif
+        this->packFile->deleteFile();
 
-        const int64 position = tempOutputStream->getPosition();
-        const ssize_t numBytes = obfuscated.getNumBytesAsUTF8();
+        this->packWriteLocker = this->packFile->createOutputStream();
+        jassert(this->packWriteLocker->openedOk());
 
-        tempOutputStream->write(obfuscated.toRawUTF8(), numBytes);
+        this->packStream = this->packFile->createInputStream();
+        jassert(this->packStream->openedOk());
+    }
 
+    for (auto block : this->unsavedData)
+    {
         auto newHeader = new PackDataHeader();
         newHeader->itemId = block->itemId;
         newHeader->deltaId = block->deltaId;
-        newHeader->startPosition = position;
-        newHeader->numBytes = numBytes;
 
-        this->headers.add(newHeader);
-    }
+        const String contentHash(MD5(block->data).toHexString());
 
-    this->unsavedData.clear();
+        const PackDataHeader *sameContent = this->blobsIndex.contains(contentHash) ?
+            this->headers.getUnchecked(this->blobsIndex[contentHash]) : nullptr;
 
-    tempOutputStream = nullptr;
+        if (sameContent != nullptr && this->hasSameData(*sameContent, block->data))
+        {
+            newHeader->startPosition = sameContent->startPosition;
+            newHeader->numBytes = sameContent->numBytes;
+        }
+        else
+        {
+            newHeader->startPosition = this->packWriteLocker->getPosition();
+            newHeader->numBytes = ssize_t(block->data.getSize());
+            this->packWriteLocker->write(block->data.getData(), block->data.getSize());
 
-    if (tempFile.overwriteTargetFileWithTemporary())
-    {
-        this->packStream = this->packFile->createInputStream();
-        jassert(this->packStream->openedOk());
+            // on a hash collision, the first blob keeps the hash
+            if (sameContent == nullptr)
+            {
+                this->blobsIndex.set(contentHash, this->headers.size());
+                growIfNeeded(this->blobsIndex);
+            }
+        }
 
-        this->packWriteLocker = this->packFile->createOutputStream();
-        jassert(this->packWriteLocker->openedOk());
+        const PackDataKey key = { block->itemId, block->deltaId };
+        this->headersIndex.set(key, this->headers.size());
+        growIfNeeded(this->headersIndex);
+        this->headers.add(newHeader);
     }
-    else
+
+    this->packWriteLocker->flush();
+
+    this->unsavedData.clear();
+    this->unsavedDataIndex.clear();
+}
+
+bool Pack::hasSameData(const PackDataHeader &header, const MemoryBlock &data) const
+{
+    if (header.numBytes != ssize_t(data.getSize()))
     {
-        jassertfalse;
+        return false;
     }
+
+    // the blob may have been written by this very flush
+    this->packWriteLocker->flush();
+
+    ScopedLock lock(this->packStreamLock);
+    MemoryBlock storedData;
+    this->packStream->setPosition(header.startPosition);
+    this->packStream->readIntoMemoryBlock(storedData, header.numBytes);
+
+    return storedData == data;
 }
 
 XmlElement *Pack::createXmlData(const PackDataHeader *header) const
 {
     ScopedLock lock(this->packStreamLock);
+
     MemoryBlock mb;
     this->packStream->setPosition(header->startPosition);
     this->packStream->readIntoMemoryBlock(mb, header->numBytes);
 
-#if VCS_PACK_DEBUGGING
-    const String &xmlData = mb.toString();
-#else
-    const String &xmlData = DataEncoder::deobfuscateString(mb.toString());
-#endif
-
-    return XmlDocument::parse(xmlData);
+    return ChunkedFile::decodeElement(mb.getData(), mb.getSize());
 }
@@ -36,6 +36,22 @@ namespace VCS
         MemoryBlock data;
     };
 
+    struct PackDataKey
+    {
+        Uuid itemId;
+        Uuid deltaId;
+
+        bool operator== (const PackDataKey &other) const noexcept
+        {
+            return this->itemId == other.itemId && this->deltaId == other.deltaId;
+        }
+    };
+
+    struct PackDataKeyHash
+    {
+        static int generateHash(const PackDataKey &key, int upperLimit) noexcept;
+    };
+
     class Pack :
         public Serializable,
         public ReferenceCountedObject
@@ -82,14 +98,23 @@ namespace VCS
 
         XmlElement *createXmlData(const PackDataHeader *header) const;
 
-    private:
+        bool hasSameData(const PackDataHeader &header, const MemoryBlock &data) const;
 
-        // todo locks?
+    private:
 
         OwnedArray<PackDataHeader> headers;
 
         OwnedArray<PackDataBlock> unsavedData;
 
+        // (itemId, deltaId) -> index in headers or unsavedData
+        HashMap<PackDataKey, int, PackDataKeyHash> headersIndex;
+
+        HashMap<PackDataKey, int, PackDataKeyHash> unsavedDataIndex;
+
+        // content hash -> index of the first header storing that content,
+        // so that the identical deltas are written to the pack file only once
+        HashMap<String, int> blobsIndex;
+
         ScopedPointer<File> packFile;
 
         CriticalSection packStreamLock;
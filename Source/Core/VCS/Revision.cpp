@@ -229,6 +229,19 @@ bool Revision::isEmpty() const
 //===----------------------------------------------------------------------===//
 
 XmlElement *Revision::serialize() const
+{
+    XmlElement *const xml = this->serializeWithoutChildren();
+
+    for (int i = 0; i < this->getNumChildren(); ++i)
+    {
+        const Revision child(this->getChild(i));
+        xml->prependChildElement(child.serialize());
+    }
+
+    return xml;
+}
+
+XmlElement *Revision::serializeWithoutChildren() const
 {
     XmlElement *const xml = new XmlElement(this->getType().toString());
 
@@ -251,12 +264,6 @@ XmlElement *Revision::serialize() const
         }
     }
 
-    for (int i = 0; i < this->getNumChildren(); ++i)
-    {
-        const Revision child(this->getChild(i));
-        xml->prependChildElement(child.serialize());
-    }
-
     return xml;
 }
 
@@ -66,6 +66,9 @@ namespace VCS
 
         bool isEmpty() const;
 
+        // the properties and the items, as the history sync sends a revision
+        XmlElement *serializeWithoutChildren() const;
+
 
         //===------------------------------------------------------------------===//
         // Serializable
@@ -28,7 +28,7 @@ namespace VCS
     {
     public:
 
-        TrackedItem() {}
+        TrackedItem() : vcsModificationStamp(createModificationStamp()) {}
 
         virtual ~TrackedItem() {}
 
@@ -36,6 +36,12 @@ namespace VCS
 
         void setVCSUuid(Uuid value) { this->vcsUuid = value; }
 
+        // Updated on every change of the item, and unique across all the items,
+        // so that the stage diff could tell which items need to be compared again
+        int getVCSModificationStamp() const noexcept { return this->vcsModificationStamp.get(); }
+
+        void markVCSChanged() const noexcept { this->vcsModificationStamp = createModificationStamp(); }
+
         
         virtual int getNumDeltas() const = 0;
 
@@ -64,5 +70,15 @@ namespace VCS
 
         Uuid vcsUuid; // needs to be serialized by subclasses
 
+    private:
+
+        mutable Atomic<int> vcsModificationStamp;
+
+        static int createModificationStamp() noexcept
+        {
+            static Atomic<int> lastStamp;
+            return ++lastStamp;
+        }
+
     };
 } // namespace VCS
@@ -64,6 +64,8 @@ VersionControl::VersionControl(WeakReference<VCS::TrackedItemsSource> parent,
 
     this->remote = new Client(*this);
 
+    this->root.addListener(this);
+
     MessageManagerLock lock;
     this->addChangeListener(&this->head);
     this->head.moveTo(this->root);
@@ -71,6 +73,8 @@ VersionControl::VersionControl(WeakReference<VCS::TrackedItemsSource> parent,
 
 VersionControl::~VersionControl()
 {
+    this->root.removeListener(this);
+
     MessageManagerLock lock;
     this->removeChangeListener(&this->head);
 }
@@ -96,36 +100,61 @@ VersionControlEditor *VersionControl::createEditor()
 
 MD5 VersionControl::calculateHash() const
 {
-    // StringArray и sort - чтоб не зависеть от порядка чайлдов.
-    StringArray ids(this->recursiveGetHashes(this->root));
-    ids.sort(true);
-    return MD5(ids.joinIntoString("").toUTF8());
+    return this->getSubtreeHash(this->root);
 }
 
-StringArray VersionControl::recursiveGetHashes(const Revision revision) const
+MD5 VersionControl::getSubtreeHash(const Revision &revision) const
 {
-    StringArray sum;
+    const String revisionId(revision.getUuid());
+
+    if (this->subtreeHashes.contains(revisionId))
+    {
+        return this->subtreeHashes[revisionId];
+    }
+
+    // StringArray и sort - чтоб не зависеть от порядка чайлдов.
+    StringArray childrenHashes;
 
     for (int i = 0; i < revision.getNumChildren(); ++i)
     {
-        Revision child(revision.getChild(i));
-        sum.addArray(this->recursiveGetHashes(child));
+        const Revision child(revision.getChild(i));
+        childrenHashes.add(child.getUuid() + this->getSubtreeHash(child).toHexString());
     }
 
-    const String revisionSum(revision.calculateHash().toHexString());
-    sum.add(revisionSum);
-    return sum;
+    childrenHashes.sort(true);
+
+    const String sum(revision.calculateHash().toHexString() + childrenHashes.joinIntoString(""));
+    const MD5 subtreeHash(sum.toUTF8());
+    this->subtreeHashes.set(revisionId, subtreeHash);
+    return subtreeHash;
+}
+
+void VersionControl::invalidateSubtreeHashes(ValueTree revision)
+{
+    while (revision.isValid())
+    {
+        this->subtreeHashes.remove(Revision(revision).getUuid());
+        revision = revision.getParent();
+    }
 }
 
 void VersionControl::mergeWith(VersionControl &remoteHistory)
 {
-    this->recursiveTreeMerge(this->getRoot(), remoteHistory.getRoot());
+    this->recursiveTreeMerge(this->getRoot(), remoteHistory.getRoot(), remoteHistory);
 
-    this->publicId = remoteHistory.getPublicId();
-    this->historyMergeVersion = remoteHistory.getVersion();
+    this->finishMerge(remoteHistory.getPublicId(),
+                      remoteHistory.getVersion(),
+                      remoteHistory.getHead().getHeadingRevision().getUuid());
+}
+
+void VersionControl::finishMerge(const String &remoteId, int64 remoteVersion, const String &remoteHeadId)
+{
+    this->head.clearStateCheckpoints();
 
-    Revision newHeadRevision(this->getRevisionById(this->root,
-                             remoteHistory.getHead().getHeadingRevision().getUuid()));
+    this->publicId = remoteId;
+    this->historyMergeVersion = remoteVersion;
+
+    Revision newHeadRevision(this->getRevisionById(this->root, remoteHeadId));
 
     if (!newHeadRevision.isEmpty())
     {
@@ -137,8 +166,15 @@ void VersionControl::mergeWith(VersionControl &remoteHistory)
 }
 
 void VersionControl::recursiveTreeMerge(Revision localRevision,
-                                        Revision remoteRevision)
+                                        Revision remoteRevision,
+                                        const VersionControl &remoteHistory)
 {
+    // the identical subtrees have nothing to merge
+    if (this->getSubtreeHash(localRevision) == remoteHistory.getSubtreeHash(remoteRevision))
+    {
+        return;
+    }
+
     // сначала мерж двух ревизий.
     // проход по чайлдам идет потом, чтоб head.moveTo у чайлда имел дело
     // с уже смерженным родителем.
@@ -179,7 +215,7 @@ void VersionControl::recursiveTreeMerge(Revision localRevision,
 
             if (localChild.getUuid() == remoteChild.getUuid())
             {
-                this->recursiveTreeMerge(localChild, remoteChild);
+                this->recursiveTreeMerge(localChild, remoteChild, remoteHistory);
                 remoteChildExistsInLocal = true;
                 break;
             }
@@ -193,7 +229,7 @@ void VersionControl::recursiveTreeMerge(Revision localRevision,
             newLocalChild.copyPropertiesFrom(remoteChild);
             newLocalChild.flushData();
             localRevision.addChild(newLocalChild, -1, nullptr);
-            this->recursiveTreeMerge(newLocalChild, remoteChild);
+            this->recursiveTreeMerge(newLocalChild, remoteChild, remoteHistory);
         }
     }
 
@@ -277,6 +313,7 @@ void VersionControl::quickAmendItem(TrackedItem *targetItem)
 {
     RevisionItem::Ptr revisionRecord(new RevisionItem(this->pack, RevisionItem::Added, targetItem));
     this->head.getHeadingRevision().setProperty(revisionRecord->getUuid().toString(), var(revisionRecord), nullptr);
+    this->head.clearStateCheckpoints();
     this->head.moveTo(this->head.getHeadingRevision());
     this->head.getHeadingRevision().flushData();
     this->pack->flush();
@@ -544,6 +581,7 @@ void VersionControl::reset()
     this->head.reset();
     this->stashes->reset();
     this->pack->reset();
+    this->subtreeHashes.clear();
 }
 
 
@@ -558,6 +596,43 @@ void VersionControl::changeListenerCallback(ChangeBroadcaster* source)
 }
 
 
+//===----------------------------------------------------------------------===//
+// ValueTree::Listener
+//===----------------------------------------------------------------------===//
+
+void VersionControl::valueTreePropertyChanged(ValueTree &tree, const Identifier &property)
+{
+    // the revision has been renamed, so its old id is unknown here
+    if (property.toString() == Serialization::VCS::commitId)
+    {
+        this->subtreeHashes.clear();
+        return;
+    }
+
+    this->invalidateSubtreeHashes(tree);
+}
+
+void VersionControl::valueTreeChildAdded(ValueTree &parentTree, ValueTree &child)
+{
+    this->invalidateSubtreeHashes(parentTree);
+}
+
+void VersionControl::valueTreeChildRemoved(ValueTree &parentTree, ValueTree &child, int index)
+{
+    // the detached subtree is not listened anymore, so its hashes cannot be trusted later
+    this->subtreeHashes.clear();
+}
+
+void VersionControl::valueTreeChildOrderChanged(ValueTree &parentTree, int oldIndex, int newIndex)
+{
+    // the subtree hashes don't depend on the order of children
+}
+
+void VersionControl::valueTreeParentChanged(ValueTree &tree)
+{
+}
+
+
 //===----------------------------------------------------------------------===//
 // Private
 //===----------------------------------------------------------------------===//
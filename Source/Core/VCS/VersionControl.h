@@ -20,6 +20,11 @@
 class ProjectInfo;
 class VersionControlEditor;
 
+namespace VCS
+{
+    class HistorySync;
+}
+
 #include "TreeItem.h"
 #include "TrackedItemsSource.h"
 #include "SafeTreeItemPointer.h"
@@ -39,7 +44,8 @@ class VersionControlEditor;
 class VersionControl :
     public Serializable,
     public ChangeListener,
-    public ChangeBroadcaster
+    public ChangeBroadcaster,
+    private ValueTree::Listener
 {
 public:
 
@@ -138,9 +144,19 @@ public:
     
 protected:
 
-    StringArray recursiveGetHashes(const VCS::Revision revision) const;
+    // The Merkle-style hash of the revision and all of its children,
+    // along with the children's ids; the revision's own id is not included,
+    // since the roots of the histories are matched regardless of their ids
+    MD5 getSubtreeHash(const VCS::Revision &revision) const;
+
+    void invalidateSubtreeHashes(ValueTree revision);
 
-    void recursiveTreeMerge(VCS::Revision localRevision, VCS::Revision remoteRevision);
+    void recursiveTreeMerge(VCS::Revision localRevision,
+                            VCS::Revision remoteRevision,
+                            const VersionControl &remoteHistory);
+
+    // Takes the id, the version and the head of the history merged in
+    void finishMerge(const String &remoteId, int64 remoteVersion, const String &remoteHeadId);
 
     VCS::Revision getRevisionById(const VCS::Revision startFrom, const String &id) const;
 
@@ -153,10 +169,25 @@ protected:
     // само дерево vcs
     VCS::Revision root;
 
+    // subtree hashes by revision id, dropped for the changed revision and all its parents
+    mutable HashMap<String, MD5> subtreeHashes;
+
     ScopedPointer<VCS::Client> remote;
 
     WeakReference<VCS::TrackedItemsSource> parentItem;
 
+private:
+
+    //===------------------------------------------------------------------===//
+    // ValueTree::Listener
+    //===------------------------------------------------------------------===//
+
+    void valueTreePropertyChanged(ValueTree &tree, const Identifier &property) override;
+    void valueTreeChildAdded(ValueTree &parentTree, ValueTree &child) override;
+    void valueTreeChildRemoved(ValueTree &parentTree, ValueTree &child, int index) override;
+    void valueTreeChildOrderChanged(ValueTree &parentTree, int oldIndex, int newIndex) override;
+    void valueTreeParentChanged(ValueTree &tree) override;
+
 protected:
 
     String publicId;
@@ -167,6 +198,8 @@ protected:
 
 private:
 
+    friend class VCS::HistorySync;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VersionControl)
 
 };
@@ -91,6 +91,14 @@ void ProjectCommandPanel::handleCommandMessage(int commandId)
         case CommandIDs::RenderToWAV:
             this->proceedToRenderDialog("WAV");
             return;
+
+        case CommandIDs::RenderToWAV24:
+            this->proceedToRenderDialog("WAV", 24);
+            return;
+
+        case CommandIDs::RenderToWAV32:
+            this->proceedToRenderDialog("WAV", 32);
+            return;
             
         case CommandIDs::BatchChangeInstrument:
             this->initInstrumentSelection();
@@ -330,7 +338,7 @@ void ProjectCommandPanel::handleCommandMessage(int commandId)
     }
 }
 
-void ProjectCommandPanel::proceedToRenderDialog(const String &extension)
+void ProjectCommandPanel::proceedToRenderDialog(const String &extension, int bitDepth)
 {
     const File initialPath = File::getSpecialLocation(File::userMusicDirectory);
     const String renderFileName = this->project.getName() + "." + extension.toLowerCase();
@@ -342,10 +350,10 @@ void ProjectCommandPanel::proceedToRenderDialog(const String &extension)
     
     if (fc.browseForFileToSave(true))
     {
-        App::Helio()->showModalComponent(new RenderDialog(this->project, fc.getResult(), extension));
+        App::Helio()->showModalComponent(new RenderDialog(this->project, fc.getResult(), extension, bitDepth));
     }
 #else
-    App::Helio()->showModalComponent(new RenderDialog(this->project, initialPath.getChildFile(safeRenderName), extension));
+    App::Helio()->showModalComponent(new RenderDialog(this->project, initialPath.getChildFile(safeRenderName), extension, bitDepth));
 #endif
     
     this->getParentComponent()->exitModalState(0);
@@ -444,6 +452,8 @@ void ProjectCommandPanel::initRenderMenu()
     ReferenceCountedArray<CommandItem> cmds;
     cmds.add(CommandItem::withParams(Icons::left, CommandIDs::Back, TRANS("menu::back")));
     cmds.add(CommandItem::withParams(Icons::render, CommandIDs::RenderToWAV, TRANS("menu::project::render::wav")));
+    cmds.add(CommandItem::withParams(Icons::render, CommandIDs::RenderToWAV24, TRANS("menu::project::render::wav24")));
+    cmds.add(CommandItem::withParams(Icons::render, CommandIDs::RenderToWAV32, TRANS("menu::project::render::wav32")));
     cmds.add(CommandItem::withParams(Icons::render, CommandIDs::RenderToOGG, TRANS("menu::project::render::ogg")));
     cmds.add(CommandItem::withParams(Icons::render, CommandIDs::RenderToFLAC, TRANS("menu::project::render::flac")));
     cmds.add(CommandItem::withParams(Icons::commit, CommandIDs::ExportMidi, TRANS("menu::project::render::midi")));
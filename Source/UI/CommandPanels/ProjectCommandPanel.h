@@ -55,7 +55,7 @@ private:
     String createPianoLayerTempate(const String &name) const;
     String createAutoLayerTempate(const String &name, int controllerNumber, const String &instrumentId = "") const;
     
-    void proceedToRenderDialog(const String &extension);
+    void proceedToRenderDialog(const String &extension, int bitDepth = 16);
     void focusRollAndExit();
 
 };
@@ -163,6 +163,9 @@ namespace CommandIDs
         BatchChangeInstrument           = 0x018000,
         BatchSetInstrument              = 0x018001, // more ids reserved for instruments
         
+        RenderToWAV24                   = 0x019000,
+        RenderToWAV32                   = 0x019001,
+        
         // Add your command ids here
     };
 } // namespace CommandIDs
@@ -35,9 +35,10 @@
 #include "CommandIDs.h"
 //[/MiscUserDefs]
 
-RenderDialog::RenderDialog(ProjectTreeItem &parentProject, const File &renderTo, const String &formatExtension)
+RenderDialog::RenderDialog(ProjectTreeItem &parentProject, const File &renderTo, const String &formatExtension, int formatBitDepth)
     : project(parentProject),
       extension(formatExtension.toLowerCase()),
+      bitDepth(formatBitDepth),
       shouldRenderAfterDialogCompletes(false)
 {
     addAndMakeVisible (background = new PanelC());
@@ -298,7 +299,7 @@ void RenderDialog::startOrAbortRender()
 
     if (! transport.isRendering())
     {
-        transport.startRender(this->getFileName());
+        transport.startRender(this->getFileName(), this->bitDepth);
         this->startTrackingProgress();
     }
     else
@@ -373,8 +374,8 @@ BEGIN_JUCER_METADATA
 
 <JUCER_COMPONENT documentType="Component" className="RenderDialog" template="../../Template"
                  componentName="" parentClasses="public FadingDialog, private Timer"
-                 constructorParams="ProjectTreeItem &amp;parentProject, const File &amp;renderTo, const String &amp;formatExtension"
-                 variableInitialisers="project(parentProject),&#10;extension(formatExtension.toLowerCase()),&#10;shouldRenderAfterDialogCompletes(false)"
+                 constructorParams="ProjectTreeItem &amp;parentProject, const File &amp;renderTo, const String &amp;formatExtension, int formatBitDepth"
+                 variableInitialisers="project(parentProject),&#10;extension(formatExtension.toLowerCase()),&#10;bitDepth(formatBitDepth),&#10;shouldRenderAfterDialogCompletes(false)"
                  snapPixels="8" snapActive="1" snapShown="1" overlayOpacity="0.330"
                  fixedSize="1" initialWidth="520" initialHeight="230">
   <METHODS>
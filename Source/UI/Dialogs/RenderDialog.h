@@ -39,7 +39,7 @@ class RenderDialog  : public FadingDialog,
 {
 public:
 
-    RenderDialog (ProjectTreeItem &parentProject, const File &renderTo, const String &formatExtension);
+    RenderDialog (ProjectTreeItem &parentProject, const File &renderTo, const String &formatExtension, int formatBitDepth);
 
     ~RenderDialog();
 
@@ -73,6 +73,7 @@ private:
     ProjectTreeItem &project;
 
     String extension;
+    int bitDepth;
     bool shouldRenderAfterDialogCompletes;
 
     void startOrAbortRender();
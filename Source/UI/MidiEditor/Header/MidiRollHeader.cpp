@@ -137,7 +137,6 @@ void MidiRollHeader::updateTimeDistanceIndicator()
     double outTimeMs2 = 0.0;
     double outTempo2 = 0.0;
     
-    // todo dont rebuild sequences here
     this->transport.calcTimeAndTempoAt(seek1, outTimeMs1, outTempo1);
     this->transport.calcTimeAndTempoAt(seek2, outTimeMs2, outTempo2);
     
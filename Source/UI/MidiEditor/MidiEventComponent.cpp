@@ -141,7 +141,7 @@ int MidiEventComponent::compareElements(MidiEventComponent *first, MidiEventComp
     if (first == second) { return 0; }
     const float diff = first->getBeat() - second->getBeat();
     const int diffResult = (diff > 0.f) - (diff < 0.f);
-    return (diffResult != 0) ? diffResult : (first->midiEvent.getID().compare(second->midiEvent.getID()));
+    return (diffResult != 0) ? diffResult : (MidiEvent::compareIds(first->midiEvent.getID(), second->midiEvent.getID()));
 }
 
 void MidiEventComponent::activateCorrespondingLayer(bool selectOthers, bool deselectOthers)
@@ -18,6 +18,7 @@
 #include "Common.h"
 #include "MidiEventSelection.h"
 #include "MidiEventComponentLasso.h"
+#include "MidiRoll.h"
 #include "HelioTheme.h"
 
 MidiEventComponentLasso::MidiEventComponentLasso() :
@@ -25,7 +26,7 @@ MidiEventComponentLasso::MidiEventComponentLasso() :
 {
 }
 
-void MidiEventComponentLasso::beginLasso(const MouseEvent &e, LassoSource<MidiEventComponent *> *const lassoSource)
+void MidiEventComponentLasso::beginLasso(const MouseEvent &e, MidiRoll *const lassoSource)
 {
     jassert(source == nullptr);
     jassert(lassoSource != nullptr);
@@ -35,6 +36,14 @@ void MidiEventComponentLasso::beginLasso(const MouseEvent &e, LassoSource<MidiEv
     {
         source = lassoSource;
         originalSelection = lassoSource->getLassoSelection().getItemArray();
+        originalSelectionSet.clear();
+        originalSelectionSet.remapTable(jmax(101, originalSelection.size()));
+
+        for (auto item : originalSelection)
+        {
+            originalSelectionSet.set(item, true);
+        }
+
         this->setSize(0, 0);
         this->toFront(false);
         dragStartPos = e.getMouseDownPosition();
@@ -51,21 +60,39 @@ void MidiEventComponentLasso::dragLasso(const MouseEvent &e)
         Array<MidiEventComponent *> itemsInLasso;
         source->findLassoItemsInArea(itemsInLasso, getBounds());
 
-        if (e.mods.isShiftDown())
-        {
-            itemsInLasso.removeValuesIn(originalSelection);
-            itemsInLasso.addArray(originalSelection);
-        }
-        else if (e.mods.isAltDown())
+        if (e.mods.isShiftDown() || e.mods.isAltDown())
         {
-            Array<MidiEventComponent *> originalMinusNew(originalSelection);
-            originalMinusNew.removeValuesIn(itemsInLasso);
+            HashMap<MidiEventComponent *, bool, MidiEventComponentHashFunction> itemsInLassoSet;
+            itemsInLassoSet.remapTable(jmax(101, itemsInLasso.size()));
+
+            for (auto item : itemsInLasso)
+            {
+                itemsInLassoSet.set(item, true);
+            }
+
+            Array<MidiEventComponent *> result;
+
+            for (auto item : itemsInLasso)
+            {
+                // shift adds the lasso to the original selection, alt inverts it
+                if (e.mods.isShiftDown() || !originalSelectionSet.contains(item))
+                {
+                    result.add(item);
+                }
+            }
+
+            for (auto item : originalSelection)
+            {
+                if (!itemsInLassoSet.contains(item))
+                {
+                    result.add(item);
+                }
+            }
 
-            itemsInLasso.removeValuesIn(originalSelection);
-            itemsInLasso.addArray(originalMinusNew);
+            itemsInLasso.swapWith(result);
         }
 
-        source->getLassoSelection() = MidiEventSelection(itemsInLasso);
+        source->getLassoSelection().setSelection(itemsInLasso);
     }
 }
 
@@ -75,6 +102,7 @@ void MidiEventComponentLasso::endLasso()
     {
         this->source = nullptr;
         this->originalSelection.clear();
+        this->originalSelectionSet.clear();
         this->setVisible(false);
     }
 }
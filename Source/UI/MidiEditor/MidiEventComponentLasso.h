@@ -17,7 +17,9 @@
 
 #pragma once
 
-#include "MidiEventComponent.h"
+#include "MidiEventSelection.h"
+
+class MidiRoll;
 
 class MidiEventComponentLasso : public Component
 {
@@ -32,8 +34,7 @@ public:
     };
 
 
-    virtual void beginLasso(const MouseEvent &e,
-                            LassoSource<MidiEventComponent *> *const lassoSource);
+    virtual void beginLasso(const MouseEvent &e, MidiRoll *const lassoSource);
 
     virtual void dragLasso(const MouseEvent &e);
 
@@ -48,8 +49,10 @@ public:
 private:
 
     Array<MidiEventComponent *> originalSelection;
+    
+    HashMap<MidiEventComponent *, bool, MidiEventComponentHashFunction> originalSelectionSet;
 
-    LassoSource<MidiEventComponent *> *source;
+    MidiRoll *source;
 
     Point<int> dragStartPos;
 
@@ -0,0 +1,202 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "MidiEventSelection.h"
+
+template <typename HashMapType>
+static void growIfNeeded(HashMapType &hashMap)
+{
+    if (hashMap.size() > hashMap.getNumSlots() * 2)
+    {
+        hashMap.remapTable(hashMap.getNumSlots() * 4);
+    }
+}
+
+MidiEventSelection::MidiEventSelection() {}
+
+
+//===----------------------------------------------------------------------===//
+// Items
+//===----------------------------------------------------------------------===//
+
+bool MidiEventSelection::isSelected(MidiEventComponent *item) const
+{
+    return this->positions.contains(item);
+}
+
+void MidiEventSelection::addToSelection(MidiEventComponent *item)
+{
+    if (item == nullptr || this->positions.contains(item))
+    {
+        return;
+    }
+
+    const String layerId(item->getEvent().getLayer()->getLayerIdAsString());
+    SelectionProxyArray *layerGroup = this->getWritableLayerGroup(layerId);
+
+    const ItemPosition position = { this->items.size(), layerGroup->size(), layerId };
+    this->items.add(item);
+    layerGroup->add(item);
+
+    this->positions.set(item, position);
+    growIfNeeded(this->positions);
+
+    item->setSelected(true);
+}
+
+void MidiEventSelection::addToSelection(const ItemArray &itemsToAdd)
+{
+    for (auto item : itemsToAdd)
+    {
+        this->addToSelection(item);
+    }
+}
+
+void MidiEventSelection::deselect(MidiEventComponent *item)
+{
+    if (!this->positions.contains(item))
+    {
+        return;
+    }
+
+    const ItemPosition position(this->positions[item]);
+    this->positions.remove(item);
+
+    // move the last items into the freed slots
+    MidiEventComponent *lastItem = this->items.getLast();
+    this->items.removeLast();
+
+    if (lastItem != item)
+    {
+        ItemPosition lastItemPosition(this->positions[lastItem]);
+        lastItemPosition.index = position.index;
+        this->positions.set(lastItem, lastItemPosition);
+        this->items.set(position.index, lastItem);
+    }
+
+    SelectionProxyArray *layerGroup = this->getWritableLayerGroup(position.layerId);
+    MidiEventComponent *lastItemInLayer = layerGroup->getLast();
+    layerGroup->removeLast();
+
+    if (lastItemInLayer != item)
+    {
+        ItemPosition lastItemPosition(this->positions[lastItemInLayer]);
+        lastItemPosition.indexInLayer = position.indexInLayer;
+        this->positions.set(lastItemInLayer, lastItemPosition);
+        layerGroup->set(position.indexInLayer, lastItemInLayer);
+    }
+
+    if (layerGroup->size() == 0)
+    {
+        this->layerGroups.remove(position.layerId);
+    }
+
+    item->setSelected(false);
+}
+
+void MidiEventSelection::deselect(const ItemArray &itemsToRemove)
+{
+    for (auto item : itemsToRemove)
+    {
+        this->deselect(item);
+    }
+}
+
+void MidiEventSelection::deselectAll()
+{
+    const ItemArray deselectedItems(this->items);
+
+    this->items.clear();
+    this->positions.clear();
+    this->layerGroups.clear();
+
+    for (auto item : deselectedItems)
+    {
+        item->setSelected(false);
+    }
+}
+
+void MidiEventSelection::setSelection(const ItemArray &newItems)
+{
+    HashMap<MidiEventComponent *, bool, MidiEventComponentHashFunction> newItemsSet;
+    newItemsSet.remapTable(jmax(newItemsSet.getNumSlots(), newItems.size()));
+
+    for (auto item : newItems)
+    {
+        newItemsSet.set(item, true);
+    }
+
+    // deselecting swaps the last item in, and that one is already checked
+    for (int i = this->items.size(); --i >= 0; )
+    {
+        MidiEventComponent *item = this->items.getUnchecked(i);
+
+        if (!newItemsSet.contains(item))
+        {
+            this->deselect(item);
+        }
+    }
+
+    this->addToSelection(newItems);
+}
+
+
+//===----------------------------------------------------------------------===//
+// Helpers
+//===----------------------------------------------------------------------===//
+
+void MidiEventSelection::needsToCalculateSelectionBounds()
+{
+    this->bounds = Rectangle<int>();
+
+    for (auto item : this->items)
+    {
+        this->bounds = this->bounds.getUnion(item->getBounds());
+    }
+}
+
+Rectangle<int> MidiEventSelection::getSelectionBounds() const
+{
+    return this->bounds;
+}
+
+const MidiEventSelection::MultiLayerMap &MidiEventSelection::getMultiLayerSelections() const
+{
+    return this->layerGroups;
+}
+
+SelectionProxyArray *MidiEventSelection::getWritableLayerGroup(const String &layerId)
+{
+    SelectionProxyArray *layerGroup = this->layerGroups[layerId].get();
+
+    if (layerGroup == nullptr)
+    {
+        layerGroup = new SelectionProxyArray();
+        this->layerGroups.set(layerId, layerGroup);
+    }
+    else if (layerGroup->getReferenceCount() > 1)
+    {
+        // someone still holds the group (probably iterating it),
+        // so the changes go to a copy and leave that one intact
+        layerGroup = new SelectionProxyArray();
+        layerGroup->addArray(*this->layerGroups[layerId]);
+        this->layerGroups.set(layerId, layerGroup);
+    }
+
+    return layerGroup;
+}
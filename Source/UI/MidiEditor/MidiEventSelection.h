@@ -27,63 +27,70 @@ public:
     typedef ReferenceCountedObjectPtr<SelectionProxyArray> Ptr;
 };
 
-
-class MidiEventSelection :
-    public SelectedItemSet<MidiEventComponent *>
+class MidiEventComponentHashFunction
 {
 public:
-
-    MidiEventSelection() : SelectedItemSet() {}
-    
-    explicit MidiEventSelection(const ItemArray &items) : SelectedItemSet (items)
-    {
-        this->invalidateCache();
-    }
     
-    void itemSelected(MidiEventComponent *item) override
+    static int generateHash(const MidiEventComponent *const key, const int upperLimit) noexcept
     {
-        this->invalidateCache();
-        item->setSelected(true);
+        // components are heap-allocated, so the lowest bits are always the same
+        return static_cast<int>((reinterpret_cast<pointer_sized_uint>(key) >> 4) %
+                                static_cast<pointer_sized_uint>(upperLimit));
     }
+};
 
-    void itemDeselected(MidiEventComponent *item) override
-    {
-        this->invalidateCache();
-        item->setSelected(false);
-    }
+// Keeps the selected items in an array for the indexed access,
+// with a hash index for O(1) membership tests and removals
+// and the per-layer groups, updated as the items come and go.
+// Removals swap the last item in, so the order is not preserved.
+class MidiEventSelection
+{
+public:
 
-    void needsToCalculateSelectionBounds()
-    {
-        this->bounds = Rectangle<int>();
+    typedef Array<MidiEventComponent *> ItemArray;
+    typedef HashMap< String, SelectionProxyArray::Ptr > MultiLayerMap;
 
-        for (int i = 0; i < this->getNumSelected(); ++i)
-        {
-            this->bounds = this->bounds.getUnion(this->getSelectedItem(i)->getBounds());
-        }
-    }
+    MidiEventSelection();
 
-    Rectangle<int> getSelectionBounds() const
-    {
-        return this->bounds;
-    }
-    
-    
-    typedef HashMap< String, SelectionProxyArray::Ptr > MultiLayerMap;
+    //===------------------------------------------------------------------===//
+    // Items
+    //===------------------------------------------------------------------===//
 
-    void invalidateCache()
-    {
-        this->selectionsCache.clear();
-    }
+    inline int getNumSelected() const noexcept
+    { return this->items.size(); }
 
-    const MultiLayerMap &getMultiLayerSelections() const
-    {
-        if (this->selectionsCache.size() == 0)
-        {
-            this->rebuildCache();
-        }
-        
-        return this->selectionsCache;
-    }
+    inline MidiEventComponent *getSelectedItem(int index) const noexcept
+    { return this->items[index]; }
+
+    inline const ItemArray &getItemArray() const noexcept
+    { return this->items; }
+
+    inline MidiEventComponent **begin() const noexcept
+    { return this->items.begin(); }
+
+    inline MidiEventComponent **end() const noexcept
+    { return this->items.end(); }
+
+    bool isSelected(MidiEventComponent *item) const;
+
+    void addToSelection(MidiEventComponent *item);
+    void addToSelection(const ItemArray &itemsToAdd);
+
+    void deselect(MidiEventComponent *item);
+    void deselect(const ItemArray &itemsToRemove);
+    void deselectAll();
+
+    // Only touches the items which change their state
+    void setSelection(const ItemArray &newItems);
+
+    //===------------------------------------------------------------------===//
+    // Helpers
+    //===------------------------------------------------------------------===//
+
+    void needsToCalculateSelectionBounds();
+    Rectangle<int> getSelectionBounds() const;
+
+    const MultiLayerMap &getMultiLayerSelections() const;
 
     bool shouldDisplayGhostNotes() const
     {
@@ -92,33 +99,21 @@ public:
 
 private:
 
+    struct ItemPosition
+    {
+        int index;
+        int indexInLayer;
+        String layerId;
+    };
+
+    ItemArray items;
+    HashMap<MidiEventComponent *, ItemPosition, MidiEventComponentHashFunction> positions;
+    MultiLayerMap layerGroups;
+
     Rectangle<int> bounds;
-    
-    mutable MultiLayerMap selectionsCache;
 
-    void rebuildCache() const
-    {
-        //Logger::writeToLog("rebuildCache");
-
-        for (int i = 0; i < this->getNumSelected(); ++i)
-        {
-            MidiEventComponent *item = this->getSelectedItem(i);
-            const String &layerId(item->getEvent().getLayer()->getLayerIdAsString());
-            
-            SelectionProxyArray::Ptr targetArray;
-            
-            if (this->selectionsCache.contains(layerId))
-            {
-                targetArray = this->selectionsCache[layerId];
-            }
-            else
-            {
-                targetArray = new SelectionProxyArray();
-            }
-            
-            targetArray->add(item);
-            this->selectionsCache.set(layerId, targetArray);
-        }
-    }
+    SelectionProxyArray *getWritableLayerGroup(const String &layerId);
+
+    JUCE_DECLARE_NON_COPYABLE(MidiEventSelection)
 
 };
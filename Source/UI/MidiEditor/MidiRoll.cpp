@@ -720,7 +720,7 @@ bool MidiRoll::isUsingAnyAltMode() const
 
 
 //===----------------------------------------------------------------------===//
-// LassoSource
+// Lasso selection
 //===----------------------------------------------------------------------===//
 
 MidiEventSelection &MidiRoll::getLassoSelection()
@@ -735,18 +735,31 @@ void MidiRoll::selectEventsInRange(float startBeat, float endBeat, bool shouldCl
         this->selection.deselectAll();
     }
 
-    for (int i = 0; i < this->eventComponents.size(); ++i)
+    const Array<MidiLayer *> &layers = this->project.getLayersList();
+    Array<MidiEvent *> eventsInRange;
+
+    for (auto layer : layers)
     {
-        MidiEventComponent *ec = this->eventComponents.getUnchecked(i);
-        if (ec->isActive() &&
-            ec->getBeat() >= startBeat &&
-            ec->getBeat() < endBeat)
+        // the rolls may create the components on demand, so the inactive ones are skipped early
+        if (! this->activeLayers.contains(layer))
         {
-            this->selection.addToSelection(ec);
-            //this->selection.addToSelectionBasedOnModifiers(ec, Desktop::getInstance().getMainMouseSource().getCurrentModifiers());
+            continue;
         }
-    }
 
+        eventsInRange.clearQuick();
+        layer->findEventsInRange(startBeat, endBeat, eventsInRange);
+
+        for (auto event : eventsInRange)
+        {
+            MidiEventComponent *ec = this->getEventComponentFor(*event);
+
+            if (ec != nullptr && ec->isActive())
+            {
+                this->selection.addToSelection(ec);
+                //this->selection.addToSelectionBasedOnModifiers(ec, Desktop::getInstance().getMainMouseSource().getCurrentModifiers());
+            }
+        }
+    }
 }
 
 void MidiRoll::selectEvent(MidiEventComponent *event, bool shouldClearAllOthers)
@@ -774,13 +787,15 @@ void MidiRoll::deselectAll()
 
 void MidiRoll::selectAll()
 {
-    for (int i = 0; i < this->eventComponents.size(); ++i)
+    // not all the events have their components, until asked for
+    for (auto layer : this->activeLayers)
     {
-        MidiEventComponent *child = this->eventComponents.getUnchecked(i);
-
-        if (child->belongsToLayerSet(this->activeLayers))
+        for (int i = 0; i < layer->size(); ++i)
         {
-            this->selection.addToSelection(child);
+            if (MidiEventComponent *child = this->getEventComponentFor(*layer->getUnchecked(i)))
+            {
+                this->selection.addToSelection(child);
+            }
         }
     }
 }
@@ -18,6 +18,7 @@
 #pragma once
 
 class MidiLayer;
+class MidiEvent;
 class MidiEventComponentLasso;
 class ProjectTreeItem;
 class LongTapController;
@@ -84,7 +85,6 @@ class MidiRoll :
     public MultiTouchListener,
     public ProjectListener,
     public ClipboardOwner,
-    public LassoSource<MidiEventComponent *>,
     protected ChangeListener, // listens to MidiRollEditMode,
     protected TransportListener,
     protected AsyncUpdater, // for async scrolling on transport listener events
@@ -127,6 +127,7 @@ public:
     virtual void reloadMidiTrack() = 0;
     virtual void setActiveMidiLayers(Array<MidiLayer *> tracks, MidiLayer *primaryLayer) = 0;
     virtual Rectangle<float> getEventBounds(MidiEventComponent *nc) const = 0;
+    virtual MidiEventComponent *getEventComponentFor(const MidiEvent &event) = 0;
     
     void scrollToSeekPosition();
     void insertAnnotationWithinScreen(const String &annotation);
@@ -250,10 +251,12 @@ public:
     void stopFollowingIndicator();
     
     //===------------------------------------------------------------------===//
-    // LassoSource
+    // Lasso selection
     //===------------------------------------------------------------------===//
 
-    MidiEventSelection &getLassoSelection() override;
+    MidiEventSelection &getLassoSelection();
+    virtual void findLassoItemsInArea(Array<MidiEventComponent *> &itemsFound,
+                                      const Rectangle<int> &rectangle) = 0;
     void selectEventsInRange(float startBeat, float endBeat, bool shouldClearAllOthers);
     void selectEvent(MidiEventComponent *event, bool shouldClearAllOthers);
     void deselectEvent(MidiEventComponent *event);
@@ -0,0 +1,231 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "NotesIndex.h"
+#include "PianoLayer.h"
+
+//===----------------------------------------------------------------------===//
+// NotesIndex
+//===----------------------------------------------------------------------===//
+
+struct NotesIndexEntryComparator
+{
+    bool operator()(const NotesIndex::Entry &a, const NotesIndex::Entry &b) const
+    {
+        return (a.beat < b.beat) || (a.beat == b.beat && a.id < b.id);
+    }
+};
+
+NotesIndex::NotesIndex() : maxLength(0.f) {}
+
+void NotesIndex::rebuild(const Array<MidiLayer *> &layers)
+{
+    this->clear();
+
+    for (auto layer : layers)
+    {
+        if (dynamic_cast<PianoLayer *>(layer) == nullptr)
+        {
+            continue;
+        }
+
+        this->entries.ensureStorageAllocated(this->entries.size() + layer->size());
+
+        for (int i = 0; i < layer->size(); ++i)
+        {
+            const Note *note = static_cast<const Note *>(layer->getUnchecked(i));
+            const Entry entry = { note->getBeat(), note->getID(), note, nullptr };
+            this->entries.add(entry);
+            this->maxLength = jmax(this->maxLength, note->getLength());
+        }
+    }
+
+    // the layers are sorted each, but not all together
+    std::sort(this->entries.begin(), this->entries.end(), NotesIndexEntryComparator());
+}
+
+void NotesIndex::clear()
+{
+    this->entries.clearQuick();
+    this->maxLength = 0.f;
+}
+
+void NotesIndex::add(const Note &note, NoteComponent *component)
+{
+    const Entry entry = { note.getBeat(), note.getID(), &note, component };
+    this->entries.insert(this->lowerBound(entry.beat, entry.id), entry);
+    this->maxLength = jmax(this->maxLength, note.getLength());
+}
+
+NoteComponent *NotesIndex::remove(const Note &note)
+{
+    const int index = this->indexOf(note);
+
+    if (index < 0)
+    {
+        return nullptr;
+    }
+
+    NoteComponent *component = this->entries.getReference(index).component;
+    this->entries.remove(index);
+    return component;
+}
+
+void NotesIndex::setComponent(const Note &note, NoteComponent *component)
+{
+    const int index = this->indexOf(note);
+
+    if (index >= 0)
+    {
+        this->entries.getReference(index).component = component;
+    }
+}
+
+void NotesIndex::findNotesInRange(float startBeat, float endBeat, Array<const Entry *> &result) const
+{
+    const int startIndex =
+        this->lowerBound(startBeat - this->maxLength, std::numeric_limits<MidiEvent::Id>::min());
+
+    for (int i = startIndex; i < this->entries.size(); ++i)
+    {
+        const Entry &entry = this->entries.getReference(i);
+
+        if (entry.beat >= endBeat)
+        {
+            break;
+        }
+
+        result.add(&entry);
+    }
+}
+
+int NotesIndex::lowerBound(float beat, MidiEvent::Id id) const
+{
+    const Entry key = { beat, id, nullptr, nullptr };
+    const Entry *found = std::lower_bound(this->entries.begin(), this->entries.end(),
+                                          key, NotesIndexEntryComparator());
+
+    return int(found - this->entries.begin());
+}
+
+int NotesIndex::indexOf(const Note &note) const
+{
+    const int index = this->lowerBound(note.getBeat(), note.getID());
+
+    if (index < this->entries.size() &&
+        this->entries.getReference(index).id == note.getID())
+    {
+        return index;
+    }
+
+    // the note has been changed in place, and the roll is not notified yet;
+    // a stale entry would point to a deleted note later, so it is found anyway
+    for (int i = 0; i < this->entries.size(); ++i)
+    {
+        if (this->entries.getReference(i).id == note.getID())
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//===----------------------------------------------------------------------===//
+// NotesBatchPainter
+//===----------------------------------------------------------------------===//
+
+NotesBatchPainter::NotesBatchPainter() : lastBatch(nullptr) {}
+
+void NotesBatchPainter::add(const Note &note, const Rectangle<float> &bounds, bool isActive)
+{
+    LayerBatch *batch = this->getBatchFor(note.getLayer());
+
+    const float x1 = bounds.getX();
+    const float y1 = bounds.getY();
+    const float w = bounds.getWidth();
+    const float h = bounds.getHeight();
+
+    // the same shapes as NoteComponent draws, without the bevel
+    batch->topEdges.addWithoutMerging(Rectangle<float>(x1 + 1.f, y1, w - 2.f, 1.f));
+    batch->bottomEdges.addWithoutMerging(Rectangle<float>(x1 + 1.f, y1 + h - 1.f, w - 2.f, 1.f));
+
+    if (! isActive)
+    {
+        batch->outlines.addWithoutMerging(Rectangle<float>(x1, y1 + 1.f, 1.f, h - 2.f));
+        batch->outlines.addWithoutMerging(Rectangle<float>(x1 + w - 1.f, y1 + 1.f, 1.f, h - 2.f));
+        return;
+    }
+
+    batch->bodies.addWithoutMerging(Rectangle<float>(x1, y1 + 1.f, w, h - 2.f));
+
+    const float velocityWidth = (w - 2.f) * note.getVelocity() - 2.f;
+
+    if (velocityWidth > 0.f)
+    {
+        this->velocityBars.addWithoutMerging(Rectangle<float>(x1 + 2.f, y1 + h - 4.f, velocityWidth, 3.f));
+    }
+}
+
+void NotesBatchPainter::paint(Graphics &g)
+{
+    for (auto batch : this->batches)
+    {
+        const Colour colour(Colours::white
+                            .interpolatedWith(batch->layer->getColour(), 0.5f)
+                            .withAlpha(0.95f));
+
+        g.setColour(colour);
+        g.fillRectList(batch->outlines);
+        g.fillRectList(batch->bodies);
+
+        g.setColour(colour.brighter(0.125f));
+        g.fillRectList(batch->topEdges);
+
+        g.setColour(colour.darker(0.175f));
+        g.fillRectList(batch->bottomEdges);
+    }
+
+    g.setColour(Colours::black.withAlpha(0.4f));
+    g.fillRectList(this->velocityBars);
+
+    this->batches.clearQuick(true);
+    this->lastBatch = nullptr;
+    this->velocityBars.clear();
+}
+
+NotesBatchPainter::LayerBatch *NotesBatchPainter::getBatchFor(const MidiLayer *layer)
+{
+    if (this->lastBatch != nullptr && this->lastBatch->layer == layer)
+    {
+        return this->lastBatch;
+    }
+
+    for (auto batch : this->batches)
+    {
+        if (batch->layer == layer)
+        {
+            this->lastBatch = batch;
+            return batch;
+        }
+    }
+
+    this->lastBatch = this->batches.add(new LayerBatch());
+    this->lastBatch->layer = layer;
+    return this->lastBatch;
+}
@@ -0,0 +1,110 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+class MidiLayer;
+class NoteComponent;
+
+#include "Note.h"
+
+// All the notes of the roll sorted by beat, so that the ones within an area
+// are found with a binary search, and are painted and hit-tested without
+// having a component each. The beats are stored along with the notes,
+// because the notes are changed in place before the roll gets notified.
+class NotesIndex
+{
+public:
+
+    struct Entry
+    {
+        float beat;
+        MidiEvent::Id id;
+        const Note *note;
+
+        // only the hovered, selected or dragged notes have their components
+        NoteComponent *component;
+    };
+
+    NotesIndex();
+
+    // Indexes all the notes of the piano layers at once
+    void rebuild(const Array<MidiLayer *> &layers);
+    void clear();
+
+    void add(const Note &note, NoteComponent *component = nullptr);
+
+    // Returns the component the note had, if any
+    NoteComponent *remove(const Note &note);
+
+    void setComponent(const Note &note, NoteComponent *component);
+
+    inline int size() const noexcept
+    { return this->entries.size(); }
+
+    // The notes that may intersect the given beat range, in the order of beats;
+    // the pointers are only valid until the index is changed
+    void findNotesInRange(float startBeat, float endBeat, Array<const Entry *> &result) const;
+
+private:
+
+    int lowerBound(float beat, MidiEvent::Id id) const;
+    int indexOf(const Note &note) const;
+
+    Array<Entry> entries;
+
+    // notes can start way before the visible area and still be visible
+    float maxLength;
+
+    JUCE_DECLARE_NON_COPYABLE(NotesIndex)
+
+};
+
+// Paints the notes which have no components in a few calls per layer:
+// the bodies, their top and bottom edges, and the velocity bars of all the notes
+class NotesBatchPainter
+{
+public:
+
+    NotesBatchPainter();
+
+    void add(const Note &note, const Rectangle<float> &bounds, bool isActive);
+
+    // Paints everything added, and starts over
+    void paint(Graphics &g);
+
+private:
+
+    struct LayerBatch
+    {
+        const MidiLayer *layer;
+        RectangleList<float> bodies;
+        RectangleList<float> topEdges;
+        RectangleList<float> bottomEdges;
+        RectangleList<float> outlines;
+    };
+
+    LayerBatch *getBatchFor(const MidiLayer *layer);
+
+    OwnedArray<LayerBatch> batches;
+    LayerBatch *lastBatch;
+
+    RectangleList<float> velocityBars;
+
+    JUCE_DECLARE_NON_COPYABLE(NotesBatchPainter)
+
+};
@@ -52,6 +52,7 @@
 // todo fixed NUM_BEATS_IN_BAR(4)
 #define ROWS_OF_TWO_OCTAVES 24
 
+
 PianoRoll::PianoRoll(ProjectTreeItem &parentProject,
                      Viewport &viewportRef,
                      WeakReference<AudioMonitor> clippingDetector) :
@@ -66,7 +67,8 @@ PianoRoll::PianoRoll(ProjectTreeItem &parentProject,
     canEmitChordMenu(true),
     canEmitEditMenu(true),
     mouseDownWasTriggered(false),
-    usingFullRender(false)
+    usingFullRender(false),
+    notesIndex(new NotesIndex())
 {
     this->setRowHeight(MIN_ROW_HEIGHT + 5);
 
@@ -151,40 +153,18 @@ void PianoRoll::reloadMidiTrack()
 
     this->selection.deselectAll();
 
-    for (int i = 0; i < this->eventComponents.size(); ++i)
+    for (auto component : this->visibleNotes)
     {
-        this->removeChildComponent(this->eventComponents.getUnchecked(i));
+        this->removeChildComponent(component);
     }
 
+    this->visibleNotes.clearQuick();
+    this->draggingNote = nullptr;
     this->eventComponents.clear();
     this->componentsHashTable.clear();
 
-
-    const Array<MidiLayer *> &layers = this->project.getLayersList();
-
-    for (auto layer : layers)
-    {
-        for (int j = 0; j < layer->size(); ++j)
-        {
-            MidiEvent *event = layer->getUnchecked(j);
-
-            if (Note *note = dynamic_cast<Note *>(event))
-            {
-                auto noteComponent = new NoteComponent(*this, *note);
-
-                //noteComponent->setSelected(this->selection.isSelected(noteComponent)); // ��� �� �:
-                //noteComponent->setSelected(this->activeLayer->getLassoSelection().isSelected(noteComponent));
-
-                this->eventComponents.add(noteComponent);
-                this->componentsHashTable.set(*note, noteComponent);
-
-                const bool belongsToActiveLayer = noteComponent->belongsToLayerSet(this->activeLayers);
-                noteComponent->setActive(belongsToActiveLayer, true);
-
-                this->addAndMakeVisible(noteComponent);
-            }
-        }
-    }
+    // no components are created here, the notes are painted from the index
+    this->notesIndex->rebuild(this->project.getLayersList());
 
     this->resized();
     this->repaint(this->viewport.getViewArea());
@@ -349,6 +329,16 @@ void PianoRoll::addNote(int key, float beat, float length, float velocity)
     }
 }
 
+MidiEventComponent *PianoRoll::getEventComponentFor(const MidiEvent &event)
+{
+    if (const Note *note = dynamic_cast<const Note *>(&event))
+    {
+        return this->getNoteComponent(*note);
+    }
+
+    return nullptr;
+}
+
 Rectangle<float> PianoRoll::getEventBounds(MidiEventComponent *mc) const
 {
     NoteComponent *nc = static_cast<NoteComponent *>(mc);
@@ -448,7 +438,10 @@ void PianoRoll::onEventChanged(const MidiEvent &oldEvent, const MidiEvent &newEv
     const Note &note = static_cast<const Note &>(oldEvent);
     const Note &newNote = static_cast<const Note &>(newEvent);
 
-    if (NoteComponent *component = this->componentsHashTable[note])
+    NoteComponent *component = this->notesIndex->remove(note);
+    this->notesIndex->add(newNote, component);
+
+    if (component != nullptr)
     {
         //component->repaint(); // если делать так - будут дикие тормоза, поэтому:
         this->batchRepaintList.add(component);
@@ -456,6 +449,17 @@ void PianoRoll::onEventChanged(const MidiEvent &oldEvent, const MidiEvent &newEv
 
         this->componentsHashTable.remove(note);
         this->componentsHashTable.set(newNote, component);
+
+        this->attachNoteIfVisible(component);
+    }
+    else
+    {
+        // the painted notes are repainted all at once, same as the components
+        const Rectangle<float> oldBounds(this->getEventBounds(note.getKey(), note.getBeat(), note.getLength()));
+        const Rectangle<float> newBounds(this->getEventBounds(newNote.getKey(), newNote.getBeat(), newNote.getLength()));
+        const Rectangle<int> changedArea(oldBounds.getUnion(newBounds).getSmallestIntegerContainer());
+        this->dirtyNotesArea = this->dirtyNotesArea.isEmpty() ? changedArea : this->dirtyNotesArea.getUnion(changedArea);
+        this->triggerAsyncUpdate();
     }
 }
 
@@ -465,25 +469,28 @@ void PianoRoll::onEventAdded(const MidiEvent &event)
 
     const Note &note = static_cast<const Note &>(event);
 
-    auto component = new NoteComponent(*this, note);
-    this->addAndMakeVisible(component);
+    // the new notes get selected, so they need their components right away
+    this->notesIndex->add(note);
+    NoteComponent *component = this->createNoteComponent(note);
 
     this->batchRepaintList.add(component);
     this->triggerAsyncUpdate();
     // ^^ вместо:
     //component->updateBounds(this->getEventBounds(component));
 
-    component->toFront(false);
-
-    this->fader.fadeIn(component, 150);
-
-    this->eventComponents.add(component);
     this->selectEvent(component, false); // selectEvent(component, true)
 
-    const bool isActive = component->belongsToLayerSet(this->activeLayers);
-    component->setActive(isActive);
+    // the note being drawn gets the mouse events, so it is always attached
+    if (this->addNewNoteMode)
+    {
+        this->attachNote(component);
+    }
 
-    this->componentsHashTable.set(note, component);
+    if (component->getParentComponent() == this)
+    {
+        component->toFront(false);
+        this->fader.fadeIn(component, 150);
+    }
 
     if (this->addNewNoteMode)
     {
@@ -500,15 +507,22 @@ void PianoRoll::onEventRemoved(const MidiEvent &event)
     
     const Note &note = static_cast<const Note &>(event);
 
-    if (NoteComponent *component = this->componentsHashTable[note])
+    if (NoteComponent *component = this->notesIndex->remove(note))
     {
-        this->fader.fadeOut(component, 150);
+        if (component->getParentComponent() == this)
+        {
+            this->fader.fadeOut(component, 150);
+        }
         
         this->selection.deselect(component);
 
-        this->removeChildComponent(component); // O(N)
+        this->detachNote(component);
         this->componentsHashTable.remove(note);
-        this->eventComponents.removeObject(component, true); // O(N)
+        this->eventComponents.removeObject(component, true);
+    }
+    else
+    {
+        this->repaint(this->getEventBounds(note.getKey(), note.getBeat(), note.getLength()).getSmallestIntegerContainer());
     }
 }
 
@@ -537,45 +551,54 @@ void PianoRoll::onLayerRemoved(const MidiLayer *layer)
     {
         const Note &note = static_cast<const Note &>(*layer->getUnchecked(i));
 
-        if (NoteComponent *component = this->componentsHashTable[note])
+        if (NoteComponent *component = this->notesIndex->remove(note))
         {
             this->selection.deselect(component);
-            this->removeChildComponent(component);
+            this->detachNote(component);
             this->componentsHashTable.remove(note);
             this->eventComponents.removeObject(component, true);
         }
     }
+
+    this->repaint(this->viewport.getViewArea());
 }
 
 
 //===----------------------------------------------------------------------===//
-// LassoSource
+// Lasso selection
 //===----------------------------------------------------------------------===//
 
 void PianoRoll::findLassoItemsInArea(Array<MidiEventComponent *> &itemsFound, const Rectangle<int> &rectangle)
 {
-    bool shouldInvalidateSelectionCache = false;
-
-    for (int i = 0; i < this->eventComponents.size(); ++i)
+    // the detached notes are synced with the selection when attached
+    for (auto note : this->visibleNotes)
     {
-        NoteComponent *note = static_cast<NoteComponent *>(this->eventComponents.getUnchecked(i));
         note->setSelected(this->selection.isSelected(note));
     }
 
-    for (int i = 0; i < this->eventComponents.size(); ++i)
+    Array<const NotesIndex::Entry *> candidates;
+    this->notesIndex->findNotesInRange(this->getBeatByXPosition(float(rectangle.getX())),
+                                       this->getBeatByXPosition(float(rectangle.getRight())),
+                                       candidates);
+
+    // only the notes within the lasso get their components
+    Array<const Note *> notesFound;
+
+    for (auto entry : candidates)
     {
-        NoteComponent *note = static_cast<NoteComponent *>(this->eventComponents.getUnchecked(i));
+        const Note &note = *entry->note;
+        const Rectangle<float> bounds(this->getEventBounds(note.getKey(), note.getBeat(), note.getLength()));
 
-        if (rectangle.intersects(note->getBounds()) && note->isActive())
+        if (rectangle.intersects(bounds.getSmallestIntegerContainer()) &&
+            this->activeLayers.contains(note.getLayer()))
         {
-            shouldInvalidateSelectionCache = true;
-            itemsFound.addIfNotAlreadyThere(note);
+            notesFound.add(&note);
         }
     }
 
-    if (shouldInvalidateSelectionCache)
+    for (auto note : notesFound)
     {
-        this->selection.invalidateCache();
+        itemsFound.add(this->getNoteComponent(*note)); // the index never returns duplicates
     }
 }
 
@@ -809,6 +832,25 @@ void PianoRoll::clipboardPaste(const XmlElement &xml)
 //    MidiRoll::longTapEvent(e);
 //}
 
+void PianoRoll::mouseMove(const MouseEvent &e)
+{
+    MidiRoll::mouseMove(e);
+
+    this->releaseIdleNoteComponents();
+
+    if (this->isUsingSpaceDraggingMode() ||
+        ! this->project.getEditMode().shouldInteractWithChildren())
+    {
+        return;
+    }
+
+    // the hovered note gets its component, which handles the clicks from now on
+    if (const Note *note = this->findNoteAt(e.getPosition()))
+    {
+        this->attachNote(this->getNoteComponent(*note));
+    }
+}
+
 void PianoRoll::mouseDown(const MouseEvent &e)
 {
     if (this->multiTouchController->hasMultitouch() || (e.source.getIndex() > 0))
@@ -816,6 +858,23 @@ void PianoRoll::mouseDown(const MouseEvent &e)
         return;
     }
     
+    // there's no hover on touch screens, so the painted note is clicked directly
+    if (e.mods.isLeftButtonDown() &&
+        ! this->isUsingSpaceDraggingMode() &&
+        this->project.getEditMode().shouldInteractWithChildren())
+    {
+        const Note *note = this->findNoteAt(e.getPosition());
+
+        if (note != nullptr && this->activeLayers.contains(note->getLayer()))
+        {
+            NoteComponent *component = this->getNoteComponent(*note);
+            this->attachNote(component);
+            this->forwardedMouseNote = component;
+            component->mouseDown(e.getEventRelativeTo(component));
+            return;
+        }
+    }
+
     if (! this->isUsingSpaceDraggingMode())
     {
         this->setInterceptsMouseClicks(true, false);
@@ -851,6 +910,12 @@ void PianoRoll::mouseDrag(const MouseEvent &e)
         return;
     }
 
+    if (NoteComponent *component = this->forwardedMouseNote)
+    {
+        component->mouseDrag(e.getEventRelativeTo(component));
+        return;
+    }
+
     if (this->draggingNote)
     {
         if (this->draggingNote->isResizing())
@@ -888,6 +953,14 @@ void PianoRoll::mouseUp(const MouseEvent &e)
 //        return;
 //    }
 
+    if (NoteComponent *component = this->forwardedMouseNote)
+    {
+        this->forwardedMouseNote = nullptr;
+        component->mouseUp(e.getEventRelativeTo(component));
+        this->releaseIdleNoteComponents();
+        return;
+    }
+
     const bool justEndedDraggingNewNote = this->dismissDraggingNoteIfNeeded();
 
     if (! this->isUsingSpaceDraggingMode())
@@ -921,6 +994,9 @@ void PianoRoll::mouseUp(const MouseEvent &e)
     }
 
     this->mouseDownWasTriggered = false;
+
+    // the notes deselected by the click or the lasso are painted again
+    this->releaseIdleNoteComponents();
 }
 
 bool PianoRoll::dismissDraggingNoteIfNeeded()
@@ -1169,9 +1245,9 @@ void PianoRoll::resized()
 {
     MIDI_ROLL_BULK_REPAINT_START
 
-    for (int i = 0; i < this->eventComponents.size(); ++i)
+    // the detached ones are updated when attached
+    for (auto note : this->visibleNotes)
     {
-        NoteComponent *note = static_cast<NoteComponent *>(this->eventComponents.getUnchecked(i));
         note->updateBounds(this->getEventBounds(note));
     }
 
@@ -1180,6 +1256,13 @@ void PianoRoll::resized()
     MIDI_ROLL_BULK_REPAINT_END
 }
 
+void PianoRoll::moved()
+{
+    // the viewport has scrolled
+    this->updateVisibleNotes();
+    MidiRoll::moved();
+}
+
 void PianoRoll::paint(Graphics &g)
 {
 #if PIANOROLL_HAS_PRERENDERED_BACKGROUND
@@ -1250,6 +1333,8 @@ void PianoRoll::paint(Graphics &g)
 #endif
 
     MidiRoll::paint(g);
+
+    this->paintNotes(g);
 }
 
 void PianoRoll::insertNewNoteAt(const MouseEvent &e)
@@ -1309,12 +1394,20 @@ void PianoRoll::handleAsyncUpdate()
     }
 #endif
 
+    if (! this->dirtyNotesArea.isEmpty())
+    {
+        this->repaint(this->dirtyNotesArea);
+        this->dirtyNotesArea = Rectangle<int>();
+    }
+
     MidiRoll::handleAsyncUpdate();
 }
 
 
 void PianoRoll::updateChildrenBounds()
 {
+    this->updateVisibleNotes();
+
 #if PIANOROLL_HAS_NOTE_RESIZERS
     if (this->noteResizerLeft != nullptr)
     {
@@ -1348,6 +1441,271 @@ void PianoRoll::updateChildrenPositions()
 }
 
 
+//===----------------------------------------------------------------------===//
+// Painted notes
+//===----------------------------------------------------------------------===//
+
+float PianoRoll::getBeatByXPosition(float x) const
+{
+    const float startOffsetBeat = float(this->firstBar * NUM_BEATS_IN_BAR);
+    return startOffsetBeat + (x / this->snapWidth) * this->snapsPerBeat;
+}
+
+void PianoRoll::paintNotes(Graphics &g)
+{
+    if (this->snapWidth <= 0.f)
+    {
+        return;
+    }
+
+    const Rectangle<int> area(g.getClipBounds().getIntersection(this->viewport.getViewArea()));
+
+    if (area.isEmpty())
+    {
+        return;
+    }
+
+    Array<const NotesIndex::Entry *> entries;
+    this->notesIndex->findNotesInRange(this->getBeatByXPosition(float(area.getX())),
+                                       this->getBeatByXPosition(float(area.getRight())),
+                                       entries);
+
+    // the inactive notes go behind, just like their components do
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const bool paintsActive = (pass > 0);
+
+        for (auto entry : entries)
+        {
+            // the attached components paint themselves
+            if (entry->component != nullptr &&
+                entry->component->getParentComponent() == this)
+            {
+                continue;
+            }
+
+            const Note &note = *entry->note;
+            const bool isActive = this->activeLayers.contains(note.getLayer());
+
+            if (isActive != paintsActive)
+            {
+                continue;
+            }
+
+            const Rectangle<float> bounds(this->getEventBounds(note.getKey(), note.getBeat(), note.getLength()));
+
+            if (area.intersects(bounds.getSmallestIntegerContainer()))
+            {
+                this->notesPainter.add(note, bounds, isActive);
+            }
+        }
+
+        this->notesPainter.paint(g);
+    }
+}
+
+const Note *PianoRoll::findNoteAt(const Point<int> &position) const
+{
+    if (this->snapWidth <= 0.f)
+    {
+        return nullptr;
+    }
+
+    const float beat = this->getBeatByXPosition(float(position.getX()));
+
+    Array<const NotesIndex::Entry *> entries;
+    this->notesIndex->findNotesInRange(beat, beat + 1.f, entries);
+
+    // the active notes are painted on top, and so are the later ones
+    const Note *result = nullptr;
+    bool resultIsActive = false;
+
+    for (auto entry : entries)
+    {
+        const Note &note = *entry->note;
+        const bool isActive = this->activeLayers.contains(note.getLayer());
+
+        if (resultIsActive && ! isActive)
+        {
+            continue;
+        }
+
+        const Rectangle<float> bounds(this->getEventBounds(note.getKey(), note.getBeat(), note.getLength()));
+
+        if (bounds.contains(position.toFloat()))
+        {
+            result = &note;
+            resultIsActive = isActive;
+        }
+    }
+
+    return result;
+}
+
+
+//===----------------------------------------------------------------------===//
+// Note components
+//===----------------------------------------------------------------------===//
+
+NoteComponent *PianoRoll::createNoteComponent(const Note &note)
+{
+    auto component = new NoteComponent(*this, note);
+
+    this->eventComponents.add(component);
+    this->componentsHashTable.set(note, component);
+    this->notesIndex->setComponent(note, component);
+
+    const bool belongsToActiveLayer = component->belongsToLayerSet(this->activeLayers);
+    component->setActive(belongsToActiveLayer, true);
+
+    // the same as MidiRoll sets up for all the components on the edit mode change
+    const bool interactsWithChildren = this->project.getEditMode().shouldInteractWithChildren();
+    component->setInterceptsMouseClicks(interactsWithChildren, interactsWithChildren);
+    component->setMouseCursor(interactsWithChildren ? MouseCursor::NormalCursor : this->project.getEditMode().getCursor());
+
+    this->attachNoteIfVisible(component);
+    return component;
+}
+
+NoteComponent *PianoRoll::getNoteComponent(const Note &note)
+{
+    if (NoteComponent *component = this->componentsHashTable[note])
+    {
+        return component;
+    }
+
+    return this->createNoteComponent(note);
+}
+
+void PianoRoll::releaseIdleNoteComponents()
+{
+    if (this->eventComponents.size() <= this->selection.getNumSelected())
+    {
+        return;
+    }
+
+    for (int i = this->eventComponents.size(); --i >= 0; )
+    {
+        NoteComponent *component = static_cast<NoteComponent *>(this->eventComponents.getUnchecked(i));
+
+        const bool isInUse =
+            (component == this->draggingNote) ||
+            (component == this->forwardedMouseNote) ||
+            component->isMouseOverOrDragging() ||
+            component->isMouseButtonDown() ||
+            this->selection.isSelected(component);
+
+        if (! isInUse)
+        {
+            const Note &note = component->getNote();
+            this->notesIndex->setComponent(note, nullptr);
+            this->componentsHashTable.remove(note);
+
+            // the parent repaints the area, and the note gets painted there instead
+            this->detachNote(component);
+            this->eventComponents.remove(i, true);
+        }
+    }
+}
+
+
+//===----------------------------------------------------------------------===//
+// Visible notes
+//===----------------------------------------------------------------------===//
+
+Rectangle<int> PianoRoll::getVisibleNotesArea() const
+{
+    // a margin around the viewport, so that the small scrolls
+    // don't attach and detach anything
+    const Rectangle<int> viewArea(this->viewport.getViewArea());
+    return viewArea.expanded(viewArea.getWidth() / 2, viewArea.getHeight() / 2);
+}
+
+void PianoRoll::updateVisibleNotes()
+{
+    if (this->snapWidth <= 0.f)
+    {
+        return;
+    }
+
+    const Rectangle<int> area(this->getVisibleNotesArea());
+
+    Array<const NotesIndex::Entry *> candidates;
+    this->notesIndex->findNotesInRange(this->getBeatByXPosition(float(area.getX())),
+                                       this->getBeatByXPosition(float(area.getRight())),
+                                       candidates);
+
+    Array<NoteComponent *> nowVisible;
+    SortedSet<NoteComponent *> nowVisibleSet;
+
+    // the painted notes have nothing to attach
+    for (auto entry : candidates)
+    {
+        NoteComponent *note = entry->component;
+
+        if (note != nullptr &&
+            area.intersects(this->getEventBounds(note).getSmallestIntegerContainer()))
+        {
+            nowVisible.add(note);
+            nowVisibleSet.add(note);
+        }
+    }
+
+    for (int i = this->visibleNotes.size(); --i >= 0; )
+    {
+        NoteComponent *note = this->visibleNotes.getUnchecked(i);
+
+        // never detach the notes being dragged, as they would lose the mouse
+        const bool isInteracting = (note == this->draggingNote || note->isMouseButtonDown());
+
+        if (! isInteracting && ! nowVisibleSet.contains(note))
+        {
+            this->removeChildComponent(note);
+            this->visibleNotes.remove(i);
+        }
+    }
+
+    for (auto note : nowVisible)
+    {
+        this->attachNote(note);
+    }
+}
+
+void PianoRoll::attachNoteIfVisible(NoteComponent *component)
+{
+    const Rectangle<float> bounds(this->getEventBounds(component));
+
+    if (this->getVisibleNotesArea().intersects(bounds.getSmallestIntegerContainer()))
+    {
+        this->attachNote(component);
+    }
+}
+
+void PianoRoll::attachNote(NoteComponent *component)
+{
+    if (component->getParentComponent() == this)
+    {
+        return;
+    }
+
+    component->updateBounds(this->getEventBounds(component));
+    component->setSelected(this->selection.isSelected(component));
+
+    // inactive notes go behind everything, just like MidiEventComponent::setActive does
+    this->addAndMakeVisible(component, component->isActive() ? -1 : 0);
+    this->visibleNotes.add(component);
+}
+
+void PianoRoll::detachNote(NoteComponent *component)
+{
+    if (component->getParentComponent() == this)
+    {
+        this->removeChildComponent(component);
+        this->visibleNotes.removeFirstMatchingValue(component);
+    }
+}
+
+
 //===----------------------------------------------------------------------===//
 // Serializable
 //===----------------------------------------------------------------------===//
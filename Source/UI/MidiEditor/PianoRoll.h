@@ -54,6 +54,7 @@ class NoteResizerRight;
 #include "HelioTheme.h"
 #include "MidiRoll.h"
 #include "Note.h"
+#include "NotesIndex.h"
 
 class PianoRoll : public MidiRoll
 {
@@ -116,6 +117,7 @@ public:
 
     void addNote(int key, float beat, float length, float velocity);
     Rectangle<float> getEventBounds(MidiEventComponent *mc) const override;
+    MidiEventComponent *getEventComponentFor(const MidiEvent &event) override;
     Rectangle<float> getEventBounds(const int key, const float beat, const float length) const;
     void getRowsColsByComponentPosition(const float x, const float y, int &noteNumber, float &beatNumber) const;
     void getRowsColsByMousePosition(int x, int y, int &noteNumber, float &beatNumber) const;
@@ -144,7 +146,7 @@ public:
 
 
     //===------------------------------------------------------------------===//
-    // LassoSource
+    // Lasso selection
     //===------------------------------------------------------------------===//
 
     void findLassoItemsInArea(Array<MidiEventComponent *> &itemsFound,
@@ -164,6 +166,7 @@ public:
     //===------------------------------------------------------------------===//
 
     //virtual void longTapEvent(const MouseEvent &e) override;
+    void mouseMove(const MouseEvent &e) override;
     void mouseDown(const MouseEvent &e) override;
     void mouseDoubleClick(const MouseEvent &e) override;
     void mouseUp(const MouseEvent &e) override;
@@ -171,6 +174,7 @@ public:
     void handleCommandMessage(int commandId) override;
     bool keyPressed(const KeyPress &key) override;
     void resized() override;
+    void moved() override;
     void paint(Graphics &g) override;
 
     
@@ -222,6 +226,35 @@ private:
     
     OwnedArray<NoteComponent> ghostNotes;
     
+private:
+    
+    // The notes are painted right from the layers, and only the hovered, selected,
+    // dragged or just added ones have their components; of those, only the ones
+    // within or near the viewport are added as children
+    void paintNotes(Graphics &g);
+    const Note *findNoteAt(const Point<int> &position) const;
+    float getBeatByXPosition(float x) const;
+
+    NoteComponent *createNoteComponent(const Note &note);
+    NoteComponent *getNoteComponent(const Note &note);
+    void releaseIdleNoteComponents();
+
+    void updateVisibleNotes();
+    void attachNoteIfVisible(NoteComponent *component);
+    void attachNote(NoteComponent *component);
+    void detachNote(NoteComponent *component);
+    Rectangle<int> getVisibleNotesArea() const;
+    
+    ScopedPointer<NotesIndex> notesIndex;
+    NotesBatchPainter notesPainter;
+    Array<NoteComponent *> visibleNotes;
+
+    // the changed notes without components, to be repainted at once
+    Rectangle<int> dirtyNotesArea;
+
+    // the note which was clicked while painted, and has got its component just now
+    SafePointer<NoteComponent> forwardedMouseNote;
+    
     //ScopedPointer<HelperRectangle> helperVertical;
     ScopedPointer<HelperRectangle> helperHorizontal;
 
@@ -24,61 +24,6 @@
 #include "MidiRoll.h"
 #include "AnnotationEvent.h"
 
-class TrackMapNoteComponent : public Component
-{
-public:
-
-    TrackMapNoteComponent(PianoTrackMap &parent, const Note &event) :
-        note(event),
-        map(parent),
-        dx(0.f),
-        dw(0.f)
-    {
-        this->setOpaque(false);
-        this->setInterceptsMouseClicks(false, false);
-        this->setWantsKeyboardFocus(false);
-        this->setPaintingIsUnclipped(true);
-    }
-
-    inline int getKey() const noexcept           { return this->note.getKey(); }
-    inline float getBeat() const noexcept        { return this->note.getBeat(); }
-    inline float getLength() const noexcept      { return this->note.getLength(); }
-    inline float getVelocity() const noexcept    { return this->note.getVelocity(); }
-
-    void setRealBounds(float x, int y, float w, int h)
-    {
-#if HELIO_DESKTOP
-        this->dx = x - float(int(x));
-        this->dw = w - float(int(w));
-#endif
-        this->setBounds(int(x), y, int(w), h);
-    }
-    
-    void paint(Graphics &g) override
-    {
-        g.setColour(this->note.getLayer()->getColour().
-                    interpolatedWith(Colours::white, .35f).
-                    withAlpha(this->note.getVelocity() * .3f + .4f));
-
-#if HELIO_DESKTOP
-        g.drawHorizontalLine(0, this->dx, float(this->getWidth()) + this->dw + this->dx);
-#elif HELIO_MOBILE
-        g.drawHorizontalLine(0, 0, float(this->getWidth()));
-#endif
-    }
-
-private:
-
-    const Note &note;
-
-    PianoTrackMap &map;
-    
-    float dx;
-    
-    float dw;
-
-};
-
 
 PianoTrackMap::PianoTrackMap(ProjectTreeItem &parentProject, MidiRoll &parentRoll) :
     project(parentProject),
@@ -87,11 +32,11 @@ PianoTrackMap::PianoTrackMap(ProjectTreeItem &parentProject, MidiRoll &parentRol
     projectLastBeat(0.f),
     rollFirstBeat(0.f),
     rollLastBeat(0.f),
-    componentHeight(1.f)
+    hasDirtyBeats(false)
 {
     this->setOpaque(false);
     this->setInterceptsMouseClicks(false, false);
-    this->reloadTrackMap();
+    this->setPaintingIsUnclipped(true);
     this->project.addListener(this);
 }
 
@@ -105,20 +50,35 @@ PianoTrackMap::~PianoTrackMap()
 // Component
 //===----------------------------------------------------------------------===//
 
+void PianoTrackMap::paint(Graphics &g)
+{
+    if (this->cachedMap.isValid())
+    {
+        g.drawImageAt(this->cachedMap, 0, 0);
+    }
+}
+
 void PianoTrackMap::resized()
 {
-    this->rollFirstBeat = this->roll.getFirstBeat();
-    this->rollLastBeat = this->roll.getLastBeat();
-    this->componentHeight = float(this->getHeight()) / 128.f;
-    
-    this->setVisible(false);
+    // Scroller calls this every time the roll is resized or zoomed,
+    // but the map only needs to be rebuilt when its geometry has changed
+    const float newFirstBeat = this->roll.getFirstBeat();
+    const float newLastBeat = this->roll.getLastBeat();
+
+    const bool sizeChanged =
+        (this->cachedMap.getWidth() != this->getWidth() ||
+         this->cachedMap.getHeight() != this->getHeight());
 
-    for (int i = 0; i < this->eventComponents.size(); ++i)
+    const bool beatRangeChanged =
+        (this->rollFirstBeat != newFirstBeat ||
+         this->rollLastBeat != newLastBeat);
+
+    if (sizeChanged || beatRangeChanged)
     {
-        this->applyNoteBounds(this->eventComponents.getUnchecked(i));
+        this->rollFirstBeat = newFirstBeat;
+        this->rollLastBeat = newLastBeat;
+        this->reloadTrackMap();
     }
-
-    this->setVisible(true);
 }
 
 
@@ -133,15 +93,8 @@ void PianoTrackMap::onEventChanged(const MidiEvent &oldEvent, const MidiEvent &n
     const Note &note = static_cast<const Note &>(oldEvent);
     const Note &newNote = static_cast<const Note &>(newEvent);
 
-    if (TrackMapNoteComponent *component = this->componentsHashTable[note])
-    {
-        //component->setVisible(false);
-        this->applyNoteBounds(component);
-        //component->repaint(); // for volume changes
-        //component->setVisible(true);
-
-        this->componentsHashTable.set(newNote, component);
-    }
+    this->invalidateBeatRange(note.getBeat(), note.getBeat() + note.getLength());
+    this->invalidateBeatRange(newNote.getBeat(), newNote.getBeat() + newNote.getLength());
 }
 
 void PianoTrackMap::onEventAdded(const MidiEvent &event)
@@ -149,16 +102,7 @@ void PianoTrackMap::onEventAdded(const MidiEvent &event)
     if (!dynamic_cast<const Note *>(&event)) { return; }
 
     const Note &note = static_cast<const Note &>(event);
-
-    auto component = new TrackMapNoteComponent(*this, note);
-    this->addAndMakeVisible(component);
-    this->applyNoteBounds(component);
-    component->toFront(false);
-
-    //this->eventAnimator.fadeIn(component, 150);
-    this->eventComponents.add(component);
-
-    this->componentsHashTable.set(note, component);
+    this->invalidateBeatRange(note.getBeat(), note.getBeat() + note.getLength());
 }
 
 void PianoTrackMap::onEventRemoved(const MidiEvent &event)
@@ -166,14 +110,7 @@ void PianoTrackMap::onEventRemoved(const MidiEvent &event)
     if (!dynamic_cast<const Note *>(&event)) { return; }
 
     const Note &note = static_cast<const Note &>(event);
-
-    if (TrackMapNoteComponent *component = this->componentsHashTable[note])
-    {
-        //this->eventAnimator.fadeOut(component, 150);
-        this->removeChildComponent(component);
-        this->componentsHashTable.remove(note);
-        this->eventComponents.removeObject(component, true);
-    }
+    this->invalidateBeatRange(note.getBeat(), note.getBeat() + note.getLength());
 }
 
 void PianoTrackMap::onLayerChanged(const MidiLayer *layer)
@@ -197,16 +134,12 @@ void PianoTrackMap::onLayerRemoved(const MidiLayer *layer)
 {
     if (!dynamic_cast<const PianoLayer *>(layer)) { return; }
 
+    // The layer might still be listed in the project at this point,
+    // so its range is only re-rasterized on the next async update
     for (int i = 0; i < layer->size(); ++i)
     {
         const Note &note = static_cast<const Note &>(*layer->getUnchecked(i));
-
-        if (TrackMapNoteComponent *component = this->componentsHashTable[note])
-        {
-            this->removeChildComponent(component);
-            this->componentsHashTable.remove(note);
-            this->eventComponents.removeObject(component, true);
-        }
+        this->invalidateBeatRange(note.getBeat(), note.getBeat() + note.getLength());
     }
 }
 
@@ -217,58 +150,142 @@ void PianoTrackMap::onProjectBeatRangeChanged(float firstBeat, float lastBeat)
 }
 
 
+//===----------------------------------------------------------------------===//
+// AsyncUpdater
+//===----------------------------------------------------------------------===//
+
+void PianoTrackMap::handleAsyncUpdate()
+{
+    if (!this->hasDirtyBeats)
+    {
+        return;
+    }
+
+    const Range<int> columns =
+        this->getColumnsForBeatRange(this->dirtyBeats.getStart(), this->dirtyBeats.getEnd());
+
+    this->hasDirtyBeats = false;
+    this->rasterize(columns);
+    this->repaint(columns.getStart(), 0, columns.getLength(), this->getHeight());
+}
+
+
 //===----------------------------------------------------------------------===//
 // Private
 //===----------------------------------------------------------------------===//
 
 void PianoTrackMap::reloadTrackMap()
 {
-    for (int i = 0; i < this->eventComponents.size(); ++i)
+    this->cancelPendingUpdate();
+    this->hasDirtyBeats = false;
+
+    if (this->getWidth() <= 0 || this->getHeight() <= 0)
     {
-        this->removeChildComponent(this->eventComponents.getUnchecked(i));
+        this->cachedMap = Image();
+        return;
     }
 
-    this->eventComponents.clear();
-    this->componentsHashTable.clear();
+    if (this->cachedMap.getWidth() != this->getWidth() ||
+        this->cachedMap.getHeight() != this->getHeight())
+    {
+        this->cachedMap = Image(Image::ARGB, this->getWidth(), this->getHeight(), true);
+    }
 
-    const Array<MidiLayer *> &layers = this->project.getLayersList();
+    this->rasterize(Range<int>(0, this->getWidth()));
+    this->repaint();
+}
+
+void PianoTrackMap::invalidateBeatRange(float startBeat, float endBeat)
+{
+    const Range<float> range(startBeat, jmax(startBeat, endBeat));
+
+    this->dirtyBeats = this->hasDirtyBeats ? this->dirtyBeats.getUnionWith(range) : range;
+    this->hasDirtyBeats = true;
+
+    this->triggerAsyncUpdate();
+}
+
+void PianoTrackMap::rasterize(const Range<int> &columns)
+{
+    const Range<int> clippedColumns = columns.getIntersectionWith(Range<int>(0, this->cachedMap.getWidth()));
+
+    if (clippedColumns.isEmpty())
+    {
+        return;
+    }
+
+    const Rectangle<int> area(clippedColumns.getStart(), 0,
+                              clippedColumns.getLength(), this->cachedMap.getHeight());
 
-    this->setVisible(false);
+    this->cachedMap.clear(area);
+
+    const float rollLengthInBeats = (this->rollLastBeat - this->rollFirstBeat);
+
+    if (rollLengthInBeats <= 0.f)
+    {
+        return;
+    }
+
+    Graphics g(this->cachedMap);
+    g.reduceClipRegion(area);
+
+    const float pixelsPerBeat = float(this->getWidth()) / rollLengthInBeats;
+    const float keyHeight = float(this->getHeight()) / 128.f;
+    const float left = float(area.getX());
+    const float right = float(area.getRight());
+
+    // the notes are at least one pixel wide, so the lookup range
+    // is widened by a pixel to catch the very short ones on its left edge
+    const float startBeat = this->rollFirstBeat + (left - 1.f) / pixelsPerBeat;
+    const float endBeat = this->rollFirstBeat + right / pixelsPerBeat;
+
+    const Array<MidiLayer *> &layers = this->project.getLayersList();
+    Array<MidiEvent *> visibleNotes;
 
     for (auto layer : layers)
     {
-        for (int j = 0; j < layer->size(); ++j)
-        {
-            MidiEvent *event = layer->getUnchecked(j);
+        if (!dynamic_cast<const PianoLayer *>(layer)) { continue; }
 
-            if (Note *note = dynamic_cast<Note *>(event))
-            {
-                auto noteComponent = new TrackMapNoteComponent(*this, *note);
+        const Colour layerColour(layer->getColour().interpolatedWith(Colours::white, .35f));
+
+        visibleNotes.clearQuick();
+        layer->findEventsOverlappingRange(startBeat, endBeat, visibleNotes);
 
-                this->eventComponents.add(noteComponent);
-                this->componentsHashTable.set(*note, noteComponent);
+        for (auto event : visibleNotes)
+        {
+            const Note *note = static_cast<const Note *>(event);
 
-                //const bool &belongsToActiveLayer = noteComponent->belongsToLayer(this->activeLayer);
-                //noteComponent->setActive(belongsToActiveLayer);
-                this->addAndMakeVisible(noteComponent);
+            const float x = this->getXForBeat(note->getBeat());
+            const float w = jmax(1.f, note->getLength() * pixelsPerBeat);
+
+            if (x >= right || (x + w) <= left)
+            {
+                continue;
             }
+
+            const int y = this->getHeight() - int(note->getKey() * keyHeight);
+            g.setColour(layerColour.withAlpha(note->getVelocity() * .3f + .4f));
+            g.drawHorizontalLine(y, x, x + w);
         }
     }
+}
 
-    this->resized();
-    this->setVisible(true);
+Range<int> PianoTrackMap::getColumnsForBeatRange(float startBeat, float endBeat) const
+{
+    // one extra pixel on each side covers the rounding and the minimal note width
+    const int x1 = int(floorf(this->getXForBeat(startBeat))) - 1;
+    const int x2 = int(ceilf(this->getXForBeat(endBeat))) + 2;
+    return Range<int>(x1, x2);
 }
 
-void PianoTrackMap::applyNoteBounds(TrackMapNoteComponent *nc)
+float PianoTrackMap::getXForBeat(float beat) const
 {
     const float rollLengthInBeats = (this->rollLastBeat - this->rollFirstBeat);
-    const float projectLengthInBeats = (this->projectLastBeat - this->projectFirstBeat);
 
-    const float beat = (nc->getBeat() - this->rollFirstBeat);
-    const float mapWidth = float(this->getWidth()) * (projectLengthInBeats / rollLengthInBeats);
+    if (rollLengthInBeats <= 0.f)
+    {
+        return 0.f;
+    }
 
-    const float x = (mapWidth * (beat / projectLengthInBeats));
-    const float w = (mapWidth * (nc->getLength() / projectLengthInBeats));
-    const int y = this->getHeight() - (nc->getKey() * this->componentHeight);
-    nc->setRealBounds(x, y, jmax(1.f, w), 1.f);
+    return float(this->getWidth()) * ((beat - this->rollFirstBeat) / rollLengthInBeats);
 }
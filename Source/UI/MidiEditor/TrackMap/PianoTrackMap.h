@@ -22,11 +22,13 @@
 
 class MidiRoll;
 class ProjectTreeItem;
-class TrackMapNoteComponent;
 
+// The map is rendered into a cached image in a single pass over the layers,
+// and then only the beat ranges touched by the edits are re-rasterized.
 class PianoTrackMap :
     public Component,
-    public ProjectListener
+    public ProjectListener,
+    private AsyncUpdater
 {
 public:
 
@@ -37,6 +39,7 @@ public:
     // Component
     //===------------------------------------------------------------------===//
 
+    void paint(Graphics &g) override;
     void resized() override;
 
     //===------------------------------------------------------------------===//
@@ -53,8 +56,20 @@ public:
 
 private:
 
-    void applyNoteBounds(TrackMapNoteComponent *nc);
+    //===------------------------------------------------------------------===//
+    // AsyncUpdater
+    //===------------------------------------------------------------------===//
+
+    void handleAsyncUpdate() override;
+
+private:
+
     void reloadTrackMap();
+    void invalidateBeatRange(float startBeat, float endBeat);
+    void rasterize(const Range<int> &columns);
+
+    Range<int> getColumnsForBeatRange(float startBeat, float endBeat) const;
+    float getXForBeat(float beat) const;
 
     float projectFirstBeat;
     float projectLastBeat;
@@ -62,12 +77,13 @@ private:
     float rollFirstBeat;
     float rollLastBeat;
     
-    float componentHeight;
-    
     MidiRoll &roll;
     ProjectTreeItem &project;
     
-    OwnedArray<TrackMapNoteComponent> eventComponents;
-    HashMap<Note, TrackMapNoteComponent *, NoteHashFunction> componentsHashTable;
+    Image cachedMap;
+    
+    // Beats to be re-rasterized on the next async update
+    Range<float> dirtyBeats;
+    bool hasDirtyBeats;
     
 };
@@ -61,7 +61,7 @@ public:
         const int diffResult = (diff > 0.f) - (diff < 0.f);
         if (diffResult != 0) { return diffResult; }
 
-        return first->event.getID().compare(second->event.getID());
+        return MidiEvent::compareIds(first->event.getID(), second->event.getID());
     }
 
     //[/UserMethods]
@@ -93,6 +93,7 @@ StageComponent::StageComponent(VersionControl &versionControl)
     setSize (600, 400);
 
     //[Constructor]
+    this->isShowingProgress = false;
     this->updateList();
     this->updateToggleButton();
 
@@ -240,11 +241,18 @@ void StageComponent::changeListenerCallback(ChangeBroadcaster *source)
     {
         if (head->isRebuildingDiff())
         {
-            this->startProgressAnimation();
-            this->clearList();
+            if (! this->isShowingProgress)
+            {
+                this->isShowingProgress = true;
+                this->startProgressAnimation();
+            }
+            
+            // the head publishes the diff item by item, so the list grows as it goes
+            this->updateList();
         }
         else
         {
+            this->isShowingProgress = false;
             this->stopProgressAnimation();
             this->updateList();
             this->updateToggleButton();
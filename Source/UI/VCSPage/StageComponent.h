@@ -84,6 +84,7 @@ private:
     String commitMessage;
 
     ComponentFader fader;
+    bool isShowingProgress;
     void startProgressAnimation();
     void stopProgressAnimation();
 
@@ -0,0 +1,303 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The timing jitter of the note-ons, as the instrument's graph receives them,
+// played by the sleeping player thread and by the scheduled one, on the idle
+// machine and under the full CPU load; the jitter is the deviation of each
+// interval between the note-ons from the mean interval, which is constant here.
+
+#include "TestsAudio.h"
+#include "Transport.h"
+
+#define SAMPLE_RATE 48000.0
+#define BLOCK_SIZE 512
+#define NUM_NOTES 64
+#define NOTES_INTERVAL_BEATS 0.25f
+#define MAX_ONSETS 1024
+#define PLAYBACK_TIMEOUT_MS 30000
+#define MAX_SCHEDULED_JITTER_SAMPLES 1
+
+// Records the frames at which the note-ons are received
+class OnsetsProbe : public AudioProcessor
+{
+public:
+
+    OnsetsProbe() :
+        framesProcessed(0)
+    {
+        this->onsets.insertMultiple(0, 0, MAX_ONSETS);
+    }
+
+    Array<int64> getOnsets() const
+    {
+        Array<int64> result;
+        result.addArray(this->onsets, 0, this->numOnsets.get());
+        return result;
+    }
+
+    const String getName() const override
+    { return "OnsetsProbe"; }
+
+    void prepareToPlay(double, int) override {}
+
+    void releaseResources() override {}
+
+    void processBlock(AudioSampleBuffer &buffer, MidiBuffer &midiMessages) override
+    {
+        MidiBuffer::Iterator it(midiMessages);
+        MidiMessage message;
+        int samplePosition = 0;
+
+        while (it.getNextEvent(message, samplePosition))
+        {
+            const int index = this->numOnsets.get();
+
+            if (message.isNoteOn() && index < MAX_ONSETS)
+            {
+                this->onsets.set(index, this->framesProcessed + samplePosition);
+                this->numOnsets = index + 1;
+            }
+        }
+
+        this->framesProcessed += buffer.getNumSamples();
+    }
+
+    double getTailLengthSeconds() const override
+    { return 0.0; }
+
+    bool acceptsMidi() const override
+    { return true; }
+
+    bool producesMidi() const override
+    { return false; }
+
+    AudioProcessorEditor *createEditor() override
+    { return nullptr; }
+
+    bool hasEditor() const override
+    { return false; }
+
+    int getNumPrograms() override
+    { return 0; }
+
+    int getCurrentProgram() override
+    { return 0; }
+
+    void setCurrentProgram(int) override {}
+
+    const String getProgramName(int) override
+    { return String::empty; }
+
+    void changeProgramName(int, const String &) override {}
+
+    void getStateInformation(juce::MemoryBlock &) override {}
+
+    void setStateInformation(const void *, int) override {}
+
+private:
+
+    // written by the audio thread only, read when the device is stopped
+    Array<int64> onsets;
+    Atomic<int> numOnsets;
+    int64 framesProcessed;
+
+};
+
+class CpuLoadThread : public Thread
+{
+public:
+
+    CpuLoadThread() : Thread("CpuLoadThread") {}
+
+    void run() override
+    {
+        Random random;
+        volatile double sink = 0.0;
+
+        while (! this->threadShouldExit())
+        {
+            HeapBlock<double> block(4096);
+
+            for (int i = 0; i < 4096; ++i)
+            {
+                block[i] = sqrt(random.nextDouble()) * sink;
+            }
+
+            sink = block[random.nextInt(4096)] + 1.0;
+        }
+    }
+};
+
+struct JitterStats
+{
+    Array<double> jittersMs;
+    int numOnsets;
+    double maxJitterMs;
+};
+
+static JitterStats measureJitter(bool scheduledPlayback, bool underLoad)
+{
+    HelioTests::TestFormatManager formatManager;
+    AudioMonitor deviceClock;
+    HelioTests::TestOrchestra orchestra;
+    Transport transport(orchestra, scheduledPlayback);
+    HelioTests::TestLayersOwner layers;
+
+    Instrument *instrument = orchestra.addInstrument(formatManager, deviceClock, "Test");
+    AudioProcessorGraph::Node *probeNode = instrument->getProcessorGraph()->addNode(new OnsetsProbe());
+    instrument->addConnection(instrument->getMidiInId(), Instrument::midiChannelNumber,
+                              probeNode->nodeId, Instrument::midiChannelNumber);
+
+    layers.addListener(&transport);
+    PianoLayer *layer = layers.addPianoLayer();
+
+    Array<Note> notes;
+
+    for (int i = 0; i < NUM_NOTES; ++i)
+    {
+        notes.add(Note(layer, 60 + (i % 2) * 2, i * NOTES_INTERVAL_BEATS, NOTES_INTERVAL_BEATS, 0.75f));
+    }
+
+    layer->silentImportGroup(notes);
+    layer->notifyLayerChanged();
+    layers.onBeatRangeChanged();
+
+    // the player falls back to the sleeping thread, if the device clock isn't running,
+    // so the monitor is only added to the device for the scheduled playback
+    HelioTests::SimulatedAudioDevice device(SAMPLE_RATE, BLOCK_SIZE);
+
+    if (scheduledPlayback)
+    {
+        device.addCallback(&deviceClock);
+    }
+
+    device.addCallback(&instrument->getProcessorPlayer());
+
+    OwnedArray<CpuLoadThread> loadThreads;
+
+    if (underLoad)
+    {
+        for (int i = 0; i < SystemStats::getNumCpus(); ++i)
+        {
+            loadThreads.add(new CpuLoadThread())->startThread(0);
+        }
+    }
+
+    device.start(nullptr);
+    Thread::sleep(100);
+
+    transport.startPlayback();
+    const double startTime = Time::getMillisecondCounterHiRes();
+
+    while (transport.isPlaying() &&
+           (Time::getMillisecondCounterHiRes() - startTime) < PLAYBACK_TIMEOUT_MS)
+    {
+        Thread::sleep(50);
+    }
+
+    // the last note's messages are let through the lookahead
+    Thread::sleep(200);
+    transport.stopPlayback();
+    device.stop();
+
+    for (auto thread : loadThreads)
+    {
+        thread->stopThread(1000);
+    }
+
+    layers.removeListener(&transport);
+
+    const Array<int64> onsets(static_cast<OnsetsProbe *>(probeNode->getProcessor())->getOnsets());
+
+    JitterStats stats;
+    stats.numOnsets = onsets.size();
+    stats.maxJitterMs = 0.0;
+
+    if (onsets.size() > 2)
+    {
+        const double meanInterval = double(onsets.getLast() - onsets.getFirst()) / (onsets.size() - 1);
+
+        for (int i = 1; i < onsets.size(); ++i)
+        {
+            const double deviation = fabs(double(onsets[i] - onsets[i - 1]) - meanInterval);
+            const double deviationMs = deviation * 1000.0 / SAMPLE_RATE;
+            stats.jittersMs.add(deviationMs);
+            stats.maxJitterMs = jmax(stats.maxJitterMs, deviationMs);
+        }
+    }
+
+    return stats;
+}
+
+static void reportHistogram(const String &title, const JitterStats &stats)
+{
+    static const double bins[] = { 0.1, 0.5, 1.0, 2.0, 5.0, 10.0 };
+    static const int numBins = numElementsInArray(bins);
+
+    int counts[numBins + 1] = { 0 };
+
+    for (auto jitterMs : stats.jittersMs)
+    {
+        int bin = 0;
+
+        while (bin < numBins && jitterMs >= bins[bin])
+        {
+            ++bin;
+        }
+
+        ++counts[bin];
+    }
+
+    String line(title + "\t" + String(stats.numOnsets) + "\t" + String(stats.maxJitterMs, 3));
+
+    for (int i = 0; i <= numBins; ++i)
+    {
+        line << "\t" << counts[i];
+    }
+
+    HelioTests::report(line);
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+
+    HelioTests::report("Engine\tNote-ons\tMax, ms\t<0.1\t<0.5\t<1\t<2\t<5\t<10\t>=10");
+
+    const JitterStats threadIdle = measureJitter(false, false);
+    const JitterStats scheduledIdle = measureJitter(true, false);
+    const JitterStats threadLoaded = measureJitter(false, true);
+    const JitterStats scheduledLoaded = measureJitter(true, true);
+
+    reportHistogram("Thread, idle", threadIdle);
+    reportHistogram("Scheduled, idle", scheduledIdle);
+    reportHistogram("Thread, loaded", threadLoaded);
+    reportHistogram("Scheduled, loaded", scheduledLoaded);
+
+    HELIO_CHECK(threadIdle.numOnsets == NUM_NOTES);
+    HELIO_CHECK(scheduledIdle.numOnsets == NUM_NOTES);
+    HELIO_CHECK(threadLoaded.numOnsets == NUM_NOTES);
+    HELIO_CHECK(scheduledLoaded.numOnsets == NUM_NOTES);
+
+    // the scheduled events land on the exact frames, so their intervals
+    // differ only by the rounding of the frames, whatever the load is
+    const double maxScheduledJitterMs = MAX_SCHEDULED_JITTER_SAMPLES * 1000.0 / SAMPLE_RATE;
+    HELIO_CHECK(scheduledIdle.maxJitterMs <= maxScheduledJitterMs);
+    HELIO_CHECK(scheduledLoaded.maxJitterMs <= maxScheduledJitterMs);
+
+    return HelioTests::finish("PlaybackJitterBenchmark");
+}
@@ -0,0 +1,196 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Renders the synthetic projects of N layers by M notes, played by several
+// instances of the built-in piano, into the wav files of each bit depth,
+// and reports the realtime factor along with the time spent by each instrument.
+// The renders by one thread and by several threads are compared sample by sample.
+
+#include "TestsAudio.h"
+#include "Transport.h"
+#include "RendererThread.h"
+
+#define SAMPLE_RATE 44100.0
+#define BLOCK_SIZE 512
+#define NUM_INSTRUMENTS 4
+#define NOTES_BEATS_RANGE 64.f
+#define RENDER_TIMEOUT_MS 600000
+
+struct RenderSetup
+{
+    int numLayers;
+    int numNotesPerLayer;
+};
+
+// Renders the project of random notes into the file, by the given number
+// of threads, or by one per CPU, if it is 0
+static RendererThread::Stats renderProject(const RenderSetup &setup, int bitDepth,
+                                           int numThreads, Random &random, const File &file)
+{
+    HelioTests::TestFormatManager formatManager;
+    AudioMonitor deviceClock;
+    HelioTests::TestOrchestra orchestra;
+    Transport transport(orchestra);
+    HelioTests::TestLayersOwner layers;
+
+    Array<Instrument *> instruments;
+
+    for (int i = 0; i < NUM_INSTRUMENTS; ++i)
+    {
+        Instrument *instrument = orchestra.addInstrument(formatManager, deviceClock, "Piano " + String(i + 1));
+        HELIO_CHECK(HelioTests::addBuiltInPiano(*instrument, formatManager, SAMPLE_RATE, BLOCK_SIZE));
+        instruments.add(instrument);
+    }
+
+    layers.addListener(&transport);
+
+    for (int i = 0; i < setup.numLayers; ++i)
+    {
+        PianoLayer *layer = layers.addPianoLayer();
+        layer->setInstrumentId(instruments[i % NUM_INSTRUMENTS]->getIdAndHash());
+        HelioTests::TestLayersOwner::fillWithRandomNotes(*layer, setup.numNotesPerLayer,
+                                                         NOTES_BEATS_RANGE, random);
+    }
+
+    layers.onBeatRangeChanged();
+
+    RendererThread renderer(transport);
+    renderer.startRecording(file, bitDepth, BLOCK_SIZE, numThreads);
+
+    const double startTime = Time::getMillisecondCounterHiRes();
+
+    while (renderer.isRecording() &&
+           (Time::getMillisecondCounterHiRes() - startTime) < RENDER_TIMEOUT_MS)
+    {
+        Thread::sleep(10);
+    }
+
+    HELIO_CHECK(! renderer.isRecording());
+    renderer.stop();
+
+    const RendererThread::Stats stats(renderer.getLastStats());
+    HELIO_CHECK(stats.renderedSeconds > 0.0);
+    HELIO_CHECK(stats.instrumentNames.size() == NUM_INSTRUMENTS);
+    HELIO_CHECK(file.getSize() > 0);
+
+    layers.removeListener(&transport);
+    return stats;
+}
+
+static void benchmarkRender(const RenderSetup &setup, int bitDepth, Random &random)
+{
+    const File file(File::createTempFile(".wav"));
+    const RendererThread::Stats stats(renderProject(setup, bitDepth, 0, random, file));
+    file.deleteFile();
+
+    String line(String(setup.numLayers) + "\t" +
+                String(setup.numLayers * setup.numNotesPerLayer) + "\t" +
+                String(bitDepth) + "\t" +
+                String(stats.renderedSeconds, 1) + "\t" +
+                String(stats.renderSeconds, 2) + "\t" +
+                String(stats.renderedSeconds / jmax(0.001, stats.renderSeconds), 1));
+
+    for (int i = 0; i < stats.instrumentNames.size(); ++i)
+    {
+        line << "\t" << String(stats.instrumentProcessingMs[i], 1);
+    }
+
+    HelioTests::report(line);
+}
+
+static bool readSamples(const File &file, AudioSampleBuffer &result)
+{
+    WavAudioFormat wavFormat;
+    ScopedPointer<AudioFormatReader> reader(wavFormat.createReaderFor(file.createInputStream(), true));
+
+    if (reader == nullptr)
+    {
+        return false;
+    }
+
+    const int numSamples = int(reader->lengthInSamples);
+    result.setSize(int(reader->numChannels), numSamples);
+    return reader->read(&result, 0, numSamples, 0, true, true);
+}
+
+// The parallel render should give exactly the same samples as the serial one:
+// the 32-bit files keep the mixing buffer's floats as they are
+static void checkParallelRender(const RenderSetup &setup, int64 seed)
+{
+    const File serialFile(File::createTempFile(".wav"));
+    const File parallelFile(File::createTempFile(".wav"));
+
+    Random serialRandom(seed);
+    renderProject(setup, 32, 1, serialRandom, serialFile);
+
+    Random parallelRandom(seed);
+    renderProject(setup, 32, NUM_INSTRUMENTS, parallelRandom, parallelFile);
+
+    AudioSampleBuffer serialSamples;
+    AudioSampleBuffer parallelSamples;
+    HELIO_CHECK(readSamples(serialFile, serialSamples));
+    HELIO_CHECK(readSamples(parallelFile, parallelSamples));
+
+    bool samplesAreEqual = (serialSamples.getNumSamples() > 0 &&
+                            serialSamples.getNumChannels() == parallelSamples.getNumChannels() &&
+                            serialSamples.getNumSamples() == parallelSamples.getNumSamples());
+
+    for (int i = 0; samplesAreEqual && i < serialSamples.getNumChannels(); ++i)
+    {
+        samplesAreEqual = (memcmp(serialSamples.getReadPointer(i), parallelSamples.getReadPointer(i),
+                                  sizeof(float) * size_t(serialSamples.getNumSamples())) == 0);
+    }
+
+    HELIO_CHECK(samplesAreEqual);
+
+    HelioTests::report("Layers: " + String(setup.numLayers) + ", threads: 1 and " + String(NUM_INSTRUMENTS) +
+                       ", bit-identical: " + (samplesAreEqual ? "yes" : "no"));
+
+    serialFile.deleteFile();
+    parallelFile.deleteFile();
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    const RenderSetup setups[] = { { 4, 500 }, { 16, 500 }, { 64, 500 }, { 16, 4000 } };
+    const int bitDepths[] = { 16, 24, 32 };
+
+    String header("Layers\tNotes\tBits\tRendered, s\tRender, s\tRealtime factor");
+
+    for (int i = 0; i < NUM_INSTRUMENTS; ++i)
+    {
+        header << "\tPiano " << (i + 1) << ", ms";
+    }
+
+    HelioTests::report(header);
+
+    for (const auto &setup : setups)
+    {
+        for (const auto bitDepth : bitDepths)
+        {
+            benchmarkRender(setup, bitDepth, random);
+        }
+    }
+
+    checkParallelRender(setups[0], 54321);
+    checkParallelRender(setups[1], 54321);
+
+    return HelioTests::finish("RenderBenchmark");
+}
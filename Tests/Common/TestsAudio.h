@@ -0,0 +1,289 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// The instruments and the audio device stand-ins for the transport tests.
+
+#include "TestsCommon.h"
+#include "OrchestraPit.h"
+#include "Instrument.h"
+#include "AudioMonitor.h"
+#include "InternalPluginFormat.h"
+#include "BuiltInSynthFormat.h"
+
+namespace HelioTests
+{
+    // The same formats as the audio core has, except the external plugins
+    class TestFormatManager : public AudioPluginFormatManager
+    {
+    public:
+
+        TestFormatManager()
+        {
+            this->addFormat(new InternalPluginFormat());
+            this->addFormat(new BuiltInSynthFormat());
+        }
+    };
+
+    // Connects the built-in piano the way Instrument::initializeFrom does,
+    // but synchronously, since there's no message loop running in most of the tests
+    inline bool addBuiltInPiano(Instrument &instrument, AudioPluginFormatManager &formatManager,
+                                double sampleRate, int blockSize)
+    {
+        AudioProcessorGraph *graph = instrument.getProcessorGraph();
+        graph->setPlayConfigDetails(0, 2, sampleRate, blockSize);
+        graph->prepareToPlay(sampleRate, blockSize);
+
+        OwnedArray<PluginDescription> descriptions;
+        BuiltInSynthFormat format;
+        format.findAllTypesForFile(descriptions, BuiltInSynth::pianoId);
+
+        if (descriptions.isEmpty())
+        {
+            return false;
+        }
+
+        String error;
+        AudioPluginInstance *piano = formatManager.createPluginInstance(*descriptions.getFirst(),
+                                                                       sampleRate, blockSize, error);
+
+        if (piano == nullptr)
+        {
+            return false;
+        }
+
+        AudioProcessorGraph::Node *node = graph->addNode(piano);
+        instrument.addConnection(instrument.getMidiInId(), Instrument::midiChannelNumber,
+                                 node->nodeId, Instrument::midiChannelNumber);
+
+        for (int i = 0; i < piano->getTotalNumOutputChannels(); ++i)
+        {
+            instrument.addConnection(node->nodeId, i, instrument.getAudioOutId(), i);
+        }
+
+        return true;
+    }
+
+    class TestOrchestra : public OrchestraPit
+    {
+    public:
+
+        Instrument *addInstrument(AudioPluginFormatManager &formatManager,
+                                  const AudioMonitor &deviceClock,
+                                  const String &name)
+        {
+            Instrument *instrument = this->instruments.add(new Instrument(formatManager, deviceClock, name));
+            this->broadcastInstrumentAdded(instrument);
+            return instrument;
+        }
+
+        Array<Instrument *> getInstruments() const override
+        {
+            Array<Instrument *> result;
+            result.addArray(this->instruments);
+            return result;
+        }
+
+        Instrument *findInstrumentById(const String &id) const override
+        {
+            for (auto instrument : this->instruments)
+            {
+                if (id == instrument->getIdAndHash())
+                {
+                    return instrument;
+                }
+            }
+
+            return nullptr;
+        }
+
+    private:
+
+        OwnedArray<Instrument> instruments;
+    };
+
+    // Calls back the way a sound card does: a block every blockSize / sampleRate seconds,
+    // on its own high priority thread; the callbacks are called in the order of adding,
+    // so the monitor, which is the device clock, should go first, as in the audio core
+    class SimulatedAudioDevice : public AudioIODevice, private Thread
+    {
+    public:
+
+        SimulatedAudioDevice(double deviceSampleRate, int deviceBlockSize) :
+            AudioIODevice("Simulated", "Simulated"),
+            Thread("SimulatedAudioDevice"),
+            sampleRate(deviceSampleRate),
+            blockSize(deviceBlockSize),
+            buffer(2, deviceBlockSize),
+            running(false) {}
+
+        ~SimulatedAudioDevice() override
+        {
+            this->stop();
+        }
+
+        void addCallback(AudioIODeviceCallback *callback)
+        {
+            jassert(! this->running);
+            this->callbacks.add(callback);
+        }
+
+        //===------------------------------------------------------------------===//
+        // AudioIODevice
+        //===------------------------------------------------------------------===//
+
+        StringArray getOutputChannelNames() override
+        { return StringArray("Left", "Right"); }
+
+        StringArray getInputChannelNames() override
+        { return StringArray(); }
+
+        Array<double> getAvailableSampleRates() override
+        { return Array<double>(&this->sampleRate, 1); }
+
+        Array<int> getAvailableBufferSizes() override
+        { return Array<int>(&this->blockSize, 1); }
+
+        int getDefaultBufferSize() override
+        { return this->blockSize; }
+
+        String open(const BigInteger &, const BigInteger &, double, int) override
+        { return String::empty; }
+
+        void close() override
+        { this->stop(); }
+
+        bool isOpen() override
+        { return true; }
+
+        void start(AudioIODeviceCallback *callback) override
+        {
+            if (this->running)
+            {
+                return;
+            }
+
+            if (callback != nullptr)
+            {
+                this->callbacks.addIfNotAlreadyThere(callback);
+            }
+
+            for (auto deviceCallback : this->callbacks)
+            {
+                deviceCallback->audioDeviceAboutToStart(this);
+            }
+
+            this->running = true;
+            this->startThread(9);
+        }
+
+        void stop() override
+        {
+            if (! this->running)
+            {
+                return;
+            }
+
+            this->stopThread(1000);
+            this->running = false;
+
+            for (auto deviceCallback : this->callbacks)
+            {
+                deviceCallback->audioDeviceStopped();
+            }
+        }
+
+        bool isPlaying() override
+        { return this->running; }
+
+        String getLastError() override
+        { return String::empty; }
+
+        int getCurrentBufferSizeSamples() override
+        { return this->blockSize; }
+
+        double getCurrentSampleRate() override
+        { return this->sampleRate; }
+
+        int getCurrentBitDepth() override
+        { return 32; }
+
+        BigInteger getActiveOutputChannels() const override
+        {
+            BigInteger channels;
+            channels.setRange(0, 2, true);
+            return channels;
+        }
+
+        BigInteger getActiveInputChannels() const override
+        { return BigInteger(); }
+
+        int getOutputLatencyInSamples() override
+        { return 0; }
+
+        int getInputLatencyInSamples() override
+        { return 0; }
+
+    private:
+
+        void run() override
+        {
+            const double blockDurationMs = 1000.0 * this->blockSize / this->sampleRate;
+            double nextBlockTime = Time::getMillisecondCounterHiRes();
+
+            while (! this->threadShouldExit())
+            {
+                // sleeping is too coarse, so the last couple of milliseconds are spun
+                double timeLeft = nextBlockTime - Time::getMillisecondCounterHiRes();
+
+                while (timeLeft > 0.0)
+                {
+                    if (timeLeft > 2.0)
+                    {
+                        Thread::sleep(1);
+                    }
+                    else
+                    {
+                        Thread::yield();
+                    }
+
+                    timeLeft = nextBlockTime - Time::getMillisecondCounterHiRes();
+                }
+
+                nextBlockTime += blockDurationMs;
+
+                float *outputs[2] = { this->buffer.getWritePointer(0), this->buffer.getWritePointer(1) };
+
+                for (auto callback : this->callbacks)
+                {
+                    this->buffer.clear();
+                    callback->audioDeviceIOCallback(nullptr, 0, outputs, 2, this->blockSize);
+                }
+            }
+        }
+
+        double sampleRate;
+        int blockSize;
+        AudioSampleBuffer buffer;
+        bool running;
+
+        Array<AudioIODeviceCallback *> callbacks;
+
+        JUCE_DECLARE_NON_COPYABLE(SimulatedAudioDevice)
+    };
+}
@@ -0,0 +1,223 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// The helpers shared by the stress tests and the benchmarks.
+// Each test is a console program, which runs without the App instance,
+// so it only uses the core classes which don't need the workspace.
+
+#include "Common.h"
+#include "MidiLayerOwner.h"
+#include "ProjectListener.h"
+#include "PianoLayer.h"
+#include "Note.h"
+
+#include <stdio.h>
+
+//===----------------------------------------------------------------------===//
+// Checks
+//===----------------------------------------------------------------------===//
+
+namespace HelioTests
+{
+    inline int &failuresCount()
+    {
+        static int numFailures = 0;
+        return numFailures;
+    }
+
+    inline void check(bool condition, const char *expression, const char *file, int line)
+    {
+        if (! condition)
+        {
+            ++failuresCount();
+            printf("FAILED: %s (%s:%d)\n", expression, file, line);
+        }
+    }
+
+    // The return code of main()
+    inline int finish(const String &testName)
+    {
+        const int numFailures = failuresCount();
+        printf("%s: %s\n", testName.toRawUTF8(),
+               (numFailures == 0) ? "passed" : (String(numFailures) + " checks failed").toRawUTF8());
+        fflush(stdout);
+        return (numFailures == 0) ? 0 : 1;
+    }
+}
+
+#define HELIO_CHECK(expression) \
+    HelioTests::check((expression), #expression, __FILE__, __LINE__)
+
+
+//===----------------------------------------------------------------------===//
+// Measurements
+//===----------------------------------------------------------------------===//
+
+namespace HelioTests
+{
+    // Calls the function the given number of times and returns the best run, in ms
+    template <typename Function>
+    double measureBestOf(int numRuns, Function function)
+    {
+        double bestTimeMs = DBL_MAX;
+
+        for (int i = 0; i < numRuns; ++i)
+        {
+            const double startTimeMs = Time::getMillisecondCounterHiRes();
+            function();
+            bestTimeMs = jmin(bestTimeMs, Time::getMillisecondCounterHiRes() - startTimeMs);
+        }
+
+        return bestTimeMs;
+    }
+
+    inline void report(const String &line)
+    {
+        printf("%s\n", line.toRawUTF8());
+        fflush(stdout);
+    }
+}
+
+
+//===----------------------------------------------------------------------===//
+// Layers without a project
+//===----------------------------------------------------------------------===//
+
+namespace HelioTests
+{
+    // Owns the layers the way the layer tree items do, and forwards
+    // their changes to the listeners, like the project does;
+    // the layers are only edited with undoable = false, as there is no undo stack.
+    // Unlike the project, it only reports the beat range when it has really changed.
+    class TestLayersOwner : public MidiLayerOwner
+    {
+    public:
+
+        TestLayersOwner() :
+            lastFirstBeat(0.f),
+            lastLastBeat(0.f) {}
+
+        ~TestLayersOwner() override
+        {
+            for (auto layer : this->layers)
+            {
+                this->listeners.call(&ProjectListener::onLayerRemoved, layer);
+            }
+
+            this->layers.clear();
+        }
+
+        PianoLayer *addPianoLayer()
+        {
+            PianoLayer *layer = this->layers.add(new PianoLayer(*this));
+            this->listeners.call(&ProjectListener::onLayerAdded, layer);
+            return layer;
+        }
+
+        int getNumLayers() const noexcept
+        { return this->layers.size(); }
+
+        PianoLayer *getLayer(int index) const noexcept
+        { return this->layers[index]; }
+
+        void addListener(ProjectListener *listener)
+        { this->listeners.add(listener); }
+
+        void removeListener(ProjectListener *listener)
+        { this->listeners.remove(listener); }
+
+        // Fills the layer with the random notes, in bulk, like the midi import does
+        static void fillWithRandomNotes(PianoLayer &layer, int numNotes,
+                                        float beatsRange, Random &random)
+        {
+            Array<Note> notes;
+            notes.ensureStorageAllocated(numNotes);
+
+            for (int i = 0; i < numNotes; ++i)
+            {
+                const float beat = Note::roundBeat(random.nextFloat() * beatsRange);
+                const float length = Note::roundBeat(0.25f + random.nextFloat() * 4.f);
+                notes.add(Note(&layer, 24 + random.nextInt(72), beat, length, 0.25f + random.nextFloat() * 0.75f));
+            }
+
+            layer.silentImportGroup(notes);
+            layer.notifyLayerChanged();
+        }
+
+        //===------------------------------------------------------------------===//
+        // MidiLayerOwner
+        //===------------------------------------------------------------------===//
+
+        Transport *getTransport() const override
+        { return nullptr; }
+
+        String getXPath() const override
+        { return "Tests"; }
+
+        void setXPath(const String &path) override {}
+
+        void onEventChanged(const MidiEvent &oldEvent, const MidiEvent &newEvent) override
+        { this->listeners.call(&ProjectListener::onEventChanged, oldEvent, newEvent); }
+
+        void onEventAdded(const MidiEvent &event) override
+        { this->listeners.call(&ProjectListener::onEventAdded, event); }
+
+        void onEventRemoved(const MidiEvent &event) override
+        { this->listeners.call(&ProjectListener::onEventRemoved, event); }
+
+        void onEventRemovedPostAction(const MidiLayer *layer) override
+        { this->listeners.call(&ProjectListener::onEventRemovedPostAction, layer); }
+
+        void onLayerChanged(const MidiLayer *layer) override
+        { this->listeners.call(&ProjectListener::onLayerChanged, layer); }
+
+        void onBeatRangeChanged() override
+        {
+            float firstBeat = FLT_MAX;
+            float lastBeat = -FLT_MAX;
+
+            for (auto layer : this->layers)
+            {
+                if (layer->size() > 0)
+                {
+                    firstBeat = jmin(firstBeat, layer->getFirstBeat());
+                    lastBeat = jmax(lastBeat, layer->getLastBeat());
+                }
+            }
+
+            if (firstBeat <= lastBeat &&
+                (firstBeat != this->lastFirstBeat || lastBeat != this->lastLastBeat))
+            {
+                this->lastFirstBeat = firstBeat;
+                this->lastLastBeat = lastBeat;
+                this->listeners.call(&ProjectListener::onProjectBeatRangeChanged, firstBeat, lastBeat);
+            }
+        }
+
+    private:
+
+        float lastFirstBeat;
+        float lastLastBeat;
+
+        OwnedArray<PianoLayer> layers;
+        ListenerList<ProjectListener> listeners;
+
+        JUCE_DECLARE_NON_COPYABLE(TestLayersOwner)
+    };
+}
@@ -0,0 +1,211 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// The loopback stand-in for the history sync server.
+
+#include "TestsCommon.h"
+#include "SyncTransport.h"
+
+namespace HelioTests
+{
+    // Keeps the manifest and the objects in memory, and does what the server
+    // should do on the sync requests; every request goes through the same
+    // bundle format as over HTTP, and the bytes both ways are counted.
+    // The server of the wholeHistory protocol only stores the history blob,
+    // and answers the manifest request as the history fetch, as the older ones do
+    class LoopbackSyncServer : public VCS::SyncTransport
+    {
+    public:
+
+        explicit LoopbackSyncServer(Protocol serverProtocol = historyObjects) :
+            protocol(serverProtocol),
+            numRequests(0),
+            numBytesUploaded(0),
+            numBytesDownloaded(0) {}
+
+        int getNumRequests() const noexcept
+        { return this->numRequests; }
+
+        int64 getNumBytesUploaded() const noexcept
+        { return this->numBytesUploaded; }
+
+        int64 getNumBytesDownloaded() const noexcept
+        { return this->numBytesDownloaded; }
+
+        int getNumObjects() const noexcept
+        { return this->objects.size(); }
+
+        bool hasManifest() const noexcept
+        { return this->manifest.getSize() > 0; }
+
+        const MemoryBlock &getHistory() const noexcept
+        { return this->history; }
+
+        // As if the history was pushed by the released client
+        void storeHistory(const MemoryBlock &data)
+        { this->history = data; }
+
+        void resetCounters()
+        {
+            this->numRequests = 0;
+            this->numBytesUploaded = 0;
+            this->numBytesDownloaded = 0;
+        }
+
+        //===------------------------------------------------------------------===//
+        // SyncTransport
+        //===------------------------------------------------------------------===//
+
+        Status fetchManifest(MemoryBlock &result, Protocol &serverProtocol) override
+        {
+            serverProtocol = this->protocol;
+
+            if (this->protocol == wholeHistory)
+            {
+                return this->fetchHistory(result);
+            }
+
+            ++this->numRequests;
+
+            if (this->manifest.getSize() == 0)
+            {
+                return notFound;
+            }
+
+            result = this->manifest;
+            this->numBytesDownloaded += int64(result.getSize());
+            return ok;
+        }
+
+        Status findMissingObjects(const StringArray &names, StringArray &missingNames) override
+        {
+            ++this->numRequests;
+            this->numBytesUploaded += names.joinIntoString("\n").getNumBytesAsUTF8();
+
+            for (const auto &name : names)
+            {
+                if (! this->objects.contains(name))
+                {
+                    missingNames.add(name);
+                }
+            }
+
+            this->numBytesDownloaded += missingNames.joinIntoString("\n").getNumBytesAsUTF8();
+            return ok;
+        }
+
+        Status fetchObjects(const StringArray &names, VCS::SyncObjects &result) override
+        {
+            ++this->numRequests;
+            this->numBytesUploaded += names.joinIntoString("\n").getNumBytesAsUTF8();
+
+            VCS::SyncObjects found;
+
+            for (const auto &name : names)
+            {
+                if (! this->objects.contains(name))
+                {
+                    return notFound;
+                }
+
+                found.add(name, this->objects[name]);
+            }
+
+            const MemoryBlock bundle(found.toMemoryBlock());
+            this->numBytesDownloaded += int64(bundle.getSize());
+            return result.fromMemoryBlock(bundle) ? ok : failed;
+        }
+
+        Status pushObjects(const VCS::SyncObjects &pushedObjects,
+                           const MemoryBlock &pushedManifest,
+                           const String &baseManifestHash) override
+        {
+            ++this->numRequests;
+
+            const MemoryBlock bundle(pushedObjects.toMemoryBlock());
+            this->numBytesUploaded += int64(bundle.getSize() + pushedManifest.getSize());
+
+            const String currentManifestHash = (this->manifest.getSize() == 0) ?
+                String::empty : MD5(this->manifest).toHexString();
+
+            if (baseManifestHash != currentManifestHash)
+            {
+                return outdated;
+            }
+
+            VCS::SyncObjects received;
+
+            if (! received.fromMemoryBlock(bundle))
+            {
+                return failed;
+            }
+
+            for (int i = 0; i < received.size(); ++i)
+            {
+                this->objects.set(received.getName(i), received.getData(i));
+
+                if (this->objects.size() > this->objects.getNumSlots() * 2)
+                {
+                    this->objects.remapTable(this->objects.getNumSlots() * 4);
+                }
+            }
+
+            this->manifest = pushedManifest;
+            return ok;
+        }
+
+        Status fetchHistory(MemoryBlock &result) override
+        {
+            ++this->numRequests;
+
+            if (this->history.getSize() == 0)
+            {
+                return notFound;
+            }
+
+            result = this->history;
+            this->numBytesDownloaded += int64(result.getSize());
+            return ok;
+        }
+
+        Status pushHistory(const MemoryBlock &pushedHistory) override
+        {
+            ++this->numRequests;
+            this->numBytesUploaded += int64(pushedHistory.getSize());
+            this->history = pushedHistory;
+            return ok;
+        }
+
+    private:
+
+        Protocol protocol;
+
+        MemoryBlock history;
+
+        MemoryBlock manifest;
+
+        HashMap<String, MemoryBlock> objects;
+
+        int numRequests;
+        int64 numBytesUploaded;
+        int64 numBytesDownloaded;
+
+        JUCE_DECLARE_NON_COPYABLE(LoopbackSyncServer)
+    };
+}
@@ -0,0 +1,276 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The automation curves compared to the interpolated events the automation
+// layers used to export: the points the tempo map and the MIDI files get,
+// and the values the playback samples at the block rate, should be within
+// VALUE_TOLERANCE of what the former exponentalInterpolation gave: that is
+// less than a step of a controller value, and 50 microseconds per quarter note.
+//
+// The CC values are compared with the interpolated ones, not with the bytes
+// the former export wrote, as it repeated the node's value for every point.
+// Also reports the time to expand the curves the old way and the new ways.
+
+#include "TestsCommon.h"
+#include "AutomationLayer.h"
+#include "AutomationEvent.h"
+#include "AutomationCurve.h"
+#include "Transport.h"
+
+#define NUM_NODES 5000
+#define MAX_NODES_DISTANCE_BEATS 8.f
+#define SAMPLING_STEP_TICKS 32.0
+#define VALUE_TOLERANCE 0.0001f
+#define TEMPO_TOLERANCE_USEC (int(VALUE_TOLERANCE * Transport::millisecondsPerBeat * 1000) + 1)
+#define NUM_RUNS 5
+
+//===----------------------------------------------------------------------===//
+// The former interpolation
+//===----------------------------------------------------------------------===//
+
+#define LEGACY_MIN_INTERPOLATED_CONTROLLER_DELTA (0.01f)
+#define LEGACY_INTERPOLATED_EVENTS_STEP_MS (350)
+
+static float legacyInterpolation(float y0, float y1, float factor, float easing)
+{
+    const float delta = y1 - y0;
+    const float easeIn = delta * powf(2.f, 16.f * (factor - 1.f)) * easing;
+    const float easeOut = delta * (-powf(2.f, -16.f * factor) + 1.f) * (1.f - easing);
+    return y0 + (easeIn + easeOut);
+}
+
+struct LegacyPoint
+{
+    float timeStamp;
+    float value;
+};
+
+// The node events and the interpolated events, as AutomationEvent::exportMessages made them
+static void legacyExpand(const AutomationLayer &layer, Array<LegacyPoint> &result)
+{
+    for (int i = 0; i < layer.size(); ++i)
+    {
+        const AutomationEvent *event = static_cast<AutomationEvent *>(layer.getUnchecked(i));
+        const float startTime = event->getBeat() * Transport::millisecondsPerBeat;
+        result.add({ startTime, event->getControllerValue() });
+
+        if (i == (layer.size() - 1))
+        {
+            continue;
+        }
+
+        const AutomationEvent *nextEvent = static_cast<AutomationEvent *>(layer.getUnchecked(i + 1));
+        const float controllerDelta = fabs(event->getControllerValue() - nextEvent->getControllerValue());
+
+        if (controllerDelta > LEGACY_MIN_INTERPOLATED_CONTROLLER_DELTA)
+        {
+            const float nextTime = nextEvent->getBeat() * Transport::millisecondsPerBeat;
+            float interpolatedEventTimeStamp = startTime + LEGACY_INTERPOLATED_EVENTS_STEP_MS;
+
+            while (interpolatedEventTimeStamp < nextTime)
+            {
+                const float lerpFactor = (interpolatedEventTimeStamp - startTime) / (nextTime - startTime);
+                const float c = (event->getControllerValue() > nextEvent->getControllerValue()) ?
+                    event->getCurvature() : (1.f - event->getCurvature());
+
+                result.add({ interpolatedEventTimeStamp,
+                    legacyInterpolation(event->getControllerValue(), nextEvent->getControllerValue(), lerpFactor, c) });
+
+                interpolatedEventTimeStamp += LEGACY_INTERPOLATED_EVENTS_STEP_MS;
+            }
+        }
+    }
+}
+
+// The value the former formula gives at the timestamp; the timestamps
+// should only grow from call to call, as the segment is searched from the last one
+static float legacyValueAt(const AutomationLayer &layer, float timeStamp, int &segment)
+{
+    auto getNode = [&layer](int index)
+    {
+        return static_cast<AutomationEvent *>(layer.getUnchecked(index));
+    };
+
+    while (segment < (layer.size() - 1) &&
+           getNode(segment + 1)->getBeat() * Transport::millisecondsPerBeat <= timeStamp)
+    {
+        ++segment;
+    }
+
+    const AutomationEvent *event = getNode(segment);
+    const float startTime = event->getBeat() * Transport::millisecondsPerBeat;
+
+    if (startTime > timeStamp || segment == (layer.size() - 1))
+    {
+        return event->getControllerValue();
+    }
+
+    const AutomationEvent *nextEvent = getNode(segment + 1);
+    const float nextTime = nextEvent->getBeat() * Transport::millisecondsPerBeat;
+
+    if (fabs(event->getControllerValue() - nextEvent->getControllerValue()) <= LEGACY_MIN_INTERPOLATED_CONTROLLER_DELTA)
+    {
+        return event->getControllerValue();
+    }
+
+    const float c = (event->getControllerValue() > nextEvent->getControllerValue()) ?
+        event->getCurvature() : (1.f - event->getCurvature());
+
+    return legacyInterpolation(event->getControllerValue(), nextEvent->getControllerValue(),
+                               (timeStamp - startTime) / (nextTime - startTime), c);
+}
+
+//===----------------------------------------------------------------------===//
+// Checks
+//===----------------------------------------------------------------------===//
+
+static void fillWithRandomNodes(AutomationLayer &layer, Random &random)
+{
+    float beat = 0.f;
+
+    for (int i = 0; i < NUM_NODES; ++i)
+    {
+        // some of the segments are flat, or shorter than the interpolation step
+        const float value = (random.nextInt(8) == 0 && i > 0) ?
+            static_cast<AutomationEvent *>(layer.getUnchecked(i - 1))->getControllerValue() :
+            random.nextFloat();
+
+        const AutomationEvent event(&layer, beat, value);
+        layer.silentImport(event.withCurvature(random.nextFloat()));
+
+        beat += Note::roundBeat(0.0625f + random.nextFloat() * MAX_NODES_DISTANCE_BEATS);
+    }
+
+    layer.notifyLayerChanged();
+}
+
+static void checkLayer(AutomationLayer &layer, const String &name)
+{
+    const MidiLayer::ExportedSequence::Ptr sequence(layer.exportMidi());
+    HELIO_CHECK(sequence->curve != nullptr);
+
+    if (sequence->curve == nullptr)
+    {
+        return;
+    }
+
+    const AutomationCurve &curve = *sequence->curve;
+
+    // the points for the tempo map and the MIDI files
+    Array<LegacyPoint> legacyPoints;
+    const double legacyMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        legacyPoints.clearQuick();
+        legacyExpand(layer, legacyPoints);
+    });
+
+    Array<double> timeStamps;
+    Array<float> values;
+    const double resampleMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        timeStamps.clearQuick();
+        values.clearQuick();
+        curve.getResampledPoints(timeStamps, values);
+    });
+
+    HELIO_CHECK(timeStamps.size() == legacyPoints.size());
+
+    float maxPointsError = 0.f;
+    int maxControllerError = 0;
+    int maxTempoError = 0;
+    bool timeStampsAreEqual = true;
+
+    for (int i = 0; i < jmin(timeStamps.size(), legacyPoints.size()); ++i)
+    {
+        const LegacyPoint &legacyPoint = legacyPoints.getReference(i);
+        const float value = values.getUnchecked(i);
+
+        timeStampsAreEqual = timeStampsAreEqual && (fabs(timeStamps.getUnchecked(i) - legacyPoint.timeStamp) < 0.01);
+        maxPointsError = jmax(maxPointsError, fabs(value - legacyPoint.value));
+
+        maxControllerError = jmax(maxControllerError,
+            abs(AutomationCurve::getControllerValue(value) - int(legacyPoint.value * 127)));
+
+        const MidiMessage tempoEvent(AutomationCurve::createTempoEvent(value));
+        const MidiMessage legacyTempoEvent(MidiMessage::tempoMetaEvent(int((1.f - legacyPoint.value) * Transport::millisecondsPerBeat * 1000)));
+        maxTempoError = jmax(maxTempoError, int(fabs(tempoEvent.getTempoSecondsPerQuarterNote() -
+                                                     legacyTempoEvent.getTempoSecondsPerQuarterNote()) * 1000000.0 + 0.5));
+    }
+
+    HELIO_CHECK(timeStampsAreEqual);
+    HELIO_CHECK(maxPointsError <= VALUE_TOLERANCE);
+
+    if (layer.isTempoLayer())
+    {
+        HELIO_CHECK(maxTempoError <= TEMPO_TOLERANCE_USEC);
+    }
+    else
+    {
+        // the values are truncated to 7 bits, so the tolerance may flip the last one
+        HELIO_CHECK(maxControllerError <= 1);
+    }
+
+    // the values the playback and the renderer sample
+    const double lastTimeStamp = timeStamps.getLast() + AUTOMATION_CURVE_RESOLUTION;
+    const int numSamples = int(lastTimeStamp / SAMPLING_STEP_TICKS);
+    HeapBlock<float> samples(numSamples);
+
+    const double samplingMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        curve.getValues(0.0, SAMPLING_STEP_TICKS, samples.getData(), numSamples);
+    });
+
+    float maxSamplesError = 0.f;
+    int legacySegment = 0;
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const float legacyValue = legacyValueAt(layer, float(SAMPLING_STEP_TICKS * i), legacySegment);
+        maxSamplesError = jmax(maxSamplesError, fabs(samples[i] - legacyValue));
+    }
+
+    HELIO_CHECK(maxSamplesError <= VALUE_TOLERANCE);
+
+    HelioTests::report(name + "\t" + String(legacyPoints.size()) + "\t" +
+                       String(legacyMs, 2) + "\t" + String(resampleMs, 2) + "\t" +
+                       String(numSamples) + "\t" + String(samplingMs, 2) + "\t" +
+                       String(jmax(maxPointsError, maxSamplesError), 7) + "\t" +
+                       String(layer.isTempoLayer() ? maxTempoError : maxControllerError));
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    HelioTests::TestLayersOwner layers;
+
+    AutomationLayer controllerLayer(layers);
+    controllerLayer.setControllerNumber(1);
+    fillWithRandomNodes(controllerLayer, random);
+
+    AutomationLayer tempoLayer(layers);
+    tempoLayer.setControllerNumber(MidiLayer::tempoController);
+    fillWithRandomNodes(tempoLayer, random);
+    HELIO_CHECK(tempoLayer.isTempoLayer());
+
+    HelioTests::report("Layer\tPoints\tLegacy expand, ms\tResample, ms\tSamples\tSample, ms\tMax error\tMax CC/usec error");
+    checkLayer(controllerLayer, "CC");
+    checkLayer(tempoLayer, "Tempo");
+
+    return HelioTests::finish("AutomationCurveBenchmark");
+}
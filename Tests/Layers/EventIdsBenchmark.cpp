@@ -0,0 +1,243 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The 64-bit event ids compared to the 16-character string ids they have
+// replaced: the memory the id takes per note, and the throughput of sorting
+// the events with the id tie-breaks and of the id hash tables.
+//
+// Also checks the compatibility promises: the legacy 16 hex digits ids
+// load as the same ids and are saved back the same, the ids of any other
+// format map to the stable hashes, and the tie-break order is the same as
+// the old string order, except for the ids with the highest bit set,
+// which are now compared as the negative numbers.
+
+#include "TestsCommon.h"
+#include "SerializationKeys.h"
+
+#define NUM_EVENTS 500000
+#define NUM_DISTINCT_BEATS 64
+#define NUM_NON_HEX_IDS 10000
+#define NUM_RUNS 3
+
+// The id as MidiEvent::createId used to make it
+static String createLegacyId()
+{
+    Uuid uuid;
+    return uuid.toString().substring(16, 32);
+}
+
+// The few distinct beats make most of the comparisons go to the id tie-break
+struct LegacyEvent
+{
+    float beat;
+    String id;
+
+    static int compareElements(const LegacyEvent &first, const LegacyEvent &second)
+    {
+        const float diff = first.beat - second.beat;
+        const int diffResult = (diff > 0.f) - (diff < 0.f);
+        if (diffResult != 0) { return diffResult; }
+
+        return first.id.compare(second.id);
+    }
+};
+
+struct PackedEvent
+{
+    float beat;
+    MidiEvent::Id id;
+
+    static int compareElements(const PackedEvent &first, const PackedEvent &second)
+    {
+        const float diff = first.beat - second.beat;
+        const int diffResult = (diff > 0.f) - (diff < 0.f);
+        if (diffResult != 0) { return diffResult; }
+
+        return MidiEvent::compareIds(first.id, second.id);
+    }
+};
+
+// The string's text lives on the heap: the reference count and the allocated
+// size go before the 16 characters and the terminating zero, and the allocator
+// rounds the block up to 16 bytes; this is an estimate, not a measurement
+static size_t getLegacyIdSize()
+{
+    const size_t heapBytes = sizeof(int) + sizeof(size_t) + 17;
+    return sizeof(String) + ((heapBytes + 15) / 16) * 16;
+}
+
+static void checkLegacyIds(PianoLayer &layer)
+{
+    for (int i = 0; i < 1000; ++i)
+    {
+        const String legacyId(createLegacyId());
+        const MidiEvent::Id id = MidiEvent::idFromString(legacyId);
+
+        HELIO_CHECK(MidiEvent::idToString(id) == legacyId);
+        HELIO_CHECK(MidiEvent::idFromString(legacyId.toUpperCase()) == id);
+
+        // and through the notes serialization
+        XmlElement xml(Serialization::Core::note);
+        xml.setAttribute("key", 60);
+        xml.setAttribute("beat", 4.f);
+        xml.setAttribute("len", 1.f);
+        xml.setAttribute("vel", 64);
+        xml.setAttribute("id", legacyId);
+
+        Note note(&layer);
+        note.deserialize(xml);
+        HELIO_CHECK(note.getID() == id);
+
+        ScopedPointer<XmlElement> saved(note.serialize());
+        HELIO_CHECK(saved->getStringAttribute("id") == legacyId);
+    }
+
+    // the tie-break order only differs from the old one where the sign bit is set
+    for (int i = 0; i < 1000; ++i)
+    {
+        const String firstId(createLegacyId());
+        const String secondId(createLegacyId());
+
+        const MidiEvent::Id first = MidiEvent::idFromString(firstId);
+        const MidiEvent::Id second = MidiEvent::idFromString(secondId);
+
+        const int legacyOrder = (firstId.compare(secondId) > 0) - (firstId.compare(secondId) < 0);
+        const bool signsDiffer = ((first < 0) != (second < 0));
+
+        HELIO_CHECK(MidiEvent::compareIds(first, second) == (signsDiffer ? -legacyOrder : legacyOrder));
+    }
+}
+
+static void checkNonHexIds()
+{
+    HashMap<MidiEvent::Id, String, MidiEventIdHashFunction> idsByHash(NUM_NON_HEX_IDS * 2);
+
+    for (int i = 0; i < NUM_NON_HEX_IDS; ++i)
+    {
+        const String legacyId((i % 2 == 0) ? ("note" + String(i)) : String::toHexString(i));
+        const MidiEvent::Id id = MidiEvent::idFromString(legacyId);
+
+        // the same id is made every time and on every run, as it is stored in the history
+        HELIO_CHECK(id == MidiEvent::idFromString(String(legacyId)));
+        HELIO_CHECK(id == MidiEvent::Id(legacyId.hashCode64()));
+
+        HELIO_CHECK(! idsByHash.contains(id));
+        idsByHash.set(id, legacyId);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    HelioTests::TestLayersOwner layers;
+    PianoLayer *layer = layers.addPianoLayer();
+
+    checkLegacyIds(*layer);
+    checkNonHexIds();
+
+    Array<LegacyEvent> legacyEvents;
+    Array<PackedEvent> packedEvents;
+    legacyEvents.ensureStorageAllocated(NUM_EVENTS);
+    packedEvents.ensureStorageAllocated(NUM_EVENTS);
+
+    for (int i = 0; i < NUM_EVENTS; ++i)
+    {
+        const float beat = float(random.nextInt(NUM_DISTINCT_BEATS));
+        const String legacyId(createLegacyId());
+
+        LegacyEvent legacyEvent = { beat, legacyId };
+        PackedEvent packedEvent = { beat, MidiEvent::idFromString(legacyId) };
+
+        legacyEvents.add(legacyEvent);
+        packedEvents.add(packedEvent);
+    }
+
+    //===------------------------------------------------------------------===//
+    // Sorting
+    //===------------------------------------------------------------------===//
+
+    LegacyEvent legacyOrder;
+    PackedEvent packedOrder;
+
+    const double legacySortMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        Array<LegacyEvent> events(legacyEvents);
+        events.sort(legacyOrder);
+    });
+
+    const double packedSortMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        Array<PackedEvent> events(packedEvents);
+        events.sort(packedOrder);
+    });
+
+    //===------------------------------------------------------------------===//
+    // Hashing
+    //===------------------------------------------------------------------===//
+
+    int numLegacyFound = 0;
+    int numPackedFound = 0;
+
+    const double legacyHashMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        HashMap<String, int> table(NUM_EVENTS * 2);
+
+        for (int i = 0; i < NUM_EVENTS; ++i)
+        {
+            table.set(legacyEvents.getReference(i).id, i);
+        }
+
+        numLegacyFound = 0;
+
+        for (int i = 0; i < NUM_EVENTS; ++i)
+        {
+            numLegacyFound += table.contains(legacyEvents.getReference(i).id) ? 1 : 0;
+        }
+    });
+
+    const double packedHashMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        HashMap<MidiEvent::Id, int, MidiEventIdHashFunction> table(NUM_EVENTS * 2);
+
+        for (int i = 0; i < NUM_EVENTS; ++i)
+        {
+            table.set(packedEvents.getReference(i).id, i);
+        }
+
+        numPackedFound = 0;
+
+        for (int i = 0; i < NUM_EVENTS; ++i)
+        {
+            numPackedFound += table.contains(packedEvents.getReference(i).id) ? 1 : 0;
+        }
+    });
+
+    HELIO_CHECK(numLegacyFound == NUM_EVENTS);
+    HELIO_CHECK(numPackedFound == NUM_EVENTS);
+
+    const size_t legacyNoteSize = sizeof(Note) - sizeof(MidiEvent::Id) + getLegacyIdSize();
+
+    HelioTests::report("Ids\tNote, bytes\tSort, ms\tHash set and find, ms");
+    HelioTests::report("String\t" + String(int64(legacyNoteSize)) + "\t" +
+                       String(legacySortMs, 1) + "\t" + String(legacyHashMs, 1));
+    HelioTests::report("int64\t" + String(int64(sizeof(Note))) + "\t" +
+                       String(packedSortMs, 1) + "\t" + String(packedHashMs, 1));
+
+    return HelioTests::finish("EventIdsBenchmark");
+}
@@ -0,0 +1,144 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Imports a generated multi-track midi file of a million events,
+// converting the tracks in parallel and adding the notes in bulk,
+// compared to adding them one by one on a single thread, as it was before.
+// The target is to import the whole file in well under a second.
+
+#include "TestsCommon.h"
+
+#define NUM_TRACKS 16
+#define NUM_NOTES_PER_TRACK 31250
+#define NOTES_BEATS_RANGE 8000.f
+#define NUM_RUNS 3
+#define TARGET_IMPORT_MS 1000.0
+
+static MemoryBlock createMidiFile(Random &random)
+{
+    MidiFile midiFile;
+    midiFile.setTicksPerQuarterNote(MIDI_IMPORT_SCALE);
+
+    for (int i = 0; i < NUM_TRACKS; ++i)
+    {
+        MidiMessageSequence track;
+
+        for (int j = 0; j < NUM_NOTES_PER_TRACK; ++j)
+        {
+            const double start = double(Note::roundBeat(random.nextFloat() * NOTES_BEATS_RANGE)) * MIDI_IMPORT_SCALE;
+            const double length = double(Note::roundBeat(0.25f + random.nextFloat() * 4.f)) * MIDI_IMPORT_SCALE;
+            const int key = 24 + random.nextInt(72);
+            track.addEvent(MidiMessage::noteOn(1, key, uint8(1 + random.nextInt(127))), start);
+            track.addEvent(MidiMessage::noteOff(1, key), start + length);
+        }
+
+        track.sort();
+        track.updateMatchedPairs();
+        midiFile.addTrack(track);
+    }
+
+    MemoryOutputStream out;
+    midiFile.writeTo(out);
+    return out.getMemoryBlock();
+}
+
+static bool readMidiFile(const MemoryBlock &data, MidiFile &result)
+{
+    MemoryInputStream in(data, false);
+    return result.readFrom(in);
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    const MemoryBlock midiData(createMidiFile(random));
+
+    int numEvents = 0;
+    int numNotesImported = 0;
+
+    const double readMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        MidiFile midiFile;
+        HELIO_CHECK(readMidiFile(midiData, midiFile));
+        numEvents = 0;
+
+        for (int i = 0; i < midiFile.getNumTracks(); ++i)
+        {
+            numEvents += midiFile.getTrack(i)->getNumEvents();
+        }
+    });
+
+    // the file reading is the same for both ways, so it's measured apart
+    MidiFile midiFile;
+    HELIO_CHECK(readMidiFile(midiData, midiFile));
+    HELIO_CHECK(midiFile.getNumTracks() == NUM_TRACKS);
+
+    const double bulkMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        HelioTests::TestLayersOwner layers;
+        Array<PianoLayer *> targetLayers;
+        Array<const MidiMessageSequence *> tracks;
+
+        for (int i = 0; i < midiFile.getNumTracks(); ++i)
+        {
+            targetLayers.add(layers.addPianoLayer());
+            tracks.add(midiFile.getTrack(i));
+        }
+
+        PianoLayer::importMidiTracks(targetLayers, tracks);
+
+        numNotesImported = 0;
+
+        for (auto layer : targetLayers)
+        {
+            numNotesImported += layer->size();
+        }
+    });
+
+    const double oneByOneMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        HelioTests::TestLayersOwner layers;
+
+        for (int i = 0; i < midiFile.getNumTracks(); ++i)
+        {
+            PianoLayer *layer = layers.addPianoLayer();
+            const Array<Note> notes(layer->createNotesFrom(*midiFile.getTrack(i)));
+
+            for (const auto &note : notes)
+            {
+                layer->silentImport(note);
+            }
+
+            layer->notifyLayerChanged();
+        }
+    });
+
+    HelioTests::report("Tracks: " + String(NUM_TRACKS) + ", events: " + String(numEvents) +
+                       ", notes imported: " + String(numNotesImported));
+    HelioTests::report("Reading the file: " + String(readMs, 1) + " ms");
+    HelioTests::report("Parallel bulk import: " + String(bulkMs, 1) + " ms");
+    HelioTests::report("One by one import: " + String(oneByOneMs, 1) + " ms");
+
+    HELIO_CHECK(numEvents >= NUM_TRACKS * NUM_NOTES_PER_TRACK * 2);
+    // the overlapping notes of the same key may get paired into the empty ones, which are skipped
+    HELIO_CHECK(numNotesImported > NUM_TRACKS * NUM_NOTES_PER_TRACK / 2);
+    HELIO_CHECK(readMs + bulkMs < TARGET_IMPORT_MS);
+
+    return HelioTests::finish("MidiImportBenchmark");
+}
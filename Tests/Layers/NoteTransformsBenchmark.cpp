@@ -0,0 +1,274 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The toolbox transforms over a selection of 100k notes, done with the note columns,
+// compared to building a copy of each note per transform, as the toolbox did before;
+// both ways should come to the same notes.
+// Then the layer-wide transforms, which copy the layer's own columns at once,
+// and the layer's notes, which should still read their rows after the edits.
+
+#include "TestsCommon.h"
+#include "NoteColumns.h"
+
+#define NUM_NOTES 100000
+#define NOTES_BEATS_RANGE 4000.f
+#define NUM_RUNS 5
+#define MAX_VELOCITY_ERROR 0.0001f
+
+typedef std::function<void (NoteColumns &)> ColumnsTransform;
+typedef std::function<Note (const Note &, float minBeat, float maxBeat)> NoteTransform;
+
+struct Transform
+{
+    String name;
+    ColumnsTransform columnsTransform;
+    NoteTransform noteTransform;
+};
+
+static void transformWithColumns(const Array<Note> &selection, const ColumnsTransform &transform,
+                                 Array<Note> &groupBefore, Array<Note> &groupAfter)
+{
+    NoteColumns columns;
+    columns.ensureStorageAllocated(selection.size());
+
+    for (const auto &note : selection)
+    {
+        columns.add(note);
+    }
+
+    transform(columns);
+    columns.getChanges(groupBefore, groupAfter);
+}
+
+static void transformNoteByNote(const Array<Note> &selection, const NoteTransform &transform,
+                                Array<Note> &groupBefore, Array<Note> &groupAfter)
+{
+    float minBeat = FLT_MAX;
+    float maxBeat = -FLT_MAX;
+
+    for (const auto &note : selection)
+    {
+        minBeat = jmin(minBeat, note.getBeat());
+        maxBeat = jmax(maxBeat, note.getBeat());
+    }
+
+    for (const auto &note : selection)
+    {
+        groupBefore.add(note);
+        groupAfter.add(transform(note, minBeat, maxBeat));
+    }
+}
+
+static bool haveSameNotes(const Array<Note> &columnsResult, const Array<Note> &reference)
+{
+    if (columnsResult.size() != reference.size())
+    {
+        return false;
+    }
+
+    for (int i = 0; i < reference.size(); ++i)
+    {
+        const Note &a = columnsResult.getReference(i);
+        const Note &b = reference.getReference(i);
+
+        if (a.getKey() != b.getKey() ||
+            a.getBeat() != b.getBeat() ||
+            a.getLength() != b.getLength() ||
+            fabsf(a.getVelocity() - b.getVelocity()) > MAX_VELOCITY_ERROR)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Every stored note should read the values it was last given
+static bool layerHasNotes(const PianoLayer &layer, const Array<Note> &expectedNotes)
+{
+    HashMap<MidiEvent::Id, int, MidiEventIdHashFunction> expectedIndices;
+
+    for (int i = 0; i < expectedNotes.size(); ++i)
+    {
+        expectedIndices.set(expectedNotes.getReference(i).getID(), i);
+    }
+
+    if (layer.size() != expectedNotes.size() ||
+        layer.getNoteStorage().size() != expectedNotes.size())
+    {
+        return false;
+    }
+
+    for (int i = 0; i < layer.size(); ++i)
+    {
+        const Note &note = static_cast<const Note &>(*layer.getUnchecked(i));
+
+        if (!note.isStored() || !expectedIndices.contains(note.getID()))
+        {
+            return false;
+        }
+
+        const Note &expected = expectedNotes.getReference(expectedIndices[note.getID()]);
+
+        if (note.getKey() != expected.getKey() ||
+            note.getBeat() != expected.getBeat() ||
+            note.getLength() != expected.getLength() ||
+            note.getVelocity() != expected.getVelocity())
+        {
+            return false;
+        }
+
+        if (i > 0 && layer.getUnchecked(i - 1)->getBeat() > note.getBeat())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    HelioTests::TestLayersOwner layers;
+    PianoLayer *layer = layers.addPianoLayer();
+    HelioTests::TestLayersOwner::fillWithRandomNotes(*layer, NUM_NOTES, NOTES_BEATS_RANGE, random);
+
+    Array<Note> selection;
+
+    for (int i = 0; i < layer->size(); ++i)
+    {
+        selection.add(static_cast<const Note &>(*layer->getUnchecked(i)));
+    }
+
+    Array<Transform> transforms;
+
+    transforms.add({ "Transpose",
+        [](NoteColumns &columns) { columns.transpose(1); },
+        [](const Note &note, float, float) { return note.withDeltaKey(1); } });
+
+    transforms.add({ "Shift beats",
+        [](NoteColumns &columns) { columns.shiftBeats(0.5f); },
+        [](const Note &note, float, float) { return note.withDeltaBeat(0.5f); } });
+
+    transforms.add({ "Scale volume",
+        [](NoteColumns &columns) { columns.scaleVelocities(0.9f); },
+        [](const Note &note, float, float) { return note.withVelocity(note.getVelocity() * 0.9f); } });
+
+    transforms.add({ "Fade out",
+        [](NoteColumns &columns) { columns.fadeOutVelocities(0.5f); },
+        [](const Note &note, float minBeat, float maxBeat)
+        {
+            const float localX = ((note.getBeat() - minBeat) / (maxBeat - minBeat)) + 0.0001f;
+            return note.withVelocity(note.getVelocity() * (1.f - ((localX / sqrtf(localX)) * 0.5f)));
+        } });
+
+    HelioTests::report("Transform\tColumns, notes/s\tNote by note, notes/s");
+
+    for (const auto &transform : transforms)
+    {
+        Array<Note> columnsBefore, columnsAfter;
+        Array<Note> referenceBefore, referenceAfter;
+        transformWithColumns(selection, transform.columnsTransform, columnsBefore, columnsAfter);
+        transformNoteByNote(selection, transform.noteTransform, referenceBefore, referenceAfter);
+        HELIO_CHECK(haveSameNotes(columnsAfter, referenceAfter));
+
+        const double columnsMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            Array<Note> groupBefore, groupAfter;
+            transformWithColumns(selection, transform.columnsTransform, groupBefore, groupAfter);
+        });
+
+        const double noteByNoteMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            Array<Note> groupBefore, groupAfter;
+            transformNoteByNote(selection, transform.noteTransform, groupBefore, groupAfter);
+        });
+
+        HelioTests::report(transform.name + "\t" +
+                           String(int64(NUM_NOTES / (jmax(0.001, columnsMs) * 0.001))) + "\t" +
+                           String(int64(NUM_NOTES / (jmax(0.001, noteByNoteMs) * 0.001))));
+    }
+
+    // the changes are applied to the layer the same way after both,
+    // so this is the cost that is left for the undo action to pay
+    Array<Note> groupBefore, groupAfter;
+    transformWithColumns(selection, transforms.getReference(0).columnsTransform, groupBefore, groupAfter);
+
+    const double applyMs = HelioTests::measureBestOf(1, [&]()
+    {
+        layer->changeGroup(groupBefore, groupAfter, false);
+    });
+
+    HELIO_CHECK(layerHasNotes(*layer, groupAfter));
+    HelioTests::report("Applying a transposition of " + String(groupBefore.size()) +
+                       " notes to the layer: " + String(applyMs, 1) + " ms");
+
+    // the whole layer, taken right from its columns, in the storage order
+    for (const auto &transform : transforms)
+    {
+        Array<Note> layerSelection;
+
+        for (int i = 0; i < layer->getNoteStorage().size(); ++i)
+        {
+            layerSelection.add(*layer->getNoteStorage().getHandle(i));
+        }
+
+        Array<Note> layerBefore, layerAfter;
+        Array<Note> referenceBefore, referenceAfter;
+        transformWithColumns(layerSelection, transform.columnsTransform, referenceBefore, referenceAfter);
+
+        const double layerMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            layerBefore.clearQuick();
+            layerAfter.clearQuick();
+            NoteColumns columns;
+            columns.addAll(layer->getNoteStorage());
+            transform.columnsTransform(columns);
+            columns.getChanges(layerBefore, layerAfter);
+        });
+
+        HELIO_CHECK(haveSameNotes(layerAfter, referenceAfter));
+        HelioTests::report(transform.name + " of the whole layer: " +
+                           String(int64(NUM_NOTES / (jmax(0.001, layerMs) * 0.001))) + " notes/s");
+    }
+
+    // the removed rows are filled with the last ones, the rest of the notes shouldn't notice
+    Array<Note> removedNotes, remainingNotes;
+
+    for (int i = 0; i < groupAfter.size(); ++i)
+    {
+        if (i % 3 == 0)
+        {
+            removedNotes.add(groupAfter.getReference(i));
+        }
+        else
+        {
+            remainingNotes.add(groupAfter.getReference(i));
+        }
+    }
+
+    layer->removeGroup(removedNotes, false);
+    HELIO_CHECK(layerHasNotes(*layer, remainingNotes));
+
+    layer->insertGroup(removedNotes, false);
+    HELIO_CHECK(layerHasNotes(*layer, groupAfter));
+
+    return HelioTests::finish("NoteTransformsBenchmark");
+}
@@ -0,0 +1,616 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Removing the overlaps and the duplicates: a corpus of the small cases
+// with the expected results, then the timing on the random selections,
+// compared to the pairwise passes the toolbox used before the sweep.
+
+#include "TestsCommon.h"
+#include "MidiRollToolbox.h"
+
+#include <vector>
+
+#define NUM_RUNS 3
+#define NUM_KEYS 12
+#define MAX_BEAT_ERROR 0.001f
+
+struct NoteParams
+{
+    int key;
+    float beat;
+    float length;
+};
+
+struct CleanupCase
+{
+    String name;
+    std::vector<NoteParams> input;
+    std::vector<NoteParams> expectedOverlaps;
+    std::vector<NoteParams> expectedDuplicates;
+};
+
+class NoteParamsSorter
+{
+public:
+
+    static int compareElements(const NoteParams &first, const NoteParams &second)
+    {
+        if (first.key != second.key)
+        { return (first.key > second.key) - (first.key < second.key); }
+
+        if (first.beat != second.beat)
+        { return (first.beat > second.beat) - (first.beat < second.beat); }
+
+        return (first.length > second.length) - (first.length < second.length);
+    }
+};
+
+// The notes left after the changes and the removals are applied
+static Array<Note> applyCleanup(const Array<Note> &notes, const Array<Note> &groupBefore,
+                                const Array<Note> &groupAfter, const Array<Note> &removalGroup)
+{
+    HashMap<MidiEvent::Id, int, MidiEventIdHashFunction> removed;
+    HashMap<MidiEvent::Id, int, MidiEventIdHashFunction> changed;
+
+    for (int i = 0; i < removalGroup.size(); ++i)
+    {
+        removed.set(removalGroup.getReference(i).getID(), i);
+    }
+
+    for (int i = 0; i < groupBefore.size(); ++i)
+    {
+        changed.set(groupBefore.getReference(i).getID(), i);
+    }
+
+    Array<Note> result;
+
+    for (const auto &note : notes)
+    {
+        if (removed.contains(note.getID()))
+        {
+            continue;
+        }
+
+        result.add(changed.contains(note.getID()) ? groupAfter.getReference(changed[note.getID()]) : note);
+    }
+
+    return result;
+}
+
+static bool hasSameNotes(const Array<Note> &notes, const std::vector<NoteParams> &expectedParams)
+{
+    Array<NoteParams> actual;
+    Array<NoteParams> expected;
+
+    for (const auto &params : expectedParams)
+    {
+        expected.add(params);
+    }
+
+    for (const auto &note : notes)
+    {
+        actual.add({ note.getKey(), note.getBeat(), note.getLength() });
+    }
+
+    if (actual.size() != expected.size())
+    {
+        return false;
+    }
+
+    NoteParamsSorter sorter;
+    actual.sort(sorter);
+    expected.sort(sorter);
+
+    for (int i = 0; i < actual.size(); ++i)
+    {
+        if (actual[i].key != expected[i].key ||
+            fabsf(actual[i].beat - expected[i].beat) > MAX_BEAT_ERROR ||
+            fabsf(actual[i].length - expected[i].length) > MAX_BEAT_ERROR)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static Array<CleanupCase> createCorpus()
+{
+    Array<CleanupCase> corpus;
+
+    //    --             --            --
+    // --------   ->   --     or      (removed)
+    corpus.add({ "nested",
+        { { 60, 0.f, 4.f }, { 60, 1.f, 1.f } },
+        { { 60, 0.f, 1.f }, { 60, 1.f, 3.f } },
+        { { 60, 1.f, 1.f } } });
+
+    corpus.add({ "partial",
+        { { 60, 0.f, 2.f }, { 60, 1.f, 2.f } },
+        { { 60, 0.f, 1.f }, { 60, 1.f, 2.f } },
+        { { 60, 0.f, 2.f }, { 60, 1.f, 2.f } } });
+
+    // the earlier note would be too short after the cut, so it is kept at the minimum length
+    corpus.add({ "too short to cut",
+        { { 60, 0.f, 2.f }, { 60, 0.125f, 1.f } },
+        { { 60, 0.f, Note::minLength }, { 60, 0.125f, 1.875f } },
+        { { 60, 0.125f, 1.f } } });
+
+    corpus.add({ "same start",
+        { { 60, 0.f, 2.f }, { 60, 0.f, 1.f } },
+        { { 60, 0.f, 2.f } },
+        { { 60, 0.f, 1.f } } });
+
+    corpus.add({ "exact copies",
+        { { 60, 0.f, 2.f }, { 60, 0.f, 2.f } },
+        { { 60, 0.f, 2.f } },
+        { { 60, 0.f, 2.f } } });
+
+    corpus.add({ "chain",
+        { { 60, 0.f, 8.f }, { 60, 1.f, 4.f }, { 60, 2.f, 1.f } },
+        { { 60, 0.f, 1.f }, { 60, 1.f, 1.f }, { 60, 2.f, 6.f } },
+        { { 60, 2.f, 1.f } } });
+
+    corpus.add({ "touching",
+        { { 60, 0.f, 1.f }, { 60, 1.f, 1.f } },
+        { { 60, 0.f, 1.f }, { 60, 1.f, 1.f } },
+        { { 60, 0.f, 1.f }, { 60, 1.f, 1.f } } });
+
+    corpus.add({ "different keys",
+        { { 60, 0.f, 4.f }, { 61, 1.f, 1.f } },
+        { { 60, 0.f, 4.f }, { 61, 1.f, 1.f } },
+        { { 60, 0.f, 4.f }, { 61, 1.f, 1.f } } });
+
+    // snapped to 0.1 beat, then rounded to 1/16 beat, as Note::withBeat does
+    corpus.add({ "snapping",
+        { { 60, 0.0625f, 1.f } },
+        { { 60, 0.125f, 1.f } },
+        { { 60, 0.0625f, 1.f } } });
+
+    corpus.add({ "snapping off the grid",
+        { { 60, 1.04f, 0.96f } },
+        { { 60, 1.f, 1.f } },
+        { { 60, 1.04f, 0.96f } } });
+
+    return corpus;
+}
+
+//===----------------------------------------------------------------------===//
+// The pairwise passes, as they were in the toolbox
+//===----------------------------------------------------------------------===//
+
+static float snappedBeat(float beat, float snapsPerBeat)
+{
+    return roundf(beat / snapsPerBeat) * snapsPerBeat;
+}
+
+// Applies the changes to the selection, as the note components would see them
+static bool applyChanges(Array<Note> &notes, const Array<int> &indices, const Array<Note> &changes)
+{
+    for (int i = 0; i < indices.size(); ++i)
+    {
+        notes.set(indices[i], changes[i]);
+    }
+
+    return ! indices.isEmpty();
+}
+
+static void removeOverlapsPairwise(Array<Note> &notes)
+{
+    {
+        Array<int> indices;
+        Array<Note> changes;
+
+        for (int i = 0; i < notes.size(); ++i)
+        {
+            const Note &nc = notes.getReference(i);
+            const float minSnap = 0.1f;
+            const float startBeat = nc.getBeat();
+            const float startBeatSnap = snappedBeat(startBeat, minSnap);
+            const float endBeat = nc.getBeat() + nc.getLength();
+            const float endBeatSnap = snappedBeat(endBeat, minSnap);
+            const float lengthSnap = endBeatSnap - startBeatSnap;
+
+            if (startBeat != startBeatSnap || endBeat != endBeatSnap)
+            {
+                indices.add(i);
+                changes.add(nc.withBeat(startBeatSnap).withLength(lengthSnap));
+            }
+        }
+
+        applyChanges(notes, indices, changes);
+    }
+
+    bool hasChanges = false;
+
+    do
+    {
+        Array<int> indices;
+        Array<Note> changes;
+
+        for (int i = 0; i < notes.size(); ++i)
+        {
+            const Note &nc = notes.getReference(i);
+            float deltaBeats = -FLT_MAX;
+            bool found = false;
+
+            for (int j = 0; j < notes.size(); ++j)
+            {
+                const Note &nc2 = notes.getReference(j);
+
+                if (nc.getKey() == nc2.getKey() &&
+                    nc.getBeat() > nc2.getBeat() &&
+                    (nc.getBeat() + nc.getLength()) < (nc2.getBeat() + nc2.getLength()))
+                {
+                    const float currentDelta = (nc2.getBeat() + nc2.getLength()) - (nc.getBeat() + nc.getLength());
+
+                    if (deltaBeats < currentDelta)
+                    {
+                        deltaBeats = currentDelta;
+                        found = true;
+                    }
+                }
+            }
+
+            if (found)
+            {
+                indices.add(i);
+                changes.add(nc.withLength(nc.getLength() + deltaBeats));
+            }
+        }
+
+        hasChanges = applyChanges(notes, indices, changes);
+    }
+    while (hasChanges);
+
+    do
+    {
+        Array<int> indices;
+        Array<Note> changes;
+
+        for (int i = 0; i < notes.size(); ++i)
+        {
+            const Note &nc = notes.getReference(i);
+            float deltaBeats = -FLT_MAX;
+            int overlappingIndex = -1;
+
+            for (int j = 0; j < notes.size(); ++j)
+            {
+                const Note &nc2 = notes.getReference(j);
+
+                if (nc.getKey() == nc2.getKey() &&
+                    nc.getBeat() > nc2.getBeat() &&
+                    nc.getBeat() < (nc2.getBeat() + nc2.getLength()) &&
+                    (nc.getBeat() + nc.getLength()) > (nc2.getBeat() + nc2.getLength()))
+                {
+                    const float currentDelta = (nc.getBeat() + nc.getLength()) - (nc2.getBeat() + nc2.getLength());
+
+                    if (deltaBeats < currentDelta)
+                    {
+                        deltaBeats = currentDelta;
+                        overlappingIndex = j;
+                    }
+                }
+            }
+
+            if (overlappingIndex >= 0)
+            {
+                indices.add(overlappingIndex);
+                changes.add(notes.getReference(overlappingIndex).withDeltaLength(deltaBeats));
+            }
+        }
+
+        hasChanges = applyChanges(notes, indices, changes);
+    }
+    while (hasChanges);
+
+    do
+    {
+        Array<int> indices;
+        Array<Note> changes;
+
+        for (int i = 0; i < notes.size(); ++i)
+        {
+            const Note &nc = notes.getReference(i);
+            float overlappingBeats = -FLT_MAX;
+            bool found = false;
+
+            for (int j = 0; j < notes.size(); ++j)
+            {
+                const Note &nc2 = notes.getReference(j);
+
+                if (nc.getKey() == nc2.getKey() &&
+                    nc.getBeat() < nc2.getBeat() &&
+                    (nc.getBeat() + nc.getLength()) >= (nc2.getBeat() + nc2.getLength()))
+                {
+                    const float overlapsWith = (nc.getBeat() + nc.getLength()) - nc2.getBeat();
+
+                    if (overlapsWith > overlappingBeats)
+                    {
+                        overlappingBeats = overlapsWith;
+                        found = true;
+                    }
+                }
+            }
+
+            if (found)
+            {
+                indices.add(i);
+                changes.add(nc.withLength(nc.getLength() - overlappingBeats));
+            }
+        }
+
+        hasChanges = applyChanges(notes, indices, changes);
+    }
+    while (hasChanges);
+
+    HashMap<MidiEvent::Id, int, MidiEventIdHashFunction> deferredRemoval;
+    HashMap<MidiEvent::Id, int, MidiEventIdHashFunction> unremovableNotes;
+
+    for (int i = 0; i < notes.size(); ++i)
+    {
+        const Note &nc = notes.getReference(i);
+
+        for (int j = 0; j < notes.size(); ++j)
+        {
+            if (i == j)
+            {
+                continue;
+            }
+
+            const Note &nc2 = notes.getReference(j);
+
+            const bool isOverlappingNote = (nc.getKey() == nc2.getKey() &&
+                                            nc.getBeat() >= nc2.getBeat() &&
+                                            nc.getBeat() < (nc2.getBeat() + nc2.getLength()));
+
+            const bool startsFromTheSameBeat = (nc.getKey() == nc2.getKey() &&
+                                                nc.getBeat() == nc2.getBeat());
+
+            if (! unremovableNotes.contains(nc2.getID()) &&
+                (isOverlappingNote || startsFromTheSameBeat))
+            {
+                unremovableNotes.set(nc.getID(), i);
+                deferredRemoval.set(nc2.getID(), j);
+            }
+        }
+    }
+
+    Array<Note> result;
+
+    for (const auto &note : notes)
+    {
+        if (! deferredRemoval.contains(note.getID()))
+        {
+            result.add(note);
+        }
+    }
+
+    notes.swapWith(result);
+}
+
+static void removeDuplicatesPairwise(Array<Note> &notes)
+{
+    HashMap<MidiEvent::Id, int, MidiEventIdHashFunction> deferredRemoval;
+    HashMap<MidiEvent::Id, int, MidiEventIdHashFunction> unremovableNotes;
+
+    for (int i = 0; i < notes.size(); ++i)
+    {
+        const Note &nc = notes.getReference(i);
+
+        for (int j = 0; j < notes.size(); ++j)
+        {
+            if (i == j)
+            {
+                continue;
+            }
+
+            const Note &nc2 = notes.getReference(j);
+
+            const bool isOverlappingNote = (nc.getKey() == nc2.getKey() &&
+                                            nc.getBeat() >= nc2.getBeat() &&
+                                            (nc.getBeat() + nc.getLength()) <= (nc2.getBeat() + nc2.getLength()));
+
+            const bool startsFromTheSameBeat = (nc.getKey() == nc2.getKey() &&
+                                                nc.getBeat() == nc2.getBeat());
+
+            if (! unremovableNotes.contains(nc2.getID()) &&
+                (isOverlappingNote || startsFromTheSameBeat))
+            {
+                unremovableNotes.set(nc.getID(), i);
+                deferredRemoval.set(nc2.getID(), j);
+            }
+        }
+    }
+
+    Array<Note> result;
+
+    for (const auto &note : notes)
+    {
+        if (! deferredRemoval.contains(note.getID()))
+        {
+            result.add(note);
+        }
+    }
+
+    notes.swapWith(result);
+}
+
+//===----------------------------------------------------------------------===//
+// Checks for the random selections
+//===----------------------------------------------------------------------===//
+
+static Array<Note> createRandomNotes(PianoLayer &layer, int numNotes, Random &random)
+{
+    // a few keys and a short range, so that most of the notes overlap something
+    const float beatsRange = numNotes / 4.f;
+    Array<Note> notes;
+
+    for (int i = 0; i < numNotes; ++i)
+    {
+        const float beat = Note::roundBeat(random.nextFloat() * beatsRange);
+        const float length = Note::roundBeat(0.25f + random.nextFloat() * 4.f);
+        notes.add(Note(&layer, 60 + random.nextInt(NUM_KEYS), beat, length, 0.75f));
+    }
+
+    return notes;
+}
+
+// No note starts before the previous one on its key ends,
+// unless the previous one couldn't be cut any shorter
+static bool hasNoOverlaps(Array<Note> notes)
+{
+    NoteParamsSorter sorter;
+    Array<NoteParams> sorted;
+
+    for (const auto &note : notes)
+    {
+        sorted.add({ note.getKey(), note.getBeat(), note.getLength() });
+    }
+
+    sorted.sort(sorter);
+
+    for (int i = 1; i < sorted.size(); ++i)
+    {
+        const NoteParams &previous = sorted.getReference(i - 1);
+        const NoteParams &note = sorted.getReference(i);
+
+        if (note.key == previous.key &&
+            note.beat < previous.beat + previous.length - MAX_BEAT_ERROR &&
+            previous.length > Note::minLength)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// No note covers another one on its key
+static bool hasNoDuplicates(const Array<Note> &notes)
+{
+    for (int i = 0; i < notes.size(); ++i)
+    {
+        for (int j = 0; j < notes.size(); ++j)
+        {
+            const Note &outer = notes.getReference(i);
+            const Note &inner = notes.getReference(j);
+
+            if (i != j && outer.getKey() == inner.getKey() &&
+                inner.getBeat() >= outer.getBeat() &&
+                inner.getBeat() + inner.getLength() <= outer.getBeat() + outer.getLength())
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    HelioTests::TestLayersOwner layers;
+    PianoLayer *layer = layers.addPianoLayer();
+
+    for (const auto &cleanupCase : createCorpus())
+    {
+        Array<Note> notes;
+
+        for (const auto &params : cleanupCase.input)
+        {
+            notes.add(Note(layer, params.key, params.beat, params.length, 0.75f));
+        }
+
+        Array<Note> groupBefore, groupAfter, removalGroup;
+        MidiRollToolbox::findOverlaps(notes, groupBefore, groupAfter, removalGroup);
+        const bool overlapsPassed = hasSameNotes(applyCleanup(notes, groupBefore, groupAfter, removalGroup),
+                                                 cleanupCase.expectedOverlaps);
+
+        Array<Note> noChanges, duplicatesRemovalGroup;
+        MidiRollToolbox::findDuplicates(notes, duplicatesRemovalGroup);
+        const bool duplicatesPassed = hasSameNotes(applyCleanup(notes, noChanges, noChanges, duplicatesRemovalGroup),
+                                                   cleanupCase.expectedDuplicates);
+
+        HELIO_CHECK(overlapsPassed);
+        HELIO_CHECK(duplicatesPassed);
+
+        if (! overlapsPassed || ! duplicatesPassed)
+        {
+            HelioTests::report("Case failed: " + cleanupCase.name);
+        }
+    }
+
+    HelioTests::report("Notes\tOverlaps, ms\tPairwise, ms\tDuplicates, ms\tPairwise, ms");
+
+    for (int numNotes = 250; numNotes <= 64000; numNotes *= 4)
+    {
+        const Array<Note> notes(createRandomNotes(*layer, numNotes, random));
+
+        Array<Note> groupBefore, groupAfter, removalGroup;
+        MidiRollToolbox::findOverlaps(notes, groupBefore, groupAfter, removalGroup);
+        HELIO_CHECK(hasNoOverlaps(applyCleanup(notes, groupBefore, groupAfter, removalGroup)));
+
+        Array<Note> noChanges, duplicatesRemovalGroup;
+        MidiRollToolbox::findDuplicates(notes, duplicatesRemovalGroup);
+
+        if (numNotes <= 4000)
+        {
+            HELIO_CHECK(hasNoDuplicates(applyCleanup(notes, noChanges, noChanges, duplicatesRemovalGroup)));
+        }
+
+        const double overlapsMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            Array<Note> before, after, removals;
+            MidiRollToolbox::findOverlaps(notes, before, after, removals);
+        });
+
+        const double duplicatesMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            Array<Note> removals;
+            MidiRollToolbox::findDuplicates(notes, removals);
+        });
+
+        // the pairwise passes take minutes on the larger selections
+        String pairwiseOverlaps("-");
+        String pairwiseDuplicates("-");
+
+        if (numNotes <= 4000)
+        {
+            pairwiseOverlaps = String(HelioTests::measureBestOf(1, [&]()
+            {
+                Array<Note> copy(notes);
+                removeOverlapsPairwise(copy);
+            }), 2);
+
+            pairwiseDuplicates = String(HelioTests::measureBestOf(1, [&]()
+            {
+                Array<Note> copy(notes);
+                removeDuplicatesPairwise(copy);
+            }), 2);
+        }
+
+        HelioTests::report(String(numNotes) + "\t" +
+                           String(overlapsMs, 2) + "\t" + pairwiseOverlaps + "\t" +
+                           String(duplicatesMs, 2) + "\t" + pairwiseDuplicates);
+    }
+
+    return HelioTests::finish("OverlapsCleanupBenchmark");
+}
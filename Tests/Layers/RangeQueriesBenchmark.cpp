@@ -0,0 +1,199 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The lasso selection and the insert-space on a 100k notes layer,
+// done with the layer's range queries, compared to the full scans
+// they have replaced; both ways should find the same notes.
+//
+// The toolbox functions apply their changes through the project's undo stack,
+// so here the insert-space collects the notes the same way the toolbox does,
+// and applies them to the layer directly.
+
+#include "TestsCommon.h"
+
+#define NUM_NOTES 100000
+#define NOTES_BEATS_RANGE 4000.f
+#define NUM_LASSOS 200
+#define NUM_INSERTS 20
+#define INSERT_SPACE_BEATS 4.f
+#define NUM_RUNS 3
+
+struct Lasso
+{
+    float startBeat;
+    float endBeat;
+    int lowKey;
+    int highKey;
+
+    bool contains(const Note &note) const noexcept
+    {
+        return note.getKey() >= this->lowKey && note.getKey() <= this->highKey &&
+            note.getBeat() < this->endBeat && (note.getBeat() + note.getLength()) > this->startBeat;
+    }
+};
+
+static void lassoWithRangeQuery(const PianoLayer &layer, const Lasso &lasso, Array<MidiEvent *> &result)
+{
+    Array<MidiEvent *> candidates;
+    layer.findEventsOverlappingRange(lasso.startBeat, lasso.endBeat, candidates);
+
+    for (auto event : candidates)
+    {
+        if (lasso.contains(*static_cast<Note *>(event)))
+        {
+            result.add(event);
+        }
+    }
+}
+
+// The way the piano roll did it before: all the notes are tested,
+// and each found one is looked up in the results
+static void lassoWithFullScan(const PianoLayer &layer, const Lasso &lasso, Array<MidiEvent *> &result)
+{
+    for (int i = 0; i < layer.size(); ++i)
+    {
+        MidiEvent *event = layer.getUnchecked(i);
+
+        if (lasso.contains(*static_cast<Note *>(event)))
+        {
+            result.addIfNotAlreadyThere(event);
+        }
+    }
+}
+
+static void collectNotesToShift(const PianoLayer &layer, float targetBeat, bool useRangeQuery,
+                                Array<Note> &groupBefore, Array<Note> &groupAfter)
+{
+    const int firstIndex = useRangeQuery ? layer.indexOfFirstEventAtOrAfter(targetBeat) : 0;
+
+    for (int i = firstIndex; i < layer.size(); ++i)
+    {
+        const Note &note = static_cast<const Note &>(*layer.getUnchecked(i));
+
+        if (note.getBeat() >= targetBeat)
+        {
+            groupBefore.add(note);
+            groupAfter.add(note.withDeltaBeat(INSERT_SPACE_BEATS));
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    HelioTests::TestLayersOwner layers;
+    PianoLayer *layer = layers.addPianoLayer();
+    HelioTests::TestLayersOwner::fillWithRandomNotes(*layer, NUM_NOTES, NOTES_BEATS_RANGE, random);
+
+    Array<Lasso> lassos;
+
+    for (int i = 0; i < NUM_LASSOS; ++i)
+    {
+        Lasso lasso;
+        lasso.startBeat = random.nextFloat() * NOTES_BEATS_RANGE;
+        lasso.endBeat = lasso.startBeat + 8.f + random.nextFloat() * 56.f;
+        lasso.lowKey = 24 + random.nextInt(48);
+        lasso.highKey = lasso.lowKey + 12 + random.nextInt(24);
+        lassos.add(lasso);
+    }
+
+    // the same notes are found both ways
+    int numNotesLassoed = 0;
+
+    for (const auto &lasso : lassos)
+    {
+        Array<MidiEvent *> queried;
+        Array<MidiEvent *> scanned;
+        lassoWithRangeQuery(*layer, lasso, queried);
+        lassoWithFullScan(*layer, lasso, scanned);
+
+        queried.sort();
+        scanned.sort();
+        HELIO_CHECK(queried == scanned);
+        numNotesLassoed += queried.size();
+    }
+
+    const double lassoQueryMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        for (const auto &lasso : lassos)
+        {
+            Array<MidiEvent *> result;
+            lassoWithRangeQuery(*layer, lasso, result);
+        }
+    });
+
+    const double lassoScanMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        for (const auto &lasso : lassos)
+        {
+            Array<MidiEvent *> result;
+            lassoWithFullScan(*layer, lasso, result);
+        }
+    });
+
+    HelioTests::report("Lasso, " + String(NUM_NOTES) + " notes, " +
+                       String(numNotesLassoed / NUM_LASSOS) + " notes per lasso");
+    HelioTests::report("Range query: " + String(lassoQueryMs * 1000.0 / NUM_LASSOS, 1) + " us per lasso");
+    HelioTests::report("Full scan: " + String(lassoScanMs * 1000.0 / NUM_LASSOS, 1) + " us per lasso");
+
+    // the insert-space at the random beats, the collecting is measured apart from applying,
+    // since the changes are applied the same way by both
+    double collectQueryMs = 0.0;
+    double collectScanMs = 0.0;
+    double applyMs = 0.0;
+    int numNotesShifted = 0;
+
+    for (int i = 0; i < NUM_INSERTS; ++i)
+    {
+        const float targetBeat = Note::roundBeat(random.nextFloat() * NOTES_BEATS_RANGE);
+        Array<Note> groupBefore;
+        Array<Note> groupAfter;
+        Array<Note> scannedBefore;
+        Array<Note> scannedAfter;
+
+        collectQueryMs += HelioTests::measureBestOf(1, [&]()
+        {
+            collectNotesToShift(*layer, targetBeat, true, groupBefore, groupAfter);
+        });
+
+        collectScanMs += HelioTests::measureBestOf(1, [&]()
+        {
+            collectNotesToShift(*layer, targetBeat, false, scannedBefore, scannedAfter);
+        });
+
+        HELIO_CHECK(groupBefore.size() == scannedBefore.size());
+
+        const int numNotesBefore = layer->size();
+
+        applyMs += HelioTests::measureBestOf(1, [&]()
+        {
+            layer->changeGroup(groupBefore, groupAfter, false);
+        });
+
+        HELIO_CHECK(layer->size() == numNotesBefore);
+        numNotesShifted += groupBefore.size();
+    }
+
+    HelioTests::report("Insert space, " + String(numNotesShifted / NUM_INSERTS) + " notes shifted per insert");
+    HelioTests::report("Range query: collect " + String(collectQueryMs / NUM_INSERTS, 2) +
+                       " ms, apply " + String(applyMs / NUM_INSERTS, 2) + " ms per insert");
+    HelioTests::report("Full scan: collect " + String(collectScanMs / NUM_INSERTS, 2) + " ms per insert");
+
+    return HelioTests::finish("RangeQueriesBenchmark");
+}
@@ -0,0 +1,181 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Saving and loading the projects of a growing size as the chunked binary files,
+// compared to the compressed xml text, which they have replaced;
+// both should read back the same document as the one saved.
+// Also checks that the binary attribute values survive the round trip,
+// and that the sections are never unpacked beyond their stored sizes.
+
+#include "TestsCommon.h"
+#include "DataEncoder.h"
+#include "ChunkedFile.h"
+
+#define NUM_LAYERS 16
+#define NOTES_BEATS_RANGE 1000.f
+#define NUM_RUNS 3
+
+static XmlElement *createProjectXml(int numNotesPerLayer, Random &random)
+{
+    HelioTests::TestLayersOwner layers;
+    auto project = new XmlElement("Project");
+    project->setAttribute("name", "Benchmark");
+
+    for (int i = 0; i < NUM_LAYERS; ++i)
+    {
+        PianoLayer *layer = layers.addPianoLayer();
+        HelioTests::TestLayersOwner::fillWithRandomNotes(*layer, numNotesPerLayer,
+                                                         NOTES_BEATS_RANGE, random);
+        project->addChildElement(layer->serialize());
+    }
+
+    return project;
+}
+
+// The packed undo actions keep their data as base64 attributes,
+// which the chunked encoding stores as the raw bytes
+static void checkBinaryAttributes(Random &random)
+{
+    MemoryBlock data(4096);
+
+    for (size_t i = 0; i < data.getSize(); ++i)
+    {
+        data[i] = char(random.nextInt(256));
+    }
+
+    XmlElement xml("Changes");
+    xml.setAttribute("Data", data.toBase64Encoding());
+    xml.setAttribute("Number", "1234567890123456789012345678901234567890123456789012345678901234567890");
+
+    const MemoryBlock encoded(ChunkedFile::encodeElement(xml));
+    ScopedPointer<XmlElement> decoded(ChunkedFile::decodeElement(encoded.getData(), encoded.getSize()));
+
+    HELIO_CHECK(decoded != nullptr && decoded->isEquivalentTo(&xml, false));
+    HELIO_CHECK(encoded.getSize() < data.getSize() + 256);
+}
+
+// The uncompressed size of the root section is the last field
+// of the first entry of the section table, right after its tag
+static bool loadsWithRootSize(const MemoryBlock &original, const String &rootTag,
+                              int64 uncompressedSize, const File &file)
+{
+    MemoryBlock data(original);
+    const size_t sizeOffset = 12 + rootTag.getNumBytesAsUTF8() + 1 + sizeof(int64) * 2;
+    const int64 littleEndianSize = int64(ByteOrder::swapIfBigEndian(uint64(uncompressedSize)));
+    data.copyFrom(&littleEndianSize, int(sizeOffset), sizeof(int64));
+
+    file.replaceWithData(data.getData(), data.getSize());
+
+    const ChunkedFile chunked(file);
+    ScopedPointer<XmlElement> loaded(chunked.createXml());
+    return loaded != nullptr;
+}
+
+static void checkSectionSizeLimits(Random &random, const File &file)
+{
+    ScopedPointer<XmlElement> project(createProjectXml(100, random));
+
+    MemoryOutputStream out;
+    HELIO_CHECK(ChunkedFile::write(*project, out));
+    const MemoryBlock data(out.getData(), out.getDataSize());
+
+    file.replaceWithData(data.getData(), data.getSize());
+
+    {
+        const ChunkedFile chunked(file);
+        ScopedPointer<XmlElement> loaded(chunked.createXml());
+        HELIO_CHECK(chunked.getVersion() == ChunkedFile::currentVersion);
+        HELIO_CHECK(loaded != nullptr && loaded->isEquivalentTo(project, false));
+    }
+
+    // the root section is tiny, and any other size is a corruption
+    MemoryInputStream in(data, false);
+    in.setPosition(12);
+    const String rootTag(in.readString());
+    in.skipNextBytes(sizeof(int64) * 2);
+    const int64 rootSize = in.readInt64();
+
+    HELIO_CHECK(loadsWithRootSize(data, rootTag, rootSize, file));
+    HELIO_CHECK(! loadsWithRootSize(data, rootTag, rootSize + 1, file));
+    HELIO_CHECK(! loadsWithRootSize(data, rootTag, std::numeric_limits<int64>::max(), file));
+    HELIO_CHECK(! loadsWithRootSize(data, rootTag, -1, file));
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    checkBinaryAttributes(random);
+
+    const File xmlFile(File::createTempFile(".helio"));
+    const File chunkedFile(File::createTempFile(".helio"));
+
+    checkSectionSizeLimits(random, chunkedFile);
+
+    HelioTests::report("Notes\tXml, KB\tChunked, KB\tXml save, ms\tChunked save, ms\tXml load, ms\tChunked load, ms");
+
+    for (int numNotesPerLayer = 1000; numNotesPerLayer <= 100000; numNotesPerLayer *= 10)
+    {
+        ScopedPointer<XmlElement> project(createProjectXml(numNotesPerLayer, random));
+
+        const double xmlSaveMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            HELIO_CHECK(DataEncoder::saveObfuscated(xmlFile, project));
+        });
+
+        const double chunkedSaveMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            HELIO_CHECK(DataEncoder::saveChunked(chunkedFile, project));
+        });
+
+        HELIO_CHECK(! ChunkedFile::isChunkedFile(xmlFile));
+        HELIO_CHECK(ChunkedFile::isChunkedFile(chunkedFile));
+
+        const double xmlLoadMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            ScopedPointer<XmlElement> loaded(DataEncoder::loadObfuscated(xmlFile));
+            HELIO_CHECK(loaded != nullptr);
+        });
+
+        const double chunkedLoadMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            ScopedPointer<XmlElement> loaded(DataEncoder::loadObfuscated(chunkedFile));
+            HELIO_CHECK(loaded != nullptr);
+        });
+
+        {
+            ScopedPointer<XmlElement> fromXml(DataEncoder::loadObfuscated(xmlFile));
+            ScopedPointer<XmlElement> fromChunked(DataEncoder::loadObfuscated(chunkedFile));
+            HELIO_CHECK(fromXml != nullptr && fromXml->isEquivalentTo(project, false));
+            HELIO_CHECK(fromChunked != nullptr && fromChunked->isEquivalentTo(project, false));
+        }
+
+        HelioTests::report(String(numNotesPerLayer * NUM_LAYERS) + "\t" +
+                           String(xmlFile.getSize() / 1024) + "\t" +
+                           String(chunkedFile.getSize() / 1024) + "\t" +
+                           String(xmlSaveMs, 1) + "\t" +
+                           String(chunkedSaveMs, 1) + "\t" +
+                           String(xmlLoadMs, 1) + "\t" +
+                           String(chunkedLoadMs, 1));
+    }
+
+    xmlFile.deleteFile();
+    chunkedFile.deleteFile();
+
+    return HelioTests::finish("ChunkedFileBenchmark");
+}
@@ -0,0 +1,244 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Encryption and decryption throughput of the histories of about 100 MB,
+// for the chunked streamed format and for the legacy one, compared to
+// the single-threaded whole-buffer encoder; the legacy format is what the
+// released clients read, so encryptXml should stay byte-identical to the old
+// encoder, and all of them should read back the same document.
+
+#include "TestsCommon.h"
+#include "DataEncoder.h"
+
+#define NUM_REVISIONS 96
+#define NUM_NOTES_PER_REVISION 16000
+#define NOTES_BEATS_RANGE 1000.f
+#define KEY_SIZE 256
+#define NUM_RUNS 2
+
+// The history is many revisions, each one holding a layer state
+static XmlElement *createHistoryXml(Random &random)
+{
+    HelioTests::TestLayersOwner layers;
+    auto history = new XmlElement("History");
+
+    for (int i = 0; i < NUM_REVISIONS; ++i)
+    {
+        PianoLayer *layer = layers.addPianoLayer();
+        HelioTests::TestLayersOwner::fillWithRandomNotes(*layer, NUM_NOTES_PER_REVISION,
+                                                         NOTES_BEATS_RANGE, random);
+
+        auto revision = new XmlElement("Revision");
+        revision->setAttribute("id", Uuid().toString());
+        revision->addChildElement(layer->serialize());
+        history->addChildElement(revision);
+    }
+
+    return history;
+}
+
+//===----------------------------------------------------------------------===//
+// The way the documents were encrypted before
+//===----------------------------------------------------------------------===//
+
+static void createLegacyCrypters(const MemoryBlock &key, OwnedArray<BlowFish> &crypters)
+{
+    MemoryInputStream keyStream(key, false);
+
+    while (! keyStream.isExhausted())
+    {
+        MemoryBlock nextKey;
+        keyStream.readIntoMemoryBlock(nextKey, 64);
+        crypters.add(new BlowFish(nextKey.getData(), nextKey.getSize()));
+    }
+}
+
+static MemoryBlock legacyEncryptXml(const XmlElement &xml, const MemoryBlock &key)
+{
+    const String xmlString = xml.createDocument("", false, true, "UTF-8", 512);
+
+    MemoryOutputStream compressedStream;
+
+    {
+        GZIPCompressorOutputStream compressor(&compressedStream, 1, false);
+        compressor.write(xmlString.toRawUTF8(), xmlString.getNumBytesAsUTF8());
+        compressor.flush();
+    }
+
+    MemoryBlock compressed(compressedStream.getData(), compressedStream.getDataSize());
+    const int modulo = (compressed.getSize() % 4);
+    const int alignDelta = (modulo > 0) ? (4 - modulo) : 0;
+    compressed.ensureSize(compressed.getSize() + alignDelta, true);
+
+    OwnedArray<BlowFish> crypters;
+    createLegacyCrypters(key, crypters);
+
+    MemoryInputStream xmlStream(compressed, false);
+    MemoryBlock cipher;
+    MemoryOutputStream cipherStream(cipher, false);
+    int currentCrypter = 0;
+
+    cipherStream.writeInt(static_cast<int>(ByteOrder::littleEndianInt("PR::")));
+
+    while (! xmlStream.isExhausted())
+    {
+        uint32 int1(xmlStream.readInt());
+        uint32 int2(xmlStream.readInt());
+
+        crypters[currentCrypter]->encrypt(int1, int2);
+        currentCrypter = (currentCrypter + 1) % crypters.size();
+
+        cipherStream.writeInt(int1);
+        cipherStream.writeInt(int2);
+    }
+
+    cipherStream.flush();
+    return cipher;
+}
+
+static XmlElement *legacyCreateDecryptedXml(const MemoryBlock &buffer, const MemoryBlock &key)
+{
+    OwnedArray<BlowFish> crypters;
+    createLegacyCrypters(key, crypters);
+
+    MemoryInputStream bufferStream(buffer, false);
+    MemoryBlock decipher;
+    MemoryOutputStream decipherStream(decipher, false);
+    int currentCrypter = 0;
+
+    bufferStream.readInt();
+
+    while (! bufferStream.isExhausted())
+    {
+        uint32 int1(bufferStream.readInt());
+        uint32 int2(bufferStream.readInt());
+
+        crypters[currentCrypter]->decrypt(int1, int2);
+        currentCrypter = (currentCrypter + 1) % crypters.size();
+
+        decipherStream.writeInt(int1);
+        decipherStream.writeInt(int2);
+    }
+
+    decipherStream.flush();
+
+    MemoryInputStream input(decipher, false);
+    GZIPDecompressorInputStream decompressor(input);
+    MemoryOutputStream text;
+
+    while (! decompressor.isExhausted())
+    {
+        char buffer[512];
+        const int numBytes = decompressor.read(buffer, sizeof(buffer));
+
+        if (numBytes <= 0)
+        {
+            break;
+        }
+
+        text.write(buffer, size_t(numBytes));
+    }
+
+    return XmlDocument::parse(text.toUTF8());
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    MemoryBlock key(KEY_SIZE);
+
+    for (size_t i = 0; i < key.getSize(); ++i)
+    {
+        key[i] = char(random.nextInt(256));
+    }
+
+    ScopedPointer<XmlElement> history(createHistoryXml(random));
+    const double textMb = history->createDocument("", false, true, "UTF-8", 512).getNumBytesAsUTF8() / (1024.0 * 1024.0);
+
+    MemoryBlock chunkedBlob;
+    MemoryBlock inPlaceBlob;
+    MemoryBlock legacyBlob;
+
+    const double chunkedEncryptMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        chunkedBlob = DataEncoder::encryptXmlStreamed(*history, key);
+    });
+
+    const double inPlaceEncryptMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        inPlaceBlob = DataEncoder::encryptXml(*history, key);
+    });
+
+    const double legacyEncryptMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        legacyBlob = legacyEncryptXml(*history, key);
+    });
+
+    ScopedPointer<XmlElement> fromChunked;
+    ScopedPointer<XmlElement> fromLegacy;
+
+    const double chunkedDecryptMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        fromChunked = DataEncoder::createDecryptedXml(chunkedBlob, key);
+    });
+
+    const double legacyDecryptMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+    {
+        fromLegacy = legacyCreateDecryptedXml(legacyBlob, key);
+    });
+
+    HELIO_CHECK(fromChunked != nullptr && fromChunked->isEquivalentTo(history, false));
+    HELIO_CHECK(fromLegacy != nullptr && fromLegacy->isEquivalentTo(history, false));
+
+    HELIO_CHECK(chunkedBlob.getSize() > 0);
+    HELIO_CHECK(inPlaceBlob == legacyBlob);
+
+    // the old blobs, which are already on the server, are still read
+    {
+        ScopedPointer<XmlElement> legacyFromNewDecoder(DataEncoder::createDecryptedXml(legacyBlob, key));
+        HELIO_CHECK(legacyFromNewDecoder != nullptr && legacyFromNewDecoder->isEquivalentTo(history, false));
+    }
+
+    // the corrupted blobs fail to load
+    {
+        MemoryBlock truncatedBlob(chunkedBlob.getData(), chunkedBlob.getSize() / 2);
+        ScopedPointer<XmlElement> fromTruncated(DataEncoder::createDecryptedXml(truncatedBlob, key));
+        HELIO_CHECK(fromTruncated == nullptr);
+    }
+
+    // an invalid key is reported as an empty block, not as a broken cipher
+    {
+        const MemoryBlock shortKey(key.getData(), KEY_SIZE / 2 + 1);
+        HELIO_CHECK(DataEncoder::encryptXml(*history, shortKey).getSize() == 0);
+        HELIO_CHECK(DataEncoder::encryptXmlStreamed(*history, shortKey).getSize() == 0);
+    }
+
+    HelioTests::report("History, MB\tChunked, KB\tLegacy, KB\tChunked encrypt, MB/s\tIn-place encrypt, MB/s\tLegacy encrypt, MB/s\tChunked decrypt, MB/s\tLegacy decrypt, MB/s");
+
+    HelioTests::report(String(textMb, 1) + "\t" +
+                       String(int64(chunkedBlob.getSize() / 1024)) + "\t" +
+                       String(int64(legacyBlob.getSize() / 1024)) + "\t" +
+                       String(textMb / (chunkedEncryptMs * 0.001), 1) + "\t" +
+                       String(textMb / (inPlaceEncryptMs * 0.001), 1) + "\t" +
+                       String(textMb / (legacyEncryptMs * 0.001), 1) + "\t" +
+                       String(textMb / (chunkedDecryptMs * 0.001), 1) + "\t" +
+                       String(textMb / (legacyDecryptMs * 0.001), 1));
+
+    return HelioTests::finish("DataEncoderBenchmark");
+}
@@ -0,0 +1,247 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Edits the layers at random while the transport plays a loop over them:
+// the playback should never stop, the messages should keep coming,
+// and the edits should be heard without restarting the playback.
+
+#include "TestsAudio.h"
+#include "Transport.h"
+
+#define NUM_LAYERS 32
+#define NUM_NOTES_PER_LAYER 2000
+#define NOTES_BEATS_RANGE 90.f
+#define NUM_EDIT_STEPS 1000
+#define NUM_EDITS_PER_STEP 4
+#define EDIT_STEP_MS 5
+#define MAX_SILENCE_MS 500
+#define MARKER_KEY 127
+#define MARKER_TIMEOUT_MS 8000
+
+class PlaybackEditsStressTest : private Timer
+{
+public:
+
+    PlaybackEditsStressTest() :
+        transport(orchestra),
+        instrument(nullptr),
+        random(12345),
+        numStepsDone(0),
+        numMessagesReceived(0),
+        lastMessageTime(0.0),
+        markerSentTime(0.0),
+        markerHeard(false)
+    {
+        this->instrument = this->orchestra.addInstrument(this->formatManager, this->deviceClock, "Test");
+
+        // the device isn't running, so the player falls back to the thread timing,
+        // and the collector should just know some sample rate to accept the messages
+        this->getCollector().reset(44100.0);
+
+        this->layers.addListener(&this->transport);
+
+        // the frame layer keeps the project's beat range constant,
+        // since the range changes stop the playback by design
+        PianoLayer *frame = this->layers.addPianoLayer();
+        frame->insert(Note(frame, 0, 0.f, 1.f, 0.5f), false);
+        frame->insert(Note(frame, 0, NOTES_BEATS_RANGE + 10.f, 4.f, 0.5f), false);
+
+        for (int i = 0; i < NUM_LAYERS; ++i)
+        {
+            PianoLayer *layer = this->layers.addPianoLayer();
+            HelioTests::TestLayersOwner::fillWithRandomNotes(*layer, NUM_NOTES_PER_LAYER,
+                                                             NOTES_BEATS_RANGE, this->random);
+        }
+
+        this->layers.onBeatRangeChanged();
+    }
+
+    ~PlaybackEditsStressTest()
+    {
+        this->layers.removeListener(&this->transport);
+    }
+
+    void start()
+    {
+        // the loop of about 10 beats, which is 5 seconds at 120 BPM
+        this->transport.startPlaybackLooped(0.0, 0.1);
+        this->lastMessageTime = Time::getMillisecondCounterHiRes();
+        this->startTimer(EDIT_STEP_MS);
+    }
+
+private:
+
+    MidiMessageCollector &getCollector()
+    {
+        return this->instrument->getProcessorPlayer().getMidiMessageCollector();
+    }
+
+    void receiveMessages()
+    {
+        MidiBuffer buffer;
+        this->getCollector().removeNextBlockOfMessages(buffer, 512);
+
+        MidiBuffer::Iterator it(buffer);
+        MidiMessage message;
+        int samplePosition = 0;
+        int numMessages = 0;
+
+        while (it.getNextEvent(message, samplePosition))
+        {
+            ++numMessages;
+
+            if (message.isNoteOn() && message.getNoteNumber() == MARKER_KEY)
+            {
+                this->markerHeard = true;
+            }
+        }
+
+        const double timeNow = Time::getMillisecondCounterHiRes();
+
+        if (numMessages > 0)
+        {
+            this->numMessagesReceived += numMessages;
+            this->lastMessageTime = timeNow;
+        }
+
+        HELIO_CHECK(timeNow - this->lastMessageTime < MAX_SILENCE_MS);
+    }
+
+    void makeRandomEdit()
+    {
+        PianoLayer *layer = this->layers.getLayer(1 + this->random.nextInt(NUM_LAYERS));
+
+        if (layer->size() == 0)
+        {
+            return;
+        }
+
+        // a copy, since the removed note is deleted
+        const Note note(static_cast<const Note &>(*layer->getUnchecked(this->random.nextInt(layer->size()))));
+        const float newBeat = Note::roundBeat(1.f + this->random.nextFloat() * (NOTES_BEATS_RANGE - 1.f));
+        const int newKey = 24 + this->random.nextInt(72);
+
+        switch (this->random.nextInt(4))
+        {
+            case 0:
+                layer->change(note, note.withKeyBeat(newKey, newBeat), false);
+                break;
+
+            case 1:
+                layer->change(note, note.withLength(Note::roundBeat(0.25f + this->random.nextFloat() * 4.f)), false);
+                break;
+
+            case 2:
+                layer->remove(note, false);
+                break;
+
+            default:
+                layer->insert(Note(layer, newKey, newBeat, 1.f, 0.75f), false);
+                break;
+        }
+    }
+
+    // After the random edits, all the notes of one layer are moved to a key
+    // not used anywhere else, so that the edit can be recognized by ear
+    void sendMarkerEdit()
+    {
+        PianoLayer *layer = this->layers.getLayer(1);
+        Array<Note> notesBefore;
+        Array<Note> notesAfter;
+
+        for (int i = 0; i < layer->size(); ++i)
+        {
+            const Note &note = static_cast<const Note &>(*layer->getUnchecked(i));
+            notesBefore.add(note);
+            notesAfter.add(note.withKeyBeat(MARKER_KEY, note.getBeat()));
+        }
+
+        layer->changeGroup(notesBefore, notesAfter, false);
+        this->markerSentTime = Time::getMillisecondCounterHiRes();
+    }
+
+    void timerCallback() override
+    {
+        this->receiveMessages();
+        HELIO_CHECK(this->transport.isPlaying());
+
+        if (this->numStepsDone < NUM_EDIT_STEPS)
+        {
+            for (int i = 0; i < NUM_EDITS_PER_STEP; ++i)
+            {
+                this->makeRandomEdit();
+            }
+
+            if (++this->numStepsDone == NUM_EDIT_STEPS)
+            {
+                this->sendMarkerEdit();
+            }
+
+            return;
+        }
+
+        const bool markerTimedOut =
+            (Time::getMillisecondCounterHiRes() - this->markerSentTime) > MARKER_TIMEOUT_MS;
+
+        if (this->markerHeard || markerTimedOut)
+        {
+            this->stopTimer();
+            this->finish();
+        }
+    }
+
+    void finish()
+    {
+        HELIO_CHECK(this->markerHeard);
+        HELIO_CHECK(this->transport.isPlaying());
+
+        HelioTests::report("Edits made while playing: " + String(NUM_EDIT_STEPS * NUM_EDITS_PER_STEP) +
+                           ", messages received: " + String(this->numMessagesReceived));
+
+        this->transport.stopPlayback();
+        HELIO_CHECK(! this->transport.isPlaying());
+
+        MessageManager::getInstance()->stopDispatchLoop();
+    }
+
+    HelioTests::TestFormatManager formatManager;
+    AudioMonitor deviceClock;
+    HelioTests::TestOrchestra orchestra;
+    Transport transport;
+    Instrument *instrument;
+    HelioTests::TestLayersOwner layers;
+
+    Random random;
+    int numStepsDone;
+    int numMessagesReceived;
+    double lastMessageTime;
+    double markerSentTime;
+    bool markerHeard;
+};
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+
+    {
+        PlaybackEditsStressTest test;
+        test.start();
+        MessageManager::getInstance()->runDispatchLoop();
+    }
+
+    return HelioTests::finish("PlaybackEditsStressTest");
+}
@@ -0,0 +1,210 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Messages per second merged by ProjectSequences versus the number of layers,
+// compared to the linear scan over all the sequences, which it has replaced;
+// also checks that both produce the same order of the messages.
+
+#include "TestsCommon.h"
+#include "ProjectSequencesWrapper.h"
+
+#define NUM_EVENTS_PER_LAYER 2000
+#define NUM_RUNS 3
+#define NUM_SEEKS 100
+#define MAX_LAYERS 256
+
+static SequenceWrapper *createRandomSequence(int numEvents, Random &random)
+{
+    MidiLayer::ExportedSequence::Ptr exported(new MidiLayer::ExportedSequence());
+
+    for (int i = 0; i < numEvents; ++i)
+    {
+        // timestamps are in the ticks, as exported by the layers
+        const double timeStamp = double(random.nextInt(NUM_EVENTS_PER_LAYER * 50));
+        exported->messages.addEvent(MidiMessage::noteOn(1, 24 + random.nextInt(72), 0.5f), timeStamp);
+    }
+
+    exported->messages.sort();
+
+    auto wrapper = new SequenceWrapper();
+    wrapper->sequence = exported;
+    wrapper->channel = 1;
+    wrapper->controllerNumber = 0;
+    wrapper->timeOffset = 0.0;
+    wrapper->listener = nullptr;
+    wrapper->instrument = nullptr;
+    wrapper->layer = nullptr;
+    return wrapper;
+}
+
+// The way the messages were merged before: every message scans all the cursors
+struct LinearMerge
+{
+    explicit LinearMerge(const ReferenceCountedArray<SequenceWrapper> &targetSequences) :
+        sequences(targetSequences)
+    {
+        this->indexes.insertMultiple(0, 0, this->sequences.size());
+    }
+
+    bool getNextMessage(MidiMessage &result)
+    {
+        int foundSequence = -1;
+        double minTimeStamp = DBL_MAX;
+
+        for (int i = 0; i < this->sequences.size(); ++i)
+        {
+            const MidiMessageSequence &messages = this->sequences.getUnchecked(i)->sequence->messages;
+            const int index = this->indexes.getUnchecked(i);
+
+            if (index < messages.getNumEvents() &&
+                messages.getEventPointer(index)->message.getTimeStamp() < minTimeStamp)
+            {
+                minTimeStamp = messages.getEventPointer(index)->message.getTimeStamp();
+                foundSequence = i;
+            }
+        }
+
+        if (foundSequence < 0)
+        {
+            return false;
+        }
+
+        int &index = this->indexes.getReference(foundSequence);
+        result = this->sequences.getUnchecked(foundSequence)->sequence->messages.getEventPointer(index)->message;
+        ++index;
+        return true;
+    }
+
+    // A walk from the start of each sequence
+    void seekToTime(double position)
+    {
+        for (int i = 0; i < this->sequences.size(); ++i)
+        {
+            const MidiMessageSequence &messages = this->sequences.getUnchecked(i)->sequence->messages;
+            int index = 0;
+
+            while (index < messages.getNumEvents() &&
+                   messages.getEventPointer(index)->message.getTimeStamp() < position)
+            {
+                ++index;
+            }
+
+            this->indexes.set(i, index);
+        }
+    }
+
+    const ReferenceCountedArray<SequenceWrapper> &sequences;
+    Array<int> indexes;
+};
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    HelioTests::report("Layers\tMessages\tHeap, msg/s\tLinear, msg/s\tHeap seek, us\tLinear seek, us");
+
+    for (int numLayers = 1; numLayers <= MAX_LAYERS; numLayers *= 4)
+    {
+        ReferenceCountedArray<SequenceWrapper> wrappers;
+        ProjectSequences sequences;
+
+        for (int i = 0; i < numLayers; ++i)
+        {
+            wrappers.add(createRandomSequence(NUM_EVENTS_PER_LAYER, random));
+            sequences.addWrapper(wrappers.getLast());
+        }
+
+        const int totalMessages = numLayers * NUM_EVENTS_PER_LAYER;
+
+        // both merges should emit the same timestamps in the same order
+        {
+            ProjectSequences heapMerge(sequences);
+            LinearMerge linearMerge(wrappers);
+            heapMerge.seekToZeroIndexes();
+
+            MessageWrapper heapMessage;
+            MidiMessage linearMessage;
+            int numMessages = 0;
+            bool sameOrder = true;
+
+            while (heapMerge.getNextMessage(heapMessage))
+            {
+                sameOrder = sameOrder &&
+                    linearMerge.getNextMessage(linearMessage) &&
+                    (heapMessage.message.getTimeStamp() == linearMessage.getTimeStamp());
+
+                ++numMessages;
+            }
+
+            HELIO_CHECK(sameOrder);
+            HELIO_CHECK(numMessages == totalMessages);
+            HELIO_CHECK(! linearMerge.getNextMessage(linearMessage));
+        }
+
+        const double heapMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            ProjectSequences heapMerge(sequences);
+            heapMerge.seekToZeroIndexes();
+            MessageWrapper message;
+            while (heapMerge.getNextMessage(message)) {}
+        });
+
+        const double linearMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            LinearMerge linearMerge(wrappers);
+            MidiMessage message;
+            while (linearMerge.getNextMessage(message)) {}
+        });
+
+        const double lastTimeStamp = sequences.getLastEventTimestamp();
+
+        const double heapSeekMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            ProjectSequences heapMerge(sequences);
+            Random seekRandom(1);
+
+            for (int i = 0; i < NUM_SEEKS; ++i)
+            {
+                heapMerge.seekToTime(seekRandom.nextDouble() * lastTimeStamp);
+            }
+        });
+
+        const double linearSeekMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            LinearMerge linearMerge(wrappers);
+            Random seekRandom(1);
+
+            for (int i = 0; i < NUM_SEEKS; ++i)
+            {
+                linearMerge.seekToTime(seekRandom.nextDouble() * lastTimeStamp);
+            }
+        });
+
+        // the timer resolution is about a microsecond
+        const double minMs = 0.001;
+
+        HelioTests::report(String(numLayers) + "\t" +
+                           String(totalMessages) + "\t" +
+                           String(int64(totalMessages / (jmax(minMs, heapMs) * 0.001))) + "\t" +
+                           String(int64(totalMessages / (jmax(minMs, linearMs) * 0.001))) + "\t" +
+                           String(heapSeekMs * 1000.0 / NUM_SEEKS, 2) + "\t" +
+                           String(linearSeekMs * 1000.0 / NUM_SEEKS, 2));
+    }
+
+    return HelioTests::finish("SequencesMergeBenchmark");
+}
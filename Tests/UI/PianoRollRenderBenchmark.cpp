@@ -0,0 +1,254 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The time to open the piano roll and its scrolling frame rate, by the number of notes:
+// the notes painted from the index, as the roll does now, compared to a component
+// per note, as it did before. The roll itself needs the whole workspace, so its
+// geometry is simplified here: a beat is a fixed width, a key is a row.
+
+#include "TestsCommon.h"
+#include "NotesIndex.h"
+
+#define NOTES_PER_BEAT 10
+#define BEAT_WIDTH 32.f
+#define ROW_HEIGHT 12
+#define VIEW_WIDTH 1600
+#define VIEW_HEIGHT 900
+#define NUM_FRAMES 60
+#define NUM_RUNS 3
+
+static Rectangle<float> getNoteBounds(const Note &note)
+{
+    return Rectangle<float>(note.getBeat() * BEAT_WIDTH,
+                            float((127 - note.getKey()) * ROW_HEIGHT + 1),
+                            note.getLength() * BEAT_WIDTH,
+                            float(ROW_HEIGHT - 1));
+}
+
+// Paints about the same as NoteComponent does, to make the old way comparable
+class StandInNoteComponent : public Component
+{
+public:
+
+    explicit StandInNoteComponent(const Note &targetNote) : note(targetNote)
+    {
+        this->setBounds(getNoteBounds(note).getSmallestIntegerContainer());
+    }
+
+    void paint(Graphics &g) override
+    {
+        const Colour colour(Colours::white.interpolatedWith(this->note.getLayer()->getColour(), 0.5f).withAlpha(0.95f));
+        const float w = float(this->getWidth());
+        const float h = float(this->getHeight());
+
+        g.setColour(colour);
+        g.fillRect(0.f, 1.f, w, h - 2.f);
+
+        g.setColour(colour.brighter(0.125f));
+        g.fillRect(1.f, 0.f, w - 2.f, 1.f);
+
+        g.setColour(colour.darker(0.175f));
+        g.fillRect(1.f, h - 1.f, w - 2.f, 1.f);
+
+        g.setColour(Colours::black.withAlpha(0.4f));
+        g.fillRect(2.f, h - 4.f, (w - 2.f) * this->note.getVelocity() - 2.f, 3.f);
+    }
+
+private:
+
+    const Note &note;
+
+};
+
+class StandInRoll : public Component
+{
+public:
+
+    void addNotes(const PianoLayer &layer)
+    {
+        for (int i = 0; i < layer.size(); ++i)
+        {
+            const Note &note = static_cast<const Note &>(*layer.getUnchecked(i));
+            this->addAndMakeVisible(this->notes.add(new StandInNoteComponent(note)));
+        }
+    }
+
+    void paint(Graphics &g) override
+    {
+        g.fillAll(Colours::darkgrey);
+    }
+
+private:
+
+    OwnedArray<StandInNoteComponent> notes;
+
+};
+
+static Rectangle<int> getViewArea(int frame, float beatsRange)
+{
+    const float maxX = jmax(0.f, beatsRange * BEAT_WIDTH - VIEW_WIDTH);
+    const int x = int(maxX * frame / (NUM_FRAMES - 1));
+    return Rectangle<int>(x, 64 * ROW_HEIGHT - VIEW_HEIGHT / 2, VIEW_WIDTH, VIEW_HEIGHT);
+}
+
+static void paintIndexedFrame(Graphics &g, const NotesIndex &index,
+                              NotesBatchPainter &painter, const Rectangle<int> &area)
+{
+    g.fillAll(Colours::darkgrey);
+
+    Array<const NotesIndex::Entry *> entries;
+    index.findNotesInRange(area.getX() / BEAT_WIDTH, area.getRight() / BEAT_WIDTH, entries);
+
+    for (auto entry : entries)
+    {
+        const Rectangle<float> bounds(getNoteBounds(*entry->note));
+
+        if (area.intersects(bounds.getSmallestIntegerContainer()))
+        {
+            painter.add(*entry->note, bounds, true);
+        }
+    }
+
+    painter.paint(g);
+}
+
+static int countVisibleNotes(const PianoLayer &layer, const Rectangle<int> &area)
+{
+    int numVisible = 0;
+
+    for (int i = 0; i < layer.size(); ++i)
+    {
+        const Note &note = static_cast<const Note &>(*layer.getUnchecked(i));
+        numVisible += area.intersects(getNoteBounds(note).getSmallestIntegerContainer()) ? 1 : 0;
+    }
+
+    return numVisible;
+}
+
+static int countIndexedNotes(const NotesIndex &index, const Rectangle<int> &area)
+{
+    Array<const NotesIndex::Entry *> entries;
+    index.findNotesInRange(area.getX() / BEAT_WIDTH, area.getRight() / BEAT_WIDTH, entries);
+
+    int numVisible = 0;
+
+    for (auto entry : entries)
+    {
+        numVisible += area.intersects(getNoteBounds(*entry->note).getSmallestIntegerContainer()) ? 1 : 0;
+    }
+
+    return numVisible;
+}
+
+static void checkIndexUpdates(PianoLayer &layer, NotesIndex &index, Random &random)
+{
+    Array<MidiLayer *> layers;
+    layers.add(&layer);
+    index.rebuild(layers);
+    HELIO_CHECK(index.size() == layer.size());
+
+    const Note &note = static_cast<const Note &>(*layer.getUnchecked(random.nextInt(layer.size())));
+    const Rectangle<int> noteArea(getNoteBounds(note).getSmallestIntegerContainer());
+    const int numVisible = countIndexedNotes(index, noteArea);
+
+    HELIO_CHECK(index.remove(note) == nullptr);
+    HELIO_CHECK(index.size() == layer.size() - 1);
+    HELIO_CHECK(countIndexedNotes(index, noteArea) == numVisible - 1);
+
+    index.add(note);
+    HELIO_CHECK(index.size() == layer.size());
+    HELIO_CHECK(countIndexedNotes(index, noteArea) == numVisible);
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    const int noteCounts[] = { 1000, 10000, 100000, 250000 };
+
+    HelioTests::report("Notes\tIndexed open, ms\tComponents open, ms\tIndexed scroll, FPS\tComponents scroll, FPS");
+
+    for (auto numNotes : noteCounts)
+    {
+        HelioTests::TestLayersOwner layers;
+        PianoLayer *layer = layers.addPianoLayer();
+        const float beatsRange = float(numNotes / NOTES_PER_BEAT);
+        HelioTests::TestLayersOwner::fillWithRandomNotes(*layer, numNotes, beatsRange, random);
+
+        Array<MidiLayer *> layersList;
+        layersList.add(layer);
+
+        NotesIndex index;
+        ScopedPointer<StandInRoll> roll;
+
+        const double indexedOpenMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            index.rebuild(layersList);
+        });
+
+        const double componentsOpenMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            roll = nullptr;
+            roll = new StandInRoll();
+            roll->setSize(int(beatsRange * BEAT_WIDTH) + VIEW_WIDTH, 128 * ROW_HEIGHT);
+            roll->addNotes(*layer);
+        });
+
+        HELIO_CHECK(countIndexedNotes(index, getViewArea(NUM_FRAMES / 2, beatsRange)) ==
+                    countVisibleNotes(*layer, getViewArea(NUM_FRAMES / 2, beatsRange)));
+
+        Image frameImage(Image::ARGB, VIEW_WIDTH, VIEW_HEIGHT, true);
+        NotesBatchPainter painter;
+
+        const double indexedScrollMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            for (int frame = 0; frame < NUM_FRAMES; ++frame)
+            {
+                const Rectangle<int> area(getViewArea(frame, beatsRange));
+                Graphics g(frameImage);
+                g.setOrigin(-area.getX(), -area.getY());
+                g.reduceClipRegion(area);
+                paintIndexedFrame(g, index, painter, area);
+            }
+        });
+
+        const double componentsScrollMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            for (int frame = 0; frame < NUM_FRAMES; ++frame)
+            {
+                const Rectangle<int> area(getViewArea(frame, beatsRange));
+                Graphics g(frameImage);
+                g.setOrigin(-area.getX(), -area.getY());
+                g.reduceClipRegion(area);
+                roll->paintEntireComponent(g, false);
+            }
+        });
+
+        roll = nullptr;
+
+        checkIndexUpdates(*layer, index, random);
+
+        HelioTests::report(String(numNotes) + "\t" +
+                           String(indexedOpenMs, 2) + "\t" +
+                           String(componentsOpenMs, 2) + "\t" +
+                           String(NUM_FRAMES / (indexedScrollMs * 0.001), 1) + "\t" +
+                           String(NUM_FRAMES / (componentsScrollMs * 0.001), 1));
+    }
+
+    return HelioTests::finish("PianoRollRenderBenchmark");
+}
@@ -0,0 +1,419 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Diffs and merges of the layers of 1,000 to 100,000 notes with the hash join
+// on the serialized events, compared to the way PianoLayerDiffLogic did them
+// before: the notes deserialized into a throwaway layer, the nested loop diff,
+// and the merges removing the replaced notes one by one.
+// Both should give the same notes; the old diff is quadratic, so it is only
+// measured up to 10,000 notes.
+
+#include "TestsCommon.h"
+#include "SerializedEventsDiff.h"
+#include "PianoLayerDeltas.h"
+#include "SerializationKeys.h"
+
+#define NOTES_BEATS_RANGE 1000.f
+#define MAX_LEGACY_NOTES 10000
+#define NUM_RUNS 3
+
+//===----------------------------------------------------------------------===//
+// The way the notes were diffed and merged before
+//===----------------------------------------------------------------------===//
+
+static void legacyDeserialize(MidiLayer &layer, const XmlElement *xml, OwnedArray<Note> &notes)
+{
+    forEachXmlChildElementWithTagName(*xml, e, Serialization::Core::note)
+    {
+        auto note = new Note(&layer, 0, 0, 0, 0);
+        note->deserialize(*e);
+        notes.addSorted(*note, note);
+    }
+}
+
+static XmlElement *legacySerialize(const Array<const MidiEvent *> &events, const String &tag)
+{
+    auto xml = new XmlElement(tag);
+
+    for (auto event : events)
+    {
+        xml->addChildElement(event->serialize());
+    }
+
+    return xml;
+}
+
+struct LegacyDiff
+{
+    OwnedArray<Note> stateNotes;
+    OwnedArray<Note> changesNotes;
+
+    Array<const MidiEvent *> added;
+    Array<const MidiEvent *> removed;
+    Array<const MidiEvent *> changed;
+};
+
+static void legacyCreateDiff(MidiLayer &layer, const XmlElement *state, const XmlElement *changes, LegacyDiff &diff)
+{
+    legacyDeserialize(layer, state, diff.stateNotes);
+    legacyDeserialize(layer, changes, diff.changesNotes);
+
+    for (auto stateNote : diff.stateNotes)
+    {
+        bool foundNoteInChanges = false;
+
+        for (auto changesNote : diff.changesNotes)
+        {
+            if (stateNote->getID() == changesNote->getID())
+            {
+                foundNoteInChanges = true;
+
+                const bool noteHasChanged = (stateNote->getKey() != changesNote->getKey() ||
+                                             stateNote->getBeat() != changesNote->getBeat() ||
+                                             stateNote->getLength() != changesNote->getLength() ||
+                                             stateNote->getVelocity() != changesNote->getVelocity());
+
+                if (noteHasChanged)
+                {
+                    diff.changed.add(changesNote);
+                }
+
+                break;
+            }
+        }
+
+        if (! foundNoteInChanges)
+        {
+            diff.removed.add(stateNote);
+        }
+    }
+
+    for (auto changesNote : diff.changesNotes)
+    {
+        bool foundNoteInState = false;
+
+        for (auto stateNote : diff.stateNotes)
+        {
+            if (stateNote->getID() == changesNote->getID())
+            {
+                foundNoteInState = true;
+                break;
+            }
+        }
+
+        if (! foundNoteInState)
+        {
+            diff.added.add(changesNote);
+        }
+    }
+}
+
+static XmlElement *legacyMergeAdded(MidiLayer &layer, const XmlElement *state, const XmlElement *changes)
+{
+    OwnedArray<Note> stateNotes;
+    OwnedArray<Note> changesNotes;
+    legacyDeserialize(layer, state, stateNotes);
+    legacyDeserialize(layer, changes, changesNotes);
+
+    Array<const MidiEvent *> result;
+    result.addArray(stateNotes);
+
+    HashMap<MidiEvent::Id, int> stateIDs;
+
+    for (int j = 0; j < stateNotes.size(); ++j)
+    {
+        stateIDs.set(stateNotes.getUnchecked(j)->getID(), j);
+    }
+
+    for (auto changesNote : changesNotes)
+    {
+        if (! stateIDs.contains(changesNote->getID()))
+        {
+            result.add(changesNote);
+        }
+    }
+
+    return legacySerialize(result, PianoLayerDeltas::notesAdded);
+}
+
+static XmlElement *legacyMergeRemoved(MidiLayer &layer, const XmlElement *state, const XmlElement *changes)
+{
+    OwnedArray<Note> stateNotes;
+    OwnedArray<Note> changesNotes;
+    legacyDeserialize(layer, state, stateNotes);
+    legacyDeserialize(layer, changes, changesNotes);
+
+    Array<const MidiEvent *> result;
+    HashMap<MidiEvent::Id, int> changesIDs;
+
+    for (int j = 0; j < changesNotes.size(); ++j)
+    {
+        changesIDs.set(changesNotes.getUnchecked(j)->getID(), j);
+    }
+
+    for (auto stateNote : stateNotes)
+    {
+        if (! changesIDs.contains(stateNote->getID()))
+        {
+            result.add(stateNote);
+        }
+    }
+
+    return legacySerialize(result, PianoLayerDeltas::notesAdded);
+}
+
+static XmlElement *legacyMergeChanged(MidiLayer &layer, const XmlElement *state, const XmlElement *changes)
+{
+    OwnedArray<Note> stateNotes;
+    OwnedArray<Note> changesNotes;
+    legacyDeserialize(layer, state, stateNotes);
+    legacyDeserialize(layer, changes, changesNotes);
+
+    Array<const MidiEvent *> result;
+    result.addArray(stateNotes);
+
+    HashMap<MidiEvent::Id, const Note *> changesIDs;
+
+    for (auto changesNote : changesNotes)
+    {
+        changesIDs.set(changesNote->getID(), changesNote);
+    }
+
+    for (auto stateNote : stateNotes)
+    {
+        if (changesIDs.contains(stateNote->getID()))
+        {
+            result.removeAllInstancesOf(stateNote);
+            result.addIfNotAlreadyThere(changesIDs[stateNote->getID()]);
+        }
+    }
+
+    return legacySerialize(result, PianoLayerDeltas::notesAdded);
+}
+
+//===----------------------------------------------------------------------===//
+// Comparing the results
+//===----------------------------------------------------------------------===//
+
+// The notes are compared as the events see them, regardless of their order
+struct IdsOrder
+{
+    static int compareElements(const MidiEvent *first, const MidiEvent *second)
+    {
+        return MidiEvent::compareIds(first->getID(), second->getID());
+    }
+};
+
+static bool haveSameNotes(Array<const MidiEvent *> notes, Array<const MidiEvent *> legacyNotes)
+{
+    if (notes.size() != legacyNotes.size())
+    {
+        return false;
+    }
+
+    IdsOrder order;
+    notes.sort(order);
+    legacyNotes.sort(order);
+
+    for (int i = 0; i < notes.size(); ++i)
+    {
+        const Note *note = static_cast<const Note *>(notes.getUnchecked(i));
+        const Note *legacyNote = static_cast<const Note *>(legacyNotes.getUnchecked(i));
+
+        if (note->getID() != legacyNote->getID() ||
+            note->getKey() != legacyNote->getKey() ||
+            note->getBeat() != legacyNote->getBeat() ||
+            note->getLength() != legacyNote->getLength() ||
+            note->getVelocity() != legacyNote->getVelocity())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void deserializeAll(MidiLayer &layer, const Array<const XmlElement *> &events,
+                           OwnedArray<Note> &notes, Array<const MidiEvent *> &result)
+{
+    for (auto e : events)
+    {
+        auto note = notes.add(new Note(&layer, 0, 0, 0, 0));
+        note->deserialize(*e);
+        result.add(note);
+    }
+}
+
+static Array<const XmlElement *> getChildren(const XmlElement *xml)
+{
+    Array<const XmlElement *> events;
+
+    forEachXmlChildElementWithTagName(*xml, e, Serialization::Core::note)
+    {
+        events.add(e);
+    }
+
+    return events;
+}
+
+static bool haveSameNotes(MidiLayer &layer, const Array<const XmlElement *> &events,
+                          const Array<const MidiEvent *> &legacyEvents)
+{
+    OwnedArray<Note> notes;
+    Array<const MidiEvent *> noteEvents;
+    deserializeAll(layer, events, notes, noteEvents);
+    return haveSameNotes(noteEvents, legacyEvents);
+}
+
+static bool haveSameNotes(MidiLayer &layer, const XmlElement *xml, const XmlElement *legacyXml)
+{
+    OwnedArray<Note> legacyNotes;
+    Array<const MidiEvent *> legacyEvents;
+    deserializeAll(layer, getChildren(legacyXml), legacyNotes, legacyEvents);
+    return haveSameNotes(layer, getChildren(xml), legacyEvents);
+}
+
+//===----------------------------------------------------------------------===//
+// The deltas
+//===----------------------------------------------------------------------===//
+
+// A tenth of the notes is removed, a tenth is changed, and a tenth is added
+static void createDeltas(PianoLayer &layer, int numNotes, Random &random,
+                         ScopedPointer<XmlElement> &state, ScopedPointer<XmlElement> &changes)
+{
+    HelioTests::TestLayersOwner::fillWithRandomNotes(layer, numNotes, NOTES_BEATS_RANGE, random);
+
+    state = new XmlElement(PianoLayerDeltas::notesAdded);
+    changes = new XmlElement(PianoLayerDeltas::notesAdded);
+
+    for (int i = 0; i < layer.size(); ++i)
+    {
+        const Note *note = static_cast<const Note *>(layer.getUnchecked(i));
+        state->addChildElement(note->serialize());
+
+        switch (i % 10)
+        {
+            case 0:
+                break;
+
+            case 1:
+                changes->addChildElement(note->withDeltaBeat(1.f).serialize());
+                break;
+
+            default:
+                changes->addChildElement(note->serialize());
+                break;
+        }
+    }
+
+    for (int i = 0; i < numNotes / 10; ++i)
+    {
+        const float beat = Note::roundBeat(random.nextFloat() * NOTES_BEATS_RANGE);
+        const Note note(&layer, 24 + random.nextInt(72), beat, 1.f, 0.5f);
+        changes->addChildElement(note.serialize());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    VCS::SerializedEventsDiff eventsDiff(Serialization::Core::note);
+
+    // the same attributes as PianoLayerDiffLogic compares
+    eventsDiff
+        .compareNumber("key")
+        .compareNumber("beat")
+        .compareNumber("len")
+        .compareNumber("vel");
+
+    HelioTests::report("Notes\tDiff, ms\tLegacy diff, ms\tMerges, ms\tLegacy merges, ms");
+
+    for (int numNotes = 1000; numNotes <= 100000; numNotes *= 10)
+    {
+        HelioTests::TestLayersOwner layers;
+        PianoLayer *layer = layers.addPianoLayer();
+
+        ScopedPointer<XmlElement> state;
+        ScopedPointer<XmlElement> changes;
+        createDeltas(*layer, numNotes, random, state, changes);
+
+        VCS::SerializedEventsDiff::Result diff;
+
+        const double diffMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            diff = eventsDiff.createDiff(state, changes);
+        });
+
+        ScopedPointer<XmlElement> added;
+        ScopedPointer<XmlElement> removed;
+        ScopedPointer<XmlElement> changed;
+
+        const double mergeMs = HelioTests::measureBestOf(NUM_RUNS, [&]()
+        {
+            added = eventsDiff.mergeAdded(state, changes, PianoLayerDeltas::notesAdded);
+            removed = eventsDiff.mergeRemoved(state, changes, PianoLayerDeltas::notesAdded);
+            changed = eventsDiff.mergeChanged(state, changes, PianoLayerDeltas::notesAdded);
+        });
+
+        HELIO_CHECK(diff.removed.size() == numNotes / 10);
+        HELIO_CHECK(diff.changed.size() == numNotes / 10);
+        HELIO_CHECK(diff.added.size() == numNotes / 10);
+
+        String legacyDiffTime("-");
+        String legacyMergeTime("-");
+
+        if (numNotes <= MAX_LEGACY_NOTES)
+        {
+            LegacyDiff legacyDiff;
+
+            const double legacyDiffMs = HelioTests::measureBestOf(1, [&]()
+            {
+                legacyCreateDiff(*layer, state, changes, legacyDiff);
+            });
+
+            HELIO_CHECK(haveSameNotes(*layer, diff.added, legacyDiff.added));
+            HELIO_CHECK(haveSameNotes(*layer, diff.removed, legacyDiff.removed));
+            HELIO_CHECK(haveSameNotes(*layer, diff.changed, legacyDiff.changed));
+
+            ScopedPointer<XmlElement> legacyAdded;
+            ScopedPointer<XmlElement> legacyRemoved;
+            ScopedPointer<XmlElement> legacyChanged;
+
+            const double legacyMergeMs = HelioTests::measureBestOf(1, [&]()
+            {
+                legacyAdded = legacyMergeAdded(*layer, state, changes);
+                legacyRemoved = legacyMergeRemoved(*layer, state, changes);
+                legacyChanged = legacyMergeChanged(*layer, state, changes);
+            });
+
+            HELIO_CHECK(haveSameNotes(*layer, added, legacyAdded));
+            HELIO_CHECK(haveSameNotes(*layer, removed, legacyRemoved));
+            HELIO_CHECK(haveSameNotes(*layer, changed, legacyChanged));
+
+            legacyDiffTime = String(legacyDiffMs, 1);
+            legacyMergeTime = String(legacyMergeMs, 1);
+        }
+
+        HelioTests::report(String(numNotes) + "\t" +
+                           String(diffMs, 1) + "\t" + legacyDiffTime + "\t" +
+                           String(mergeMs, 1) + "\t" + legacyMergeTime);
+    }
+
+    return HelioTests::finish("EventsDiffBenchmark");
+}
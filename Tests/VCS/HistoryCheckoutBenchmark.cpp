@@ -0,0 +1,298 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checkouts in a synthetic history of 5,000 linear commits of a tracked layer:
+// the head moving from the nearest state checkpoint, versus replaying the
+// whole path from the root, as it did before the checkpoints were added.
+// After each checkout, the layer restored to its state at that commit
+// should have nothing on the stage.
+
+#include "TestsCommon.h"
+#include "Head.h"
+#include "Revision.h"
+#include "RevisionItem.h"
+#include "Pack.h"
+#include "TrackedItem.h"
+#include "TrackedItemsSource.h"
+#include "PianoLayerDiffLogic.h"
+#include "PianoLayerDeltas.h"
+
+#define NUM_REVISIONS 5000
+#define NUM_NOTES 300
+#define NOTES_BEATS_RANGE 128.f
+#define NUM_EDITS_PER_COMMIT 4
+#define NUM_CHECKOUTS 16
+
+// The piano layer as the tree item tracks it, with only the path and the notes deltas
+class TrackedLayer : public VCS::TrackedItem
+{
+public:
+
+    explicit TrackedLayer(PianoLayer &targetLayer) :
+        layer(targetLayer)
+    {
+        this->vcsDiffLogic = new VCS::PianoLayerDiffLogic(*this);
+        this->deltas.add(new VCS::Delta(VCS::DeltaDescription(""), PianoLayerDeltas::layerPath));
+        this->deltas.add(new VCS::Delta(VCS::DeltaDescription(""), PianoLayerDeltas::notesAdded));
+    }
+
+    int getNumDeltas() const override
+    { return this->deltas.size(); }
+
+    VCS::Delta *getDelta(int index) const override
+    { return this->deltas[index]; }
+
+    XmlElement *createDeltaDataFor(int index) const override
+    {
+        if (this->deltas[index]->getType() == PianoLayerDeltas::layerPath)
+        {
+            auto xml = new XmlElement(PianoLayerDeltas::layerPath);
+            xml->setAttribute(Serialization::VCS::delta, "Tests/Layer");
+            return xml;
+        }
+
+        auto xml = new XmlElement(PianoLayerDeltas::notesAdded);
+
+        for (int i = 0; i < this->layer.size(); ++i)
+        {
+            xml->addChildElement(this->layer.getUnchecked(i)->serialize());
+        }
+
+        return xml;
+    }
+
+    String getVCSName() const override
+    { return "Layer"; }
+
+    VCS::DiffLogic *getDiffLogic() const override
+    { return this->vcsDiffLogic; }
+
+    void resetStateTo(const VCS::TrackedItem &newState) override
+    {
+        for (int i = 0; i < newState.getNumDeltas(); ++i)
+        {
+            if (newState.getDelta(i)->getType() == PianoLayerDeltas::notesAdded)
+            {
+                ScopedPointer<XmlElement> newDeltaData(newState.createDeltaDataFor(i));
+                Array<Note> notes;
+
+                forEachXmlChildElementWithTagName(*newDeltaData, e, Serialization::Core::note)
+                {
+                    notes.add(Note(&this->layer).withParameters(*e));
+                }
+
+                this->layer.reset();
+                this->layer.silentImportGroup(notes);
+            }
+        }
+
+        this->markVCSChanged();
+    }
+
+private:
+
+    PianoLayer &layer;
+
+    ScopedPointer<VCS::PianoLayerDiffLogic> vcsDiffLogic;
+    OwnedArray<VCS::Delta> deltas;
+};
+
+class TrackedLayerSource : public VCS::TrackedItemsSource
+{
+public:
+
+    explicit TrackedLayerSource(TrackedLayer &targetItem) :
+        item(targetItem) {}
+
+    String getVCSName() const override
+    { return "Tests"; }
+
+    int getNumTrackedItems() override
+    { return 1; }
+
+    VCS::TrackedItem *getTrackedItem(int index) override
+    { return &this->item; }
+
+private:
+
+    TrackedLayer &item;
+};
+
+// Head::moveTo logs every revision on its path, which would be measured too
+class SilentLogger : public Logger
+{
+    void logMessage(const String &message) override {}
+};
+
+static void makeRandomEdit(PianoLayer &layer, Random &random)
+{
+    const Note note(static_cast<const Note &>(*layer.getUnchecked(random.nextInt(layer.size()))));
+    const float newBeat = Note::roundBeat(random.nextFloat() * NOTES_BEATS_RANGE);
+    const int newKey = 24 + random.nextInt(72);
+
+    switch (random.nextInt(4))
+    {
+        case 0:
+            layer.change(note, note.withKeyBeat(newKey, newBeat), false);
+            break;
+
+        case 1:
+            layer.change(note, note.withLength(Note::roundBeat(0.25f + random.nextFloat() * 4.f)), false);
+            break;
+
+        case 2:
+            // keeps the number of notes about the same
+            layer.remove(note, false);
+            layer.insert(Note(&layer, newKey, newBeat, 1.f, 0.75f), false);
+            break;
+
+        default:
+            layer.change(note, note.withVelocity(0.25f + random.nextFloat() * 0.75f), false);
+            break;
+    }
+}
+
+// Restores the layer as it was committed, and checks that the head sees no changes
+static bool isHeadAtSnapshot(VCS::Head &head, TrackedLayer &item,
+                             PianoLayer &layer, const XmlElement &snapshot)
+{
+    layer.deserialize(snapshot);
+    item.markVCSChanged();
+    head.rebuildDiffSynchronously();
+    return ! head.hasAnythingOnTheStage();
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    SilentLogger silentLogger;
+    Logger::setCurrentLogger(&silentLogger);
+
+    Random random(12345);
+    HelioTests::TestLayersOwner layers;
+    PianoLayer *layer = layers.addPianoLayer();
+    HelioTests::TestLayersOwner::fillWithRandomNotes(*layer, NUM_NOTES, NOTES_BEATS_RANGE, random);
+
+    TrackedLayer item(*layer);
+    TrackedLayerSource source(item);
+
+    {
+        VCS::Pack::Ptr pack(new VCS::Pack());
+        VCS::Head head(pack, &source);
+
+        VCS::Revision root(pack, "root");
+        head.moveTo(root);
+
+        // the same steps as VersionControl::commit, with every change selected
+        Array<VCS::Revision> revisions;
+        OwnedArray<XmlElement> snapshots;
+        Array<int> checkoutIndexes;
+
+        for (int i = 0; i < NUM_CHECKOUTS; ++i)
+        {
+            checkoutIndexes.add(random.nextInt(NUM_REVISIONS));
+        }
+
+        const double commitStartMs = Time::getMillisecondCounterHiRes();
+
+        for (int i = 0; i < NUM_REVISIONS; ++i)
+        {
+            for (int j = 0; j < NUM_EDITS_PER_COMMIT; ++j)
+            {
+                makeRandomEdit(*layer, random);
+            }
+
+            item.markVCSChanged();
+            head.rebuildDiffSynchronously();
+
+            VCS::Revision newRevision(pack, "Commit " + String(i));
+            VCS::Revision allChanges(head.getDiff().createCopy());
+
+            for (int j = 0; j < allChanges.getNumProperties(); ++j)
+            {
+                const Identifier id(allChanges.getPropertyName(j));
+                newRevision.setProperty(id, allChanges.getProperty(id), nullptr);
+            }
+
+            VCS::Revision headingRevision(head.getHeadingRevision());
+            headingRevision.addChild(newRevision, -1, nullptr);
+            head.moveTo(newRevision);
+
+            newRevision.flushData();
+            pack->flush();
+
+            revisions.add(newRevision);
+            snapshots.add(checkoutIndexes.contains(i) ? layer->serialize() : nullptr);
+        }
+
+        const double commitMs = Time::getMillisecondCounterHiRes() - commitStartMs;
+
+        // a sanity check, that the root doesn't look like the last commit
+        head.moveTo(root);
+        head.rebuildDiffSynchronously();
+        HELIO_CHECK(head.hasAnythingOnTheStage());
+
+        double checkpointsTotalMs = 0.0;
+        double checkpointsMaxMs = 0.0;
+        double replayTotalMs = 0.0;
+        double replayMaxMs = 0.0;
+
+        for (const auto index : checkoutIndexes)
+        {
+            const XmlElement &snapshot = *snapshots.getUnchecked(index);
+
+            const double checkpointsMs = HelioTests::measureBestOf(1, [&]()
+            {
+                head.moveTo(revisions.getReference(index));
+            });
+
+            HELIO_CHECK(isHeadAtSnapshot(head, item, *layer, snapshot));
+
+            // the replay still stores new checkpoints on its way,
+            // so it is a bit slower than the old moveTo was
+            const double replayMs = HelioTests::measureBestOf(1, [&]()
+            {
+                head.clearStateCheckpoints();
+                head.moveTo(revisions.getReference(index));
+            });
+
+            HELIO_CHECK(isHeadAtSnapshot(head, item, *layer, snapshot));
+
+            checkpointsTotalMs += checkpointsMs;
+            checkpointsMaxMs = jmax(checkpointsMaxMs, checkpointsMs);
+            replayTotalMs += replayMs;
+            replayMaxMs = jmax(replayMaxMs, replayMs);
+        }
+
+        HelioTests::report("Revisions: " + String(NUM_REVISIONS) +
+                           ", notes: " + String(NUM_NOTES) +
+                           ", commits/s: " + String(NUM_REVISIONS / (commitMs * 0.001), 1));
+
+        HelioTests::report("Checkout\tAverage, ms\tMax, ms");
+
+        HelioTests::report("Checkpoints\t" +
+                           String(checkpointsTotalMs / NUM_CHECKOUTS, 2) + "\t" +
+                           String(checkpointsMaxMs, 2));
+
+        HelioTests::report("From the root\t" +
+                           String(replayTotalMs / NUM_CHECKOUTS, 2) + "\t" +
+                           String(replayMaxMs, 2));
+    }
+
+    Logger::setCurrentLogger(nullptr);
+    return HelioTests::finish("HistoryCheckoutBenchmark");
+}
@@ -0,0 +1,396 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Two devices sync a history of 1,000 commits through the loopback server:
+// after the first push, each sync should only transfer the manifest,
+// the revisions which differ and the pack entries the other side lacks,
+// compared to the whole encrypted history going both ways on every push,
+// as it did before. Both devices should end up with the same history,
+// with all the delta data in place.
+// The servers which only store the whole history, and the histories pushed
+// as one blob by the released clients, should still be synced as the blobs
+// in the format the released clients read.
+
+#include "TestsSync.h"
+#include "VersionControl.h"
+#include "HistorySync.h"
+#include "DataEncoder.h"
+#include "PianoLayerDiffLogic.h"
+#include "PianoLayerDeltas.h"
+
+#define NUM_REVISIONS 1000
+#define NUM_LAYERS 8
+#define NUM_NOTES_PER_COMMIT 100
+#define NUM_NEW_COMMITS 10
+#define NOTES_BEATS_RANGE 128.f
+
+// A layer as the diff logic sees it: new deltas on every change, as real diffs have
+class TestTrackedLayer : public VCS::TrackedItem
+{
+public:
+
+    explicit TestTrackedLayer(int layerIndex) :
+        path("Tests/Layer" + String(layerIndex))
+    {
+        this->vcsDiffLogic = new VCS::PianoLayerDiffLogic(*this);
+    }
+
+    void addRandomNotes(PianoLayer &notesOwner, Random &random)
+    {
+        this->deltas.clear();
+        this->deltasData.clear();
+
+        auto pathData = new XmlElement(PianoLayerDeltas::layerPath);
+        pathData->setAttribute(Serialization::VCS::delta, this->path);
+        this->deltas.add(new VCS::Delta(VCS::DeltaDescription(""), PianoLayerDeltas::layerPath));
+        this->deltasData.add(pathData);
+
+        auto notesData = new XmlElement(PianoLayerDeltas::notesAdded);
+
+        for (int i = 0; i < NUM_NOTES_PER_COMMIT; ++i)
+        {
+            const float beat = Note::roundBeat(random.nextFloat() * NOTES_BEATS_RANGE);
+            const float length = Note::roundBeat(0.25f + random.nextFloat() * 4.f);
+            const Note note(&notesOwner, 24 + random.nextInt(72), beat, length, 0.25f + random.nextFloat() * 0.75f);
+            notesData->addChildElement(note.serialize());
+        }
+
+        this->deltas.add(new VCS::Delta(VCS::DeltaDescription(""), PianoLayerDeltas::notesAdded));
+        this->deltasData.add(notesData);
+    }
+
+    int getNumDeltas() const override
+    { return this->deltas.size(); }
+
+    VCS::Delta *getDelta(int index) const override
+    { return this->deltas[index]; }
+
+    XmlElement *createDeltaDataFor(int index) const override
+    { return new XmlElement(*this->deltasData[index]); }
+
+    String getVCSName() const override
+    { return this->path; }
+
+    VCS::DiffLogic *getDiffLogic() const override
+    { return this->vcsDiffLogic; }
+
+    void resetStateTo(const VCS::TrackedItem &newState) override {}
+
+private:
+
+    String path;
+
+    ScopedPointer<VCS::PianoLayerDiffLogic> vcsDiffLogic;
+    OwnedArray<VCS::Delta> deltas;
+    OwnedArray<XmlElement> deltasData;
+};
+
+// The history of a device without a project: the commits are put
+// right into the tree, as VersionControl::commit puts them
+class TestHistory : public VersionControl
+{
+public:
+
+    TestHistory() :
+        VersionControl(nullptr) {}
+
+    TestHistory(const String &existingId, const String &existingKeyBase64) :
+        VersionControl(nullptr, existingId, existingKeyBase64) {}
+
+    void commit(TestTrackedLayer &item, const String &message)
+    {
+        VCS::Revision newRevision(this->pack, message);
+        VCS::RevisionItem::Ptr revisionItem(new VCS::RevisionItem(this->pack, VCS::RevisionItem::Changed, &item));
+        newRevision.setProperty(revisionItem->getUuid().toString(), var(revisionItem), nullptr);
+
+        this->head.getHeadingRevision().addChild(newRevision, -1, nullptr);
+        this->head.pointTo(newRevision);
+
+        newRevision.flushData();
+        this->pack->flush();
+    }
+
+    // Every delta of every revision should have its data in the pack
+    bool hasAllDeltaData() const
+    {
+        return this->hasAllDeltaData(this->root);
+    }
+
+    int getNumRevisions() const
+    {
+        return this->getNumRevisions(this->root);
+    }
+
+private:
+
+    bool hasAllDeltaData(const VCS::Revision &revision) const
+    {
+        for (int i = 0; i < revision.getNumProperties(); ++i)
+        {
+            const var property(revision.getProperty(revision.getPropertyName(i)));
+
+            if (auto revItem = dynamic_cast<VCS::RevisionItem *>(property.getObject()))
+            {
+                for (int j = 0; j < revItem->getNumDeltas(); ++j)
+                {
+                    if (! this->pack->containsDeltaDataFor(revItem->getUuid(), revItem->getDelta(j)->getUuid()))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < revision.getNumChildren(); ++i)
+        {
+            if (! this->hasAllDeltaData(VCS::Revision(revision.getChild(i))))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    int getNumRevisions(const VCS::Revision &revision) const
+    {
+        int numRevisions = 1;
+
+        for (int i = 0; i < revision.getNumChildren(); ++i)
+        {
+            numRevisions += this->getNumRevisions(VCS::Revision(revision.getChild(i)));
+        }
+
+        return numRevisions;
+    }
+};
+
+// Head::moveTo logs every revision on its path, which would be measured too
+class SilentLogger : public Logger
+{
+    void logMessage(const String &message) override {}
+};
+
+static void commitRandomChanges(TestHistory &history, OwnedArray<TestTrackedLayer> &items,
+                                PianoLayer &notesOwner, int numCommits, Random &random)
+{
+    for (int i = 0; i < numCommits; ++i)
+    {
+        TestTrackedLayer *item = items[random.nextInt(items.size())];
+        item->addRandomNotes(notesOwner, random);
+        history.commit(*item, "Commit " + String(i));
+    }
+}
+
+static MemoryBlock createFullBlob(const VersionControl &history, const MemoryBlock &key)
+{
+    ScopedPointer<XmlElement> xml(history.serialize());
+    return DataEncoder::encryptXml(*xml, key);
+}
+
+struct SyncMeasurement
+{
+    VCS::SyncThread::State result;
+    double ms;
+    int64 numBytes;
+};
+
+// The blob should stay readable by the released clients, which only know the legacy format
+static bool isLegacyBlob(const MemoryBlock &blob)
+{
+    return blob.getSize() >= 4 &&
+        ByteOrder::littleEndianInt(blob.getData()) == ByteOrder::littleEndianInt("PR::");
+}
+
+static SyncMeasurement measureSync(HelioTests::LoopbackSyncServer &server, VersionControl &history,
+                                   const MemoryBlock &key, bool shouldPush)
+{
+    VCS::HistorySync sync(server, key);
+    SyncMeasurement measurement;
+
+    server.resetCounters();
+
+    measurement.ms = HelioTests::measureBestOf(1, [&]()
+    {
+        measurement.result = shouldPush ? sync.push(history) : sync.pull(history);
+    });
+
+    measurement.numBytes = server.getNumBytesUploaded() + server.getNumBytesDownloaded();
+    return measurement;
+}
+
+static void reportSync(const String &name, const SyncMeasurement &measurement)
+{
+    HelioTests::report(name + "\t" +
+                       String(measurement.numBytes / 1024) + "\t" +
+                       String(measurement.ms, 1));
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    SilentLogger silentLogger;
+    Logger::setCurrentLogger(&silentLogger);
+
+    Random random(12345);
+    HelioTests::TestLayersOwner layers;
+    PianoLayer *notesOwner = layers.addPianoLayer();
+
+    OwnedArray<TestTrackedLayer> items;
+
+    for (int i = 0; i < NUM_LAYERS; ++i)
+    {
+        items.add(new TestTrackedLayer(i));
+    }
+
+    HelioTests::LoopbackSyncServer server;
+
+    {
+        TestHistory deviceA;
+        const MemoryBlock key(deviceA.getKey());
+        TestHistory deviceB(deviceA.getPublicId(), key.toBase64Encoding());
+
+        commitRandomChanges(deviceA, items, *notesOwner, NUM_REVISIONS, random);
+
+        // the first push uploads everything, and the first pull downloads everything
+        const SyncMeasurement firstPush = measureSync(server, deviceA, key, true);
+        HELIO_CHECK(firstPush.result == VCS::SyncThread::allDone);
+
+        const SyncMeasurement firstPull = measureSync(server, deviceB, key, false);
+        HELIO_CHECK(firstPull.result == VCS::SyncThread::allDone);
+        HELIO_CHECK(deviceB.calculateHash() == deviceA.calculateHash());
+        HELIO_CHECK(deviceB.getNumRevisions() == NUM_REVISIONS + 1);
+        HELIO_CHECK(deviceB.hasAllDeltaData());
+
+        // the device which pushed has nothing to download, except the new version
+        const SyncMeasurement emptyPull = measureSync(server, deviceA, key, false);
+        HELIO_CHECK(emptyPull.result == VCS::SyncThread::allDone);
+        HELIO_CHECK(deviceA.getVersion() == deviceB.getVersion());
+
+        const SyncMeasurement upToDatePush = measureSync(server, deviceA, key, true);
+        HELIO_CHECK(upToDatePush.result == VCS::SyncThread::upToDate);
+
+        // both devices commit, the second one to push should pull first
+        const MemoryBlock fullBlobBefore(createFullBlob(deviceA, key));
+
+        commitRandomChanges(deviceA, items, *notesOwner, NUM_NEW_COMMITS, random);
+        commitRandomChanges(deviceB, items, *notesOwner, NUM_NEW_COMMITS, random);
+
+        const SyncMeasurement incrementalPush = measureSync(server, deviceA, key, true);
+        HELIO_CHECK(incrementalPush.result == VCS::SyncThread::allDone);
+
+        const SyncMeasurement outdatedPush = measureSync(server, deviceB, key, true);
+        HELIO_CHECK(outdatedPush.result == VCS::SyncThread::mergeError);
+
+        const SyncMeasurement incrementalPull = measureSync(server, deviceB, key, false);
+        HELIO_CHECK(incrementalPull.result == VCS::SyncThread::allDone);
+        HELIO_CHECK(deviceB.getNumRevisions() == NUM_REVISIONS + 2 * NUM_NEW_COMMITS + 1);
+        HELIO_CHECK(deviceB.hasAllDeltaData());
+
+        const SyncMeasurement mergingPush = measureSync(server, deviceB, key, true);
+        HELIO_CHECK(mergingPush.result == VCS::SyncThread::allDone);
+
+        const SyncMeasurement mergingPull = measureSync(server, deviceA, key, false);
+        HELIO_CHECK(mergingPull.result == VCS::SyncThread::allDone);
+        HELIO_CHECK(deviceA.calculateHash() == deviceB.calculateHash());
+        HELIO_CHECK(deviceA.getNumRevisions() == deviceB.getNumRevisions());
+        HELIO_CHECK(deviceA.hasAllDeltaData());
+
+        // the push which raced with another one is rejected by the server
+        {
+            VCS::SyncObjects noObjects;
+            HELIO_CHECK(server.pushObjects(noObjects, MemoryBlock(16, true), "stale") == VCS::SyncTransport::outdated);
+        }
+
+        // the whole history downloaded, merged and uploaded, as the push did before
+        MemoryBlock legacyPushedBlob;
+
+        const double legacyPushMs = HelioTests::measureBestOf(1, [&]()
+        {
+            ScopedPointer<XmlElement> remoteXml(DataEncoder::createDecryptedXml(fullBlobBefore, key));
+            VersionControl remoteVCS(nullptr);
+            remoteVCS.deserialize(*remoteXml);
+            remoteVCS.mergeWith(deviceA);
+            remoteVCS.incrementVersion();
+            legacyPushedBlob = createFullBlob(remoteVCS, key);
+        });
+
+        HelioTests::report("Revisions: " + String(deviceA.getNumRevisions()) +
+                           ", objects on the server: " + String(server.getNumObjects()));
+
+        HelioTests::report("Sync\tTransferred, KB\tTime, ms");
+
+        reportSync("First push", firstPush);
+        reportSync("First pull", firstPull);
+        reportSync("Pull after own push", emptyPull);
+        reportSync("Push of " + String(NUM_NEW_COMMITS) + " commits", incrementalPush);
+        reportSync("Pull of " + String(NUM_NEW_COMMITS) + " commits", incrementalPull);
+        reportSync("Merging push", mergingPush);
+
+        HelioTests::report("Whole history push\t" +
+                           String(int64(fullBlobBefore.getSize() + legacyPushedBlob.getSize()) / 1024) + "\t" +
+                           String(legacyPushMs, 1));
+
+        // a few commits should cost a small part of the whole history
+        HELIO_CHECK(incrementalPush.numBytes * 5 < int64(fullBlobBefore.getSize()));
+        HELIO_CHECK(incrementalPull.numBytes * 5 < int64(fullBlobBefore.getSize()));
+    }
+
+    // the older server only gets the whole history
+    {
+        HelioTests::LoopbackSyncServer legacyServer(VCS::SyncTransport::wholeHistory);
+
+        TestHistory deviceA;
+        const MemoryBlock key(deviceA.getKey());
+        TestHistory deviceB(deviceA.getPublicId(), key.toBase64Encoding());
+
+        commitRandomChanges(deviceA, items, *notesOwner, NUM_NEW_COMMITS, random);
+
+        HELIO_CHECK(measureSync(legacyServer, deviceA, key, true).result == VCS::SyncThread::allDone);
+        HELIO_CHECK(isLegacyBlob(legacyServer.getHistory()));
+        HELIO_CHECK(legacyServer.getNumObjects() == 0 && ! legacyServer.hasManifest());
+
+        HELIO_CHECK(measureSync(legacyServer, deviceB, key, false).result == VCS::SyncThread::allDone);
+        HELIO_CHECK(deviceB.calculateHash() == deviceA.calculateHash());
+        HELIO_CHECK(deviceB.hasAllDeltaData());
+
+        commitRandomChanges(deviceB, items, *notesOwner, NUM_NEW_COMMITS, random);
+        HELIO_CHECK(measureSync(legacyServer, deviceB, key, true).result == VCS::SyncThread::allDone);
+        HELIO_CHECK(measureSync(legacyServer, deviceA, key, false).result == VCS::SyncThread::allDone);
+        HELIO_CHECK(deviceA.calculateHash() == deviceB.calculateHash());
+
+        // the history pushed by the released client to the newer server stays a blob
+        HelioTests::LoopbackSyncServer newServer;
+        newServer.storeHistory(legacyServer.getHistory());
+
+        TestHistory deviceC(deviceA.getPublicId(), key.toBase64Encoding());
+        HELIO_CHECK(measureSync(newServer, deviceC, key, false).result == VCS::SyncThread::allDone);
+        HELIO_CHECK(deviceC.calculateHash() == deviceA.calculateHash());
+
+        commitRandomChanges(deviceC, items, *notesOwner, NUM_NEW_COMMITS, random);
+        HELIO_CHECK(measureSync(newServer, deviceC, key, true).result == VCS::SyncThread::allDone);
+        HELIO_CHECK(isLegacyBlob(newServer.getHistory()));
+        HELIO_CHECK(newServer.getNumObjects() == 0 && ! newServer.hasManifest());
+
+        HELIO_CHECK(measureSync(newServer, deviceA, key, false).result == VCS::SyncThread::allDone);
+        HELIO_CHECK(deviceA.calculateHash() == deviceC.calculateHash());
+        HELIO_CHECK(deviceA.hasAllDeltaData());
+    }
+
+    Logger::setCurrentLogger(nullptr);
+    return HelioTests::finish("HistorySyncBenchmark");
+}
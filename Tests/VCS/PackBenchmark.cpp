@@ -0,0 +1,381 @@
+/*
+    This file is part of Helio Workstation.
+
+    Helio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Helio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Helio. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The pack of a synthetic history of 4,000 commits, each one changing
+// one of the layers, and every tenth one copying a layer state which was
+// committed before, as merges do: the lookups a checkout does along its path,
+// and the head states read back for the stage diff, compared to the pack
+// as it was before, which scanned all the headers on every lookup,
+// kept the deltas as the obfuscated xml text and copied its file on every flush.
+// Both should give back the same deltas.
+
+#include "TestsCommon.h"
+#include "Pack.h"
+#include "DataEncoder.h"
+#include "SerializedEventsDiff.h"
+#include "PianoLayerDeltas.h"
+#include "SerializationKeys.h"
+
+#define NUM_REVISIONS 4000
+#define NUM_LAYERS 8
+#define NUM_NOTES_PER_DELTA 40
+#define NOTES_BEATS_RANGE 128.f
+#define COPIES_EVERY 10
+#define NUM_CHECKOUTS 8
+
+//===----------------------------------------------------------------------===//
+// The pack as it was before
+//===----------------------------------------------------------------------===//
+
+class LegacyPack
+{
+public:
+
+    LegacyPack() :
+        packFile(File::createTempFile(".vcs")) {}
+
+    ~LegacyPack()
+    {
+        this->packStream = nullptr;
+        this->packFile.deleteFile();
+    }
+
+    void setDeltaDataFor(const Uuid &itemId, const Uuid &deltaId, const XmlElement &data)
+    {
+        auto block = new VCS::PackDataBlock();
+        block->itemId = itemId;
+        block->deltaId = deltaId;
+
+        MemoryOutputStream ms(block->data, false);
+        data.writeToStream(ms, "", true, false);
+        ms.flush();
+
+        this->unsavedData.add(block);
+    }
+
+    void flush()
+    {
+        TemporaryFile tempFile(this->packFile);
+        ScopedPointer<FileOutputStream> tempOutputStream(tempFile.getFile().createOutputStream());
+
+        if (this->packStream != nullptr)
+        {
+            this->packStream->setPosition(0);
+            tempOutputStream->writeFromInputStream(*this->packStream, -1);
+            this->packStream = nullptr;
+        }
+
+        for (auto block : this->unsavedData)
+        {
+            const String obfuscated(DataEncoder::obfuscateString(block->data.toString()));
+
+            auto newHeader = new VCS::PackDataHeader();
+            newHeader->itemId = block->itemId;
+            newHeader->deltaId = block->deltaId;
+            newHeader->startPosition = tempOutputStream->getPosition();
+            newHeader->numBytes = obfuscated.getNumBytesAsUTF8();
+
+            tempOutputStream->write(obfuscated.toRawUTF8(), size_t(newHeader->numBytes));
+            this->headers.add(newHeader);
+        }
+
+        this->unsavedData.clear();
+        tempOutputStream = nullptr;
+
+        tempFile.overwriteTargetFileWithTemporary();
+        this->packStream = this->packFile.createInputStream();
+    }
+
+    bool containsDeltaDataFor(const Uuid &itemId, const Uuid &deltaId) const
+    {
+        for (auto header : this->headers)
+        {
+            if (header->itemId == itemId && header->deltaId == deltaId)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    XmlElement *createDeltaDataFor(const Uuid &itemId, const Uuid &deltaId) const
+    {
+        for (auto header : this->headers)
+        {
+            if (header->itemId == itemId && header->deltaId == deltaId)
+            {
+                MemoryBlock mb;
+                this->packStream->setPosition(header->startPosition);
+                this->packStream->readIntoMemoryBlock(mb, header->numBytes);
+                return XmlDocument::parse(DataEncoder::deobfuscateString(mb.toString()));
+            }
+        }
+
+        return nullptr;
+    }
+
+private:
+
+    File packFile;
+
+    ScopedPointer<FileInputStream> packStream;
+
+    OwnedArray<VCS::PackDataHeader> headers;
+
+    OwnedArray<VCS::PackDataBlock> unsavedData;
+};
+
+//===----------------------------------------------------------------------===//
+// The history
+//===----------------------------------------------------------------------===//
+
+// Each commit stores the path and the notes of one layer
+struct HistoryDelta
+{
+    Uuid itemId;
+    Uuid deltaId;
+    int layerIndex;
+    bool isNotes;
+    XmlElement *data;
+};
+
+static XmlElement *createNotesData(PianoLayer &notesOwner, Random &random)
+{
+    auto notesData = new XmlElement(PianoLayerDeltas::notesAdded);
+
+    for (int i = 0; i < NUM_NOTES_PER_DELTA; ++i)
+    {
+        const float beat = Note::roundBeat(random.nextFloat() * NOTES_BEATS_RANGE);
+        const float length = Note::roundBeat(0.25f + random.nextFloat() * 4.f);
+        const Note note(&notesOwner, 24 + random.nextInt(72), beat, length, 0.25f + random.nextFloat() * 0.75f);
+        notesData->addChildElement(note.serialize());
+    }
+
+    return notesData;
+}
+
+static void createHistory(PianoLayer &notesOwner, Random &random,
+                          Array<HistoryDelta> &history, OwnedArray<XmlElement> &data)
+{
+    for (int i = 0; i < NUM_REVISIONS; ++i)
+    {
+        const int layerIndex = random.nextInt(NUM_LAYERS);
+        const Uuid itemId;
+
+        auto pathData = data.add(new XmlElement(PianoLayerDeltas::layerPath));
+        pathData->setAttribute(Serialization::VCS::delta, "Tests/Layer" + String(layerIndex));
+
+        const bool copiesEarlierState = (i > COPIES_EVERY) && (i % COPIES_EVERY == 0);
+
+        XmlElement *notesData = copiesEarlierState ?
+            data.add(new XmlElement(*history.getReference(2 * random.nextInt(i) + 1).data)) :
+            data.add(createNotesData(notesOwner, random));
+
+        const HistoryDelta pathDelta = { itemId, Uuid(), layerIndex, false, pathData };
+        const HistoryDelta notesDelta = { itemId, Uuid(), layerIndex, true, notesData };
+
+        history.add(pathDelta);
+        history.add(notesDelta);
+    }
+}
+
+// The last notes of each layer at the given commit
+static void findHeadStates(const Array<HistoryDelta> &history, int numRevisions, Array<HistoryDelta> &headStates)
+{
+    Array<int> foundLayers;
+
+    for (int i = numRevisions * 2 - 1; i >= 0 && foundLayers.size() < NUM_LAYERS; --i)
+    {
+        const HistoryDelta &delta = history.getReference(i);
+
+        if (delta.isNotes && ! foundLayers.contains(delta.layerIndex))
+        {
+            foundLayers.add(delta.layerIndex);
+            headStates.add(delta);
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Checkout and diff
+//===----------------------------------------------------------------------===//
+
+// Head replays the deltas of every revision on the path
+template <typename PackType>
+static int checkout(const PackType &pack, const Array<HistoryDelta> &history, int revisionIndex)
+{
+    int numFound = 0;
+
+    for (int i = 0; i < (revisionIndex + 1) * 2; ++i)
+    {
+        const HistoryDelta &delta = history.getReference(i);
+
+        if (pack.containsDeltaDataFor(delta.itemId, delta.deltaId))
+        {
+            ScopedPointer<XmlElement> deltaData(pack.createDeltaDataFor(delta.itemId, delta.deltaId));
+            numFound += (deltaData != nullptr) ? 1 : 0;
+        }
+    }
+
+    return numFound;
+}
+
+// The stage diff compares the head state of each layer with the working copy,
+// which here has lost its first note
+template <typename PackType>
+static int diffHead(const PackType &pack, const Array<HistoryDelta> &headStates,
+                    const VCS::SerializedEventsDiff &eventsDiff)
+{
+    int numChanges = 0;
+
+    for (const auto &headState : headStates)
+    {
+        ScopedPointer<XmlElement> state(pack.createDeltaDataFor(headState.itemId, headState.deltaId));
+        XmlElement workingCopy(*state);
+        workingCopy.removeChildElement(workingCopy.getFirstChildElement(), true);
+
+        const VCS::SerializedEventsDiff::Result diff(eventsDiff.createDiff(state, &workingCopy));
+        numChanges += diff.added.size() + diff.removed.size() + diff.changed.size();
+    }
+
+    return numChanges;
+}
+
+int main(int argc, char *argv[])
+{
+    ScopedJuceInitialiser_GUI juce;
+    Random random(12345);
+
+    HelioTests::TestLayersOwner layers;
+    PianoLayer *notesOwner = layers.addPianoLayer();
+
+    Array<HistoryDelta> history;
+    OwnedArray<XmlElement> historyData;
+    createHistory(*notesOwner, random, history, historyData);
+
+    VCS::SerializedEventsDiff eventsDiff(Serialization::Core::note);
+    eventsDiff.compareNumber("key").compareNumber("beat").compareNumber("len").compareNumber("vel");
+
+    VCS::Pack::Ptr pack(new VCS::Pack());
+    LegacyPack legacyPack;
+
+    // the commits are flushed one by one, as VersionControl::commit does
+    const double commitMs = HelioTests::measureBestOf(1, [&]()
+    {
+        for (const auto &delta : history)
+        {
+            pack->setDeltaDataFor(delta.itemId, delta.deltaId, *delta.data);
+
+            if (delta.isNotes)
+            {
+                pack->flush();
+            }
+        }
+    });
+
+    // the old pack copied the whole file on every flush, so it is loaded at once,
+    // as Pack::deserialize does, otherwise this would take minutes
+    const double legacyLoadMs = HelioTests::measureBestOf(1, [&]()
+    {
+        for (const auto &delta : history)
+        {
+            legacyPack.setDeltaDataFor(delta.itemId, delta.deltaId, *delta.data);
+        }
+
+        legacyPack.flush();
+    });
+
+    // all the deltas come back as they were committed
+    for (const auto &delta : history)
+    {
+        ScopedPointer<XmlElement> deltaData(pack->createDeltaDataFor(delta.itemId, delta.deltaId));
+        ScopedPointer<XmlElement> legacyDeltaData(legacyPack.createDeltaDataFor(delta.itemId, delta.deltaId));
+        HELIO_CHECK(deltaData != nullptr && deltaData->isEquivalentTo(delta.data, false));
+        HELIO_CHECK(legacyDeltaData != nullptr && legacyDeltaData->isEquivalentTo(delta.data, false));
+    }
+
+    // and survive the project save and load
+    {
+        ScopedPointer<XmlElement> packXml(pack->serialize());
+        HELIO_CHECK(packXml->getNumChildElements() == history.size());
+
+        VCS::Pack::Ptr reloadedPack(new VCS::Pack());
+        reloadedPack->deserialize(*packXml);
+
+        for (int i = 0; i < history.size(); i += COPIES_EVERY)
+        {
+            const HistoryDelta &delta = history.getReference(i);
+            ScopedPointer<XmlElement> deltaData(reloadedPack->createDeltaDataFor(delta.itemId, delta.deltaId));
+            HELIO_CHECK(deltaData != nullptr && deltaData->isEquivalentTo(delta.data, false));
+        }
+    }
+
+    double checkoutMs = 0.0;
+    double legacyCheckoutMs = 0.0;
+    double diffMs = 0.0;
+    double legacyDiffMs = 0.0;
+
+    for (int i = 0; i < NUM_CHECKOUTS; ++i)
+    {
+        const int revisionIndex = random.nextInt(NUM_REVISIONS);
+        int numFound = 0;
+        int legacyNumFound = 0;
+
+        checkoutMs += HelioTests::measureBestOf(1, [&]()
+        {
+            numFound = checkout(*pack, history, revisionIndex);
+        });
+
+        legacyCheckoutMs += HelioTests::measureBestOf(1, [&]()
+        {
+            legacyNumFound = checkout(legacyPack, history, revisionIndex);
+        });
+
+        HELIO_CHECK(numFound == (revisionIndex + 1) * 2);
+        HELIO_CHECK(legacyNumFound == numFound);
+
+        Array<HistoryDelta> headStates;
+        findHeadStates(history, revisionIndex + 1, headStates);
+
+        int numChanges = 0;
+        int legacyNumChanges = 0;
+
+        diffMs += HelioTests::measureBestOf(1, [&]()
+        {
+            numChanges = diffHead(*pack, headStates, eventsDiff);
+        });
+
+        legacyDiffMs += HelioTests::measureBestOf(1, [&]()
+        {
+            legacyNumChanges = diffHead(legacyPack, headStates, eventsDiff);
+        });
+
+        HELIO_CHECK(numChanges == headStates.size());
+        HELIO_CHECK(legacyNumChanges == numChanges);
+    }
+
+    HelioTests::report("Revisions: " + String(NUM_REVISIONS) + ", deltas: " + String(history.size()));
+    HelioTests::report("Commits with a flush each, ms: " + String(commitMs, 1) +
+                       ", legacy load at once, ms: " + String(legacyLoadMs, 1));
+
+    HelioTests::report("Pack\tCheckout, ms\tDiff, ms");
+    HelioTests::report("Indexed\t" + String(checkoutMs / NUM_CHECKOUTS, 1) + "\t" + String(diffMs / NUM_CHECKOUTS, 2));
+    HelioTests::report("Legacy\t" + String(legacyCheckoutMs / NUM_CHECKOUTS, 1) + "\t" + String(legacyDiffMs / NUM_CHECKOUTS, 2));
+
+    return HelioTests::finish("PackBenchmark");
+}